@@ -59,6 +59,11 @@ struct AUDIO_OUTPUT_STATUS
     int audioOutLfeChannelIndex;
     unsigned short audioOutChannelCount;
     uint16_t audioOutDataBurstSize;
+    unsigned char audioOutFramesPerSample;
+    // set when PCM is delivered via the jitter buffer
+    bool audioOutJitterBuffer;
+    double audioOutJitterDepthMs;
+    double audioOutJitterRatioPpm;
 };
 
 struct VIDEO_INPUT_STATUS
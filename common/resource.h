@@ -84,6 +84,12 @@
 #define IDC_HDR_MAX_FALL                1080
 #define IDC_DEVICE_ID_LABEL             1081
 #define IDC_DEVICE_ID                   1082
+#define IDC_AUDIO_OUT_FRAMES_LABEL      1083
+#define IDC_AUDIO_OUT_FRAMES            1084
+#define IDC_AUDIO_OUT_JITTER_DEPTH_LABEL 1085
+#define IDC_AUDIO_OUT_JITTER_DEPTH      1086
+#define IDC_AUDIO_OUT_JITTER_RATIO_LABEL 1087
+#define IDC_AUDIO_OUT_JITTER_RATIO      1088
 
 // Next default values for new objects
 // 
@@ -91,7 +97,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        103
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1083
+#define _APS_NEXT_CONTROL_VALUE         1089
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -159,6 +159,33 @@ HRESULT CSignalInfoProp::Reload(AUDIO_OUTPUT_STATUS* payload)
 		_snwprintf_s(buffer, _TRUNCATE, L"%d", payload->audioOutDataBurstSize);
 	}
 	SendDlgItemMessage(m_Dlg, IDC_AUDIO_OUT_BURST_SZ, WM_SETTEXT, 0, reinterpret_cast<LPARAM>(buffer));
+	if (payload->audioOutCodec == "PCM")
+	{
+		_snwprintf_s(buffer, _TRUNCATE, L"%d", payload->audioOutFramesPerSample);
+	}
+	else
+	{
+		_snwprintf_s(buffer, _TRUNCATE, L"N/A");
+	}
+	SendDlgItemMessage(m_Dlg, IDC_AUDIO_OUT_FRAMES, WM_SETTEXT, 0, reinterpret_cast<LPARAM>(buffer));
+	if (payload->audioOutJitterBuffer && payload->audioOutCodec == "PCM")
+	{
+		_snwprintf_s(buffer, _TRUNCATE, L"%.1f ms", payload->audioOutJitterDepthMs);
+	}
+	else
+	{
+		_snwprintf_s(buffer, _TRUNCATE, L"N/A");
+	}
+	SendDlgItemMessage(m_Dlg, IDC_AUDIO_OUT_JITTER_DEPTH, WM_SETTEXT, 0, reinterpret_cast<LPARAM>(buffer));
+	if (payload->audioOutJitterBuffer && payload->audioOutCodec == "PCM")
+	{
+		_snwprintf_s(buffer, _TRUNCATE, L"%+.1f ppm", payload->audioOutJitterRatioPpm);
+	}
+	else
+	{
+		_snwprintf_s(buffer, _TRUNCATE, L"N/A");
+	}
+	SendDlgItemMessage(m_Dlg, IDC_AUDIO_OUT_JITTER_RATIO, WM_SETTEXT, 0, reinterpret_cast<LPARAM>(buffer));
 	return S_OK;
 }
 
@@ -0,0 +1,77 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "../mwcapture/ayuv.h"
+
+// args: width, height
+static void BM_ReverseAyuvFrame(benchmark::State& state)
+{
+	std::vector<uint8_t> frame(state.range(0) * state.range(1) * 4, 0x5A);
+	for (auto _ : state)
+	{
+		std::reverse(frame.begin(), frame.end());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(frame.size()));
+}
+
+template <SimdLevel level>
+static void BM_SwizzleAyuvFrame(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	std::vector<uint8_t> frame(state.range(0) * state.range(1) * 4, 0x5A);
+	for (auto _ : state)
+	{
+		SwizzleAyuv(frame.data(), frame.size() / 4, level);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(frame.size()));
+}
+
+// args: width, height, worker threads
+static void BM_SwizzleAyuvFrameByRowBand(benchmark::State& state)
+{
+	auto lineLength = static_cast<uint32_t>(state.range(0) * 4);
+	auto rows = static_cast<uint32_t>(state.range(1));
+	std::vector<uint8_t> frame(static_cast<size_t>(lineLength) * rows, 0x5A);
+	RowBandWorkers workers(static_cast<unsigned int>(state.range(2)));
+	for (auto _ : state)
+	{
+		SwizzleAyuv(&workers, frame.data(), lineLength, rows);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(frame.size()));
+}
+
+#define FRAME_SIZES Args({ 3840, 2160 })->Args({ 4096, 2160 })->Unit(benchmark::kMillisecond)
+
+BENCHMARK(BM_ReverseAyuvFrame)->FRAME_SIZES;
+BENCHMARK(BM_SwizzleAyuvFrame<SIMD_SCALAR>)->FRAME_SIZES;
+#if defined(HAS_X86_SIMD)
+BENCHMARK(BM_SwizzleAyuvFrame<SIMD_SSE41>)->FRAME_SIZES;
+BENCHMARK(BM_SwizzleAyuvFrame<SIMD_AVX2>)->FRAME_SIZES;
+#endif
+#if defined(HAS_NEON_SIMD)
+BENCHMARK(BM_SwizzleAyuvFrame<SIMD_NEON>)->FRAME_SIZES;
+#endif
+BENCHMARK(BM_SwizzleAyuvFrameByRowBand)->ArgsProduct({ { 3840, 4096 }, { 2160 }, { 0, 1, 3 } })
+	->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,58 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "../mwcapture/bitstream_header.h"
+#include "../mwcapture-test/syntheticbursts.h"
+
+namespace
+{
+	const std::vector<uint8_t>& GetBurst(int64_t codec)
+	{
+		static const std::vector<uint8_t> ac3 = MakeAc3Burst();
+		// 6 frames of 1 block with a dependent substream is the most work per burst
+		static const std::vector<uint8_t> eac3 = MakeEac3Burst(0, 6, true);
+		static const std::vector<uint8_t> dts = MakeDtsCoreFrame();
+		static const std::vector<uint8_t> dtsHd = MakeDtsHdBurst(false);
+		// the major sync in the last access unit means the whole frame is searched
+		static const std::vector<uint8_t> trueHd = MakeTrueHdBurst(2, 23);
+		switch (codec)
+		{
+		case EAC3: return eac3;
+		case DTS: return dts;
+		case DTSHD: return dtsHd;
+		case TRUEHD: return trueHd;
+		default: return ac3;
+		}
+	}
+}
+
+// args: codec, parses one complete burst as the audio pin does each time a burst is collected
+static void BM_ParseBitstreamHeader(benchmark::State& state)
+{
+	auto codec = static_cast<Codec>(state.range(0));
+	auto& burst = GetBurst(codec);
+	BITSTREAM_HEADER header;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(ParseBitstreamHeader(codec, burst.data(), static_cast<uint32_t>(burst.size()), &header));
+		benchmark::ClobberMemory();
+	}
+	state.SetLabel(codecNames[codec]);
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ParseBitstreamHeader)->Arg(AC3)->Arg(EAC3)->Arg(DTS)->Arg(DTSHD)->Arg(TRUEHD);
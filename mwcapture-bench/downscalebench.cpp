@@ -0,0 +1,88 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "../mwcapture/downscale.h"
+
+namespace
+{
+	// a 3840x2160 frame of the layout along with its stride
+	std::vector<uint8_t> MakeFrame(DownscaleLayout layout, uint32_t* lineLength)
+	{
+		auto plane = GetDownscalePlane(layout, 0);
+		*lineLength = 3840 * (plane.sampleBytes == 4 ? 4 : plane.sampleBytes * plane.components);
+		size_t size = 0;
+		for (uint32_t p = 0; p < GetDownscalePlaneCount(layout); ++p)
+		{
+			size += static_cast<size_t>(*lineLength) * (2160 / GetDownscalePlane(layout, p).heightDivisor);
+		}
+		return std::vector<uint8_t>(size, 0x5A);
+	}
+}
+
+// args: layout, downscale size
+template <SimdLevel level>
+static void BM_DownscaleUhdFrame(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	auto layout = static_cast<DownscaleLayout>(state.range(0));
+	uint32_t lineLength;
+	auto frame = MakeFrame(layout, &lineLength);
+	uint32_t cx, cy;
+	GetDownscaledSize(static_cast<DownscaleSize>(state.range(1)), 3840, 2160, &cx, &cy);
+	auto dstLineLength = static_cast<uint32_t>(static_cast<uint64_t>(lineLength) * cx / 3840);
+	std::vector<uint8_t> out(frame.size());
+	RowBandWorkers workers(0);
+	FrameDownscaler downscaler;
+	for (auto _ : state)
+	{
+		downscaler.Downscale(&workers, layout, frame.data(), 3840, 2160, lineLength, out.data(), cx, cy, dstLineLength, level);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(frame.size()));
+}
+
+// args: worker threads
+static void BM_DownscaleUhdFrameByRowBand(benchmark::State& state)
+{
+	uint32_t lineLength;
+	auto frame = MakeFrame(DOWNSCALE_P010, &lineLength);
+	std::vector<uint8_t> out(frame.size());
+	RowBandWorkers workers(static_cast<unsigned int>(state.range(0)));
+	FrameDownscaler downscaler;
+	for (auto _ : state)
+	{
+		downscaler.Downscale(&workers, DOWNSCALE_P010, frame.data(), 3840, 2160, lineLength, out.data(), 1920, 1080, lineLength / 2);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(frame.size()));
+}
+
+#define DOWNSCALES ArgsProduct({ { DOWNSCALE_NV12, DOWNSCALE_P010, DOWNSCALE_BGR24, DOWNSCALE_BGR10 }, \
+	{ DOWNSCALE_HALF, DOWNSCALE_960X540 } })->Unit(benchmark::kMillisecond)
+
+BENCHMARK(BM_DownscaleUhdFrame<SIMD_SCALAR>)->DOWNSCALES;
+#if defined(HAS_X86_SIMD)
+BENCHMARK(BM_DownscaleUhdFrame<SIMD_SSE41>)->DOWNSCALES;
+#endif
+#if defined(HAS_NEON_SIMD)
+BENCHMARK(BM_DownscaleUhdFrame<SIMD_NEON>)->DOWNSCALES;
+#endif
+BENCHMARK(BM_DownscaleUhdFrameByRowBand)->Arg(0)->Arg(1)->Arg(3)->Unit(benchmark::kMillisecond)->UseRealTime();
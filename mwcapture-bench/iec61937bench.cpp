@@ -0,0 +1,256 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "../mwcapture/audio_format.h"
+#include "../mwcapture/iec61937.h"
+#include "../mwcapture-test/legacybitstream.h"
+
+namespace
+{
+	// a synthetic capture of one codec, bursts of up to payload bytes (less up to jitter bytes) at the start of each
+	// repetition period
+	struct CAPTURE
+	{
+		uint16_t channels;
+		std::vector<std::vector<uint8_t>> frames;
+	};
+
+	CAPTURE MakeCapture(IEC61937DataType dataType, uint16_t channels, uint32_t period, uint16_t maxPayload, int periods, uint16_t jitter = 0)
+	{
+		std::vector<uint8_t> stream(static_cast<size_t>(period) * periods, 0);
+		uint32_t seed = 61937;
+		for (auto p = 0; p < periods; ++p)
+		{
+			seed = seed * 1664525 + 1013904223;
+			uint16_t payload = jitter == 0 ? maxPayload : maxPayload - static_cast<uint16_t>((seed >> 8) % jitter);
+			auto burst = stream.data() + static_cast<size_t>(p) * period;
+			// AC3 and DTS give the length in bits
+			uint16_t lengthCode = dataType == IEC61937_AC3 || dataType == IEC61937_DTS3 ? payload * 8 : payload;
+			const uint8_t preamble[8]{ 0xF8, 0x72, 0x4E, 0x1F, 0x00, dataType, static_cast<uint8_t>(lengthCode >> 8), static_cast<uint8_t>(lengthCode) };
+			std::copy_n(preamble, 8, burst);
+			for (auto i = 0; i < payload; ++i) burst[8 + i] = static_cast<uint8_t>(i * 31 + p);
+		}
+
+		CAPTURE capture{ channels, {} };
+		const size_t frameBytes = pcmSamplesPerFrame * channels * 2;
+		for (size_t offset = 0; offset + frameBytes <= stream.size(); offset += frameBytes)
+		{
+			std::vector<uint8_t> frame(pcmSamplesPerFrame * pcmInputBlockSizeInBytes, 0);
+			for (auto s = 0; s < pcmSamplesPerFrame; ++s)
+			{
+				for (auto c = 0; c < channels; ++c)
+				{
+					auto slot = s * pcmInputSlotCount + c / 2 + (c % 2) * pcmInputSlotCount / 2;
+					auto in = offset + (static_cast<size_t>(s) * channels + c) * 2;
+					frame[(slot + 1) * pcmInputSlotSizeInBytes - 1] = stream[in];
+					frame[(slot + 1) * pcmInputSlotSizeInBytes - 2] = stream[in + 1];
+				}
+			}
+			capture.frames.push_back(std::move(frame));
+		}
+		return capture;
+	}
+
+	const CAPTURE& GetCapture(int64_t codec)
+	{
+		// repetition periods and typical burst lengths, TrueHD and DTS-HD MA are carried on 8 channels (HBR)
+		static const CAPTURE trueHd = MakeCapture(IEC61937_TRUEHD, 8, 61440, 61424, 2);
+		static const CAPTURE dtsHdMa = MakeCapture(IEC61937_DTSHD, 8, 32768, 12000, 4);
+		static const CAPTURE eac3 = MakeCapture(IEC61937_EAC3, 2, 24576, 7000, 4);
+		static const CAPTURE ac3 = MakeCapture(IEC61937_AC3, 2, 6144, 1792, 16);
+		switch (codec)
+		{
+		case TRUEHD: return trueHd;
+		case DTSHD: return dtsHdMa;
+		case EAC3: return eac3;
+		default: return ac3;
+		}
+	}
+
+	void SetCodecLabel(benchmark::State& state)
+	{
+		state.SetLabel(codecNames[state.range(0)]);
+	}
+}
+
+static void BM_BitstreamCopyFrame(benchmark::State& state)
+{
+	auto& capture = GetCapture(AC3);
+	BitstreamParser parser;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(parser.CopyFrame(capture.frames[0].data(), 2, 2));
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(capture.frames[0].size()));
+}
+
+// args: codec, each iteration parses one captured frame and takes any completed burst as the audio pin does
+static void BM_LegacyBitstreamParse(benchmark::State& state)
+{
+	auto& capture = GetCapture(state.range(0));
+	LegacyBitstreamParser parser;
+	std::vector<uint8_t> delivered(65536);
+	Codec codec = PCM;
+	size_t frameIdx = 0;
+	for (auto _ : state)
+	{
+		auto& frame = capture.frames[frameIdx];
+		auto bytes = parser.CopyFrame(frame.data(), capture.channels, 2);
+		benchmark::DoNotOptimize(parser.Parse(bytes, &codec));
+		if (parser.GetDataBurstPayloadSize() > 0)
+		{
+			std::copy_n(parser.GetDataBurst(), parser.GetDataBurstPayloadSize(), delivered.data());
+			parser.ConsumeDataBurst();
+		}
+		if (++frameIdx == capture.frames.size()) frameIdx = 0;
+	}
+	SetCodecLabel(state);
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(capture.frames[0].size()));
+}
+
+template <SimdLevel level>
+static void BM_BitstreamParseFrame(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	auto& capture = GetCapture(state.range(0));
+	BitstreamParser parser(level);
+	std::vector<uint8_t> delivered(65536);
+	Codec codec = PCM;
+	size_t frameIdx = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(parser.ParseFrame(capture.frames[frameIdx].data(), capture.channels, 2, &codec));
+		if (parser.GetDataBurstPayloadSize() > 0)
+		{
+			std::copy_n(parser.GetDataBurst(), parser.GetDataBurstPayloadSize(), delivered.data());
+			parser.ConsumeDataBurst();
+		}
+		if (++frameIdx == capture.frames.size()) frameIdx = 0;
+	}
+	SetCodecLabel(state);
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(capture.frames[0].size()));
+}
+
+// args: codec, each iteration peeks at one captured frame for a preamble and delivers its stream untouched as the audio
+// pin does in passthrough mode, comparable with BM_BitstreamParseFrame
+template <SimdLevel level>
+static void BM_IEC61937Passthrough(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	auto& capture = GetCapture(state.range(0));
+	IEC61937Passthrough passthrough(level);
+	std::vector<uint8_t> delivered(IEC61937Passthrough::GetFrameSizeInBytes(capture.channels));
+	Codec codec = PCM;
+	size_t frameIdx = 0;
+	for (auto _ : state)
+	{
+		auto& frame = capture.frames[frameIdx];
+		benchmark::DoNotOptimize(passthrough.ScanFrame(frame.data(), capture.channels, &codec));
+		benchmark::DoNotOptimize(passthrough.CopyFrames(frame.data(), 1, capture.channels, delivered.data(), static_cast<uint32_t>(delivered.size())));
+		if (++frameIdx == capture.frames.size()) frameIdx = 0;
+	}
+	SetCodecLabel(state);
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(capture.frames[0].size()));
+}
+
+// args: codec, replays a capture with varying burst sizes and counts the media type changes proposed by the audio pin
+// against those the previous rule (any change in burst size) would have made
+static void BM_BurstRenegotiation(benchmark::State& state)
+{
+	// synthetic streams whose burst sizes vary within the codec's limit, each iteration replays one from the start as if
+	// it were a new stream so the counts are per replay
+	static const CAPTURE eac3 = MakeCapture(IEC61937_EAC3, 2, 24576, 7000, 64, 600);
+	static const CAPTURE dtsHdMa = MakeCapture(IEC61937_DTSHD, 8, 32768, 12000, 64, 2000);
+	auto& capture = state.range(0) == EAC3 ? eac3 : dtsHdMa;
+	BitstreamParser parser;
+	int64_t renegotiations = 0;
+	int64_t legacyRenegotiations = 0;
+	for (auto _ : state)
+	{
+		parser.Reset();
+		Codec codec = PCM;
+		AUDIO_FORMAT current{};
+		uint16_t lastBurstSize = 0;
+		for (auto& frame : capture.frames)
+		{
+			parser.ParseFrame(frame.data(), capture.channels, 2, &codec);
+			if (parser.GetDataBurstPayloadSize() > 0)
+			{
+				AUDIO_FORMAT proposed(current);
+				proposed.codec = codec;
+				proposed.dataBurstSize = parser.GetDataBurstPayloadSize();
+				if (GetAudioFormatChanges(&current, &proposed) != AUDIO_FORMAT_UNCHANGED)
+				{
+					renegotiations++;
+					current = proposed;
+				}
+				if (proposed.dataBurstSize != lastBurstSize)
+				{
+					legacyRenegotiations++;
+					lastBurstSize = proposed.dataBurstSize;
+				}
+				parser.ConsumeDataBurst();
+			}
+		}
+	}
+	state.counters["renegotiations_per_replay"] = benchmark::Counter(static_cast<double>(renegotiations), benchmark::Counter::kAvgIterations);
+	state.counters["legacy_renegotiations_per_replay"] = benchmark::Counter(static_cast<double>(legacyRenegotiations), benchmark::Counter::kAvgIterations);
+	SetCodecLabel(state);
+}
+
+// a PCM frame has no preamble so the whole stream is scanned
+template <SimdLevel level>
+static void BM_FindIEC61937Sync(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	std::vector<uint8_t> stream(static_cast<size_t>(state.range(0)), 0xF8);
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(FindIEC61937Sync(stream.data(), stream.size(), level));
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(stream.size()));
+}
+
+BENCHMARK(BM_BitstreamCopyFrame);
+BENCHMARK(BM_LegacyBitstreamParse)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_BitstreamParseFrame<SIMD_SCALAR>)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_BitstreamParseFrame<SIMD_SSE41>)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_BitstreamParseFrame<SIMD_AVX2>)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_BitstreamParseFrame<SIMD_NEON>)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_IEC61937Passthrough<SIMD_SCALAR>)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_IEC61937Passthrough<SIMD_SSE41>)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_IEC61937Passthrough<SIMD_AVX2>)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_IEC61937Passthrough<SIMD_NEON>)->Arg(AC3)->Arg(EAC3)->Arg(DTSHD)->Arg(TRUEHD);
+BENCHMARK(BM_BurstRenegotiation)->Arg(EAC3)->Arg(DTSHD);
+BENCHMARK(BM_FindIEC61937Sync<SIMD_SCALAR>)->Arg(768)->Arg(3072);
+BENCHMARK(BM_FindIEC61937Sync<SIMD_SSE41>)->Arg(768)->Arg(3072);
+BENCHMARK(BM_FindIEC61937Sync<SIMD_AVX2>)->Arg(768)->Arg(3072);
+BENCHMARK(BM_FindIEC61937Sync<SIMD_NEON>)->Arg(768)->Arg(3072);
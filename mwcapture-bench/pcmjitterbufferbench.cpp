@@ -0,0 +1,96 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "../mwcapture/pcm_jitter_buffer.h"
+
+// args: fs, channels
+template <SimdLevel level>
+static void BM_PcmResample(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	auto fs = static_cast<uint32_t>(state.range(0));
+	auto channels = static_cast<uint8_t>(state.range(1));
+	// 10ms per call as the pin delivers
+	auto frames = fs / 100;
+	std::vector<std::vector<float>> planar(channels, std::vector<float>(frames + resamplerTaps));
+	std::vector<const float*> in;
+	for (auto& channel : planar)
+	{
+		for (size_t i = 0; i < channel.size(); ++i) channel[i] = static_cast<float>(std::sin(0.01 * static_cast<double>(i)));
+		in.push_back(channel.data());
+	}
+	std::vector<float> out(static_cast<size_t>(frames) * channels);
+	PcmResampler resampler(level);
+	for (auto _ : state)
+	{
+		double pos = resamplerHistory;
+		benchmark::DoNotOptimize(resampler.Resample(in.data(), channels, frames + resamplerTaps, &pos, 1.0 - 0.000137, out.data(), frames));
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * frames);
+	state.SetLabel(std::to_string(fs / 1000) + "kHz");
+}
+
+// args: fs, channels, bytes per sample, the whole pcm stage i.e. conversion from and to integer pcm as well as resampling
+template <SimdLevel level>
+static void BM_PcmJitterBuffer(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	auto fs = static_cast<uint32_t>(state.range(0));
+	auto channels = static_cast<uint8_t>(state.range(1));
+	auto bitDepthInBytes = static_cast<uint8_t>(state.range(2));
+	auto frames = static_cast<uint32_t>(GetPcmFramesPerSample(fs, 100000)) * pcmSamplesPerFrame;
+	std::vector<uint8_t> in(static_cast<size_t>(frames) * channels * bitDepthInBytes, 0x5A);
+	std::vector<uint8_t> out(in.size());
+	PcmJitterBuffer buffer(level);
+	buffer.Reset(fs, bitDepthInBytes, channels, 20);
+	while (!buffer.IsPrimed()) buffer.Push(in.data(), frames);
+	for (auto _ : state)
+	{
+		buffer.Push(in.data(), frames);
+		benchmark::DoNotOptimize(buffer.Pull(out.data(), frames));
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * frames);
+	state.SetLabel(std::to_string(fs / 1000) + "kHz");
+}
+
+#define RESAMPLE_ARGS ArgsProduct({ { 48000, 96000, 192000 }, { 2, 8 } })
+#define JITTER_ARGS ArgsProduct({ { 48000, 96000, 192000 }, { 2, 8 }, { 2, 3, 4 } })
+
+BENCHMARK(BM_PcmResample<SIMD_SCALAR>)->RESAMPLE_ARGS;
+BENCHMARK(BM_PcmJitterBuffer<SIMD_SCALAR>)->JITTER_ARGS;
+#if defined(HAS_X86_SIMD)
+BENCHMARK(BM_PcmResample<SIMD_SSE41>)->RESAMPLE_ARGS;
+BENCHMARK(BM_PcmResample<SIMD_AVX2>)->RESAMPLE_ARGS;
+BENCHMARK(BM_PcmJitterBuffer<SIMD_SSE41>)->JITTER_ARGS;
+BENCHMARK(BM_PcmJitterBuffer<SIMD_AVX2>)->JITTER_ARGS;
+#endif
+#if defined(HAS_NEON_SIMD)
+BENCHMARK(BM_PcmResample<SIMD_NEON>)->RESAMPLE_ARGS;
+BENCHMARK(BM_PcmJitterBuffer<SIMD_NEON>)->JITTER_ARGS;
+#endif
@@ -0,0 +1,80 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "../mwcapture/pcm_remap.h"
+#include "../mwcapture-test/legacypcmremap.h"
+
+namespace
+{
+	constexpr auto np = not_present;
+	constexpr std::array<int, 8> offsets71{ 0, 0, 1, -1, 0, 0, 0, 0 };
+	constexpr std::array<int, 8> offsets20{ 0, 0, np, np, np, np, np, np };
+
+	const std::array<int, 8>& OffsetsFor(int channels)
+	{
+		return channels == 8 ? offsets71 : offsets20;
+	}
+}
+
+// args: channels, bytes per sample
+static void BM_LegacyRemapPcm(benchmark::State& state)
+{
+	auto channels = static_cast<int>(state.range(0));
+	auto bitDepthInBytes = static_cast<int>(state.range(1));
+	std::vector<uint8_t> in(pcmSamplesPerFrame * pcmInputBlockSizeInBytes, 0x5A);
+	std::vector<uint8_t> out(pcmSamplesPerFrame * channels * bitDepthInBytes);
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(LegacyRemapPcm(in.data(), out.data(), static_cast<long>(out.size()), bitDepthInBytes,
+			channels, channels, OffsetsFor(channels)));
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(out.size()));
+}
+
+template <SimdLevel level>
+static void BM_RemapPcm(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	auto channels = static_cast<uint16_t>(state.range(0));
+	auto bitDepthInBytes = static_cast<uint8_t>(state.range(1));
+	auto plan = MakePcmRemapPlan(bitDepthInBytes, channels, channels, OffsetsFor(channels));
+	std::vector<uint8_t> in(pcmSamplesPerFrame * pcmInputBlockSizeInBytes, 0x5A);
+	std::vector<uint8_t> out(pcmSamplesPerFrame * channels * bitDepthInBytes);
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(RemapPcm(&plan, in.data(), out.data(), static_cast<uint32_t>(out.size()), pcmSamplesPerFrame, level));
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(out.size()));
+}
+
+#define REMAP_ARGS ArgsProduct({ { 2, 8 }, { 2, 3, 4 } })
+
+BENCHMARK(BM_LegacyRemapPcm)->REMAP_ARGS;
+BENCHMARK(BM_RemapPcm<SIMD_SCALAR>)->REMAP_ARGS;
+#if defined(HAS_X86_SIMD)
+BENCHMARK(BM_RemapPcm<SIMD_SSE41>)->REMAP_ARGS;
+BENCHMARK(BM_RemapPcm<SIMD_AVX2>)->REMAP_ARGS;
+#endif
+#if defined(HAS_NEON_SIMD)
+BENCHMARK(BM_RemapPcm<SIMD_NEON>)->REMAP_ARGS;
+#endif
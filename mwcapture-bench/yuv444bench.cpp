@@ -0,0 +1,94 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "../mwcapture/yuv444.h"
+
+// args: width, height
+template <SimdLevel level>
+static void BM_UnpackY410ToY416Frame(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	auto pixels = static_cast<size_t>(state.range(0) * state.range(1));
+	std::vector<uint32_t> src(pixels, 0x9A5A5A5A);
+	std::vector<uint16_t> dst(pixels * 4);
+	for (auto _ : state)
+	{
+		UnpackY410ToY416(src.data(), dst.data(), pixels, level);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(pixels * 4));
+}
+
+template <SimdLevel level>
+static void BM_PackY410ToAyuvFrame(benchmark::State& state)
+{
+	if (!IsSimdLevelSupported(level))
+	{
+		state.SkipWithError("unsupported on this cpu");
+		return;
+	}
+	auto pixels = static_cast<size_t>(state.range(0) * state.range(1));
+	std::vector<uint32_t> src(pixels, 0x9A5A5A5A);
+	std::vector<uint32_t> dst(pixels);
+	for (auto _ : state)
+	{
+		PackY410ToAyuv(src.data(), dst.data(), pixels, level);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(pixels * 4));
+}
+
+// args: width, height, output, worker threads
+static void BM_ConvertY410FrameByRowBand(benchmark::State& state)
+{
+	auto cx = static_cast<uint32_t>(state.range(0));
+	auto cy = static_cast<uint32_t>(state.range(1));
+	auto output = static_cast<Yuv444Output>(state.range(2));
+	std::vector<uint8_t> src(static_cast<size_t>(cx) * cy * 4, 0x5A);
+	std::vector<uint8_t> dst(static_cast<size_t>(cx) * cy * GetYuv444BytesPerPixel(output));
+	RowBandWorkers workers(static_cast<unsigned int>(state.range(3)));
+	for (auto _ : state)
+	{
+		ConvertY410(&workers, output, src.data(), cx * 4, dst.data(), cx * GetYuv444BytesPerPixel(output), cx, cy);
+		benchmark::ClobberMemory();
+	}
+	state.SetLabel(yuv444output_to_name(output));
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(src.size()));
+}
+
+#define FRAME_SIZES Args({ 1920, 1080 })->Args({ 3840, 2160 })->Args({ 4096, 2160 })->Unit(benchmark::kMillisecond)
+
+BENCHMARK(BM_UnpackY410ToY416Frame<SIMD_SCALAR>)->FRAME_SIZES;
+BENCHMARK(BM_PackY410ToAyuvFrame<SIMD_SCALAR>)->FRAME_SIZES;
+#if defined(HAS_X86_SIMD)
+BENCHMARK(BM_UnpackY410ToY416Frame<SIMD_SSE41>)->FRAME_SIZES;
+BENCHMARK(BM_UnpackY410ToY416Frame<SIMD_AVX2>)->FRAME_SIZES;
+BENCHMARK(BM_PackY410ToAyuvFrame<SIMD_SSE41>)->FRAME_SIZES;
+BENCHMARK(BM_PackY410ToAyuvFrame<SIMD_AVX2>)->FRAME_SIZES;
+#endif
+#if defined(HAS_NEON_SIMD)
+BENCHMARK(BM_UnpackY410ToY416Frame<SIMD_NEON>)->FRAME_SIZES;
+BENCHMARK(BM_PackY410ToAyuvFrame<SIMD_NEON>)->FRAME_SIZES;
+#endif
+BENCHMARK(BM_ConvertY410FrameByRowBand)
+	->ArgsProduct({ { 1920 }, { 1080 }, { YUV444_Y416, YUV444_AYUV }, { 0, 1, 3 } })
+	->ArgsProduct({ { 3840 }, { 2160 }, { YUV444_Y416, YUV444_AYUV }, { 0, 1, 3 } })
+	->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,40 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "bitstream_header.h"
+
+// the first byte picks the codec and the rest is the burst payload, the payload is copied so that any read beyond len
+// is caught by asan
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size < 1) return 0;
+	constexpr Codec codecs[5]{ AC3, EAC3, DTS, DTSHD, TRUEHD };
+	auto codec = codecs[data[0] % 5];
+	std::vector<uint8_t> burst(data + 1, data + size);
+
+	BITSTREAM_HEADER header;
+	if (ParseBitstreamHeader(codec, burst.data(), static_cast<uint32_t>(burst.size()), &header))
+	{
+		if (header.codec != codec || header.samplesPerBurst == 0 || header.sampleRate == 0 || header.maxBurstSize == 0 ||
+			header.maxBurstSize > GetIEC61937RepetitionPeriodInBytes(codec))
+		{
+			abort();
+		}
+	}
+	return 0;
+}
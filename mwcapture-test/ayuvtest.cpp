@@ -0,0 +1,93 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/ayuv.h"
+
+namespace
+{
+	std::vector<uint8_t> MakeImage(size_t bytes)
+	{
+		std::vector<uint8_t> image(bytes);
+		for (size_t i = 0; i < bytes; ++i) image[i] = static_cast<uint8_t>(i * 7 + i / 251);
+		return image;
+	}
+
+	std::vector<uint8_t> ReversePerPixel(std::vector<uint8_t> image)
+	{
+		for (size_t i = 0; i + 4 <= image.size(); i += 4) std::reverse(image.begin() + i, image.begin() + i + 4);
+		return image;
+	}
+}
+
+TEST(Ayuv, SwizzlesEachPixelInPlace) {
+	for (auto level : { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2, SIMD_NEON })
+	{
+		if (!IsSimdLevelSupported(level)) continue;
+		// odd pixel counts exercise the scalar tail of the vector kernels
+		for (size_t pixels : { 1, 7, 8, 15, 16, 17, 33, 1000 })
+		{
+			auto image = MakeImage(pixels * 4);
+			auto expected = ReversePerPixel(image);
+
+			SwizzleAyuv(image.data(), pixels, level);
+
+			EXPECT_EQ(image, expected) << simdlevel_to_name(level) << " " << pixels << " pixels";
+		}
+	}
+}
+
+TEST(Ayuv, KeepsPixelOrder) {
+	// A Y U V for 2 pixels
+	std::vector<uint8_t> image{ 0xFF, 0x10, 0x80, 0x81, 0xFE, 0x20, 0x7F, 0x7E };
+
+	SwizzleAyuv(image.data(), 2);
+
+	EXPECT_EQ(image, (std::vector<uint8_t>{ 0x81, 0x80, 0x10, 0xFF, 0x7E, 0x7F, 0x20, 0xFE }));
+}
+
+TEST(Ayuv, SwizzlesByRowBand) {
+	constexpr uint32_t lineLength = 1920 * 4;
+	constexpr uint32_t rows = 1081;
+	auto image = MakeImage(static_cast<size_t>(lineLength) * rows);
+	auto expected = ReversePerPixel(image);
+	RowBandWorkers workers(3);
+
+	SwizzleAyuv(&workers, image.data(), lineLength, rows);
+
+	EXPECT_EQ(image, expected);
+}
+
+TEST(RowBandWorkers, VisitsEveryRowOnce) {
+	for (auto workerCount : { 0u, 1u, 5u })
+	{
+		RowBandWorkers workers(workerCount);
+		std::vector<std::atomic<int>> visits(37);
+		for (auto run = 0; run < 50; ++run)
+		{
+			workers.Run(static_cast<uint32_t>(visits.size()), [&visits](uint32_t first, uint32_t last)
+			{
+				for (auto i = first; i < last; ++i) visits[i]++;
+			});
+		}
+
+		EXPECT_EQ(workers.GetBandCount(), workerCount + 1);
+		EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int>& v) { return v == 50; }))
+			<< workerCount << " workers";
+	}
+}
@@ -0,0 +1,184 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/bitstream_header.h"
+#include "syntheticbursts.h"
+
+namespace
+{
+	BITSTREAM_HEADER Parse(Codec codec, const std::vector<uint8_t>& burst)
+	{
+		BITSTREAM_HEADER header;
+		EXPECT_TRUE(ParseBitstreamHeader(codec, burst.data(), static_cast<uint32_t>(burst.size()), &header));
+		EXPECT_EQ(header.codec, codec);
+		return header;
+	}
+}
+
+TEST(BitstreamHeader, ReadsBitFieldsAndFlagsOverrun) {
+	const uint8_t buf[2]{ 0xA5, 0x3C };
+	BitReader reader(buf, 2);
+	EXPECT_EQ(reader.Read(3), 0x5u);
+	EXPECT_EQ(reader.Read(9), 0x53u);
+	EXPECT_FALSE(reader.HasOverrun());
+	EXPECT_EQ(reader.Read(8), 0xC0u);
+	EXPECT_TRUE(reader.HasOverrun());
+}
+
+TEST(BitstreamHeader, ParsesAc3) {
+	auto header = Parse(AC3, MakeAc3Burst());
+	EXPECT_EQ(header.samplesPerBurst, 1536u);
+	EXPECT_EQ(header.sampleRate, 48000u);
+	EXPECT_EQ(header.bitRate, 448000u);
+	EXPECT_EQ(header.channelCount, 6);
+	EXPECT_TRUE(header.lfe);
+	EXPECT_EQ(header.maxBurstSize, 2560u);
+	EXPECT_EQ(GetBurstDuration(&header), 320000);
+
+	header = Parse(AC3, MakeAc3Burst(1, 37, 2, false));
+	EXPECT_EQ(header.sampleRate, 44100u);
+	EXPECT_EQ(header.channelCount, 2);
+	EXPECT_FALSE(header.lfe);
+	EXPECT_EQ(header.maxBurstSize, 2788u);
+
+	header = Parse(AC3, MakeAc3Burst(2, 0, 1, false));
+	EXPECT_EQ(header.channelCount, 1);
+	EXPECT_EQ(header.maxBurstSize, 3840u);
+}
+
+TEST(BitstreamHeader, RejectsInvalidAc3) {
+	BITSTREAM_HEADER header;
+	auto burst = MakeAc3Burst(3);
+	EXPECT_FALSE(ParseAc3Header(burst.data(), static_cast<uint32_t>(burst.size()), &header));
+	burst = MakeAc3Burst(0, 38);
+	EXPECT_FALSE(ParseAc3Header(burst.data(), static_cast<uint32_t>(burst.size()), &header));
+	burst = MakeAc3Burst();
+	EXPECT_FALSE(ParseAc3Header(burst.data(), 6, &header));
+	burst[0] = 0;
+	EXPECT_FALSE(ParseAc3Header(burst.data(), static_cast<uint32_t>(burst.size()), &header));
+}
+
+TEST(BitstreamHeader, SumsEac3IndependentFrames) {
+	auto header = Parse(EAC3, MakeEac3Burst());
+	EXPECT_EQ(header.samplesPerBurst, 6u * 256);
+	EXPECT_EQ(header.sampleRate, 48000u);
+	EXPECT_EQ(header.channelCount, 6);
+	EXPECT_EQ(header.bitRate, 1280u * 8 * 48000 / 1536);
+
+	// 6 frames of 1 block carry the same audio as 1 frame of 6, the dependent substream adds nothing
+	header = Parse(EAC3, MakeEac3Burst(0, 6, true));
+	EXPECT_EQ(header.samplesPerBurst, 6u * 256);
+	EXPECT_EQ(GetBurstDuration(&header), 320000);
+	EXPECT_EQ(header.bitRate, 6u * (1280 + 512) * 8 * 48000 / 1536);
+}
+
+TEST(BitstreamHeader, ParsesDtsCore) {
+	auto header = Parse(DTS, MakeDtsCoreFrame());
+	EXPECT_EQ(header.samplesPerBurst, 512u);
+	EXPECT_EQ(header.sampleRate, 48000u);
+	EXPECT_EQ(header.bitRate, 1536000u);
+	EXPECT_EQ(header.channelCount, 6);
+	EXPECT_TRUE(header.lfe);
+	// type I burst
+	EXPECT_EQ(header.maxBurstSize, 2048u);
+
+	BITSTREAM_HEADER invalid;
+	auto frame = MakeDtsCoreFrame(4);
+	EXPECT_FALSE(ParseDtsHeader(frame.data(), static_cast<uint32_t>(frame.size()), &invalid));
+	frame = MakeDtsCoreFrame(15, 2012, 9, 4);
+	EXPECT_FALSE(ParseDtsHeader(frame.data(), static_cast<uint32_t>(frame.size()), &invalid));
+}
+
+TEST(BitstreamHeader, ParsesDtsHdWithAndWithoutCore) {
+	auto header = Parse(DTSHD, MakeDtsHdBurst());
+	EXPECT_EQ(header.samplesPerBurst, 512u);
+	EXPECT_EQ(header.sampleRate, 48000u);
+	EXPECT_EQ(header.channelCount, 6);
+	EXPECT_EQ(header.maxBurstSize, GetIEC61937RepetitionPeriodInBytes(DTSHD));
+
+	header = Parse(DTSHD, MakeDtsHdBurst(false, 1));
+	EXPECT_EQ(header.samplesPerBurst, 1024u);
+	EXPECT_EQ(header.sampleRate, 48000u);
+	EXPECT_EQ(header.channelCount, 0);
+}
+
+TEST(BitstreamHeader, FindsTheTrueHdMajorSync) {
+	auto header = Parse(TRUEHD, MakeTrueHdBurst());
+	EXPECT_EQ(header.samplesPerBurst, 960u);
+	EXPECT_EQ(header.sampleRate, 48000u);
+	EXPECT_EQ(header.channelCount, 8);
+	EXPECT_TRUE(header.lfe);
+	EXPECT_EQ(header.bitRate, 0x2000u * 48000 / 16);
+	EXPECT_EQ(GetBurstDuration(&header), 200000);
+
+	header = Parse(TRUEHD, MakeTrueHdBurst(2, 7));
+	EXPECT_EQ(header.samplesPerBurst, 960u * 4);
+	EXPECT_EQ(header.sampleRate, 192000u);
+	EXPECT_EQ(GetBurstDuration(&header), 200000);
+
+	header = Parse(TRUEHD, MakeTrueHdBurst(9));
+	EXPECT_EQ(header.sampleRate, 88200u);
+
+	BITSTREAM_HEADER invalid;
+	std::vector<uint8_t> noSync(MakeTrueHdBurst().size(), 0);
+	EXPECT_FALSE(ParseTrueHdHeader(noSync.data(), static_cast<uint32_t>(noSync.size()), &invalid));
+}
+
+TEST(BitstreamHeader, RejectsCodecsWithoutAParser) {
+	BITSTREAM_HEADER header;
+	auto burst = MakeAc3Burst();
+	EXPECT_FALSE(ParseBitstreamHeader(PCM, burst.data(), static_cast<uint32_t>(burst.size()), &header));
+	EXPECT_FALSE(ParseBitstreamHeader(PAUSE_OR_NULL, burst.data(), static_cast<uint32_t>(burst.size()), &header));
+}
+
+// a cheap in tree stand in for mwcapture-fuzz, every parser sees truncated, bit flipped and random bursts
+TEST(BitstreamHeader, SurvivesTruncatedAndCorruptBursts) {
+	const std::pair<Codec, std::vector<uint8_t>> seeds[]{
+		{ AC3, MakeAc3Burst() },
+		{ EAC3, MakeEac3Burst(0, 6, true) },
+		{ DTS, MakeDtsCoreFrame() },
+		{ DTSHD, MakeDtsHdBurst(false) },
+		{ TRUEHD, MakeTrueHdBurst(2, 3) }
+	};
+	std::mt19937 rng(61937);
+	for (const auto& [codec, seed] : seeds)
+	{
+		for (auto iteration = 0; iteration < 2000; ++iteration)
+		{
+			// the parsers must not read beyond len so copy exactly that much
+			std::vector<uint8_t> burst(seed.begin(), seed.begin() + static_cast<long>(std::min<size_t>(seed.size(), rng() % 128 == 0 ? seed.size() : rng() % 96)));
+			for (auto flips = rng() % 4; flips > 0 && !burst.empty(); --flips)
+			{
+				burst[rng() % burst.size()] ^= static_cast<uint8_t>(1 << rng() % 8);
+			}
+			if (iteration % 10 == 0)
+			{
+				for (auto& b : burst) b = static_cast<uint8_t>(rng());
+			}
+			BITSTREAM_HEADER header;
+			if (ParseBitstreamHeader(codec, burst.data(), static_cast<uint32_t>(burst.size()), &header))
+			{
+				ASSERT_EQ(header.codec, codec);
+				ASSERT_GT(header.samplesPerBurst, 0u);
+				ASSERT_GT(header.sampleRate, 0u);
+				ASSERT_GT(header.maxBurstSize, 0u);
+				ASSERT_LE(header.maxBurstSize, GetIEC61937RepetitionPeriodInBytes(codec));
+			}
+		}
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "../mwcapture/capture_caps.h"
+
+namespace
+{
+	constexpr uint32_t nv12 = 0x3231564E;
+	constexpr uint32_t p010 = 0x30313050;
+	constexpr uint32_t yuy2 = 0x32595559;
+	constexpr int64_t fps50 = 200000;
+	constexpr int64_t fps60 = 166667;
+}
+
+TEST(CaptureCaps, NativeFormatComesFirst) {
+	CAPTURE_CAP native{ p010, 3840, 2160, fps50 };
+
+	auto caps = CombineCaptureCaps(native, { nv12 }, { { 1920, 1080 } }, { fps50 });
+
+	ASSERT_EQ(caps.size(), 2u);
+	EXPECT_TRUE(IsSameCaptureCap(caps[0], native));
+	EXPECT_TRUE(IsSameCaptureCap(caps[1], CAPTURE_CAP{ nv12, 1920, 1080, fps50 }));
+}
+
+TEST(CaptureCaps, OffersEveryCombination) {
+	auto caps = CombineCaptureCaps({ nv12, 3840, 2160, fps50 }, { nv12, yuy2 }, { { 3840, 2160 }, { 1920, 1080 }, { 1280, 720 } },
+		{ fps50, fps60 });
+
+	// the native format is one of the 12 combinations
+	EXPECT_EQ(caps.size(), 12u);
+	for (auto fourcc : { nv12, yuy2 })
+	{
+		for (auto size : { CAPTURE_SIZE{ 3840, 2160 }, CAPTURE_SIZE{ 1920, 1080 }, CAPTURE_SIZE{ 1280, 720 } })
+		{
+			for (auto interval : { fps50, fps60 })
+			{
+				EXPECT_GE(FindCaptureCap(caps, fourcc, size.cx, size.cy, interval), 0) << fourcc << " " << size.cx << " " << interval;
+			}
+		}
+	}
+}
+
+TEST(CaptureCaps, DropsDuplicatesAndEmptyEntries) {
+	auto caps = CombineCaptureCaps({ nv12, 1920, 1080, fps50 }, { nv12, nv12 }, { { 1920, 1080 }, { 0, 0 }, { 1920, 1080 } },
+		{ fps50, fps50 + 10, 0 });
+
+	EXPECT_EQ(caps.size(), 1u);
+}
+
+TEST(CaptureCaps, FindsTheRequestedFormat) {
+	auto caps = CombineCaptureCaps({ p010, 3840, 2160, fps50 }, { nv12, p010 }, { { 3840, 2160 }, { 1920, 1080 } }, { fps50 });
+
+	EXPECT_EQ(FindCaptureCap(caps, p010, 3840, 2160, fps50), 0);
+	EXPECT_EQ(FindCaptureCap(caps, nv12, 1920, 1080, 0), FindCaptureCap(caps, nv12, 1920, 1080, fps50 + 50));
+	EXPECT_EQ(FindCaptureCap(caps, nv12, 1920, 1080, fps60), -1);
+	EXPECT_EQ(FindCaptureCap(caps, yuy2, 1920, 1080, 0), -1);
+	EXPECT_EQ(FindCaptureCap(caps, nv12, 1280, 720, 0), -1);
+}
+
+TEST(CaptureCaps, CropMustFitTheSignal) {
+	EXPECT_TRUE(IsValidCrop({ 0, 0, 3840, 2160 }, 3840, 2160));
+	EXPECT_TRUE(IsValidCrop({ 480, 270, 3360, 1890 }, 3840, 2160));
+	EXPECT_FALSE(IsValidCrop({ 0, 0, 3842, 2160 }, 3840, 2160));
+	EXPECT_FALSE(IsValidCrop({ -2, 0, 1920, 1080 }, 3840, 2160));
+	EXPECT_FALSE(IsValidCrop({ 100, 100, 100, 500 }, 3840, 2160));
+}
+
+TEST(CaptureCaps, CropKeepsChromaWhole) {
+	EXPECT_FALSE(IsValidCrop({ 1, 0, 1921, 1080 }, 3840, 2160));
+	EXPECT_FALSE(IsValidCrop({ 0, 0, 1920, 1079 }, 3840, 2160));
+}
+
+TEST(CaptureCaps, CropHasAMinimumSize) {
+	EXPECT_TRUE(IsValidCrop({ 0, 0, minCropWidth, minCropHeight }, 3840, 2160));
+	EXPECT_FALSE(IsValidCrop({ 0, 0, minCropWidth - 2, minCropHeight }, 3840, 2160));
+	EXPECT_FALSE(IsValidCrop({ 0, 0, minCropWidth, minCropHeight - 2 }, 3840, 2160));
+}
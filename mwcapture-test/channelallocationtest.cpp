@@ -0,0 +1,182 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/channel_allocation.h"
+
+namespace
+{
+	struct Cea861Allocation
+	{
+		uint8_t code;
+		std::array<std::string, 8> slots;
+	};
+
+	// CEA-861-E Table 28, the speaker carried by each HDMI channel
+	const Cea861Allocation cea861Allocations[] = {
+		{ 0x00, { "FL", "FR", "--", "--", "--", "--", "--", "--" } },
+		{ 0x01, { "FL", "FR", "LFE", "--", "--", "--", "--", "--" } },
+		{ 0x02, { "FL", "FR", "--", "FC", "--", "--", "--", "--" } },
+		{ 0x03, { "FL", "FR", "LFE", "FC", "--", "--", "--", "--" } },
+		{ 0x04, { "FL", "FR", "--", "--", "RC", "--", "--", "--" } },
+		{ 0x05, { "FL", "FR", "LFE", "--", "RC", "--", "--", "--" } },
+		{ 0x06, { "FL", "FR", "--", "FC", "RC", "--", "--", "--" } },
+		{ 0x07, { "FL", "FR", "LFE", "FC", "RC", "--", "--", "--" } },
+		{ 0x08, { "FL", "FR", "--", "--", "RL", "RR", "--", "--" } },
+		{ 0x09, { "FL", "FR", "LFE", "--", "RL", "RR", "--", "--" } },
+		{ 0x0A, { "FL", "FR", "--", "FC", "RL", "RR", "--", "--" } },
+		{ 0x0B, { "FL", "FR", "LFE", "FC", "RL", "RR", "--", "--" } },
+		{ 0x0C, { "FL", "FR", "--", "--", "RL", "RR", "RC", "--" } },
+		{ 0x0D, { "FL", "FR", "LFE", "--", "RL", "RR", "RC", "--" } },
+		{ 0x0E, { "FL", "FR", "--", "FC", "RL", "RR", "RC", "--" } },
+		{ 0x0F, { "FL", "FR", "LFE", "FC", "RL", "RR", "RC", "--" } },
+		{ 0x10, { "FL", "FR", "--", "--", "RL", "RR", "RLC", "RRC" } },
+		{ 0x11, { "FL", "FR", "LFE", "--", "RL", "RR", "RLC", "RRC" } },
+		{ 0x12, { "FL", "FR", "--", "FC", "RL", "RR", "RLC", "RRC" } },
+		{ 0x13, { "FL", "FR", "LFE", "FC", "RL", "RR", "RLC", "RRC" } },
+		{ 0x14, { "FL", "FR", "--", "--", "--", "--", "FLC", "FRC" } },
+		{ 0x15, { "FL", "FR", "LFE", "--", "--", "--", "FLC", "FRC" } },
+		{ 0x16, { "FL", "FR", "--", "FC", "--", "--", "FLC", "FRC" } },
+		{ 0x17, { "FL", "FR", "LFE", "FC", "--", "--", "FLC", "FRC" } },
+		{ 0x18, { "FL", "FR", "--", "--", "RC", "--", "FLC", "FRC" } },
+		{ 0x19, { "FL", "FR", "LFE", "--", "RC", "--", "FLC", "FRC" } },
+		{ 0x1A, { "FL", "FR", "--", "FC", "RC", "--", "FLC", "FRC" } },
+		{ 0x1B, { "FL", "FR", "LFE", "FC", "RC", "--", "FLC", "FRC" } },
+		{ 0x1C, { "FL", "FR", "--", "--", "RL", "RR", "FLC", "FRC" } },
+		{ 0x1D, { "FL", "FR", "LFE", "--", "RL", "RR", "FLC", "FRC" } },
+		{ 0x1E, { "FL", "FR", "--", "FC", "RL", "RR", "FLC", "FRC" } },
+		{ 0x1F, { "FL", "FR", "LFE", "FC", "RL", "RR", "FLC", "FRC" } },
+		{ 0x20, { "FL", "FR", "--", "FC", "RL", "RR", "FCH", "--" } },
+		{ 0x21, { "FL", "FR", "LFE", "FC", "RL", "RR", "FCH", "--" } },
+		{ 0x22, { "FL", "FR", "--", "FC", "RL", "RR", "--", "TC" } },
+		{ 0x23, { "FL", "FR", "LFE", "FC", "RL", "RR", "--", "TC" } },
+		{ 0x24, { "FL", "FR", "--", "--", "RL", "RR", "FLH", "FRH" } },
+		{ 0x25, { "FL", "FR", "LFE", "--", "RL", "RR", "FLH", "FRH" } },
+		{ 0x26, { "FL", "FR", "--", "--", "RL", "RR", "FLW", "FRW" } },
+		{ 0x27, { "FL", "FR", "LFE", "--", "RL", "RR", "FLW", "FRW" } },
+		{ 0x28, { "FL", "FR", "--", "FC", "RL", "RR", "RC", "TC" } },
+		{ 0x29, { "FL", "FR", "LFE", "FC", "RL", "RR", "RC", "TC" } },
+		{ 0x2A, { "FL", "FR", "--", "FC", "RL", "RR", "RC", "FCH" } },
+		{ 0x2B, { "FL", "FR", "LFE", "FC", "RL", "RR", "RC", "FCH" } },
+		{ 0x2C, { "FL", "FR", "--", "FC", "RL", "RR", "FCH", "TC" } },
+		{ 0x2D, { "FL", "FR", "LFE", "FC", "RL", "RR", "FCH", "TC" } },
+		{ 0x2E, { "FL", "FR", "--", "FC", "RL", "RR", "FLH", "FRH" } },
+		{ 0x2F, { "FL", "FR", "LFE", "FC", "RL", "RR", "FLH", "FRH" } },
+		{ 0x30, { "FL", "FR", "--", "FC", "RL", "RR", "FLW", "FRW" } },
+		{ 0x31, { "FL", "FR", "LFE", "FC", "RL", "RR", "FLW", "FRW" } },
+	};
+
+	// the speaker each HDMI channel is delivered as, wide channels are dropped as Windows has no equivalent
+	uint16_t ToSpeaker(const std::string& name, bool hasRearCentrePair)
+	{
+		static const std::map<std::string, uint16_t> speakers = {
+			{ "FL", speakerFrontLeft }, { "FR", speakerFrontRight }, { "FC", speakerFrontCenter },
+			{ "LFE", speakerLowFrequency }, { "RC", speakerBackCenter }, { "RLC", speakerBackLeft },
+			{ "RRC", speakerBackRight }, { "FLC", speakerFrontLeftOfCenter }, { "FRC", speakerFrontRightOfCenter },
+			{ "FCH", speakerTopFrontCenter }, { "TC", speakerTopCenter }, { "FLH", speakerTopFrontLeft },
+			{ "FRH", speakerTopFrontRight }
+		};
+		if (name == "RL") return hasRearCentrePair ? speakerSideLeft : speakerBackLeft;
+		if (name == "RR") return hasRearCentrePair ? speakerSideRight : speakerBackRight;
+		auto it = speakers.find(name);
+		return it == speakers.end() ? 0 : it->second;
+	}
+
+	// the speaker written to each output channel by the 1 byte plan
+	std::vector<uint16_t> OutputSpeakers(const CHANNEL_ALLOCATION& ca, const Cea861Allocation& cea)
+	{
+		auto hasRearCentrePair = cea.slots[6] == "RLC";
+		auto plan = GetPcmRemapPlan(&ca, 1);
+		std::vector<uint16_t> speakers;
+		for (auto i = 0; i < plan->outputBlockSize; ++i)
+		{
+			auto src = plan->byteMap[i];
+			if (src == pcmUnmappedByte)
+			{
+				speakers.push_back(0);
+				continue;
+			}
+			auto slot = src / pcmInputSlotSizeInBytes;
+			auto channel = slot < 4 ? slot * 2 : (slot - 4) * 2 + 1;
+			speakers.push_back(ToSpeaker(cea.slots[channel], hasRearCentrePair));
+		}
+		return speakers;
+	}
+}
+
+TEST(ChannelAllocation, OutputFollowsChannelMaskOrder) {
+	for (const auto& cea : cea861Allocations)
+	{
+		const auto& ca = cea861::channelAllocations[cea.code];
+		auto speakers = OutputSpeakers(ca, cea);
+
+		uint16_t expectedMask = 0;
+		for (const auto& slot : cea.slots) expectedMask |= ToSpeaker(slot, cea.slots[6] == "RLC");
+		EXPECT_EQ(ca.channelMask, expectedMask) << "allocation " << static_cast<int>(cea.code);
+
+		ASSERT_EQ(speakers.size(), ca.outputChannelCount) << "allocation " << static_cast<int>(cea.code);
+		uint16_t previous = 0;
+		for (auto speaker : speakers)
+		{
+			EXPECT_GT(speaker, previous) << "allocation " << static_cast<int>(cea.code);
+			previous = speaker;
+		}
+	}
+}
+
+TEST(ChannelAllocation, LfeIndexPointsAtLfeChannel) {
+	for (const auto& cea : cea861Allocations)
+	{
+		const auto& ca = cea861::channelAllocations[cea.code];
+		if (cea.slots[2] == "LFE")
+		{
+			EXPECT_EQ(ca.lfeChannelIndex, 2) << "allocation " << static_cast<int>(cea.code);
+		}
+		else
+		{
+			EXPECT_EQ(ca.lfeChannelIndex, not_present) << "allocation " << static_cast<int>(cea.code);
+		}
+	}
+}
+
+TEST(ChannelAllocation, SevenPointOneSurround) {
+	auto ca = GetChannelAllocation(0x13, 0x0F);
+
+	ASSERT_NE(ca, nullptr);
+	EXPECT_EQ(ca->inputChannelCount, 8);
+	EXPECT_EQ(ca->outputChannelCount, 8);
+	EXPECT_EQ(ca->channelMask, speaker7Point1Surround);
+	EXPECT_EQ(ca->channelOffsets, (std::array<int, 8>{ 0, 0, 1, -1, 2, 2, -2, -2 }));
+	EXPECT_EQ(GetPcmRemapPlan(ca, 3)->outputBlockSize, 24);
+}
+
+TEST(ChannelAllocation, FallsBackToValidChannelPairs) {
+	EXPECT_EQ(GetChannelAllocation(0x00, 0x00), nullptr);
+	EXPECT_EQ(GetChannelAllocation(0x00, 0x01)->outputChannelCount, 2);
+	EXPECT_EQ(GetChannelAllocation(0x00, 0x03)->outputChannelCount, 4);
+	EXPECT_EQ(GetChannelAllocation(0x00, 0x07)->outputChannelCount, 6);
+	EXPECT_EQ(GetChannelAllocation(0x00, 0x0F)->outputChannelCount, 8);
+	EXPECT_EQ(GetChannelAllocation(0x00, 0x05)->outputChannelCount, 2);
+	EXPECT_EQ(GetChannelAllocation(0x32, 0x0F)->channelMask, speaker7Point1Surround);
+}
+
+TEST(ChannelAllocation, NoChannelsHasNoRemap) {
+	EXPECT_EQ(GetPcmRemapPlan(nullptr, 2)->outputBlockSize, 0);
+	EXPECT_EQ(GetPcmRemapPlan(GetChannelAllocation(0x0B, 0x07), 0)->outputBlockSize, 0);
+	EXPECT_EQ(GetPcmRemapPlan(GetChannelAllocation(0x0B, 0x07), 2)->outputBlockSize, 12);
+}
@@ -0,0 +1,203 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/delivery_queue.h"
+
+namespace
+{
+	// a consumer which can be held up to simulate a slow downstream filter
+	struct CONSUMER
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool blocked{ false };
+		bool accept{ true };
+		std::vector<int> delivered;
+		std::vector<int> released;
+
+		bool Deliver(int& item)
+		{
+			std::unique_lock lck(mutex);
+			cv.wait(lck, [this] { return !blocked; });
+			if (!accept) return false;
+			delivered.push_back(item);
+			return true;
+		}
+
+		void Release(int& item)
+		{
+			std::lock_guard lck(mutex);
+			released.push_back(item);
+		}
+
+		void Block(bool block)
+		{
+			{
+				std::lock_guard lck(mutex);
+				blocked = block;
+			}
+			cv.notify_all();
+		}
+
+		std::unique_ptr<DeliveryQueue<int>> MakeQueue(uint32_t capacity, DeliveryPolicy policy)
+		{
+			return std::make_unique<DeliveryQueue<int>>(capacity, policy, [this](int& i) { return Deliver(i); },
+				[this](int& i) { Release(i); });
+		}
+	};
+
+	// waits for the delivery thread to pick up the item at the front of the queue
+	void WaitForDepth(const DeliveryQueue<int>& queue, uint32_t depth)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (queue.GetStats().depth != depth && std::chrono::steady_clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		ASSERT_EQ(queue.GetStats().depth, depth);
+	}
+}
+
+TEST(DeliveryQueue, DeliversInOrder) {
+	CONSUMER consumer;
+	auto queue = consumer.MakeQueue(4, DELIVERY_DROP_OLDEST);
+	for (auto i = 0; i < 100; ++i)
+	{
+		queue->Push(i);
+		if (i % 3 == 0) queue->Drain();
+	}
+	queue->Drain();
+	std::vector<int> expected(100);
+	for (auto i = 0; i < 100; ++i) expected[i] = i;
+	EXPECT_EQ(consumer.delivered, expected);
+	// delivered items are released as well
+	EXPECT_EQ(consumer.released, expected);
+	EXPECT_EQ(queue->GetStats().delivered, 100u);
+	EXPECT_EQ(queue->GetStats().dropped, 0u);
+}
+
+TEST(DeliveryQueue, ASlowConsumerDoesNotBlockThePushes) {
+	for (auto policy : { DELIVERY_DROP_OLDEST, DELIVERY_DROP_NEWEST })
+	{
+		CONSUMER consumer;
+		auto queue = consumer.MakeQueue(3, policy);
+		consumer.Block(true);
+		// 0 is taken by the delivery thread and held there
+		queue->Push(0);
+		WaitForDepth(*queue, 0);
+		for (auto i = 1; i <= 3; ++i)
+		{
+			EXPECT_TRUE(queue->Push(i)) << deliverypolicy_to_name(policy);
+		}
+		for (auto i = 4; i <= 6; ++i)
+		{
+			EXPECT_FALSE(queue->Push(i)) << deliverypolicy_to_name(policy);
+		}
+		auto stats = queue->GetStats();
+		EXPECT_EQ(stats.depth, 3u);
+		EXPECT_EQ(stats.maxDepth, 3u);
+		EXPECT_EQ(stats.dropped, 3u);
+		consumer.Block(false);
+		queue->Drain();
+
+		if (policy == DELIVERY_DROP_OLDEST)
+		{
+			EXPECT_EQ(consumer.delivered, (std::vector<int>{ 0, 4, 5, 6 }));
+		}
+		else
+		{
+			EXPECT_EQ(consumer.delivered, (std::vector<int>{ 0, 1, 2, 3 }));
+		}
+		EXPECT_EQ(consumer.released.size(), 7u);
+	}
+}
+
+TEST(DeliveryQueue, FlushReleasesWhatIsQueued) {
+	CONSUMER consumer;
+	auto queue = consumer.MakeQueue(8, DELIVERY_DROP_OLDEST);
+	consumer.Block(true);
+	for (auto i = 0; i < 5; ++i) queue->Push(i);
+	WaitForDepth(*queue, 4);
+
+	// the flush waits for the item being delivered so unblock it from another thread
+	std::thread unblock([&consumer] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		consumer.Block(false);
+	});
+	queue->Flush();
+	unblock.join();
+	EXPECT_EQ(consumer.delivered, (std::vector<int>{ 0 }));
+	EXPECT_EQ(consumer.released.size(), 5u);
+	EXPECT_EQ(queue->GetStats().flushed, 4u);
+	EXPECT_EQ(queue->GetStats().depth, 0u);
+
+	// still usable afterwards
+	queue->Push(5);
+	queue->Drain();
+	EXPECT_EQ(consumer.delivered, (std::vector<int>{ 0, 5 }));
+}
+
+TEST(DeliveryQueue, StopsDeliveringWhenTheConsumerFails) {
+	CONSUMER consumer;
+	auto queue = consumer.MakeQueue(8, DELIVERY_DROP_OLDEST);
+	consumer.Block(true);
+	for (auto i = 0; i < 4; ++i) queue->Push(i);
+	{
+		std::lock_guard lck(consumer.mutex);
+		consumer.accept = false;
+	}
+	consumer.Block(false);
+	queue->Drain();
+	EXPECT_TRUE(queue->HasFailed());
+	EXPECT_TRUE(consumer.delivered.empty());
+	EXPECT_EQ(consumer.released.size(), 4u);
+
+	EXPECT_FALSE(queue->Push(4));
+	EXPECT_EQ(consumer.released.size(), 5u);
+}
+
+TEST(DeliveryQueue, ReleasesEverythingOnDestruction) {
+	CONSUMER consumer;
+	{
+		auto queue = consumer.MakeQueue(4, DELIVERY_DROP_NEWEST);
+		consumer.Block(true);
+		for (auto i = 0; i < 4; ++i) queue->Push(i);
+		WaitForDepth(*queue, 3);
+		std::thread unblock([&consumer] {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			consumer.Block(false);
+		});
+		queue.reset();
+		unblock.join();
+	}
+	EXPECT_EQ(consumer.released.size(), 4u);
+}
+
+TEST(DeliveryQueue, ParsesPolicyNamesIgnoringCase) {
+	DeliveryPolicy policy = DELIVERY_DROP_OLDEST;
+	EXPECT_TRUE(ParseDeliveryPolicy("dropnewest", &policy));
+	EXPECT_EQ(policy, DELIVERY_DROP_NEWEST);
+	EXPECT_TRUE(ParseDeliveryPolicy("DropOldest", &policy));
+	EXPECT_EQ(policy, DELIVERY_DROP_OLDEST);
+
+	EXPECT_FALSE(ParseDeliveryPolicy("", &policy));
+	EXPECT_FALSE(ParseDeliveryPolicy("Drop", &policy));
+	EXPECT_FALSE(ParseDeliveryPolicy("unknown", &policy));
+	EXPECT_EQ(policy, DELIVERY_DROP_OLDEST);
+}
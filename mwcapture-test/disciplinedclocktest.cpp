@@ -0,0 +1,152 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <random>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/disciplined_clock.h"
+
+namespace
+{
+	// a typical QueryPerformanceFrequency
+	constexpr int64_t counterFrequency = 10000000;
+	constexpr int64_t deviceEpoch = 123456789000LL;
+
+	// a counter which only moves when told to and a device clock that runs at a fixed rate relative to it
+	struct SIMULATED_CLOCKS
+	{
+		int64_t counter{ 987654321LL };
+		int64_t counterAtEpoch{ counter };
+		double driftPpm{ 0.0 };
+		// counter ticks which pass while the device is read
+		int64_t readTime{ 20 };
+		int64_t noise{ 0 };
+		int64_t step{ 0 };
+		uint64_t deviceReads{ 0 };
+		std::mt19937 rng{ 48000 };
+
+		int64_t Device()
+		{
+			deviceReads++;
+			counter += readTime / 2;
+			auto t = DeviceAt(counter);
+			counter += readTime - readTime / 2;
+			if (noise > 0) t += std::uniform_int_distribution<int64_t>(-noise, noise)(rng);
+			return t;
+		}
+
+		int64_t DeviceAt(int64_t c) const
+		{
+			auto elapsed = static_cast<double>(c - counterAtEpoch) * (10000000.0 / counterFrequency);
+			return deviceEpoch + step + std::llround(elapsed * (1.0 + driftPpm / 1000000.0));
+		}
+
+		DisciplinedClock MakeClock()
+		{
+			return DisciplinedClock([this] { return counter; }, counterFrequency, [this] { return Device(); });
+		}
+	};
+}
+
+TEST(DisciplinedClock, ConvertsTheCounterWithoutADevice) {
+	int64_t counter = 0;
+	// not a multiple of 10MHz
+	DisciplinedClock clock([&counter] { return counter; }, 3579545);
+	EXPECT_EQ(clock.GetTime(), 0);
+	counter = 3579545;
+	EXPECT_EQ(clock.GetTime(), 10000000);
+	// days of uptime do not overflow
+	counter = 3579545LL * 86400 * 30 + 3579545 / 2;
+	EXPECT_EQ(clock.GetTime(), 10000000LL * 86400 * 30 + 4999998);
+	EXPECT_FALSE(clock.GetStats().locked);
+}
+
+TEST(DisciplinedClock, TracksADriftingDevice) {
+	for (auto driftPpm : { 0.0, 80.0, -250.0 })
+	{
+		SIMULATED_CLOCKS sim;
+		sim.driftPpm = driftPpm;
+		sim.noise = 5;
+		auto clock = sim.MakeClock();
+		int64_t last = std::numeric_limits<int64_t>::min();
+		double maxError = 0.0;
+		// 60s of calls every 1ms
+		for (auto i = 0; i < 60000; ++i)
+		{
+			sim.counter += counterFrequency / 1000;
+			auto t = clock.GetTime();
+			ASSERT_GE(t, last) << driftPpm << " " << i;
+			last = t;
+			if (i > 30000) maxError = std::max(maxError, std::abs(static_cast<double>(t - sim.DeviceAt(sim.counter))));
+		}
+		const auto& stats = clock.GetStats();
+		EXPECT_TRUE(stats.locked);
+		EXPECT_EQ(stats.resyncs, 0u);
+		EXPECT_NEAR(stats.driftPpm, driftPpm, 0.5) << driftPpm;
+		// within a few us of the device once settled
+		EXPECT_LT(maxError, 30.0) << driftPpm;
+		EXPECT_LT(stats.rmsError, 10.0) << driftPpm;
+		// sampled every 100ms rather than on every call
+		EXPECT_EQ(sim.deviceReads, 600u) << driftPpm;
+	}
+}
+
+TEST(DisciplinedClock, StaysMonotonicAcrossADeviceStep) {
+	SIMULATED_CLOCKS sim;
+	auto clock = sim.MakeClock();
+	int64_t last = 0;
+	for (auto i = 0; i < 5000; ++i)
+	{
+		sim.counter += counterFrequency / 1000;
+		// the device jumps back by a second
+		if (i == 2000) sim.step = -10000000;
+		auto t = clock.GetTime();
+		ASSERT_GE(t, last) << i;
+		last = t;
+	}
+	EXPECT_EQ(clock.GetStats().resyncs, 1u);
+	// the time is held until the device catches up
+	EXPECT_LT(last, sim.DeviceAt(sim.counter) + 10000000);
+}
+
+TEST(DisciplinedClock, FollowsADeviceStepForwards) {
+	SIMULATED_CLOCKS sim;
+	auto clock = sim.MakeClock();
+	for (auto i = 0; i < 5000; ++i)
+	{
+		sim.counter += counterFrequency / 1000;
+		if (i == 2000) sim.step = 50000000;
+		clock.GetTime();
+	}
+	EXPECT_EQ(clock.GetStats().resyncs, 1u);
+	EXPECT_NEAR(static_cast<double>(clock.GetTime() - sim.DeviceAt(sim.counter)), 0.0, 10.0);
+}
+
+TEST(DisciplinedClock, DiscardsSlowReads) {
+	SIMULATED_CLOCKS sim;
+	sim.driftPpm = 100.0;
+	auto clock = sim.MakeClock();
+	for (auto i = 0; i < 20000; ++i)
+	{
+		sim.counter += counterFrequency / 1000;
+		// every other read is preempted for 5ms
+		sim.readTime = sim.deviceReads % 2 == 0 ? 20 : 50000;
+		clock.GetTime();
+	}
+	const auto& stats = clock.GetStats();
+	EXPECT_GT(stats.discarded, 0u);
+	EXPECT_EQ(stats.resyncs, 0u);
+	EXPECT_NEAR(stats.driftPpm, 100.0, 0.5);
+	EXPECT_NEAR(static_cast<double>(clock.GetTime() - sim.DeviceAt(sim.counter)), 0.0, 20.0);
+}
@@ -0,0 +1,297 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/downscale.h"
+
+namespace
+{
+	constexpr DownscaleLayout allLayouts[] = {
+		DOWNSCALE_NV12, DOWNSCALE_P010, DOWNSCALE_NV16, DOWNSCALE_P210, DOWNSCALE_AYUV, DOWNSCALE_BGR24,
+		DOWNSCALE_BGR10
+	};
+
+	size_t GetPixelBytes(const DOWNSCALE_PLANE& plane)
+	{
+		return plane.sampleBytes == 4 ? 4 : static_cast<size_t>(plane.sampleBytes) * plane.components;
+	}
+
+	uint32_t GetStride(DownscaleLayout layout, uint32_t cx)
+	{
+		auto plane = GetDownscalePlane(layout, 0);
+		return static_cast<uint32_t>(cx * GetPixelBytes(plane));
+	}
+
+	size_t GetImageSize(DownscaleLayout layout, uint32_t cx, uint32_t cy)
+	{
+		auto lineLength = GetStride(layout, cx);
+		size_t size = 0;
+		for (uint32_t p = 0; p < GetDownscalePlaneCount(layout); ++p)
+		{
+			size += static_cast<size_t>(lineLength) * (cy / GetDownscalePlane(layout, p).heightDivisor);
+		}
+		return size;
+	}
+
+	// noise with the always clear low bits cleared as the card would deliver them
+	std::vector<uint8_t> MakeImage(DownscaleLayout layout, uint32_t cx, uint32_t cy)
+	{
+		std::vector<uint8_t> image(GetImageSize(layout, cx, cy));
+		uint32_t seed = 12345;
+		for (auto& b : image)
+		{
+			seed = seed * 1103515245 + 12345;
+			b = static_cast<uint8_t>(seed >> 16);
+		}
+		auto lowBits = GetDownscalePlane(layout, 0).lowBits;
+		if (lowBits > 0)
+		{
+			auto samples = reinterpret_cast<uint16_t*>(image.data());
+			for (size_t i = 0; i < image.size() / 2; ++i) samples[i] &= static_cast<uint16_t>(~((1u << lowBits) - 1u));
+		}
+		return image;
+	}
+
+	std::vector<uint8_t> Downscale(DownscaleLayout layout, const std::vector<uint8_t>& image, uint32_t cx, uint32_t cy,
+		uint32_t dstCx, uint32_t dstCy, SimdLevel level, unsigned int workerCount = 0)
+	{
+		std::vector<uint8_t> out(GetImageSize(layout, dstCx, dstCy));
+		RowBandWorkers workers(workerCount);
+		FrameDownscaler downscaler;
+		downscaler.Downscale(&workers, layout, image.data(), cx, cy, GetStride(layout, cx), out.data(), dstCx, dstCy,
+			GetStride(layout, dstCx), level);
+		return out;
+	}
+
+	uint32_t GetSample(const std::vector<uint8_t>& image, size_t offset, uint32_t sampleBytes)
+	{
+		if (sampleBytes == 1) return image[offset];
+		if (sampleBytes == 2) return *reinterpret_cast<const uint16_t*>(image.data() + offset);
+		return *reinterpret_cast<const uint32_t*>(image.data() + offset);
+	}
+}
+
+TEST(Downscale, SizesKeepChromaWhole) {
+	uint32_t cx, cy;
+	GetDownscaledSize(DOWNSCALE_HALF, 3840, 2160, &cx, &cy);
+	EXPECT_EQ(cx, 1920u);
+	EXPECT_EQ(cy, 1080u);
+	GetDownscaledSize(DOWNSCALE_QUARTER, 1920, 1080, &cx, &cy);
+	EXPECT_EQ(cx, 480u);
+	EXPECT_EQ(cy, 270u);
+	// 720x486 / 4 would leave an odd number of rows
+	GetDownscaledSize(DOWNSCALE_QUARTER, 720, 486, &cx, &cy);
+	EXPECT_EQ(cx, 180u);
+	EXPECT_EQ(cy, 120u);
+	GetDownscaledSize(DOWNSCALE_960X540, 4096, 2160, &cx, &cy);
+	EXPECT_EQ(cx, 960u);
+	EXPECT_EQ(cy, 540u);
+	GetDownscaledSize(DOWNSCALE_NONE, 1920, 1080, &cx, &cy);
+	EXPECT_EQ(cx, 1920u);
+	EXPECT_EQ(cy, 1080u);
+}
+
+TEST(Downscale, NeverEnlarges) {
+	uint32_t cx, cy;
+	GetDownscaledSize(DOWNSCALE_960X540, 720, 576, &cx, &cy);
+	EXPECT_EQ(cx, 720u);
+	EXPECT_EQ(cy, 576u);
+	GetDownscaledSize(DOWNSCALE_960X540, 960, 540, &cx, &cy);
+	EXPECT_EQ(cx, 960u);
+	EXPECT_EQ(cy, 540u);
+}
+
+TEST(Downscale, HalvesToTheMeanOfEachBlock) {
+	for (auto layout : allLayouts)
+	{
+		// odd sample counts exercise the scalar tail of the vector kernels
+		constexpr uint32_t cx = 166;
+		constexpr uint32_t cy = 10;
+		auto image = MakeImage(layout, cx, cy);
+		auto out = Downscale(layout, image, cx, cy, cx / 2, cy / 2, SIMD_SCALAR);
+		auto srcStride = GetStride(layout, cx);
+		auto dstStride = GetStride(layout, cx / 2);
+		size_t srcPlane = 0;
+		size_t dstPlane = 0;
+		for (uint32_t p = 0; p < GetDownscalePlaneCount(layout); ++p)
+		{
+			auto plane = GetDownscalePlane(layout, p);
+			auto pixelBytes = GetPixelBytes(plane);
+			auto sampleBytes = plane.sampleBytes;
+			auto samplesPerPixel = sampleBytes == 4 ? 1 : plane.components;
+			for (uint32_t y = 0; y < cy / plane.heightDivisor / 2; ++y)
+			{
+				for (uint32_t x = 0; x < cx / plane.widthDivisor / 2; ++x)
+				{
+					for (auto c = 0; c < samplesPerPixel; ++c)
+					{
+						auto at = [&](uint32_t sy, uint32_t sx)
+						{
+							return GetSample(image, srcPlane + static_cast<size_t>(sy) * srcStride + sx * pixelBytes + c * sampleBytes, sampleBytes);
+						};
+						auto actual = GetSample(out, dstPlane + static_cast<size_t>(y) * dstStride + x * pixelBytes + c * sampleBytes, sampleBytes);
+						uint32_t expected;
+						if (sampleBytes == 4)
+						{
+							expected = AveragePacked1010102(at(2 * y, 2 * x), at(2 * y, 2 * x + 1), at(2 * y + 1, 2 * x), at(2 * y + 1, 2 * x + 1));
+						}
+						else
+						{
+							auto sum = at(2 * y, 2 * x) + at(2 * y, 2 * x + 1) + at(2 * y + 1, 2 * x) + at(2 * y + 1, 2 * x + 1);
+							auto unit = 1u << plane.lowBits;
+							auto max = sampleBytes == 1 ? 255u : 65535u;
+							expected = std::min((sum / unit + 2) / 4 * unit, max & ~(unit - 1));
+						}
+						ASSERT_EQ(actual, expected) << static_cast<int>(layout) << " plane " << p << " at " << x << "," << y << "," << c;
+					}
+				}
+			}
+			srcPlane += static_cast<size_t>(srcStride) * (cy / plane.heightDivisor);
+			dstPlane += static_cast<size_t>(dstStride) * (cy / 2 / plane.heightDivisor);
+		}
+	}
+}
+
+TEST(Downscale, AveragesPackedFieldsIndependently) {
+	// B=1023 G=0 R=512 A=3 next to B=0 G=1023 R=513 A=0
+	uint32_t a = 1023u | 0u << 10 | 512u << 20 | 3u << 30;
+	uint32_t b = 0u | 1023u << 10 | 513u << 20 | 0u << 30;
+
+	auto mean = AveragePacked1010102(a, b, a, b);
+
+	EXPECT_EQ(mean & 0x3FF, 512u);
+	EXPECT_EQ(mean >> 10 & 0x3FF, 512u);
+	EXPECT_EQ(mean >> 20 & 0x3FF, 513u);
+	EXPECT_EQ(mean >> 30, 2u);
+}
+
+TEST(Downscale, EverySimdLevelMatchesScalar) {
+	for (auto layout : allLayouts)
+	{
+		for (uint32_t cx : { 2u, 30u, 64u, 98u, 1920u })
+		{
+			constexpr uint32_t cy = 12;
+			auto image = MakeImage(layout, cx, cy);
+			auto expected = Downscale(layout, image, cx, cy, std::max(cx / 2 & ~1u, 2u), cy / 2, SIMD_SCALAR);
+			for (auto level : { SIMD_SSE41, SIMD_AVX2, SIMD_NEON })
+			{
+				if (!IsSimdLevelSupported(level)) continue;
+
+				auto actual = Downscale(layout, image, cx, cy, std::max(cx / 2 & ~1u, 2u), cy / 2, level);
+
+				EXPECT_EQ(actual, expected) << simdlevel_to_name(level) << " layout " << static_cast<int>(layout) << " " << cx;
+			}
+		}
+	}
+}
+
+TEST(Downscale, KeepsLowBitsClear) {
+	for (auto layout : { DOWNSCALE_P010, DOWNSCALE_P210 })
+	{
+		// halving then a bilinear step
+		auto image = MakeImage(layout, 1280, 720);
+		auto out = Downscale(layout, image, 1280, 720, 480, 270, GetSimdLevel());
+		auto samples = reinterpret_cast<const uint16_t*>(out.data());
+		for (size_t i = 0; i < out.size() / 2; ++i)
+		{
+			ASSERT_EQ(samples[i] & 0x3F, 0) << static_cast<int>(layout) << " at " << i;
+		}
+	}
+}
+
+TEST(Downscale, QuarterIsTwoHalvings) {
+	for (auto layout : allLayouts)
+	{
+		auto image = MakeImage(layout, 160, 40);
+		auto half = Downscale(layout, image, 160, 40, 80, 20, SIMD_SCALAR);
+		auto expected = Downscale(layout, half, 80, 20, 40, 10, SIMD_SCALAR);
+
+		auto actual = Downscale(layout, image, 160, 40, 40, 10, GetSimdLevel());
+
+		EXPECT_EQ(actual, expected) << static_cast<int>(layout);
+	}
+}
+
+TEST(Downscale, FlatImagesStayFlatThroughBilinear) {
+	for (auto layout : allLayouts)
+	{
+		// 4096x2160 to 960x540 halves twice to 1024x540 then resamples the width
+		constexpr uint32_t cx = 4096;
+		constexpr uint32_t cy = 2160;
+		std::vector<uint8_t> image(GetImageSize(layout, cx, cy));
+		auto plane = GetDownscalePlane(layout, 0);
+		if (plane.sampleBytes == 1)
+		{
+			memset(image.data(), 0x6B, image.size());
+		}
+		else if (plane.sampleBytes == 2)
+		{
+			auto samples = reinterpret_cast<uint16_t*>(image.data());
+			std::fill(samples, samples + image.size() / 2, static_cast<uint16_t>(0x8A40));
+		}
+		else
+		{
+			auto pixels = reinterpret_cast<uint32_t*>(image.data());
+			std::fill(pixels, pixels + image.size() / 4, 1000u | 64u << 10 | 512u << 20 | 3u << 30);
+		}
+
+		auto out = Downscale(layout, image, cx, cy, 960, 540, GetSimdLevel());
+
+		std::vector<uint8_t> expected(GetImageSize(layout, 960, 540));
+		memcpy(expected.data(), image.data(), expected.size());
+		EXPECT_EQ(out, expected) << static_cast<int>(layout);
+	}
+}
+
+TEST(Downscale, InterpolatesBetweenSamples) {
+	// a 4 pixel ramp resampled to 3 pixels lands a third of the way between each source pixel
+	std::vector<BILINEAR_TAP> taps;
+	GetBilinearTaps(4, 3, &taps);
+	ASSERT_EQ(taps.size(), 3u);
+	EXPECT_EQ(taps[0].index, 0u);
+	EXPECT_EQ(taps[0].weight, 42u);
+	EXPECT_EQ(taps[1].index, 1u);
+	EXPECT_EQ(taps[1].weight, 128u);
+	EXPECT_EQ(taps[2].index, 2u);
+	EXPECT_EQ(taps[2].weight, 213u);
+
+	std::vector<uint8_t> row{ 0, 90, 180, 255 };
+	std::vector<uint8_t> out(3);
+	BilinearRowScalar(row.data(), row.data(), 0, out.data(), taps, 1, 0);
+
+	EXPECT_EQ(out, (std::vector<uint8_t>{ 15, 135, 242 }));
+}
+
+TEST(Downscale, CopiesWhenTheSizeIsUnchanged) {
+	auto image = MakeImage(DOWNSCALE_NV12, 64, 32);
+
+	auto out = Downscale(DOWNSCALE_NV12, image, 64, 32, 64, 32, GetSimdLevel());
+
+	EXPECT_EQ(out, image);
+}
+
+TEST(Downscale, DownscalesByRowBand) {
+	for (auto layout : allLayouts)
+	{
+		auto image = MakeImage(layout, 1920, 1080);
+		auto expected = Downscale(layout, image, 1920, 1080, 960, 540, GetSimdLevel());
+
+		auto actual = Downscale(layout, image, 1920, 1080, 960, 540, GetSimdLevel(), 3);
+
+		EXPECT_EQ(actual, expected) << static_cast<int>(layout);
+	}
+}
@@ -0,0 +1,459 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/frame_fanout.h"
+
+TEST(FrameFanout, TakesOldestFrameFirst) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(4, 16));
+	auto consumer = fanout.Subscribe(4, DELIVERY_DROP_OLDEST);
+	const uint8_t data[3] = { 1, 2, 3 };
+
+	EXPECT_TRUE(fanout.Empty(consumer));
+	EXPECT_TRUE(fanout.Push(data, 3, 100));
+	EXPECT_TRUE(fanout.Push(data, 2, 200));
+
+	auto first = fanout.Take(consumer);
+	ASSERT_NE(first, FrameFanout::noSlot);
+	EXPECT_EQ(fanout.Get(first).ts, 100u);
+	EXPECT_EQ(fanout.Get(first).length, 3);
+	EXPECT_EQ(memcmp(fanout.Get(first).data, data, 3), 0);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(fanout.Get(first).data) % captureSlotAlignment, 0u);
+
+	auto second = fanout.Take(consumer);
+	ASSERT_NE(second, FrameFanout::noSlot);
+	EXPECT_EQ(fanout.Get(second).ts, 200u);
+	EXPECT_EQ(fanout.Get(second).sequence, 1u);
+	EXPECT_TRUE(fanout.Empty(consumer));
+	EXPECT_EQ(fanout.Take(consumer), FrameFanout::noSlot);
+	EXPECT_EQ(fanout.GetHeldCount(), 2u);
+
+	fanout.Release(first);
+	fanout.Release(second);
+	EXPECT_EQ(fanout.GetHeldCount(), 0u);
+}
+
+TEST(FrameFanout, SharesEachFrameWithEveryConsumer) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(4, 8));
+	auto notified = 0;
+	auto capture = fanout.Subscribe(2, DELIVERY_DROP_NEWEST, [&notified] { notified++; });
+	auto preview = fanout.Subscribe(2, DELIVERY_DROP_OLDEST, [&notified] { notified++; });
+	EXPECT_EQ(fanout.GetConsumerCount(), 2u);
+
+	// the frame is captured into a slot once and both consumers see that slot
+	auto slot = fanout.Acquire();
+	ASSERT_NE(slot, FrameFanout::noSlot);
+	memset(fanout.Get(slot).data, 9, 8);
+	fanout.Publish(slot, 8, 42);
+	EXPECT_EQ(notified, 2);
+	EXPECT_EQ(fanout.GetHeldCount(), 1u);
+
+	auto fromCapture = fanout.Take(capture);
+	auto fromPreview = fanout.Take(preview);
+	EXPECT_EQ(fromCapture, slot);
+	EXPECT_EQ(fromPreview, slot);
+	EXPECT_EQ(fanout.Get(slot).data[7], 9);
+
+	// the slot is only free once both have finished with it
+	fanout.Release(fromCapture);
+	EXPECT_EQ(fanout.GetHeldCount(), 1u);
+	fanout.Release(fromPreview);
+	EXPECT_EQ(fanout.GetHeldCount(), 0u);
+}
+
+TEST(FrameFanout, FramesPublishedWithoutConsumersAreFreed) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(1, 8));
+	const uint8_t data[8]{};
+	for (auto i = 0; i < 4; ++i)
+	{
+		EXPECT_TRUE(fanout.Push(data, 8, i));
+	}
+	EXPECT_EQ(fanout.GetHeldCount(), 0u);
+	EXPECT_EQ(fanout.GetDroppedCount(), 0u);
+}
+
+TEST(FrameFanout, HeldSlotsAreReturnedOutOfOrder) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(2, 8));
+	auto consumer = fanout.Subscribe(8, DELIVERY_DROP_NEWEST);
+	const uint8_t data[8]{};
+
+	EXPECT_TRUE(fanout.Push(data, 8, 0));
+	EXPECT_TRUE(fanout.Push(data, 8, 1));
+	EXPECT_FALSE(fanout.Push(data, 8, 2));
+	EXPECT_EQ(fanout.GetDroppedCount(), 1u);
+
+	auto first = fanout.Take(consumer);
+	auto second = fanout.Take(consumer);
+	// downstream finishes with the later frame first, only that slot can be reused
+	fanout.Release(second);
+	EXPECT_TRUE(fanout.Push(data, 8, 3));
+	EXPECT_FALSE(fanout.Push(data, 8, 4));
+	auto third = fanout.Take(consumer);
+	EXPECT_EQ(third, second);
+	EXPECT_EQ(fanout.Get(third).sequence, 3u);
+	EXPECT_EQ(fanout.Get(first).sequence, 0u);
+}
+
+TEST(FrameFanout, EachConsumerHasItsOwnDropPolicy) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(8, 8));
+	auto latest = fanout.Subscribe(2, DELIVERY_DROP_OLDEST);
+	auto continuous = fanout.Subscribe(2, DELIVERY_DROP_NEWEST);
+	auto keepingUp = fanout.Subscribe(8, DELIVERY_DROP_NEWEST);
+	const uint8_t data[8]{};
+
+	for (auto i = 0; i < 5; ++i)
+	{
+		// no consumer takes anything but the producer never has to drop as the full queues give up their frames
+		EXPECT_TRUE(fanout.Push(data, 8, i));
+	}
+	EXPECT_EQ(fanout.GetDroppedCount(), 0u);
+
+	auto takeAll = [&fanout](int consumer)
+	{
+		std::vector<uint64_t> seen;
+		for (auto slot = fanout.Take(consumer); slot != FrameFanout::noSlot; slot = fanout.Take(consumer))
+		{
+			seen.push_back(fanout.Get(slot).ts);
+			fanout.Release(slot);
+		}
+		return seen;
+	};
+	EXPECT_EQ(takeAll(latest), (std::vector<uint64_t>{ 3, 4 }));
+	EXPECT_EQ(takeAll(continuous), (std::vector<uint64_t>{ 0, 1 }));
+	EXPECT_EQ(takeAll(keepingUp), (std::vector<uint64_t>{ 0, 1, 2, 3, 4 }));
+
+	EXPECT_EQ(fanout.GetStats(latest).received, 5u);
+	EXPECT_EQ(fanout.GetStats(latest).dropped, 3u);
+	EXPECT_EQ(fanout.GetStats(continuous).dropped, 3u);
+	EXPECT_EQ(fanout.GetStats(keepingUp).dropped, 0u);
+	EXPECT_EQ(fanout.GetHeldCount(), 0u);
+}
+
+TEST(FrameFanout, UnsubscribeReleasesQueuedFrames) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(4, 8));
+	auto first = fanout.Subscribe(4, DELIVERY_DROP_OLDEST);
+	auto second = fanout.Subscribe(4, DELIVERY_DROP_OLDEST);
+	const uint8_t data[8]{};
+	EXPECT_TRUE(fanout.Push(data, 8, 0));
+	EXPECT_TRUE(fanout.Push(data, 8, 1));
+
+	auto held = fanout.Take(first);
+	fanout.Unsubscribe(first);
+	fanout.Unsubscribe(second);
+	EXPECT_EQ(fanout.GetConsumerCount(), 0u);
+	// a frame taken before unsubscribing stays with whoever took it
+	EXPECT_EQ(fanout.GetHeldCount(), 1u);
+	fanout.Release(held);
+	EXPECT_EQ(fanout.GetHeldCount(), 0u);
+
+	// the id is reused
+	EXPECT_EQ(fanout.Subscribe(1, DELIVERY_DROP_OLDEST), first);
+}
+
+TEST(FrameFanout, ConsumerCanClaimAFreeSlot) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(2, 8));
+	auto consumer = fanout.Subscribe(2, DELIVERY_DROP_OLDEST);
+	const uint8_t data[8] = { 7 };
+
+	EXPECT_TRUE(fanout.Push(data, 8, 0));
+	fanout.Release(fanout.Take(consumer));
+
+	auto slot = fanout.Acquire();
+	ASSERT_NE(slot, FrameFanout::noSlot);
+	auto other = fanout.Acquire();
+	ASSERT_NE(other, FrameFanout::noSlot);
+	EXPECT_EQ(fanout.Acquire(), FrameFanout::noSlot);
+	EXPECT_FALSE(fanout.Push(data, 8, 1));
+	EXPECT_TRUE(fanout.Empty(consumer));
+}
+
+TEST(FrameFanout, ResetKeepsStorageWhileSlotsAreHeld) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(2, 8));
+	auto consumer = fanout.Subscribe(4, DELIVERY_DROP_OLDEST);
+	const uint8_t data[16]{};
+
+	EXPECT_TRUE(fanout.Push(data, 8, 0));
+	EXPECT_TRUE(fanout.Push(data, 8, 1));
+	auto held = fanout.Take(consumer);
+	auto heldData = fanout.Get(held).data;
+
+	// the queued frame is discarded but the held one must stay where it is
+	EXPECT_FALSE(fanout.Reset(2, 16));
+	EXPECT_TRUE(fanout.Empty(consumer));
+	EXPECT_EQ(fanout.GetFrameCapacity(), 8u);
+	EXPECT_EQ(fanout.Get(held).data, heldData);
+	EXPECT_FALSE(fanout.Push(data, 16, 2));
+	EXPECT_EQ(fanout.GetOversizedCount(), 1u);
+
+	// slots can still be added alongside it
+	EXPECT_TRUE(fanout.Reset(4, 8));
+	EXPECT_EQ(fanout.GetSlotCount(), 4u);
+	EXPECT_EQ(fanout.Get(held).data, heldData);
+
+	fanout.Release(held);
+	EXPECT_TRUE(fanout.Reset(3, 16));
+	EXPECT_EQ(fanout.GetSlotCount(), 3u);
+	EXPECT_TRUE(fanout.Push(data, 16, 0));
+}
+
+TEST(FrameFanout, AddingSlotsKeepsQueuedFrames) {
+	FrameFanout fanout;
+	ASSERT_TRUE(fanout.Reset(2, 8));
+	auto running = fanout.Subscribe(4, DELIVERY_DROP_NEWEST);
+	const uint8_t data[8]{};
+	EXPECT_TRUE(fanout.Push(data, 8, 0));
+	EXPECT_TRUE(fanout.Push(data, 8, 1));
+
+	// a second consumer joining mid stream only needs more slots
+	auto joining = fanout.Subscribe(4, DELIVERY_DROP_OLDEST);
+	EXPECT_TRUE(fanout.Reset(6, 8));
+	EXPECT_EQ(fanout.GetSlotCount(), 6u);
+	EXPECT_EQ(fanout.GetStats(running).depth, 2u);
+	EXPECT_TRUE(fanout.Push(data, 8, 2));
+
+	std::vector<uint64_t> sequences;
+	for (auto slot = fanout.Take(running); slot != FrameFanout::noSlot; slot = fanout.Take(running))
+	{
+		sequences.push_back(fanout.Get(slot).sequence);
+		fanout.Release(slot);
+	}
+	EXPECT_EQ(sequences, (std::vector<uint64_t>{ 0, 1, 2 }));
+	auto slot = fanout.Take(joining);
+	ASSERT_NE(slot, FrameFanout::noSlot);
+	EXPECT_EQ(fanout.Get(slot).sequence, 2u);
+	fanout.Release(slot);
+	EXPECT_EQ(fanout.GetStats(running).dropped, 0u);
+}
+
+TEST(FrameFanout, LimitsTheNumberOfConsumers) {
+	FrameFanout fanout(4, 2);
+	ASSERT_TRUE(fanout.Reset(2, 8));
+	auto first = fanout.Subscribe(1, DELIVERY_DROP_OLDEST);
+	fanout.Subscribe(1, DELIVERY_DROP_OLDEST);
+	auto extra = fanout.Subscribe(1, DELIVERY_DROP_OLDEST);
+	EXPECT_EQ(extra, FrameFanout::noConsumer);
+
+	const uint8_t data[8]{};
+	EXPECT_TRUE(fanout.Push(data, 8, 0));
+	EXPECT_TRUE(fanout.Empty(extra));
+	EXPECT_EQ(fanout.Take(extra), FrameFanout::noSlot);
+	fanout.Unsubscribe(extra);
+
+	fanout.Unsubscribe(first);
+	EXPECT_EQ(fanout.Subscribe(1, DELIVERY_DROP_OLDEST), first);
+}
+
+namespace
+{
+	// 3840x2160 P010
+	constexpr int uhdP010FrameSize = 3840 * 2160 * 2 * 3 / 2;
+	// 192 samples x 8 channels x 32 bit
+	constexpr int audioFrameSize = 192 * 8 * 4;
+
+	void Stamp(std::vector<uint8_t>& frame, uint64_t value)
+	{
+		memcpy(frame.data(), &value, sizeof(value));
+		memcpy(frame.data() + frame.size() / 2, &value, sizeof(value));
+		memcpy(frame.data() + frame.size() - sizeof(value), &value, sizeof(value));
+	}
+
+	bool IsStamped(const CAPTURED_FRAME& frame, uint64_t value)
+	{
+		uint64_t first, middle, last;
+		memcpy(&first, frame.data, sizeof(first));
+		memcpy(&middle, frame.data + frame.length / 2, sizeof(middle));
+		memcpy(&last, frame.data + frame.length - sizeof(last), sizeof(last));
+		return first == value && middle == value && last == value;
+	}
+
+	// the producer publishes as fast as it can to two consumers which pass what they take to a downstream thread which
+	// holds a few frames and releases them in random order, each consumer must see its frames intact and in order
+	// with every gap accounted for by a drop
+	void StressOutOfOrderRelease(int frameSize, uint64_t frames, uint32_t slots)
+	{
+		FrameFanout fanout;
+		ASSERT_TRUE(fanout.Reset(slots, frameSize));
+		int consumers[2] = {
+			fanout.Subscribe(3, DELIVERY_DROP_OLDEST),
+			fanout.Subscribe(3, DELIVERY_DROP_NEWEST)
+		};
+
+		std::mutex lock;
+		std::deque<int> delivered;
+		std::atomic<bool> producing{ true };
+		std::atomic<int> consuming{ 2 };
+		std::atomic<uint64_t> torn{ 0 };
+
+		std::thread downstream([&]
+		{
+			std::mt19937 rng(7);
+			std::vector<int> holding;
+			while (true)
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					while (!delivered.empty())
+					{
+						holding.push_back(delivered.front());
+						delivered.pop_front();
+					}
+				}
+				if (holding.size() > 3 || (consuming.load() == 0 && !holding.empty()))
+				{
+					auto idx = std::uniform_int_distribution<size_t>(0, holding.size() - 1)(rng);
+					fanout.Release(holding[idx]);
+					holding.erase(holding.begin() + static_cast<std::ptrdiff_t>(idx));
+				}
+				else if (consuming.load() == 0)
+				{
+					break;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+
+		uint64_t consumed[2]{}, outOfOrder[2]{}, gaps[2]{};
+		std::vector<std::thread> readers;
+		for (auto c = 0; c < 2; ++c)
+		{
+			readers.emplace_back([&, c]
+			{
+				uint64_t expected = 0;
+				while (true)
+				{
+					auto finished = !producing.load(std::memory_order_acquire);
+					auto slot = fanout.Take(consumers[c]);
+					if (slot == FrameFanout::noSlot)
+					{
+						if (finished) break;
+						std::this_thread::yield();
+						continue;
+					}
+					const auto& frame = fanout.Get(slot);
+					if (frame.ts != frame.sequence || !IsStamped(frame, frame.sequence)) torn++;
+					if (frame.sequence < expected) outOfOrder[c]++;
+					if (frame.sequence > expected) gaps[c] += frame.sequence - expected;
+					expected = frame.sequence + 1;
+					consumed[c]++;
+					std::lock_guard<std::mutex> guard(lock);
+					delivered.push_back(slot);
+				}
+				// frames offered after the last one taken were dropped
+				gaps[c] += frames - expected;
+				consuming.fetch_sub(1);
+			});
+		}
+
+		std::vector<uint8_t> frame(frameSize, 0x5A);
+		for (uint64_t sequence = 0; sequence < frames; ++sequence)
+		{
+			Stamp(frame, sequence);
+			fanout.Push(frame.data(), frameSize, sequence);
+			if (sequence % 64 == 0) std::this_thread::yield();
+		}
+		producing.store(false, std::memory_order_release);
+		for (auto& reader : readers) reader.join();
+		downstream.join();
+
+		EXPECT_EQ(torn.load(), 0u);
+		for (auto c = 0; c < 2; ++c)
+		{
+			EXPECT_EQ(outOfOrder[c], 0u) << c;
+			EXPECT_GT(consumed[c], 0u) << c;
+			EXPECT_EQ(consumed[c] + gaps[c], frames) << c;
+			EXPECT_EQ(gaps[c], fanout.GetDroppedCount() + fanout.GetStats(consumers[c]).dropped) << c;
+		}
+		EXPECT_EQ(fanout.GetHeldCount(), 0u);
+	}
+}
+
+TEST(FrameFanout, StressOutOfOrderRelease) {
+	StressOutOfOrderRelease(4096, 20000, 12);
+}
+
+// 2 seconds of 4K60 P010 pushed faster than the frame rate
+TEST(FrameFanout, StressUhdP010Frames) {
+	StressOutOfOrderRelease(uhdP010FrameSize, 120, 8);
+}
+
+TEST(FrameFanout, StressAudioFrames) {
+	StressOutOfOrderRelease(audioFrameSize, 100000, 24);
+}
+
+// consumers come and go while the producer publishes, every frame they were sent must be released
+TEST(FrameFanout, StressSubscribeWhilePublishing) {
+	FrameFanout fanout(16, 4);
+	ASSERT_TRUE(fanout.Reset(16, 64));
+	auto steady = fanout.Subscribe(4, DELIVERY_DROP_OLDEST);
+	std::atomic<bool> producing{ true };
+
+	std::thread churn([&]
+	{
+		uint64_t taken = 0;
+		while (producing.load(std::memory_order_acquire))
+		{
+			auto consumer = fanout.Subscribe(2, (taken & 1) ? DELIVERY_DROP_NEWEST : DELIVERY_DROP_OLDEST);
+			ASSERT_NE(consumer, FrameFanout::noConsumer);
+			for (auto i = 0; i < 3; ++i)
+			{
+				auto slot = fanout.Take(consumer);
+				if (slot != FrameFanout::noSlot)
+				{
+					fanout.Release(slot);
+					taken++;
+				}
+				std::this_thread::yield();
+			}
+			fanout.Unsubscribe(consumer);
+		}
+	});
+
+	std::vector<uint8_t> frame(64, 0x5A);
+	uint64_t expected = 0;
+	for (uint64_t sequence = 0; sequence < 50000; ++sequence)
+	{
+		fanout.Push(frame.data(), 64, sequence);
+		for (auto slot = fanout.Take(steady); slot != FrameFanout::noSlot; slot = fanout.Take(steady))
+		{
+			EXPECT_GE(fanout.Get(slot).sequence, expected);
+			expected = fanout.Get(slot).sequence + 1;
+			fanout.Release(slot);
+		}
+	}
+	producing.store(false, std::memory_order_release);
+	churn.join();
+
+	EXPECT_EQ(fanout.GetConsumerCount(), 1u);
+	fanout.Unsubscribe(steady);
+	EXPECT_EQ(fanout.GetHeldCount(), 0u);
+}
@@ -0,0 +1,392 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/iec61937.h"
+#include "legacybitstream.h"
+
+namespace
+{
+	constexpr uint16_t stereo = 2;
+	constexpr uint8_t bytesPerSample = 2;
+	constexpr uint16_t frameBytes = pcmSamplesPerFrame * stereo * bytesPerSample;
+
+	// lays out a big endian byte stream as a captured 16bit frame, i.e. each sample is little endian in the most
+	// significant bytes of its slot with the channels carried in the order L0,R0,L1,R1..
+	std::vector<uint8_t> ToCapturedFrame(const std::vector<uint8_t>& stream, size_t offset, uint16_t channels = stereo)
+	{
+		std::vector<uint8_t> frame(pcmSamplesPerFrame * pcmInputBlockSizeInBytes, 0);
+		for (auto sampleIdx = 0; sampleIdx < pcmSamplesPerFrame; ++sampleIdx)
+		{
+			for (auto channel = 0; channel < channels; ++channel)
+			{
+				auto slot = sampleIdx * pcmInputSlotCount + channel / 2 + (channel % 2) * pcmInputSlotCount / 2;
+				for (auto byteIdx = 0; byteIdx < bytesPerSample; ++byteIdx)
+				{
+					auto in = offset + (sampleIdx * channels + channel) * bytesPerSample + byteIdx;
+					frame[(slot + 1) * pcmInputSlotSizeInBytes - byteIdx - 1] = in < stream.size() ? stream[in] : 0;
+				}
+			}
+		}
+		return frame;
+	}
+
+	// writes a data burst of the given type and payload length (in bytes) at pos
+	void WriteBurst(std::vector<uint8_t>& stream, size_t pos, uint8_t dataType, uint16_t lengthCode, uint16_t payloadBytes)
+	{
+		if (stream.size() < pos + 8 + payloadBytes) stream.resize(pos + 8 + payloadBytes, 0);
+		const uint8_t preamble[8]{ 0xF8, 0x72, 0x4E, 0x1F, 0x00, dataType, static_cast<uint8_t>(lengthCode >> 8), static_cast<uint8_t>(lengthCode & 0xff) };
+		memcpy(stream.data() + pos, preamble, sizeof(preamble));
+		for (auto i = 0; i < payloadBytes; ++i)
+		{
+			stream[pos + 8 + i] = static_cast<uint8_t>(i + 1);
+		}
+	}
+
+	BitstreamParseResult ParseFrame(BitstreamParser& parser, const std::vector<uint8_t>& stream, size_t frameIdx, Codec* codec)
+	{
+		auto frame = ToCapturedFrame(stream, frameIdx * frameBytes);
+		return parser.ParseFrame(frame.data(), stereo, bytesPerSample, codec);
+	}
+
+	void ExpectPayload(const BitstreamParser& parser, uint16_t payloadBytes)
+	{
+		ASSERT_EQ(parser.GetDataBurstPayloadSize(), payloadBytes);
+		for (auto i = 0; i < payloadBytes; ++i)
+		{
+			ASSERT_EQ(parser.GetDataBurst()[i], static_cast<uint8_t>(i + 1)) << "at " << i;
+		}
+	}
+}
+
+TEST(IEC61937, MapsPreambleToCodec) {
+	uint16_t burstSize = 2048;
+	Codec codec = PCM;
+	EXPECT_TRUE(GetCodecFromIEC61937Preamble(IEC61937_DTS2, &burstSize, &codec));
+	EXPECT_EQ(codec, DTS);
+	EXPECT_EQ(burstSize, 256);
+
+	burstSize = 2048;
+	EXPECT_TRUE(GetCodecFromIEC61937Preamble(IEC61937_TRUEHD, &burstSize, &codec));
+	EXPECT_EQ(codec, TRUEHD);
+	EXPECT_EQ(burstSize, 2048);
+
+	EXPECT_FALSE(GetCodecFromIEC61937Preamble(IEC61937_WMAPRO, &burstSize, &codec));
+	EXPECT_EQ(codec, PAUSE_OR_NULL);
+}
+
+TEST(IEC61937, CopyFrameByteSwapsEachSample) {
+	std::vector<uint8_t> stream{ 0xF8, 0x72, 0x4E, 0x1F };
+	auto frame = ToCapturedFrame(stream, 0);
+	BitstreamParser parser;
+	EXPECT_EQ(parser.CopyFrame(frame.data(), stereo, bytesPerSample), frameBytes);
+	EXPECT_EQ(memcmp(parser.GetBuffer(), stream.data(), stream.size()), 0);
+}
+
+TEST(IEC61937, DetectsAC3DataBurst) {
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 0, IEC61937_AC3, 256 * 8, 256);
+	BitstreamParser parser;
+	Codec codec = PCM;
+
+	EXPECT_EQ(ParseFrame(parser, stream, 0, &codec), PARSE_OK);
+	EXPECT_EQ(codec, AC3);
+	ExpectPayload(parser, 256);
+
+	parser.ConsumeDataBurst();
+	EXPECT_EQ(parser.GetDataBurstPayloadSize(), 0);
+}
+
+TEST(IEC61937, CollectsDataBurstAcrossFrames) {
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 0, IEC61937_EAC3, 2000, 2000);
+	BitstreamParser parser;
+	Codec codec = PCM;
+
+	EXPECT_EQ(ParseFrame(parser, stream, 0, &codec), PARSE_PARTIAL_DATABURST);
+	EXPECT_EQ(codec, EAC3);
+	EXPECT_EQ(parser.GetDataBurstSize(), 2000);
+	EXPECT_EQ(parser.GetDataBurstRead(), frameBytes - 8);
+	EXPECT_EQ(parser.GetDataBurstPayloadSize(), 0);
+
+	EXPECT_EQ(ParseFrame(parser, stream, 1, &codec), PARSE_PARTIAL_DATABURST);
+	EXPECT_EQ(ParseFrame(parser, stream, 2, &codec), PARSE_OK);
+	ExpectPayload(parser, 2000);
+}
+
+TEST(IEC61937, IgnoresPause) {
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 0, IEC61937_PAUSE, 32, 0);
+	BitstreamParser parser;
+	Codec codec = AC3;
+
+	ParseFrame(parser, stream, 0, &codec);
+	EXPECT_EQ(codec, PAUSE_OR_NULL);
+	EXPECT_EQ(parser.GetDataBurstPayloadSize(), 0);
+	EXPECT_EQ(parser.GetUnknownDataTypeCount(), 0u);
+}
+
+TEST(IEC61937, HandlesPreambleSplitAcrossFrames) {
+	std::vector<uint8_t> stream;
+	// Pa Pb and Pc at the end of the first frame, Pd at the start of the next
+	WriteBurst(stream, frameBytes - 6, IEC61937_AC3, 128 * 8, 128);
+	BitstreamParser parser;
+	Codec codec = PCM;
+
+	ParseFrame(parser, stream, 0, &codec);
+	EXPECT_EQ(codec, PCM);
+	EXPECT_EQ(ParseFrame(parser, stream, 1, &codec), PARSE_OK);
+	EXPECT_EQ(codec, AC3);
+	ExpectPayload(parser, 128);
+}
+
+TEST(IEC61937, CountsUnknownDataTypes) {
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 0, IEC61937_ATRAC, 64, 0);
+	BitstreamParser parser;
+	Codec codec = PCM;
+
+	ParseFrame(parser, stream, 0, &codec);
+	EXPECT_EQ(codec, PAUSE_OR_NULL);
+	EXPECT_EQ(parser.GetUnknownDataTypeCount(), 1u);
+	EXPECT_EQ(parser.GetLastUnknownDataType(), IEC61937_ATRAC);
+}
+
+TEST(IEC61937, FindsSyncAtEveryOffset) {
+	for (auto level : { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2, SIMD_NEON })
+	{
+		if (!IsSimdLevelSupported(level)) continue;
+		for (size_t len : { 3, 4, 19, 35, 100, 768 })
+		{
+			for (size_t pos = 0; pos + 4 <= len; ++pos)
+			{
+				// a near miss before the real preamble must not match
+				std::vector<uint8_t> buf(len, 0xF8);
+				if (pos >= 4) memcpy(buf.data() + pos - 4, "\xF8\x72\x4E\x1E", 4);
+				memcpy(buf.data() + pos, iec61937Sync, 4);
+				ASSERT_EQ(FindIEC61937Sync(buf.data(), len, level), pos) << simdlevel_to_name(level) << " len " << len;
+			}
+			std::vector<uint8_t> none(len, 0x72);
+			EXPECT_EQ(FindIEC61937Sync(none.data(), len, level), len) << simdlevel_to_name(level);
+		}
+	}
+}
+
+TEST(IEC61937, MeasuresTrailingSyncPrefix) {
+	const uint8_t buf[]{ 0x00, 0x00, 0xF8, 0x72, 0x4E };
+	EXPECT_EQ(GetIEC61937SyncPrefixLength(buf, 5), 3);
+	EXPECT_EQ(GetIEC61937SyncPrefixLength(buf, 4), 2);
+	EXPECT_EQ(GetIEC61937SyncPrefixLength(buf, 3), 1);
+	EXPECT_EQ(GetIEC61937SyncPrefixLength(buf, 2), 0);
+	EXPECT_EQ(GetIEC61937SyncPrefixLength(buf, 0), 0);
+}
+
+TEST(IEC61937, MatchesSyncSplitAcrossFrames) {
+	for (auto split = 1; split < 4; ++split)
+	{
+		std::vector<uint8_t> stream;
+		WriteBurst(stream, frameBytes - split, IEC61937_AC3, 64 * 8, 64);
+		BitstreamParser parser;
+		Codec codec = PCM;
+
+		EXPECT_EQ(ParseFrame(parser, stream, 0, &codec), PARSE_POSSIBLE_BITSTREAM) << split;
+		EXPECT_EQ(ParseFrame(parser, stream, 1, &codec), PARSE_OK) << split;
+		EXPECT_EQ(codec, AC3);
+		ExpectPayload(parser, 64);
+	}
+}
+
+TEST(IEC61937, RestartsSearchAfterAFalseStart) {
+	std::vector<uint8_t> stream(frameBytes, 0);
+	stream[frameBytes - 2] = 0xF8;
+	stream[frameBytes - 1] = 0x72;
+	// the next frame starts with a preamble rather than the rest of the one above
+	WriteBurst(stream, frameBytes, IEC61937_AC3, 64 * 8, 64);
+	BitstreamParser parser;
+	Codec codec = PCM;
+
+	EXPECT_EQ(ParseFrame(parser, stream, 0, &codec), PARSE_POSSIBLE_BITSTREAM);
+	EXPECT_EQ(ParseFrame(parser, stream, 1, &codec), PARSE_OK);
+	EXPECT_EQ(codec, AC3);
+	ExpectPayload(parser, 64);
+}
+
+TEST(IEC61937, LosesSyncAfterTheRepetitionPeriod) {
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 0, IEC61937_AC3, 64 * 8, 64);
+	BitstreamParser parser;
+	Codec codec = PCM;
+
+	ParseFrame(parser, stream, 0, &codec);
+	ASSERT_EQ(codec, AC3);
+	auto frames = 1;
+	while (!parser.HasLostSync(AC3))
+	{
+		EXPECT_EQ(ParseFrame(parser, stream, frames++, &codec), PARSE_NOTHING);
+	}
+	// two AC3 periods of 1536 stereo frames
+	EXPECT_EQ(frames, 2 * 1536 / pcmSamplesPerFrame + 1);
+}
+
+TEST(IEC61937, MatchesTheLegacyParserOnStereoStreams) {
+	// bursts of assorted lengths at arbitrary offsets separated by padding and the odd pause, at most one burst
+	// completes per frame as in a real stream
+	std::mt19937 rng(61937);
+	std::vector<uint8_t> stream;
+	std::vector<uint16_t> lengths;
+	size_t pos = 0;
+	while (pos < 200 * frameBytes)
+	{
+		pos += frameBytes + rng() % 1500;
+		if (rng() % 5 == 0)
+		{
+			WriteBurst(stream, pos, IEC61937_PAUSE, 32, 0);
+			pos += 8;
+			continue;
+		}
+		uint16_t length = 1 + rng() % 3000;
+		WriteBurst(stream, pos, IEC61937_EAC3, length, length);
+		lengths.push_back(length);
+		pos += 8 + length;
+	}
+	auto frames = stream.size() / frameBytes;
+
+	for (auto level : { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2, SIMD_NEON })
+	{
+		if (!IsSimdLevelSupported(level)) continue;
+		LegacyBitstreamParser legacy;
+		BitstreamParser parser(level);
+		Codec legacyCodec = PCM;
+		Codec codec = PCM;
+		size_t bursts = 0;
+		for (size_t f = 0; f < frames; ++f)
+		{
+			auto frame = ToCapturedFrame(stream, f * frameBytes);
+			auto bytes = legacy.CopyFrame(frame.data(), stereo, bytesPerSample);
+			auto expected = legacy.Parse(bytes, &legacyCodec);
+			auto actual = parser.ParseFrame(frame.data(), stereo, bytesPerSample, &codec);
+			// the legacy search reports a preamble split across frames in fewer cases
+			if (expected != PARSE_POSSIBLE_BITSTREAM && actual != PARSE_POSSIBLE_BITSTREAM)
+			{
+				ASSERT_EQ(actual, expected) << simdlevel_to_name(level) << " frame " << f;
+			}
+			ASSERT_EQ(codec, legacyCodec) << simdlevel_to_name(level) << " frame " << f;
+			ASSERT_EQ(parser.GetDataBurstPayloadSize(), legacy.GetDataBurstPayloadSize()) << simdlevel_to_name(level) << " frame " << f;
+			if (parser.GetDataBurstPayloadSize() > 0)
+			{
+				ASSERT_EQ(memcmp(parser.GetDataBurst(), legacy.GetDataBurst(), parser.GetDataBurstPayloadSize()), 0);
+				ASSERT_EQ(parser.GetDataBurstPayloadSize(), lengths[bursts++]);
+				parser.ConsumeDataBurst();
+				legacy.ConsumeDataBurst();
+			}
+		}
+		// the last burst may run past the final whole frame
+		EXPECT_GE(bursts, lengths.size() - 1) << simdlevel_to_name(level);
+	}
+}
+
+TEST(IEC61937, CollectsHighBitRateBurstsFromAllChannels) {
+	constexpr uint16_t hbr = 8;
+	constexpr size_t hbrFrameBytes = pcmSamplesPerFrame * hbr * bytesPerSample;
+	// a TrueHD MAT frame fills the 61440 byte repetition period
+	constexpr uint16_t payload = 61424;
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 0, IEC61937_TRUEHD, payload, payload);
+	WriteBurst(stream, 61440, IEC61937_TRUEHD, payload, payload);
+	BitstreamParser parser;
+	Codec codec = PCM;
+
+	size_t frameIdx = 0;
+	for (auto burst = 0; burst < 2; ++burst)
+	{
+		BitstreamParseResult res;
+		do
+		{
+			auto frame = ToCapturedFrame(stream, frameIdx++ * hbrFrameBytes, hbr);
+			res = parser.ParseFrame(frame.data(), hbr, bytesPerSample, &codec);
+		}
+		while (res == PARSE_PARTIAL_DATABURST);
+		EXPECT_EQ(codec, TRUEHD);
+		ExpectPayload(parser, payload);
+		parser.ConsumeDataBurst();
+	}
+	EXPECT_EQ(frameIdx, (2 * 61440 - 16) / hbrFrameBytes + 1);
+}
+
+TEST(IEC61937, PassesTheStreamThroughAsLittleEndianWords) {
+	constexpr uint16_t channels = 8;
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 0, IEC61937_TRUEHD, 3000, 3000);
+	stream.resize(IEC61937Passthrough::GetFrameSizeInBytes(channels), 0);
+	auto frame = ToCapturedFrame(stream, 0, channels);
+	IEC61937Passthrough passthrough;
+	std::vector<uint8_t> out(IEC61937Passthrough::GetFrameSizeInBytes(channels), 0);
+
+	ASSERT_EQ(passthrough.CopyFrames(frame.data(), 1, channels, out.data(), static_cast<uint32_t>(out.size())), out.size());
+	for (size_t i = 0; i < out.size(); i += 2)
+	{
+		ASSERT_EQ(out[i], stream[i + 1]) << "at " << i;
+		ASSERT_EQ(out[i + 1], stream[i]) << "at " << i;
+	}
+	EXPECT_EQ(passthrough.CopyFrames(frame.data(), 1, channels, out.data(), 100), 96u);
+}
+
+TEST(IEC61937, PassthroughTracksTheCodecWithoutReassembly) {
+	IEC61937Passthrough passthrough;
+	Codec codec = PCM;
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 64, IEC61937_PAUSE, 32, 4);
+	WriteBurst(stream, 128, IEC61937_EAC3, 6000, 6000);
+	auto frame = ToCapturedFrame(stream, 0);
+	EXPECT_TRUE(passthrough.ScanFrame(frame.data(), stereo, &codec));
+	EXPECT_EQ(codec, EAC3);
+	EXPECT_EQ(passthrough.GetBytesSincePaPb(), frameBytes - 128u);
+
+	// the rest of the burst has no preamble
+	frame = ToCapturedFrame(stream, frameBytes);
+	EXPECT_FALSE(passthrough.ScanFrame(frame.data(), stereo, &codec));
+	EXPECT_EQ(codec, EAC3);
+	EXPECT_EQ(passthrough.GetBytesSincePaPb(), 2 * frameBytes - 128u);
+
+	// a preamble on the second line of a high bit rate stream
+	stream.assign(frameBytes * 4, 0);
+	WriteBurst(stream, 8 * 2 * 10 + 4, IEC61937_DTSHD, 4000, 4000);
+	frame = ToCapturedFrame(stream, 0, 8);
+	EXPECT_TRUE(passthrough.ScanFrame(frame.data(), 8, &codec));
+	EXPECT_EQ(codec, DTSHD);
+}
+
+TEST(IEC61937, PassthroughLosesSyncAfterTheRepetitionPeriod) {
+	IEC61937Passthrough passthrough;
+	Codec codec = PCM;
+	std::vector<uint8_t> stream;
+	WriteBurst(stream, 0, IEC61937_AC3, 256 * 8, 256);
+	auto frame = ToCapturedFrame(stream, 0);
+	EXPECT_TRUE(passthrough.ScanFrame(frame.data(), stereo, &codec));
+	EXPECT_FALSE(passthrough.HasLostSync(AC3));
+
+	auto silence = ToCapturedFrame({}, 0);
+	auto frames = 0;
+	while (!passthrough.HasLostSync(AC3) && frames < 100)
+	{
+		EXPECT_FALSE(passthrough.ScanFrame(silence.data(), stereo, &codec));
+		++frames;
+	}
+	EXPECT_EQ(frames, static_cast<int>(2 * GetIEC61937RepetitionPeriodInBytes(AC3) / frameBytes));
+	EXPECT_EQ(codec, AC3);
+}
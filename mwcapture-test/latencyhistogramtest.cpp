@@ -0,0 +1,66 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "../mwcapture/latency_histogram.h"
+
+TEST(LatencyHistogram, IsEmptyUntilRecorded) {
+	LatencyHistogram histogram;
+	EXPECT_EQ(histogram.GetCount(), 0u);
+	EXPECT_EQ(histogram.GetPercentileUs(0.5), 0u);
+	EXPECT_DOUBLE_EQ(histogram.GetMeanUs(), 0.0);
+	EXPECT_EQ(histogram.Format(), "");
+}
+
+TEST(LatencyHistogram, CountsIntoBuckets) {
+	LatencyHistogram histogram(1000, 10);
+	for (auto us : { 0, 999, 1000, 4500, 9999, 10000, 250000 }) histogram.Record(us);
+	const auto& buckets = histogram.GetBuckets();
+	ASSERT_EQ(buckets.size(), 11u);
+	EXPECT_EQ(buckets[0], 2u);
+	EXPECT_EQ(buckets[1], 1u);
+	EXPECT_EQ(buckets[4], 1u);
+	EXPECT_EQ(buckets[9], 1u);
+	// the overflow bucket
+	EXPECT_EQ(buckets[10], 2u);
+	EXPECT_EQ(histogram.GetCount(), 7u);
+	EXPECT_EQ(histogram.GetMaxUs(), 250000u);
+	EXPECT_EQ(histogram.Format(), "0:2 1000:1 4000:1 9000:1 >10000:2");
+}
+
+TEST(LatencyHistogram, ReportsPercentilesAsBucketEdges) {
+	LatencyHistogram histogram(500, 64);
+	// a 60Hz capture which mostly waits out the frame with a few late frames
+	for (auto i = 0; i < 90; ++i) histogram.Record(16000 + i * 10);
+	for (auto i = 0; i < 9; ++i) histogram.Record(20200);
+	histogram.Record(40000);
+	EXPECT_EQ(histogram.GetPercentileUs(0.5), 16500u);
+	EXPECT_EQ(histogram.GetPercentileUs(0.9), 17000u);
+	EXPECT_EQ(histogram.GetPercentileUs(0.99), 20500u);
+	// beyond the last bucket the max is all that is known
+	EXPECT_EQ(histogram.GetPercentileUs(1.0), 40000u);
+	EXPECT_DOUBLE_EQ(histogram.GetMeanUs(), 17018.5);
+
+	histogram.Reset();
+	EXPECT_EQ(histogram.GetCount(), 0u);
+	EXPECT_EQ(histogram.GetMaxUs(), 0u);
+}
+
+TEST(LatencyHistogram, NeverReportsMoreThanTheMax) {
+	LatencyHistogram histogram(1000, 8);
+	histogram.Record(10);
+	histogram.Record(20);
+	EXPECT_EQ(histogram.GetPercentileUs(0.5), 20u);
+	EXPECT_EQ(histogram.GetPercentileUs(1.0), 20u);
+}
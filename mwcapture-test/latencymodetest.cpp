@@ -0,0 +1,83 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "gtest/gtest.h"
+#include "../mwcapture/latency_mode.h"
+
+TEST(LatencyMode, OnlyInterlacedFieldModeDoublesTheRate) {
+	EXPECT_EQ(GetDeliveredFrameInterval(LATENCY_FIELD_BUFFERED, true, 400000), 200000);
+	EXPECT_EQ(GetDeliveredFrameInterval(LATENCY_FIELD_BUFFERED, false, 400000), 400000);
+	EXPECT_EQ(GetDeliveredFrameInterval(LATENCY_FRAME_BUFFERING, true, 400000), 400000);
+	EXPECT_EQ(GetDeliveredFrameInterval(LATENCY_FRAME_BUFFERED, true, 333667), 333667);
+}
+
+TEST(LatencyMode, ParsesModeNamesIgnoringCase) {
+	VideoLatencyMode mode = LATENCY_FRAME_BUFFERING;
+	EXPECT_TRUE(ParseVideoLatencyMode("FieldBuffered", &mode));
+	EXPECT_EQ(mode, LATENCY_FIELD_BUFFERED);
+	EXPECT_TRUE(ParseVideoLatencyMode("framebuffered", &mode));
+	EXPECT_EQ(mode, LATENCY_FRAME_BUFFERED);
+	EXPECT_TRUE(ParseVideoLatencyMode("FRAMEBUFFERING", &mode));
+	EXPECT_EQ(mode, LATENCY_FRAME_BUFFERING);
+
+	EXPECT_FALSE(ParseVideoLatencyMode("", &mode));
+	EXPECT_FALSE(ParseVideoLatencyMode("FrameBuffer", &mode));
+	EXPECT_FALSE(ParseVideoLatencyMode("FieldBufferedX", &mode));
+	EXPECT_EQ(mode, LATENCY_FRAME_BUFFERING);
+}
+
+TEST(FieldSequence, StepsThroughEachField) {
+	FieldSequence fields(4);
+
+	EXPECT_EQ(fields.Advance(2, 0), 1u);
+	EXPECT_EQ(fields.Advance(2, 1), 1u);
+	EXPECT_EQ(fields.Advance(3, 0), 1u);
+	EXPECT_EQ(fields.Advance(3, 1), 1u);
+}
+
+TEST(FieldSequence, IgnoresAFieldAlreadyCaptured) {
+	FieldSequence fields(4);
+	fields.Advance(1, 1);
+
+	EXPECT_EQ(fields.Advance(1, 1), 0u);
+	EXPECT_EQ(fields.Advance(2, 0), 1u);
+}
+
+TEST(FieldSequence, CountsSkippedFields) {
+	FieldSequence fields(4);
+	fields.Advance(0, 0);
+
+	// fields 0/1 and 1/0 were never captured
+	EXPECT_EQ(fields.Advance(1, 1), 3u);
+}
+
+TEST(FieldSequence, WrapsAroundTheRing) {
+	FieldSequence fields(4);
+	fields.Advance(3, 1);
+
+	EXPECT_EQ(fields.Advance(0, 0), 1u);
+	EXPECT_EQ(fields.Advance(0, 1), 1u);
+}
+
+TEST(FieldSequence, RestartsWhenTheRingChanges) {
+	FieldSequence fields(4);
+	fields.Advance(3, 0);
+
+	fields.SetFrameCount(4);
+	EXPECT_EQ(fields.Advance(3, 0), 0u);
+
+	fields.SetFrameCount(8);
+	EXPECT_EQ(fields.Advance(6, 0), 1u);
+	EXPECT_EQ(fields.Advance(7, 0), 2u);
+}
@@ -0,0 +1,196 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "../mwcapture/iec61937.h"
+
+// the copy then byte at a time preamble search previously used by MagewellAudioCapturePin, kept as the reference
+// output for stereo streams and as the benchmark baseline
+class LegacyBitstreamParser
+{
+public:
+	LegacyBitstreamParser() :
+		mDataBurstBuffer(6144, 0)
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		memset(mBuffer, 0, sizeof(mBuffer));
+	}
+
+	uint16_t CopyFrame(const uint8_t* frame, uint16_t inputChannelCount, uint8_t bitDepthInBytes)
+	{
+		// copies from input to output skipping zero bytes and with a byte swap per sample
+		uint16_t bytesCopied = 0;
+		for (auto pairIdx = 0; pairIdx < inputChannelCount / 2; ++pairIdx)
+		{
+			for (auto sampleIdx = 0; sampleIdx < pcmSamplesPerFrame; sampleIdx++)
+			{
+				int inStartL = (sampleIdx * pcmInputSlotCount + pairIdx) * pcmInputSlotSizeInBytes;
+				int inStartR = (sampleIdx * pcmInputSlotCount + pairIdx + pcmInputSlotCount / 2) * pcmInputSlotSizeInBytes;
+				int outStart = (sampleIdx * inputChannelCount + pairIdx * inputChannelCount) * bitDepthInBytes;
+				for (int byteIdx = 0; byteIdx < bitDepthInBytes; ++byteIdx) {
+					auto outL = outStart + byteIdx;
+					auto outR = outStart + bitDepthInBytes + byteIdx;
+					auto inL = inStartL + pcmInputSlotSizeInBytes - byteIdx - 1;
+					auto inR = inStartR + pcmInputSlotSizeInBytes - byteIdx - 1;
+					// byte swap because compressed audio is big endian
+					mBuffer[outL] = frame[inL];
+					mBuffer[outR] = frame[inR];
+					bytesCopied += 2;
+				}
+			}
+		}
+		return bytesCopied;
+	}
+
+	BitstreamParseResult Parse(uint16_t bufSize, Codec* codec)
+	{
+		uint16_t bytesRead = 0;
+		bool copiedBytes = false;
+		bool partialDataBurst = false;
+		bool maybeBitstream = false;
+
+		while (bytesRead < bufSize)
+		{
+			uint16_t remainingInBurst = std::max(mDataBurstSize - mDataBurstRead, 0);
+			if (remainingInBurst > 0)
+			{
+				uint16_t remainingInBuffer = bufSize - bytesRead;
+				auto toCopy = std::min(remainingInBurst, remainingInBuffer);
+				memcpy(mDataBurstBuffer.data() + mDataBurstRead, mBuffer + bytesRead, toCopy);
+				bytesRead += toCopy;
+				mDataBurstRead += toCopy;
+				remainingInBurst -= toCopy;
+				mBytesSincePaPb += toCopy;
+				copiedBytes = true;
+
+				if (remainingInBurst == 0)
+				{
+					mDataBurstPayloadSize = mDataBurstSize;
+				}
+			}
+			// more to read = will need another frame
+			if (remainingInBurst > 0)
+			{
+				partialDataBurst = true;
+				continue;
+			}
+
+			// no more to read so reset the databurst state ready for the next frame
+			mDataBurstSize = mDataBurstRead = 0;
+
+			// burst complete so search the frame for the PaPb preamble F8 72 4E 1F (248 114 78 31)
+			for (; (bytesRead < bufSize) && mPaPbBytesRead != 4; ++bytesRead, ++mBytesSincePaPb)
+			{
+				if ((mBuffer[bytesRead] == 0xf8 && mPaPbBytesRead == 0)
+					|| (mBuffer[bytesRead] == 0x72 && mPaPbBytesRead == 1)
+					|| (mBuffer[bytesRead] == 0x4e && mPaPbBytesRead == 2)
+					|| (mBuffer[bytesRead] == 0x1f && mPaPbBytesRead == 3))
+				{
+					if (++mPaPbBytesRead == 4)
+					{
+						mDataBurstSize = mDataBurstRead = 0;
+						bytesRead++;
+						mBytesSincePaPb = 4;
+						maybeBitstream = false;
+						break;
+					}
+				}
+				else
+				{
+					mPaPbBytesRead = 0;
+				}
+			}
+
+			if (mPaPbBytesRead == 1 || mPaPbBytesRead == 2 || mPaPbBytesRead == 3)
+			{
+				maybeBitstream = true;
+				continue;
+			}
+
+			// grab PcPd preamble words
+			uint8_t bytesToCopy = std::min(bufSize - bytesRead, 4 - mPcPdBytesRead);
+			if (bytesToCopy > 0)
+			{
+				memcpy(mPcPdBuffer + mPcPdBytesRead, mBuffer + bytesRead, bytesToCopy);
+				mPcPdBytesRead += bytesToCopy;
+				bytesRead += bytesToCopy;
+				mBytesSincePaPb += bytesToCopy;
+				copiedBytes = true;
+			}
+
+			if (mPcPdBytesRead != 4)
+			{
+				continue;
+			}
+
+			mDataBurstSize = ((static_cast<uint16_t>(mPcPdBuffer[2]) << 8) + static_cast<uint16_t>(mPcPdBuffer[3]));
+			auto dt = static_cast<uint8_t>(mPcPdBuffer[1] & 0x7f);
+			GetCodecFromIEC61937Preamble(IEC61937DataType{ dt }, &mDataBurstSize, codec);
+
+			// ignore PAUSE_OR_NULL, start search again
+			if (*codec == PAUSE_OR_NULL)
+			{
+				mPaPbBytesRead = mPcPdBytesRead = 0;
+				mDataBurstSize = mDataBurstPayloadSize = mDataBurstRead = 0;
+				continue;
+			}
+
+			if (mDataBurstBuffer.size() > mDataBurstSize)
+			{
+				mDataBurstBuffer.clear();
+			}
+			if (mDataBurstBuffer.size() < mDataBurstSize)
+			{
+				mDataBurstBuffer.resize(mDataBurstSize);
+			}
+
+			mPaPbBytesRead = mPcPdBytesRead = 0;
+		}
+		return partialDataBurst ? PARSE_PARTIAL_DATABURST : maybeBitstream ? PARSE_POSSIBLE_BITSTREAM : copiedBytes ? PARSE_OK : PARSE_NOTHING;
+	}
+
+	uint16_t GetDataBurstPayloadSize() const
+	{
+		return mDataBurstPayloadSize;
+	}
+
+	const uint8_t* GetDataBurst() const
+	{
+		return mDataBurstBuffer.data();
+	}
+
+	void ConsumeDataBurst()
+	{
+		mDataBurstPayloadSize = 0;
+	}
+
+private:
+	uint8_t mBuffer[maxBitstreamFrameLengthInBytes];
+	uint8_t mPaPbBytesRead{ 0 };
+	uint8_t mPcPdBuffer[4]{};
+	uint8_t mPcPdBytesRead{ 0 };
+	uint16_t mDataBurstRead{ 0 };
+	uint16_t mDataBurstSize{ 0 };
+	uint16_t mDataBurstPayloadSize{ 0 };
+	uint32_t mBytesSincePaPb{ 0 };
+	std::vector<uint8_t> mDataBurstBuffer;
+};
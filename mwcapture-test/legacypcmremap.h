@@ -0,0 +1,67 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <array>
+#include <cstdint>
+#include "../mwcapture/pcm_remap.h"
+
+// the per byte remap loop previously used by MagewellAudioCapturePin::FillBuffer, kept as the reference output
+inline long LegacyRemapPcm(const uint8_t* frameBuffer, uint8_t* pmsData, long sampleSize, int bitDepthInBytes,
+	int inputChannelCount, int outputChannelCount, const std::array<int, 8>& channelOffsets)
+{
+	auto bytesCaptured = 0L;
+	auto outputChannelIdxL = -1;
+	auto outputChannelIdxR = -1;
+	auto outputChannels = -1;
+	for (auto pairIdx = 0; pairIdx < inputChannelCount / 2; ++pairIdx)
+	{
+		auto channelIdxL = pairIdx * 2;
+		auto outputOffsetL = channelOffsets[channelIdxL];
+		if (outputOffsetL != not_present) outputChannelIdxL = ++outputChannels;
+
+		auto channelIdxR = channelIdxL + 1;
+		auto outputOffsetR = channelOffsets[channelIdxR];
+		if (outputOffsetR != not_present) outputChannelIdxR = ++outputChannels;
+
+		if (outputOffsetL == not_present && outputOffsetR == not_present) continue;
+
+		for (auto sampleIdx = 0; sampleIdx < pcmSamplesPerFrame; sampleIdx++)
+		{
+			auto inByteStartIdxL = (sampleIdx * pcmInputSlotCount + pairIdx) * pcmInputSlotSizeInBytes;
+			auto inByteStartIdxR = (sampleIdx * pcmInputSlotCount + pairIdx + pcmInputSlotCount / 2) * pcmInputSlotSizeInBytes;
+			auto outByteStartIdxL = (sampleIdx * outputChannelCount + outputChannelIdxL + outputOffsetL) * bitDepthInBytes;
+			auto outByteStartIdxR = (sampleIdx * outputChannelCount + outputChannelIdxR + outputOffsetR) * bitDepthInBytes;
+
+			inByteStartIdxL += pcmInputSlotSizeInBytes - bitDepthInBytes;
+			inByteStartIdxR += pcmInputSlotSizeInBytes - bitDepthInBytes;
+			for (int k = 0; k < bitDepthInBytes; ++k)
+			{
+				if (outputOffsetL != not_present)
+				{
+					auto outIdx = outByteStartIdxL + k;
+					bytesCaptured++;
+					if (outIdx < sampleSize) pmsData[outIdx] = frameBuffer[inByteStartIdxL + k];
+				}
+				if (outputOffsetR != not_present)
+				{
+					auto outIdx = outByteStartIdxR + k;
+					bytesCaptured++;
+					if (outIdx < sampleSize) pmsData[outIdx] = frameBuffer[inByteStartIdxR + k];
+				}
+			}
+		}
+	}
+	return bytesCaptured;
+}
@@ -0,0 +1,230 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/pcm_jitter_buffer.h"
+
+namespace
+{
+	constexpr double pi = 3.14159265358979323846;
+
+	void WriteSample(int64_t value, uint8_t bitDepthInBytes, uint8_t* out)
+	{
+		for (uint8_t b = 0; b < bitDepthInBytes; ++b) out[b] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> 8 * b);
+	}
+
+	int64_t ReadSample(const uint8_t* in, uint8_t bitDepthInBytes)
+	{
+		uint32_t value = 0;
+		for (uint8_t b = 0; b < bitDepthInBytes; ++b) value |= static_cast<uint32_t>(in[b]) << 8 * b;
+		auto shift = 8 * (4 - bitDepthInBytes);
+		return static_cast<int32_t>(value << shift) >> shift;
+	}
+
+	// a captured frame of a quiet sine on every channel, phase continuous across frames
+	std::vector<uint8_t> MakeFrame(uint64_t firstFrame, uint32_t fs, uint8_t bitDepthInBytes, uint8_t channelCount)
+	{
+		std::vector<uint8_t> frame(static_cast<size_t>(pcmSamplesPerFrame) * bitDepthInBytes * channelCount);
+		const auto fullScale = static_cast<double>(1ULL << (8 * bitDepthInBytes - 1));
+		auto out = frame.data();
+		for (uint32_t f = 0; f < pcmSamplesPerFrame; ++f)
+		{
+			auto t = static_cast<double>(firstFrame + f) / fs;
+			for (uint8_t c = 0; c < channelCount; ++c, out += bitDepthInBytes)
+			{
+				WriteSample(std::llround(0.25 * fullScale * std::sin(2.0 * pi * 997.0 * t + c)), bitDepthInBytes, out);
+			}
+		}
+		return frame;
+	}
+
+	struct SIMULATION
+	{
+		PCM_JITTER_STATS stats;
+		uint32_t minDepthOnceSettled;
+		uint32_t maxDepthOnceSettled;
+	};
+
+	// pushes each frame captured at fs * (1 + driftPpm) then, as the pin does, pulls blocks of pullFrames while the
+	// output clock (at fs) says they are due
+	SIMULATION Simulate(double driftPpm, uint32_t fs, uint8_t channelCount, uint32_t pullFrames, double seconds)
+	{
+		PcmJitterBuffer buffer;
+		EXPECT_TRUE(buffer.Reset(fs, 2, channelCount, 20));
+		std::vector<uint8_t> out(static_cast<size_t>(pullFrames) * 2 * channelCount);
+		const auto captureInterval = pcmSamplesPerFrame / (fs * (1.0 + driftPpm / 1000000.0));
+		SIMULATION sim{ {}, UINT32_MAX, 0 };
+		// the content doesn't matter here
+		const auto frame = MakeFrame(0, fs, 2, channelCount);
+		auto startTime = -1.0;
+		uint64_t delivered = 0;
+		for (uint64_t captured = 0; static_cast<double>(captured + 1) * captureInterval <= seconds; ++captured)
+		{
+			auto now = static_cast<double>(captured + 1) * captureInterval;
+			buffer.Push(frame.data(), pcmSamplesPerFrame);
+			if (startTime < 0.0 && buffer.IsPrimed()) startTime = now;
+			if (startTime < 0.0) continue;
+
+			auto due = static_cast<uint64_t>(std::floor((now - startTime) * fs)) - delivered;
+			for (; due >= pullFrames; due -= pullFrames, delivered += pullFrames)
+			{
+				buffer.Pull(out.data(), pullFrames, static_cast<uint32_t>(due - pullFrames));
+			}
+			if (now > seconds / 2)
+			{
+				sim.minDepthOnceSettled = std::min(sim.minDepthOnceSettled, buffer.GetDepth());
+				sim.maxDepthOnceSettled = std::max(sim.maxDepthOnceSettled, buffer.GetDepth());
+			}
+		}
+		sim.stats = buffer.GetStats();
+		return sim;
+	}
+}
+
+TEST(PcmJitterBuffer, RejectsUnsupportedFormats) {
+	PcmJitterBuffer buffer;
+	EXPECT_FALSE(buffer.Reset(48000, 1, 2, 20));
+	EXPECT_FALSE(buffer.Reset(48000, 2, 9, 20));
+	EXPECT_FALSE(buffer.Reset(0, 2, 2, 20));
+	EXPECT_TRUE(buffer.Reset(48000, 2, 2, 20));
+	EXPECT_TRUE(buffer.IsConfiguredFor(48000, 2, 2, 20));
+	EXPECT_FALSE(buffer.IsConfiguredFor(48000, 3, 2, 20));
+}
+
+TEST(PcmJitterBuffer, IsSilentUntilPrimed) {
+	PcmJitterBuffer buffer;
+	ASSERT_TRUE(buffer.Reset(48000, 2, 2, 20));
+	EXPECT_EQ(buffer.GetTargetDepth(), 960u);
+
+	std::vector<uint8_t> out(480 * 4, 0xFF);
+	std::vector<uint8_t> silence(480 * 4, 0);
+	uint64_t captured = 0;
+	for (; captured < 4; ++captured)
+	{
+		auto frame = MakeFrame(captured * pcmSamplesPerFrame, 48000, 2, 2);
+		buffer.Push(frame.data(), pcmSamplesPerFrame);
+		EXPECT_FALSE(buffer.IsPrimed());
+		EXPECT_EQ(buffer.Pull(out.data(), 480), 0u);
+		EXPECT_EQ(out, silence);
+	}
+	auto frame = MakeFrame(captured * pcmSamplesPerFrame, 48000, 2, 2);
+	buffer.Push(frame.data(), pcmSamplesPerFrame);
+	EXPECT_TRUE(buffer.IsPrimed());
+	EXPECT_EQ(buffer.GetDepth(), 960u);
+	EXPECT_EQ(buffer.Pull(out.data(), 480), 480u);
+	EXPECT_EQ(buffer.GetDepth(), 480u);
+	EXPECT_EQ(buffer.GetStats().silentFrames, 4u * 480);
+}
+
+TEST(PcmJitterBuffer, PassesAudioThroughAtEachBitDepth) {
+	for (uint8_t bitDepthInBytes : { 2, 3, 4 })
+	{
+		for (uint8_t channelCount : { 2, 6, 8 })
+		{
+			PcmJitterBuffer buffer;
+			ASSERT_TRUE(buffer.Reset(96000, bitDepthInBytes, channelCount, 10));
+			const auto frameSize = static_cast<size_t>(bitDepthInBytes) * channelCount;
+			std::vector<uint8_t> in;
+			for (uint64_t i = 0; i < 10; ++i)
+			{
+				auto frame = MakeFrame(i * pcmSamplesPerFrame, 96000, bitDepthInBytes, channelCount);
+				buffer.Push(frame.data(), pcmSamplesPerFrame);
+				for (auto b : frame) in.push_back(b);
+			}
+			ASSERT_TRUE(buffer.IsPrimed());
+
+			// with no drift the output is the input delayed by the history reached back into on priming
+			std::vector<uint8_t> out(pcmSamplesPerFrame * frameSize);
+			ASSERT_EQ(buffer.Pull(out.data(), pcmSamplesPerFrame), pcmSamplesPerFrame);
+			const auto fullScale = static_cast<double>(1ULL << (8 * bitDepthInBytes - 1));
+			for (uint32_t s = 0; s < pcmSamplesPerFrame * channelCount; ++s)
+			{
+				auto expected = ReadSample(in.data() + s * bitDepthInBytes, bitDepthInBytes);
+				auto actual = ReadSample(out.data() + s * bitDepthInBytes, bitDepthInBytes);
+				// the first few samples are softened by the silence the filter reaches back into
+				auto tolerance = s / channelCount < resamplerHistory ? 0.1 : 1e-4;
+				ASSERT_NEAR(static_cast<double>(actual) / fullScale, static_cast<double>(expected) / fullScale, tolerance)
+					<< static_cast<int>(bitDepthInBytes) << " bytes " << static_cast<int>(channelCount) << " channels sample " << s;
+			}
+		}
+	}
+}
+
+TEST(PcmJitterBuffer, AbsorbsClockDrift) {
+	for (auto driftPpm : { 0.0, 250.0, -400.0 })
+	{
+		auto sim = Simulate(driftPpm, 48000, 2, 480, 120.0);
+		EXPECT_EQ(sim.stats.underruns, 0u) << driftPpm;
+		EXPECT_EQ(sim.stats.overruns, 0u) << driftPpm;
+		// the output has to consume input at the rate it arrives
+		EXPECT_NEAR(sim.stats.ratioPpm, driftPpm, 2.0) << driftPpm;
+		EXPECT_NEAR(sim.stats.depthMs, 20.0, 0.1) << driftPpm;
+		// the depth only moves by the blocks it is pushed and pulled in
+		EXPECT_GE(sim.minDepthOnceSettled, 960u - 8) << driftPpm;
+		EXPECT_LE(sim.maxDepthOnceSettled, 960u + 480 + 192) << driftPpm;
+	}
+}
+
+TEST(PcmJitterBuffer, AbsorbsClockDriftAtHighRates) {
+	auto sim = Simulate(-150.0, 192000, 8, 1920, 60.0);
+	EXPECT_EQ(sim.stats.underruns, 0u);
+	EXPECT_EQ(sim.stats.overruns, 0u);
+	EXPECT_NEAR(sim.stats.ratioPpm, -150.0, 2.0);
+	EXPECT_NEAR(sim.stats.depthMs, 20.0, 0.1);
+}
+
+TEST(PcmJitterBuffer, DropsTheOldestAudioOnOverrun) {
+	PcmJitterBuffer buffer;
+	ASSERT_TRUE(buffer.Reset(48000, 2, 2, 20));
+	auto frame = MakeFrame(0, 48000, 2, 2);
+	// nothing is pulled so the depth grows to 3x the target before falling back to the target
+	for (auto i = 0; i < 16; ++i)
+	{
+		buffer.Push(frame.data(), pcmSamplesPerFrame);
+		EXPECT_LE(buffer.GetDepth(), 3u * 960);
+	}
+	EXPECT_EQ(buffer.GetStats().overruns, 1u);
+	EXPECT_EQ(buffer.GetStats().framesDropped, 16u * pcmSamplesPerFrame - buffer.GetDepth());
+}
+
+TEST(PcmJitterBuffer, FillsGapsAndUnderrunsWithSilence) {
+	PcmJitterBuffer buffer;
+	ASSERT_TRUE(buffer.Reset(48000, 2, 2, 20));
+	auto frame = MakeFrame(0, 48000, 2, 2);
+	for (auto i = 0; i < 3; ++i) buffer.Push(frame.data(), pcmSamplesPerFrame);
+	// 2 lost frames count towards the depth
+	buffer.PushSilence(2 * pcmSamplesPerFrame);
+	EXPECT_TRUE(buffer.IsPrimed());
+	EXPECT_EQ(buffer.GetStats().gapFrames, 2u * pcmSamplesPerFrame);
+
+	// the input stops so the output runs dry part way through a pull
+	std::vector<uint8_t> out(960 * 4);
+	auto produced = buffer.Pull(out.data(), 960);
+	EXPECT_EQ(produced, 960u - resamplerLookahead);
+	EXPECT_EQ(buffer.GetStats().underruns, 1u);
+	EXPECT_FALSE(buffer.IsPrimed());
+	for (auto i = produced * 4; i < out.size(); ++i)
+	{
+		ASSERT_EQ(out[i], 0) << i;
+	}
+
+	// silent until refilled
+	EXPECT_EQ(buffer.Pull(out.data(), 480), 0u);
+	for (auto i = 0; i < 5; ++i) buffer.Push(frame.data(), pcmSamplesPerFrame);
+	EXPECT_TRUE(buffer.IsPrimed());
+	EXPECT_EQ(buffer.Pull(out.data(), 480), 480u);
+}
@@ -0,0 +1,192 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/pcm_remap.h"
+#include "legacypcmremap.h"
+
+namespace
+{
+	struct Layout
+	{
+		const char* name;
+		int inputChannelCount;
+		int outputChannelCount;
+		std::array<int, 8> channelOffsets;
+	};
+
+	constexpr auto np = not_present;
+
+	// a selection of the offsets produced by LoadFormat
+	const Layout layouts[] = {
+		{ "2.0", 2, 2, { 0, 0, np, np, np, np, np, np } },
+		{ "3.1", 4, 4, { 0, 0, 1, -1, np, np, np, np } },
+		{ "5.1", 6, 6, { 0, 0, 1, -1, 0, 0, np, np } },
+		{ "7.1", 8, 8, { 0, 0, 1, -1, 0, 0, 0, 0 } },
+		{ "0x13", 8, 8, { 0, 0, 1, -1, 2, 2, -2, -2 } },
+		{ "0x18", 8, 5, { 0, 0, np, np, 2, np, -1, -1 } },
+		{ "mask 0x01", 8, 5, { 0, 0, np, 0, 0, 0, np, np } },
+	};
+
+	std::vector<uint8_t> MakeFrame(unsigned seed)
+	{
+		std::vector<uint8_t> frame(pcmSamplesPerFrame * pcmInputBlockSizeInBytes);
+		std::mt19937 rng(seed);
+		for (auto& b : frame) b = static_cast<uint8_t>(rng());
+		return frame;
+	}
+
+	std::vector<SimdLevel> SupportedLevels()
+	{
+		std::vector<SimdLevel> levels;
+		for (auto level : { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2, SIMD_NEON })
+		{
+			if (IsSimdLevelSupported(level)) levels.push_back(level);
+		}
+		return levels;
+	}
+}
+
+TEST(PcmRemap, StereoKeepsTopBytesOfEachSlot) {
+	std::vector<uint8_t> frame(pcmSamplesPerFrame * pcmInputBlockSizeInBytes);
+	// first sample, L0 = 0x44332211 R0 = 0x88776655 in little endian slots
+	const uint8_t firstSample[pcmInputBlockSizeInBytes] = {
+		0x11, 0x22, 0x33, 0x44, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0x55, 0x66, 0x77, 0x88, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+	};
+	std::copy(std::begin(firstSample), std::end(firstSample), frame.begin());
+
+	for (auto level : SupportedLevels())
+	{
+		auto plan = MakePcmRemapPlan(3, 2, 2, { 0, 0, np, np, np, np, np, np });
+		std::vector<uint8_t> out(pcmSamplesPerFrame * 6, 0xFF);
+		auto samples = RemapPcm(&plan, frame.data(), out.data(), static_cast<uint32_t>(out.size()), pcmSamplesPerFrame, level);
+
+		EXPECT_EQ(samples, pcmSamplesPerFrame) << simdlevel_to_name(level);
+		const uint8_t expected[] = { 0x22, 0x33, 0x44, 0x66, 0x77, 0x88, 0, 0, 0, 0, 0, 0 };
+		EXPECT_TRUE(std::equal(std::begin(expected), std::end(expected), out.begin())) << simdlevel_to_name(level);
+	}
+}
+
+TEST(PcmRemap, SwapsCentreAndLfe) {
+	std::vector<uint8_t> frame(pcmSamplesPerFrame * pcmInputBlockSizeInBytes);
+	// 16 bit 5.1 arrives as L0 L1 L2 -- R0 R1 R2 -- = FL LFE BL -- FR FC BR --
+	for (auto slot = 0; slot < pcmInputSlotCount; ++slot)
+	{
+		frame[slot * pcmInputSlotSizeInBytes + 2] = static_cast<uint8_t>(slot);
+		frame[slot * pcmInputSlotSizeInBytes + 3] = static_cast<uint8_t>(0xA0 + slot);
+	}
+
+	for (auto level : SupportedLevels())
+	{
+		auto plan = MakePcmRemapPlan(2, 6, 6, { 0, 0, 1, -1, 0, 0, np, np });
+		std::vector<uint8_t> out(pcmSamplesPerFrame * 12);
+		RemapPcm(&plan, frame.data(), out.data(), static_cast<uint32_t>(out.size()), pcmSamplesPerFrame, level);
+
+		// FL FR FC LFE BL BR
+		const uint8_t expected[] = { 0, 0xA0, 4, 0xA4, 5, 0xA5, 1, 0xA1, 2, 0xA2, 6, 0xA6 };
+		EXPECT_TRUE(std::equal(std::begin(expected), std::end(expected), out.begin())) << simdlevel_to_name(level);
+	}
+}
+
+TEST(PcmRemap, MatchesLegacyRemap) {
+	auto frame = MakeFrame(61937);
+	for (const auto& layout : layouts)
+	{
+		for (auto bitDepthInBytes : { 2, 3, 4 })
+		{
+			auto sampleSize = pcmSamplesPerFrame * layout.outputChannelCount * bitDepthInBytes;
+			std::vector<uint8_t> expected(sampleSize, 0);
+			LegacyRemapPcm(frame.data(), expected.data(), sampleSize, bitDepthInBytes,
+				layout.inputChannelCount, layout.outputChannelCount, layout.channelOffsets);
+
+			auto plan = MakePcmRemapPlan(static_cast<uint8_t>(bitDepthInBytes), static_cast<uint16_t>(layout.inputChannelCount),
+				static_cast<uint16_t>(layout.outputChannelCount), layout.channelOffsets);
+			for (auto level : SupportedLevels())
+			{
+				std::vector<uint8_t> actual(sampleSize, 0xCD);
+				auto samples = RemapPcm(&plan, frame.data(), actual.data(), sampleSize, pcmSamplesPerFrame, level);
+
+				EXPECT_EQ(samples, pcmSamplesPerFrame);
+				EXPECT_EQ(actual, expected) << layout.name << " " << bitDepthInBytes * 8 << "bit " << simdlevel_to_name(level);
+			}
+		}
+	}
+}
+
+TEST(PcmRemap, StopsAtEndOfSample) {
+	auto frame = MakeFrame(1);
+	auto plan = MakePcmRemapPlan(3, 8, 8, { 0, 0, 1, -1, 0, 0, 0, 0 });
+	for (auto level : SupportedLevels())
+	{
+		// room for 10 and a bit samples with a guard region after it
+		std::vector<uint8_t> out(24 * 10 + 5 + 64, 0xCD);
+		auto samples = RemapPcm(&plan, frame.data(), out.data(), 24 * 10 + 5, pcmSamplesPerFrame, level);
+
+		EXPECT_EQ(samples, 10u) << simdlevel_to_name(level);
+		EXPECT_TRUE(std::all_of(out.begin() + 240, out.end(), [](uint8_t b) { return b == 0xCD; })) << simdlevel_to_name(level);
+	}
+}
+
+TEST(PcmRemap, RejectsInvalidFormat) {
+	auto plan = MakePcmRemapPlan(0, 2, 2, { 0, 0, np, np, np, np, np, np });
+	uint8_t in[pcmInputBlockSizeInBytes]{};
+	uint8_t out[8]{};
+
+	EXPECT_EQ(plan.outputBlockSize, 0);
+	EXPECT_EQ(RemapPcm(&plan, in, out, sizeof(out), 1), 0u);
+}
+
+TEST(PcmRemap, RemapsAggregatedFramesAsOneBlock) {
+	constexpr auto frames = 3;
+	std::vector<uint8_t> in;
+	for (auto i = 0; i < frames; ++i)
+	{
+		auto next = MakeFrame(100 + i);
+		in.insert(in.end(), next.begin(), next.end());
+	}
+	auto plan = MakePcmRemapPlan(3, 8, 8, { 0, 0, 1, -1, 0, 0, 0, 0 });
+	const auto frameSize = static_cast<uint32_t>(pcmSamplesPerFrame * plan.outputBlockSize);
+
+	std::vector<uint8_t> expected(frameSize * frames);
+	for (auto i = 0; i < frames; ++i)
+	{
+		RemapPcm(&plan, in.data() + i * pcmSamplesPerFrame * pcmInputBlockSizeInBytes, expected.data() + i * frameSize, frameSize,
+			pcmSamplesPerFrame, SIMD_SCALAR);
+	}
+	for (auto level : SupportedLevels())
+	{
+		std::vector<uint8_t> actual(frameSize * frames);
+		auto samples = RemapPcm(&plan, in.data(), actual.data(), static_cast<uint32_t>(actual.size()), pcmSamplesPerFrame * frames, level);
+
+		EXPECT_EQ(samples, static_cast<uint32_t>(pcmSamplesPerFrame * frames)) << simdlevel_to_name(level);
+		EXPECT_EQ(actual, expected) << simdlevel_to_name(level);
+	}
+}
+
+TEST(PcmRemap, FramesPerSampleCoversMinimumDuration) {
+	// 10ms
+	constexpr int64_t duration = 100000;
+	EXPECT_EQ(GetPcmFramesPerSample(48000, duration), 3);
+	EXPECT_EQ(GetPcmFramesPerSample(44100, duration), 3);
+	EXPECT_EQ(GetPcmFramesPerSample(96000, duration), 5);
+	EXPECT_EQ(GetPcmFramesPerSample(192000, duration), 10);
+	EXPECT_EQ(GetPcmFramesPerSample(192000, duration * 10), pcmMaxFramesPerSample);
+	EXPECT_EQ(GetPcmFramesPerSample(48000, 0), 1);
+	EXPECT_EQ(GetPcmFramesPerSample(0, duration), 1);
+}
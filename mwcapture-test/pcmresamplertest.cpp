@@ -0,0 +1,145 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/pcm_resampler.h"
+
+namespace
+{
+	constexpr double pi = 3.14159265358979323846;
+
+	std::vector<float> Sine(double frequency, uint32_t fs, uint32_t frames, double phase = 0.0)
+	{
+		std::vector<float> out(frames);
+		for (uint32_t i = 0; i < frames; ++i)
+		{
+			out[i] = static_cast<float>(0.5 * std::sin(2.0 * pi * frequency * i / fs + phase));
+		}
+		return out;
+	}
+
+	// resamples a sine from fs by ratio and returns the rms error, relative to the amplitude, against the sine sampled
+	// at the output positions
+	double ResampleSineError(SimdLevel level, double frequency, uint32_t fs, double ratio)
+	{
+		constexpr uint32_t inFrames = 4096;
+		auto left = Sine(frequency, fs, inFrames);
+		auto right = Sine(frequency, fs, inFrames, pi / 3);
+		const float* in[2]{ left.data(), right.data() };
+		std::vector<float> out(2 * inFrames);
+
+		PcmResampler resampler(level);
+		double start = resamplerHistory + 0.37;
+		auto pos = start;
+		auto written = resampler.Resample(in, 2, inFrames, &pos, ratio, out.data(), inFrames);
+		EXPECT_GT(written, inFrames / 2);
+
+		double error = 0.0;
+		for (uint32_t i = 0; i < written; ++i)
+		{
+			auto t = start + i * ratio;
+			auto expectedLeft = 0.5 * std::sin(2.0 * pi * frequency * t / fs);
+			auto expectedRight = 0.5 * std::sin(2.0 * pi * frequency * t / fs + pi / 3);
+			error += std::pow(out[2 * i] - expectedLeft, 2) + std::pow(out[2 * i + 1] - expectedRight, 2);
+		}
+		return std::sqrt(error / (2.0 * written)) / 0.5;
+	}
+
+	std::vector<SimdLevel> SupportedLevels()
+	{
+		std::vector<SimdLevel> levels;
+		for (auto level : { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2, SIMD_NEON })
+		{
+			if (IsSimdLevelSupported(level)) levels.push_back(level);
+		}
+		return levels;
+	}
+}
+
+TEST(PcmResampler, KernelsMatchScalar) {
+	std::mt19937 rng(48000);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	std::vector<float> h0(resamplerTaps);
+	std::vector<float> h1(resamplerTaps);
+	std::vector<std::vector<float>> channels(resamplerMaxChannels, std::vector<float>(resamplerTaps + 3));
+	const float* in[resamplerMaxChannels];
+	for (auto iteration = 0; iteration < 100; ++iteration)
+	{
+		for (auto& v : h0) v = dist(rng);
+		for (auto& v : h1) v = dist(rng);
+		for (uint8_t c = 0; c < resamplerMaxChannels; ++c)
+		{
+			for (auto& v : channels[c]) v = dist(rng);
+			in[c] = channels[c].data();
+		}
+		// the input is unaligned as the resampler walks it a frame at a time
+		auto first = iteration % 4;
+		auto f = dist(rng) / 2.0f + 0.5f;
+		auto channelCount = static_cast<uint8_t>(1 + iteration % resamplerMaxChannels);
+		float expected[resamplerMaxChannels]{};
+		ResampleFrameScalar(h0.data(), h1.data(), f, in, first, channelCount, expected);
+		for (auto level : SupportedLevels())
+		{
+			float actual[resamplerMaxChannels]{};
+			GetResampleFrame(level)(h0.data(), h1.data(), f, in, first, channelCount, actual);
+			for (uint8_t c = 0; c < channelCount; ++c)
+			{
+				ASSERT_NEAR(actual[c], expected[c], 1e-4f) << simdlevel_to_name(level) << " channel " << static_cast<int>(c);
+			}
+		}
+	}
+}
+
+TEST(PcmResampler, ReproducesASineAtAnyRatio) {
+	for (auto level : SupportedLevels())
+	{
+		for (auto ratio : { 1.0, 1.0 + 1e-4, 1.0 - 1e-3, 0.999937 })
+		{
+			EXPECT_LT(ResampleSineError(level, 1000.0, 48000, ratio), 1e-4) << simdlevel_to_name(level) << " " << ratio;
+			EXPECT_LT(ResampleSineError(level, 10000.0, 48000, ratio), 1e-3) << simdlevel_to_name(level) << " " << ratio;
+			// close to the top of the passband so attenuated a little
+			EXPECT_LT(ResampleSineError(level, 20000.0, 48000, ratio), 2e-2) << simdlevel_to_name(level) << " " << ratio;
+		}
+	}
+}
+
+TEST(PcmResampler, StopsWhenTheInputRunsOut) {
+	constexpr uint32_t inFrames = 256;
+	std::vector<float> ones(inFrames, 1.0f);
+	const float* in[1]{ ones.data() };
+	std::vector<float> out(inFrames, 0.0f);
+
+	for (auto level : SupportedLevels())
+	{
+		PcmResampler resampler(level);
+		double pos = resamplerHistory;
+		auto written = resampler.Resample(in, 1, inFrames, &pos, 1.0, out.data(), inFrames);
+		EXPECT_EQ(written, inFrames - resamplerHistory - resamplerLookahead);
+		EXPECT_DOUBLE_EQ(pos, inFrames - resamplerLookahead);
+		for (uint32_t i = 0; i < written; ++i)
+		{
+			// every phase has unity gain at DC
+			ASSERT_NEAR(out[i], 1.0f, 1e-5f) << simdlevel_to_name(level) << " " << i;
+		}
+
+		// nothing more until more input arrives, and nothing before there is enough history
+		EXPECT_EQ(resampler.Resample(in, 1, inFrames, &pos, 1.0, out.data(), inFrames), 0u);
+		pos = resamplerHistory - 1;
+		EXPECT_EQ(resampler.Resample(in, 1, inFrames, &pos, 1.0, out.data(), inFrames), 0u);
+	}
+}
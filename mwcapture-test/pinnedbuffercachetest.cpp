@@ -0,0 +1,120 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <map>
+#include <set>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/pinned_buffer_cache.h"
+
+namespace
+{
+	// records calls in place of MWPinVideoBuffer/MWUnpinVideoBuffer
+	struct StubPinApi
+	{
+		std::map<uint8_t*, size_t> pinned;
+		std::set<uint8_t*> failOn;
+		int pinCalls{ 0 };
+		int unpinCalls{ 0 };
+
+		bool Pin(uint8_t* data, size_t size)
+		{
+			pinCalls++;
+			if (failOn.count(data) > 0) return false;
+			EXPECT_EQ(pinned.count(data), 0u) << "pinned twice";
+			pinned[data] = size;
+			return true;
+		}
+
+		void Unpin(uint8_t* data)
+		{
+			unpinCalls++;
+			EXPECT_EQ(pinned.erase(data), 1u) << "unpinned a buffer which was not pinned";
+		}
+	};
+
+	uint8_t buffers[4][64];
+}
+
+TEST(PinnedBufferCache, PinsEachBufferOnce) {
+	PinnedBufferCache<StubPinApi> cache;
+	for (auto frame = 0; frame < 100; ++frame)
+	{
+		EXPECT_TRUE(cache.Pin(buffers[frame % 4], 64));
+	}
+	EXPECT_EQ(cache.GetApi().pinCalls, 4);
+	EXPECT_EQ(cache.GetApi().unpinCalls, 0);
+	EXPECT_EQ(cache.GetPinnedCount(), 4u);
+	EXPECT_EQ(cache.GetMissCount(), 4u);
+	EXPECT_EQ(cache.GetHitCount(), 96u);
+}
+
+TEST(PinnedBufferCache, RepinsWhenTheSizeChanges) {
+	PinnedBufferCache<StubPinApi> cache;
+	EXPECT_TRUE(cache.Pin(buffers[0], 32));
+	EXPECT_TRUE(cache.Pin(buffers[0], 64));
+	EXPECT_EQ(cache.GetApi().pinCalls, 2);
+	EXPECT_EQ(cache.GetApi().unpinCalls, 1);
+	EXPECT_EQ(cache.GetApi().pinned[buffers[0]], 64u);
+	EXPECT_EQ(cache.GetPinnedCount(), 1u);
+}
+
+TEST(PinnedBufferCache, FailedPinIsRetried) {
+	PinnedBufferCache<StubPinApi> cache;
+	cache.GetApi().failOn.insert(buffers[1]);
+	EXPECT_FALSE(cache.Pin(buffers[1], 64));
+	EXPECT_FALSE(cache.IsPinned(buffers[1]));
+	EXPECT_EQ(cache.GetFailureCount(), 1u);
+
+	cache.GetApi().failOn.clear();
+	EXPECT_TRUE(cache.Pin(buffers[1], 64));
+	EXPECT_TRUE(cache.IsPinned(buffers[1]));
+	EXPECT_EQ(cache.GetApi().pinCalls, 2);
+}
+
+TEST(PinnedBufferCache, ClearUnpinsEverything) {
+	PinnedBufferCache<StubPinApi> cache;
+	for (auto& buffer : buffers)
+	{
+		cache.Pin(buffer, 64);
+	}
+	cache.Unpin(buffers[2]);
+	cache.Unpin(buffers[2]);
+	EXPECT_EQ(cache.GetApi().unpinCalls, 1);
+
+	cache.Clear();
+	EXPECT_EQ(cache.GetApi().unpinCalls, 4);
+	EXPECT_TRUE(cache.GetApi().pinned.empty());
+	EXPECT_EQ(cache.GetPinnedCount(), 0u);
+
+	// pinned again on next use
+	EXPECT_TRUE(cache.Pin(buffers[0], 64));
+	EXPECT_EQ(cache.GetApi().pinCalls, 5);
+}
+
+TEST(PinnedBufferCache, UnpinsOnDestruction) {
+	int unpinCalls = 0;
+	struct CountingPinApi
+	{
+		int* unpinCalls;
+		bool Pin(uint8_t*, size_t) { return true; }
+		void Unpin(uint8_t*) { (*unpinCalls)++; }
+	};
+	{
+		PinnedBufferCache<CountingPinApi> cache(CountingPinApi{ &unpinCalls });
+		cache.Pin(buffers[0], 64);
+		cache.Pin(buffers[1], 64);
+	}
+	EXPECT_EQ(unpinCalls, 2);
+}
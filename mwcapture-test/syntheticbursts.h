@@ -0,0 +1,165 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// data burst payloads with valid frame headers (and filler content) for the header parser tests, benchmarks and fuzz
+// corpus
+
+class BitWriter
+{
+public:
+	explicit BitWriter(std::vector<uint8_t>& out) :
+		mOut(out)
+	{
+	}
+
+	// at most 32 bits at a time
+	void Write(uint32_t value, uint8_t bits)
+	{
+		assert(bits <= 32);
+		for (auto i = bits; i > 0; --i, ++mPos)
+		{
+			if (mPos % 8 == 0) mOut.push_back(0);
+			mOut.back() |= static_cast<uint8_t>((value >> (i - 1) & 1) << (7 - mPos % 8));
+		}
+	}
+
+private:
+	std::vector<uint8_t>& mOut;
+	size_t mPos{ 0 };
+};
+
+inline void PadTo(std::vector<uint8_t>& burst, size_t len)
+{
+	for (auto i = burst.size(); i < len; ++i) burst.push_back(static_cast<uint8_t>(i * 7));
+}
+
+// AC3 syncframe, 3/2 with LFE at the given fscod and frmsizecod
+inline std::vector<uint8_t> MakeAc3Burst(uint8_t fscod = 0, uint8_t frmsizecod = 30, uint8_t acmod = 7, bool lfe = true)
+{
+	std::vector<uint8_t> burst;
+	BitWriter w(burst);
+	w.Write(0x0B77, 16);
+	w.Write(0, 16);
+	w.Write(fscod, 2);
+	w.Write(frmsizecod, 6);
+	w.Write(8, 5);
+	w.Write(0, 3);
+	w.Write(acmod, 3);
+	if ((acmod & 1) && acmod != 1) w.Write(0, 2);
+	if (acmod & 4) w.Write(0, 2);
+	if (acmod == 2) w.Write(0, 2);
+	w.Write(lfe ? 1 : 0, 1);
+	PadTo(burst, 1792);
+	return burst;
+}
+
+inline void WriteEac3Frame(std::vector<uint8_t>& burst, uint8_t strmtyp, uint8_t substreamid, uint16_t frameBytes, uint8_t fscod,
+	uint8_t numblkscod, uint8_t acmod, bool lfe)
+{
+	auto start = burst.size();
+	BitWriter w(burst);
+	w.Write(0x0B77, 16);
+	w.Write(strmtyp, 2);
+	w.Write(substreamid, 3);
+	w.Write(frameBytes / 2 - 1, 11);
+	w.Write(fscod, 2);
+	w.Write(numblkscod, 2);
+	w.Write(acmod, 3);
+	w.Write(lfe ? 1 : 0, 1);
+	w.Write(16, 5);
+	PadTo(burst, start + frameBytes);
+}
+
+// an E-AC3 burst of frames independent frames of blocks audio blocks each, optionally with a 7.1 dependent substream
+inline std::vector<uint8_t> MakeEac3Burst(uint8_t numblkscod = 3, int frames = 1, bool dependent = false)
+{
+	std::vector<uint8_t> burst;
+	for (auto i = 0; i < frames; ++i)
+	{
+		WriteEac3Frame(burst, 0, 0, 1280, 0, numblkscod, 7, true);
+		if (dependent) WriteEac3Frame(burst, 1, 0, 512, 0, numblkscod, 2, false);
+	}
+	return burst;
+}
+
+inline std::vector<uint8_t> MakeDtsCoreFrame(uint8_t nblks = 15, uint16_t fsize = 2012, uint8_t amode = 9, uint8_t sfreq = 13, uint8_t rate = 24)
+{
+	std::vector<uint8_t> burst;
+	BitWriter w(burst);
+	w.Write(0x7FFE8001, 32);
+	w.Write(1, 1);
+	w.Write(31, 5);
+	w.Write(0, 1);
+	w.Write(nblks, 7);
+	w.Write(fsize, 14);
+	w.Write(amode, 6);
+	w.Write(sfreq, 4);
+	w.Write(rate, 5);
+	w.Write(0, 1 + 1 + 1 + 1 + 1 + 3 + 1 + 1);
+	w.Write(2, 2);
+	PadTo(burst, fsize + 1U);
+	return burst;
+}
+
+// an IEC 61937-5 type IV burst, with a core or just an extension substream
+inline std::vector<uint8_t> MakeDtsHdBurst(bool core = true, uint8_t frameDurationCode = 0)
+{
+	std::vector<uint8_t> burst{ 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0xFE, 0x2F, 0x00 };
+	if (core)
+	{
+		for (auto b : MakeDtsCoreFrame()) burst.push_back(b);
+	}
+	BitWriter w(burst);
+	w.Write(0x64582025, 32);
+	w.Write(0, 8);
+	w.Write(0, 2);
+	w.Write(0, 1);
+	w.Write(15, 8);
+	w.Write(10000, 16);
+	w.Write(1, 1);
+	w.Write(2, 2);
+	w.Write(frameDurationCode, 3);
+	PadTo(burst, burst.size() + 10000);
+	return burst;
+}
+
+// a MAT frame whose major sync is in access unit syncUnit, 7.1 at the given ratebits
+inline std::vector<uint8_t> MakeTrueHdBurst(uint8_t ratebits = 0, uint32_t syncUnit = 0)
+{
+	std::vector<uint8_t> burst{ 0x07, 0x9E, 0x00, 0x03, 0x84, 0x01, 0x01, 0x01, 0x80, 0x00, 0x56, 0xA5, 0x3B, 0xF4, 0x81, 0x83, 0x49, 0x80, 0x77, 0xE0 };
+	// access units without a major sync are zero filled to keep the search honest
+	for (uint32_t i = 0; i < syncUnit * 64; ++i) burst.push_back(0);
+	BitWriter w(burst);
+	w.Write(0x0, 4);
+	w.Write(32, 12);
+	w.Write(0, 16);
+	w.Write(0xF8726FBA, 32);
+	w.Write(ratebits, 4);
+	w.Write(0, 4 + 2 + 2);
+	w.Write(0x0F, 5);
+	w.Write(0, 2);
+	// L/R, C, LFE, Ls/Rs, Lrs/Rrs
+	w.Write(0x4F, 13);
+	w.Write(0xB752, 16);
+	w.Write(0, 16 + 16);
+	w.Write(0, 1);
+	w.Write(0x2000, 15);
+	PadTo(burst, 61424);
+	return burst;
+}
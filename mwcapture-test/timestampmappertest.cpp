@@ -0,0 +1,107 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <random>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/timestamp_mapper.h"
+
+namespace
+{
+	// 192 samples at 48kHz in 100ns units
+	constexpr int64_t audioFrameInterval = 40000;
+	constexpr int64_t deviceEpoch = 123456789000LL;
+	constexpr int64_t clockEpoch = 987654321000LL;
+}
+
+TEST(TimestampMapper, PassesClockThroughUntilLocked) {
+	TimestampMapper mapper(64, 8);
+	for (auto i = 0; i < 7; ++i)
+	{
+		auto clock = clockEpoch + i * audioFrameInterval + 3000;
+		EXPECT_EQ(mapper.Map(deviceEpoch + i * audioFrameInterval, clock), clock);
+		EXPECT_FALSE(mapper.GetStats().locked);
+	}
+	mapper.Map(deviceEpoch + 7 * audioFrameInterval, clockEpoch + 7 * audioFrameInterval + 3000);
+	EXPECT_TRUE(mapper.GetStats().locked);
+}
+
+TEST(TimestampMapper, RemovesDeliveryJitter) {
+	TimestampMapper mapper;
+	std::mt19937 rng(48000);
+	std::uniform_int_distribution<int64_t> delay(5000, 25000);
+
+	int64_t lastMapped = 0;
+	for (auto i = 0; i < 2000; ++i)
+	{
+		auto device = deviceEpoch + i * audioFrameInterval;
+		auto clock = clockEpoch + i * audioFrameInterval + delay(rng);
+		auto mapped = mapper.Map(device, clock);
+		// stays on the floor of the delay
+		EXPECT_LE(mapped, clock + 500) << i;
+		if (i > 300)
+		{
+			EXPECT_NEAR(mapped - lastMapped, audioFrameInterval, 100) << i;
+		}
+		lastMapped = mapped;
+	}
+	const auto& stats = mapper.GetStats();
+	EXPECT_TRUE(stats.locked);
+	EXPECT_NEAR(stats.driftPpm, 0.0, 500.0);
+	// uniform over 20000 has a standard deviation of ~5774
+	EXPECT_NEAR(stats.jitter, 5774.0, 1000.0);
+	EXPECT_EQ(stats.resyncs, 0u);
+}
+
+TEST(TimestampMapper, TracksDrift) {
+	TimestampMapper mapper;
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int64_t> delay(0, 2000);
+
+	// reference clock runs 200ppm fast relative to the device
+	for (auto i = 0; i < 1000; ++i)
+	{
+		auto elapsed = i * audioFrameInterval;
+		mapper.Map(deviceEpoch + elapsed, clockEpoch + elapsed + elapsed / 5000 + delay(rng));
+	}
+	EXPECT_NEAR(mapper.GetStats().driftPpm, 200.0, 20.0);
+}
+
+TEST(TimestampMapper, ResyncsOnDiscontinuity) {
+	TimestampMapper mapper(64, 8);
+	int64_t lastMapped = 0;
+	for (auto i = 0; i < 100; ++i)
+	{
+		// the device restarts its clock halfway through
+		auto device = i < 50 ? deviceEpoch + i * audioFrameInterval : (i - 50) * audioFrameInterval;
+		auto mapped = mapper.Map(device, clockEpoch + i * audioFrameInterval + 1000);
+		EXPECT_GE(mapped, lastMapped) << i;
+		lastMapped = mapped;
+	}
+	EXPECT_EQ(mapper.GetStats().resyncs, 1u);
+	EXPECT_TRUE(mapper.GetStats().locked);
+	EXPECT_EQ(lastMapped, clockEpoch + 99 * audioFrameInterval + 1000);
+}
+
+TEST(TimestampMapper, ParsesModeNamesIgnoringCase) {
+	TimestampMode mode = TIMESTAMP_DEVICE;
+	EXPECT_TRUE(ParseTimestampMode("clock", &mode));
+	EXPECT_EQ(mode, TIMESTAMP_CLOCK);
+	EXPECT_TRUE(ParseTimestampMode("DEVICE", &mode));
+	EXPECT_EQ(mode, TIMESTAMP_DEVICE);
+
+	EXPECT_FALSE(ParseTimestampMode("", &mode));
+	EXPECT_FALSE(ParseTimestampMode("Devices", &mode));
+	EXPECT_EQ(mode, TIMESTAMP_DEVICE);
+}
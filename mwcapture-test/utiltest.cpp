@@ -1,15 +1,25 @@
-#pragma once
-
-#define NOMINMAX
-
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
 #include "gtest/gtest.h"
-#include "LibMWCapture/MWCapture.h"
 #include "../mwcapture/util.h"
+#include "../mwcapture/audio_format.h"
 
 
 TEST(HDR, CanParseHDRInfoFrame) {
     HDR_META o{};
-    HDMI_HDR_INFOFRAME_PAYLOAD i{
+    HDR_INFOFRAME i{
         //02 00 34 21 AA 9B 96 19 FC 08 48 8A 08 39 13 3D 42 40 9F 0F 32 00 A0 0F E8 03 
         .byEOTF = 0x02,
         .byMetadataDescriptorID = 0x00,
@@ -59,4 +69,135 @@ TEST(HDR, CanParseHDRInfoFrame) {
     EXPECT_EQ(o.maxFALL, 1000);
     EXPECT_EQ(o.minDML, 50);
     EXPECT_EQ(o.maxDML, 3999);
-}
\ No newline at end of file
+}
+
+TEST(AudioFormat, LoadsStereoPcm) {
+    AUDIO_FORMAT f{};
+    AUDIO_INPUT in{ .fs = 44100, .bitsPerSample = 24, .lpcm = true, .channelAllocation = 0x00, .channelValidityMask = 0x01 };
+
+    LoadAudioFormat(&f, &in);
+
+    EXPECT_EQ(f.codec, PCM);
+    EXPECT_EQ(f.fs, 44100u);
+    EXPECT_EQ(f.bitDepthInBytes, 3);
+    EXPECT_EQ(f.inputChannelCount, 2);
+    EXPECT_EQ(f.outputChannelCount, 2);
+    EXPECT_DOUBLE_EQ(f.sampleInterval, 10000000.0 / 44100);
+    ASSERT_NE(f.remapPlan, nullptr);
+}
+
+TEST(AudioFormat, LoadsMultichannelPcmWithLfeAttenuation) {
+    AUDIO_FORMAT f{};
+    // 7.1 with the LFE played back 10dB down
+    AUDIO_INPUT in{ .fs = 48000, .bitsPerSample = 16, .lpcm = true, .channelAllocation = 0x13, .lfePlaybackLevel = 0x2, .channelValidityMask = 0x0F };
+
+    LoadAudioFormat(&f, &in);
+
+    EXPECT_EQ(f.inputChannelCount, 8);
+    EXPECT_EQ(f.outputChannelCount, 8);
+    EXPECT_NE(f.lfeChannelIndex, not_present);
+    EXPECT_DOUBLE_EQ(f.lfeLevelAdjustment, minus_10db);
+}
+
+TEST(AudioFormat, NoValidChannelsHasNoChannels) {
+    AUDIO_FORMAT f{};
+    AUDIO_INPUT in{ .channelAllocation = 0x13, .channelValidityMask = 0x00 };
+
+    LoadAudioFormat(&f, &in);
+
+    EXPECT_EQ(f.inputChannelCount, 0);
+    EXPECT_EQ(f.outputChannelCount, 0);
+    EXPECT_EQ(f.lfeChannelIndex, not_present);
+}
+
+TEST(AudioFormat, DetectsEachChange) {
+    AUDIO_FORMAT current{};
+    AUDIO_FORMAT proposed{};
+    EXPECT_EQ(GetAudioFormatChanges(&current, &proposed), AUDIO_FORMAT_UNCHANGED);
+
+    proposed.fs = 96000;
+    proposed.bitDepthInBytes = 3;
+    EXPECT_EQ(GetAudioFormatChanges(&current, &proposed), FS_CHANGED | BIT_DEPTH_CHANGED);
+
+    proposed = current;
+    proposed.codec = AC3;
+    proposed.dataBurstSize = 1536;
+    EXPECT_EQ(GetAudioFormatChanges(&current, &proposed), CODEC_CHANGED);
+
+    // bursts vary in size within a stream
+    current.codec = AC3;
+    current.dataBurstSize = 1792;
+    EXPECT_EQ(GetAudioFormatChanges(&current, &proposed), AUDIO_FORMAT_UNCHANGED);
+}
+
+namespace
+{
+    // consumer channel status blocks as sent by a player, bytes 0 and 3-4 carry the non audio bit, fs and word length
+    AUDIO_INPUT WithChannelStatus(std::array<uint8_t, 24> status, uint8_t codingType)
+    {
+        AUDIO_INPUT in{};
+        in.channelStatusValid = true;
+        in.channelStatus = status;
+        in.codingType = codingType;
+        return in;
+    }
+
+    constexpr std::array<uint8_t, 24> lpcm48k16{ 0x04, 0x00, 0x00, 0x02, 0x02 };
+    constexpr std::array<uint8_t, 24> ac3At48k{ 0x06, 0x00, 0x00, 0x02, 0x00 };
+    constexpr std::array<uint8_t, 24> hbrAt768k{ 0x06, 0x00, 0x00, 0x09, 0x00 };
+}
+
+TEST(AudioClassification, NonAudioBitMeansBitstream) {
+    Codec codec = PCM;
+    auto in = WithChannelStatus(ac3At48k, 0);
+    EXPECT_EQ(ClassifyAudioInput(&in, &codec), CLASSIFIED_BITSTREAM);
+    EXPECT_EQ(codec, BITSTREAM);
+
+    in = WithChannelStatus(hbrAt768k, 12);
+    EXPECT_EQ(ClassifyAudioInput(&in, &codec), CLASSIFIED_BITSTREAM);
+    EXPECT_EQ(codec, TRUEHD);
+}
+
+TEST(AudioClassification, InfoFrameCodingTypeNamesTheCodec) {
+    Codec codec = PCM;
+    AUDIO_INPUT in{};
+    for (auto [codingType, expected] : { std::pair{ 2, AC3 }, { 7, DTS }, { 10, EAC3 }, { 11, DTSHD }, { 12, TRUEHD }, { 14, BITSTREAM } })
+    {
+        in.codingType = static_cast<uint8_t>(codingType);
+        EXPECT_EQ(ClassifyAudioInput(&in, &codec), CLASSIFIED_BITSTREAM) << codingType;
+        EXPECT_EQ(codec, expected) << codingType;
+    }
+    // one bit audio is not carried as IEC 61937
+    in.codingType = 9;
+    EXPECT_EQ(ClassifyAudioInput(&in, &codec), CLASSIFIED_UNKNOWN);
+}
+
+TEST(AudioClassification, PcmOnlyWhenExplicit) {
+    Codec codec = AC3;
+    auto in = WithChannelStatus(lpcm48k16, 1);
+    EXPECT_EQ(ClassifyAudioInput(&in, &codec), CLASSIFIED_PCM);
+    EXPECT_EQ(codec, PCM);
+
+    // refer to stream header
+    in = WithChannelStatus(lpcm48k16, 0);
+    EXPECT_EQ(ClassifyAudioInput(&in, &codec), CLASSIFIED_UNKNOWN);
+
+    // an invalid status is ignored
+    in = WithChannelStatus(ac3At48k, 1);
+    in.channelStatusValid = false;
+    EXPECT_EQ(ClassifyAudioInput(&in, &codec), CLASSIFIED_UNKNOWN);
+
+    AUDIO_INPUT none{};
+    EXPECT_EQ(ClassifyAudioInput(&none, &codec), CLASSIFIED_UNKNOWN);
+}
+
+TEST(AudioClassification, LoadedIntoTheFormat) {
+    AUDIO_FORMAT f{};
+    auto in = WithChannelStatus(ac3At48k, 2);
+    in.channelValidityMask = 0x01;
+
+    LoadAudioFormat(&f, &in);
+
+    EXPECT_EQ(f.classification, CLASSIFIED_BITSTREAM);
+    EXPECT_EQ(f.codec, AC3);
+}
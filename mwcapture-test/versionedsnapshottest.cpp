@@ -0,0 +1,108 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/versioned_snapshot.h"
+
+namespace
+{
+	// deliberately not a multiple of the word size
+	struct SIGNAL
+	{
+		uint32_t state;
+		uint8_t payload[27];
+		uint64_t stamp;
+	};
+
+	SIGNAL Make(uint64_t value)
+	{
+		SIGNAL s{};
+		s.state = static_cast<uint32_t>(value);
+		for (auto& b : s.payload) b = static_cast<uint8_t>(value);
+		s.stamp = value;
+		return s;
+	}
+
+	bool IsConsistent(const SIGNAL& s)
+	{
+		for (auto b : s.payload)
+		{
+			if (b != static_cast<uint8_t>(s.stamp)) return false;
+		}
+		return s.state == static_cast<uint32_t>(s.stamp);
+	}
+}
+
+TEST(VersionedSnapshot, StartsAtVersionZero) {
+	VersionedSnapshot<SIGNAL> snapshot;
+	SIGNAL s = Make(9);
+	EXPECT_EQ(snapshot.GetVersion(), 0u);
+	EXPECT_EQ(snapshot.Read(&s), 0u);
+	EXPECT_EQ(s.stamp, 0u);
+	EXPECT_TRUE(IsConsistent(s));
+}
+
+TEST(VersionedSnapshot, EachPublishIsANewVersion) {
+	VersionedSnapshot<SIGNAL> snapshot;
+	EXPECT_EQ(snapshot.Publish(Make(5)), 1u);
+	EXPECT_EQ(snapshot.Publish(Make(6)), 2u);
+	EXPECT_EQ(snapshot.GetVersion(), 2u);
+
+	SIGNAL s{};
+	EXPECT_EQ(snapshot.Read(&s), 2u);
+	EXPECT_EQ(s.stamp, 6u);
+	EXPECT_TRUE(IsConsistent(s));
+}
+
+TEST(VersionedSnapshot, ReadersNeverSeeAPartialPublish) {
+	VersionedSnapshot<SIGNAL> snapshot;
+	constexpr uint64_t publishes = 200000;
+	std::atomic<bool> done{ false };
+	std::vector<std::thread> readers;
+	std::atomic<uint64_t> torn{ 0 };
+	std::atomic<uint64_t> backwards{ 0 };
+
+	for (auto r = 0; r < 2; ++r)
+	{
+		readers.emplace_back([&]
+		{
+			uint64_t lastVersion = 0;
+			uint64_t lastStamp = 0;
+			while (!done.load(std::memory_order_acquire))
+			{
+				SIGNAL s{};
+				auto version = snapshot.Read(&s);
+				if (!IsConsistent(s)) torn++;
+				// the value published at version n is n
+				if (version != s.stamp || version < lastVersion || s.stamp < lastStamp) backwards++;
+				lastVersion = version;
+				lastStamp = s.stamp;
+			}
+		});
+	}
+	for (uint64_t i = 1; i <= publishes; ++i)
+	{
+		snapshot.Publish(Make(i));
+	}
+	done.store(true, std::memory_order_release);
+	for (auto& reader : readers) reader.join();
+
+	EXPECT_EQ(torn.load(), 0u);
+	EXPECT_EQ(backwards.load(), 0u);
+	EXPECT_EQ(snapshot.GetVersion(), publishes);
+}
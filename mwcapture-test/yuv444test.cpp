@@ -0,0 +1,170 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../mwcapture/yuv444.h"
+
+namespace
+{
+	constexpr SimdLevel allLevels[] = { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2, SIMD_NEON };
+	// odd pixel counts exercise the scalar tail of the vector kernels
+	constexpr size_t pixelCounts[] = { 1, 3, 4, 7, 8, 9, 15, 16, 17, 33, 1000 };
+
+	std::vector<uint32_t> MakeY410(size_t pixels)
+	{
+		std::vector<uint32_t> image(pixels);
+		uint32_t x = 0x9E3779B9;
+		for (auto& px : image)
+		{
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			px = x;
+		}
+		return image;
+	}
+
+	uint32_t PackY416(const uint16_t* uyva)
+	{
+		return static_cast<uint32_t>(uyva[0] >> 6) | static_cast<uint32_t>(uyva[1] >> 6) << 10
+			| static_cast<uint32_t>(uyva[2] >> 6) << 20 | static_cast<uint32_t>(uyva[3] >> 14) << 30;
+	}
+
+	// an 8 bit pixel promoted to 10 bits with whatever LSBs the card filled in
+	uint32_t PromoteAyuv(uint32_t vuya, uint32_t lsbs)
+	{
+		auto v = vuya & 0xFF;
+		auto u = vuya >> 8 & 0xFF;
+		auto y = vuya >> 16 & 0xFF;
+		auto a = vuya >> 30;
+		return (u << 2 | (lsbs & 3)) | (y << 2 | (lsbs >> 2 & 3)) << 10 | (v << 2 | (lsbs >> 4 & 3)) << 20 | a << 30;
+	}
+}
+
+TEST(Yuv444, UnpacksY410ToMsbAlignedWords) {
+	// U 0x3FF Y 0x200 V 0x001 A 3
+	std::vector<uint32_t> src{ 0x3FF | 0x200 << 10 | 0x001 << 20 | 3u << 30, 0 };
+	std::vector<uint16_t> dst(8, 0xBEEF);
+
+	UnpackY410ToY416(src.data(), dst.data(), src.size());
+
+	EXPECT_EQ(dst, (std::vector<uint16_t>{ 0xFFC0, 0x8000, 0x0040, 0xFFFF, 0, 0, 0, 0 }));
+}
+
+TEST(Yuv444, PacksY410ToVuyaBytes) {
+	// U 0x3FF Y 0x200 V 0x007 A 2
+	std::vector<uint32_t> src{ 0x3FF | 0x200 << 10 | 0x007 << 20 | 2u << 30 };
+	std::vector<uint32_t> dst(1);
+
+	PackY410ToAyuv(src.data(), dst.data(), src.size());
+
+	auto bytes = reinterpret_cast<const uint8_t*>(dst.data());
+	EXPECT_EQ(bytes[0], 0x01);
+	EXPECT_EQ(bytes[1], 0xFF);
+	EXPECT_EQ(bytes[2], 0x80);
+	EXPECT_EQ(bytes[3], 0xAA);
+}
+
+TEST(Yuv444, Y416RoundTripsBitExact) {
+	for (auto level : allLevels)
+	{
+		if (!IsSimdLevelSupported(level)) continue;
+		for (auto pixels : pixelCounts)
+		{
+			auto src = MakeY410(pixels);
+			std::vector<uint16_t> y416(pixels * 4);
+
+			UnpackY410ToY416(src.data(), y416.data(), pixels, level);
+
+			for (size_t i = 0; i < pixels; ++i)
+			{
+				ASSERT_EQ(PackY416(&y416[i * 4]), src[i]) << simdlevel_to_name(level) << " pixel " << i << " of " << pixels;
+				ASSERT_EQ(y416[i * 4] & 0x3F, 0) << simdlevel_to_name(level);
+			}
+		}
+	}
+}
+
+TEST(Yuv444, AyuvRoundTripsBitExact) {
+	for (auto level : allLevels)
+	{
+		if (!IsSimdLevelSupported(level)) continue;
+		for (auto pixels : pixelCounts)
+		{
+			auto ayuv = MakeY410(pixels);
+			for (auto& px : ayuv)
+			{
+				// only the 4 alpha levels Y410 can carry survive the trip
+				px = (px & 0x00FFFFFF) | (px >> 30) * 0x55000000;
+			}
+			std::vector<uint32_t> y410(pixels);
+			for (size_t i = 0; i < pixels; ++i) y410[i] = PromoteAyuv(ayuv[i], static_cast<uint32_t>(i * 11));
+			std::vector<uint32_t> dst(pixels);
+
+			PackY410ToAyuv(y410.data(), dst.data(), pixels, level);
+
+			EXPECT_EQ(dst, ayuv) << simdlevel_to_name(level) << " " << pixels << " pixels";
+		}
+	}
+}
+
+TEST(Yuv444, VectorKernelsMatchScalar) {
+	for (auto level : allLevels)
+	{
+		if (!IsSimdLevelSupported(level)) continue;
+		for (auto pixels : pixelCounts)
+		{
+			auto src = MakeY410(pixels);
+			std::vector<uint16_t> y416(pixels * 4), expectedY416(pixels * 4);
+			std::vector<uint32_t> ayuv(pixels), expectedAyuv(pixels);
+
+			UnpackY410ToY416(src.data(), y416.data(), pixels, level);
+			UnpackY410ToY416Scalar(src.data(), expectedY416.data(), pixels);
+			PackY410ToAyuv(src.data(), ayuv.data(), pixels, level);
+			PackY410ToAyuvScalar(src.data(), expectedAyuv.data(), pixels);
+
+			EXPECT_EQ(y416, expectedY416) << simdlevel_to_name(level) << " " << pixels << " pixels";
+			EXPECT_EQ(ayuv, expectedAyuv) << simdlevel_to_name(level) << " " << pixels << " pixels";
+		}
+	}
+}
+
+TEST(Yuv444, ConvertsPaddedFramesByRowBand) {
+	constexpr uint32_t cx = 1918;
+	constexpr uint32_t cy = 1081;
+	constexpr uint32_t srcLineLength = 1920 * 4;
+	auto src = MakeY410(static_cast<size_t>(srcLineLength / 4) * cy);
+	auto srcBytes = reinterpret_cast<const uint8_t*>(src.data());
+	RowBandWorkers workers(3);
+
+	for (auto output : { YUV444_Y410, YUV444_Y416, YUV444_AYUV })
+	{
+		auto dstLineLength = (cx + 4) * GetYuv444BytesPerPixel(output);
+		std::vector<uint8_t> dst(static_cast<size_t>(dstLineLength) * cy, 0xCD);
+
+		ConvertY410(&workers, output, srcBytes, srcLineLength, dst.data(), dstLineLength, cx, cy);
+
+		for (uint32_t row = 0; row < cy; row += 180)
+		{
+			std::vector<uint8_t> expected(static_cast<size_t>(cx) * GetYuv444BytesPerPixel(output));
+			ConvertY410Row(output, srcBytes + static_cast<size_t>(row) * srcLineLength, expected.data(), cx, SIMD_SCALAR);
+			auto actual = dst.data() + static_cast<size_t>(row) * dstLineLength;
+			EXPECT_TRUE(std::equal(expected.begin(), expected.end(), actual)) << yuv444output_to_name(output) << " row " << row;
+			// the padding at the end of each line is left alone
+			EXPECT_EQ(actual[expected.size()], 0xCD) << yuv444output_to_name(output) << " row " << row;
+		}
+	}
+}
@@ -0,0 +1,122 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "audio_format.h"
+
+// CTA-861-G Table 24
+Codec GetCodecFromAudioCodingType(uint8_t codingType)
+{
+	switch (codingType)
+	{
+	case 1: return PCM;
+	case 2: return AC3;
+	case 7: return DTS;
+	case 10: return EAC3;
+	case 11: return DTSHD;
+	case 12: return TRUEHD;
+	default: return BITSTREAM;
+	}
+}
+
+AudioClassification ClassifyAudioInput(const AUDIO_INPUT* audioInput, Codec* codec)
+{
+	// IEC 60958-3 byte 0 bit 1 is set for non audio (i.e. IEC 61937) content in both the consumer and professional formats
+	auto statusSaysNotLpcm = audioInput->channelStatusValid && (audioInput->channelStatus[0] & 0x02) != 0;
+	auto statusSaysLpcm = audioInput->channelStatusValid && !statusSaysNotLpcm;
+	// 0 = refer to stream header, 9 = one bit audio and 13 = DST are neither LPCM nor carried by IEC 61937
+	auto codingType = audioInput->codingType;
+	auto infoFrameSaysCompressed = codingType >= 2 && codingType != 9 && codingType != 13;
+
+	if (statusSaysNotLpcm || infoFrameSaysCompressed || !audioInput->lpcm)
+	{
+		*codec = infoFrameSaysCompressed ? GetCodecFromAudioCodingType(codingType) : BITSTREAM;
+		return CLASSIFIED_BITSTREAM;
+	}
+	*codec = PCM;
+	return statusSaysLpcm && codingType == 1 ? CLASSIFIED_PCM : CLASSIFIED_UNKNOWN;
+}
+
+void LoadAudioFormat(AUDIO_FORMAT* audioFormat, const AUDIO_INPUT* audioInput)
+{
+	auto currentChannelAlloc = audioFormat->channelAllocation;
+	auto currentChannelMask = audioFormat->channelValidityMask;
+	audioFormat->fs = audioInput->fs;
+	audioFormat->bitDepth = audioInput->bitsPerSample;
+	audioFormat->bitDepthInBytes = audioFormat->bitDepth / 8;
+	audioFormat->classification = ClassifyAudioInput(audioInput, &audioFormat->codec);
+	audioFormat->sampleInterval = 10000000.0 / audioFormat->fs;
+	audioFormat->channelAllocation = audioInput->channelAllocation;
+	audioFormat->channelValidityMask = audioInput->channelValidityMask;
+
+	if (audioFormat->channelAllocation == currentChannelAlloc && audioFormat->channelValidityMask == currentChannelMask)
+	{
+		// no change, leave untouched [inputChannelCount, outputChannelCount, channelMask, channelOffsets]
+	}
+	else
+	{
+		auto channelAllocation = GetChannelAllocation(audioFormat->channelAllocation, audioFormat->channelValidityMask);
+		audioFormat->channelAllocationInfo = channelAllocation;
+		if (channelAllocation)
+		{
+			audioFormat->inputChannelCount = channelAllocation->inputChannelCount;
+			audioFormat->outputChannelCount = channelAllocation->outputChannelCount;
+			audioFormat->channelMask = channelAllocation->channelMask;
+			audioFormat->channelOffsets = channelAllocation->channelOffsets;
+			audioFormat->lfeChannelIndex = channelAllocation->lfeChannelIndex;
+			audioFormat->channelLayout = channelAllocation->channelLayout;
+
+			// CEA-861-E Table 31
+			audioFormat->lfeLevelAdjustment = audioInput->lfePlaybackLevel == 0x2 ? minus_10db : unity;
+		}
+		else
+		{
+			audioFormat->inputChannelCount = 0;
+			audioFormat->outputChannelCount = 0;
+			audioFormat->channelOffsets.fill(not_present);
+			audioFormat->lfeChannelIndex = not_present;
+		}
+	}
+	audioFormat->remapPlan = GetPcmRemapPlan(audioFormat->channelAllocationInfo, audioFormat->bitDepthInBytes);
+	audioFormat->framesPerSample = GetPcmFramesPerSample(audioFormat->fs, minAudioSampleDuration);
+}
+
+uint16_t GetAudioFormatChanges(const AUDIO_FORMAT* current, const AUDIO_FORMAT* proposed)
+{
+	uint16_t changes = AUDIO_FORMAT_UNCHANGED;
+	if (current->inputChannelCount != proposed->inputChannelCount)
+	{
+		changes |= INPUT_CHANNEL_COUNT_CHANGED;
+	}
+	if (current->outputChannelCount != proposed->outputChannelCount)
+	{
+		changes |= OUTPUT_CHANNEL_COUNT_CHANGED;
+	}
+	if (current->bitDepthInBytes != proposed->bitDepthInBytes)
+	{
+		changes |= BIT_DEPTH_CHANGED;
+	}
+	if (current->fs != proposed->fs)
+	{
+		changes |= FS_CHANGED;
+	}
+	if (current->codec != proposed->codec)
+	{
+		changes |= CODEC_CHANGED;
+	}
+	if (current->channelAllocation != proposed->channelAllocation)
+	{
+		changes |= CHANNEL_ALLOCATION_CHANGED;
+	}
+	return changes;
+}
@@ -0,0 +1,110 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include "bitstream_header.h"
+#include "channel_allocation.h"
+#include "iec61937.h"
+#include "pcm_remap.h"
+
+// pcm frames are aggregated into samples of at least this duration (in 100ns units), 0 delivers each frame as it is captured
+constexpr int64_t minAudioSampleDuration = 10000000LL / 100;
+constexpr auto unity = 1.0;
+inline const double minus_10db{ std::pow(10.0, -10.0 / 20.0) };
+
+// the parts of the incoming audio signal which determine the output format
+struct AUDIO_INPUT
+{
+	uint32_t fs{ 48000 };
+	uint8_t bitsPerSample{ 16 };
+	bool lpcm{ true };
+	// CEA-861-E audio infoframe fields
+	uint8_t channelAllocation{ 0x00 };
+	uint8_t lfePlaybackLevel{ 0x00 };
+	// one bit per channel pair with valid audio
+	uint16_t channelValidityMask{ 0 };
+	// IEC 60958-3 channel status block
+	bool channelStatusValid{ false };
+	std::array<uint8_t, 24> channelStatus{};
+	// CTA-861 audio infoframe coding type, 0 = refer to stream header
+	uint8_t codingType{ 0 };
+};
+
+// what the signal metadata says about the content, the sdk reports all audio as LPCM so this is only a hint
+enum AudioClassification : uint8_t
+{
+	// nothing indicates the content type so the stream has to be scanned
+	CLASSIFIED_UNKNOWN,
+	// the channel status and the infoframe both explicitly say LPCM
+	CLASSIFIED_PCM,
+	// the channel status non audio bit is set and/or the infoframe names a compressed coding type
+	CLASSIFIED_BITSTREAM
+};
+
+struct AUDIO_FORMAT
+{
+	bool pcm{ true };
+	uint32_t fs{ 48000 };
+	double sampleInterval{ 10000000.0 / 48000 };
+	uint8_t bitDepth{ 16 };
+	uint8_t bitDepthInBytes{ 2 };
+	uint8_t channelAllocation{ 0x00 };
+	uint16_t channelValidityMask{ 0 };
+	uint16_t inputChannelCount{ 2 };
+	uint16_t outputChannelCount{ 2 };
+	std::array<int, 8> channelOffsets{ 0, 0, not_present, not_present, not_present, not_present, not_present, not_present };
+	uint16_t channelMask{ speakerStereo };
+	std::string channelLayout;
+	int lfeChannelIndex{ not_present };
+	double lfeLevelAdjustment{ 1.0 };
+	Codec codec{ PCM };
+	// derived from the above attributes
+	const CHANNEL_ALLOCATION* channelAllocationInfo{ GetChannelAllocation(0x00, 0x01) };
+	const PCM_REMAP_PLAN* remapPlan{ GetPcmRemapPlan(channelAllocationInfo, 2) };
+	uint8_t framesPerSample{ GetPcmFramesPerSample(48000, minAudioSampleDuration) };
+	// encoded content only
+	uint16_t dataBurstSize{ 0 };
+	BITSTREAM_HEADER bitstreamHeader{};
+	AudioClassification classification{ CLASSIFIED_UNKNOWN };
+};
+
+// the attributes which differ between two formats, any change means the media type has to be renegotiated
+enum AudioFormatChange : uint16_t
+{
+	AUDIO_FORMAT_UNCHANGED = 0,
+	INPUT_CHANNEL_COUNT_CHANGED = 1 << 0,
+	OUTPUT_CHANNEL_COUNT_CHANGED = 1 << 1,
+	BIT_DEPTH_CHANGED = 1 << 2,
+	FS_CHANGED = 1 << 3,
+	CODEC_CHANGED = 1 << 4,
+	CHANNEL_ALLOCATION_CHANGED = 1 << 5
+};
+
+// maps the CTA-861 audio coding type to the codec carried in the IEC 61937 stream, BITSTREAM if there is no such codec
+Codec GetCodecFromAudioCodingType(uint8_t codingType);
+
+// classifies the input from the IEC 60958 channel status and the infoframe coding type, codec is set to the codec named by
+// the infoframe (or BITSTREAM if none) when the content is classified as bitstream
+AudioClassification ClassifyAudioInput(const AUDIO_INPUT* audioInput, Codec* codec);
+
+// updates audioFormat to describe the input, the channel layout is only recalculated if the allocation has changed
+void LoadAudioFormat(AUDIO_FORMAT* audioFormat, const AUDIO_INPUT* audioInput);
+
+// returns the AudioFormatChange flags which describe the differences between the current and proposed format, the
+// data burst size is not compared as buffers are sized for the largest burst of the codec
+uint16_t GetAudioFormatChanges(const AUDIO_FORMAT* current, const AUDIO_FORMAT* proposed);
@@ -0,0 +1,121 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include "simd.h"
+#include "worker_pool.h"
+
+// the capture card writes AYUV pixels as A Y U V bytes whereas the directshow AYUV layout is V U Y A
+// so the byte order of each 4 byte pixel is reversed in place, the pixel order is left untouched
+
+inline void SwizzleAyuvScalar(uint8_t* data, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; ++i, data += 4)
+	{
+		auto a = data[0];
+		auto y = data[1];
+		data[0] = data[3];
+		data[1] = data[2];
+		data[2] = y;
+		data[3] = a;
+	}
+}
+
+#if defined(HAS_X86_SIMD)
+TARGET_SSE41 inline void SwizzleAyuvSse41(uint8_t* data, size_t pixelCount)
+{
+	const auto mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i = 0;
+	for (; i + 8 <= pixelCount; i += 8)
+	{
+		auto p0 = reinterpret_cast<__m128i*>(data + i * 4);
+		auto p1 = reinterpret_cast<__m128i*>(data + i * 4 + 16);
+		_mm_storeu_si128(p0, _mm_shuffle_epi8(_mm_loadu_si128(p0), mask));
+		_mm_storeu_si128(p1, _mm_shuffle_epi8(_mm_loadu_si128(p1), mask));
+	}
+	SwizzleAyuvScalar(data + i * 4, pixelCount - i);
+}
+
+TARGET_AVX2 inline void SwizzleAyuvAvx2(uint8_t* data, size_t pixelCount)
+{
+	const auto mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i = 0;
+	for (; i + 16 <= pixelCount; i += 16)
+	{
+		auto p0 = reinterpret_cast<__m256i*>(data + i * 4);
+		auto p1 = reinterpret_cast<__m256i*>(data + i * 4 + 32);
+		_mm256_storeu_si256(p0, _mm256_shuffle_epi8(_mm256_loadu_si256(p0), mask));
+		_mm256_storeu_si256(p1, _mm256_shuffle_epi8(_mm256_loadu_si256(p1), mask));
+	}
+	_mm256_zeroupper();
+	SwizzleAyuvScalar(data + i * 4, pixelCount - i);
+}
+#endif
+
+#if defined(HAS_NEON_SIMD)
+inline void SwizzleAyuvNeon(uint8_t* data, size_t pixelCount)
+{
+	size_t i = 0;
+	for (; i + 8 <= pixelCount; i += 8)
+	{
+		vst1q_u8(data + i * 4, vrev32q_u8(vld1q_u8(data + i * 4)));
+		vst1q_u8(data + i * 4 + 16, vrev32q_u8(vld1q_u8(data + i * 4 + 16)));
+	}
+	SwizzleAyuvScalar(data + i * 4, pixelCount - i);
+}
+#endif
+
+inline void SwizzleAyuv(uint8_t* data, size_t pixelCount, SimdLevel level = GetSimdLevel())
+{
+	switch (level)
+	{
+	#if defined(HAS_X86_SIMD)
+	case SIMD_AVX2:
+		SwizzleAyuvAvx2(data, pixelCount);
+		break;
+	case SIMD_SSE41:
+		SwizzleAyuvSse41(data, pixelCount);
+		break;
+	#endif
+	#if defined(HAS_NEON_SIMD)
+	case SIMD_NEON:
+		SwizzleAyuvNeon(data, pixelCount);
+		break;
+	#endif
+	default:
+		SwizzleAyuvScalar(data, pixelCount);
+		break;
+	}
+}
+
+// the calling thread always takes a band so small machines swizzle inline
+inline unsigned int GetAyuvSwizzleWorkerCount()
+{
+	auto cores = std::thread::hardware_concurrency();
+	return cores >= 8 ? 3 : cores >= 4 ? 1 : 0;
+}
+
+// swizzles an image of rows * lineLength bytes, split by row band across the workers
+inline void SwizzleAyuv(RowBandWorkers* workers, uint8_t* data, uint32_t lineLength, uint32_t rows,
+	SimdLevel level = GetSimdLevel())
+{
+	workers->Run(rows, [data, lineLength, level](uint32_t first, uint32_t last)
+	{
+		SwizzleAyuv(data + static_cast<size_t>(first) * lineLength, static_cast<size_t>(last - first) * lineLength / 4, level);
+	});
+}
@@ -0,0 +1,257 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bitstream_header.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	constexpr uint32_t ac3SampleRates[3]{ 48000, 44100, 32000 };
+	// A/52 Table 5.18 nominal bit rate in kbps for each pair of frmsizecod
+	constexpr uint16_t ac3BitRates[19]{ 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 576, 640 };
+	// A/52 Table 5.8 full bandwidth channels for each acmod
+	constexpr uint8_t ac3Channels[8]{ 2, 1, 2, 3, 3, 4, 4, 5 };
+	constexpr uint8_t eac3Blocks[4]{ 1, 2, 3, 6 };
+	constexpr uint32_t dtsSampleRates[16]{ 0, 8000, 16000, 32000, 0, 0, 11025, 22050, 44100, 0, 0, 12000, 24000, 48000, 0, 0 };
+	// TS 102 114 Table 5-7 in bps, 0 = open, variable or lossless
+	constexpr uint32_t dtsBitRates[32]{
+		32000, 56000, 64000, 96000, 112000, 128000, 192000, 224000, 256000, 320000, 384000, 448000, 512000, 576000, 640000, 768000,
+		960000, 1024000, 1152000, 1280000, 1344000, 1408000, 1411200, 1472000, 1536000, 0, 0, 0, 0, 0, 0, 0
+	};
+	// TS 102 114 Table 5-4 channels for each AMODE, user defined modes are unknown
+	constexpr uint8_t dtsChannels[16]{ 1, 2, 2, 2, 2, 3, 3, 4, 4, 5, 6, 6, 6, 7, 8, 8 };
+	constexpr uint32_t dtsHdReferenceClocks[4]{ 32000, 44100, 48000, 0 };
+	// channels in each group of the TrueHD channel arrangement, i.e. L/R, C, LFE, Ls/Rs, Lvh/Rvh, Lc/Rc, Lrs/Rrs, Cs, Ts,
+	// Lsd/Rsd, Lw/Rw, Cvh, LFE2
+	constexpr uint8_t trueHdChannels[13]{ 2, 1, 1, 2, 2, 2, 2, 1, 1, 2, 2, 1, 1 };
+	constexpr uint8_t trueHdLfeGroup = 2;
+	constexpr uint8_t matStartCode[20]{ 0x07, 0x9E, 0x00, 0x03, 0x84, 0x01, 0x01, 0x01, 0x80, 0x00, 0x56, 0xA5, 0x3B, 0xF4, 0x81, 0x83, 0x49, 0x80, 0x77, 0xE0 };
+	constexpr uint32_t matAccessUnits = 24;
+	constexpr uint8_t dtsHdStartCode[10]{ 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0xFE };
+	constexpr uint32_t dtsHdStartCodeLength = 12;
+
+	uint32_t ReadUint32(const uint8_t* buf)
+	{
+		return static_cast<uint32_t>(buf[0]) << 24 | static_cast<uint32_t>(buf[1]) << 16 | static_cast<uint32_t>(buf[2]) << 8 | buf[3];
+	}
+
+	uint32_t GetAc3FrameSizeInBytes(uint8_t fscod, uint8_t frmsizecod)
+	{
+		uint32_t kbps = ac3BitRates[frmsizecod >> 1];
+		switch (fscod)
+		{
+		case 0: return kbps * 4;
+		case 1: return (kbps * 1536 * 1000 / 44100 / 16 + (frmsizecod & 1)) * 2;
+		default: return kbps * 6;
+		}
+	}
+
+	uint32_t GetBitRate(uint32_t bytes, uint32_t samples, uint32_t sampleRate)
+	{
+		return samples == 0 ? 0 : static_cast<uint32_t>(static_cast<uint64_t>(bytes) * 8 * sampleRate / samples);
+	}
+}
+
+bool ParseAc3Header(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header)
+{
+	BitReader reader(burst, len);
+	if (reader.Read(16) != 0x0B77) return false;
+	reader.Skip(16); // crc1
+	auto fscod = static_cast<uint8_t>(reader.Read(2));
+	auto frmsizecod = static_cast<uint8_t>(reader.Read(6));
+	auto bsid = reader.Read(5);
+	reader.Skip(3); // bsmod
+	auto acmod = reader.Read(3);
+	if (fscod == 3 || frmsizecod > 37 || bsid > 10) return false;
+	if ((acmod & 1) && acmod != 1) reader.Skip(2); // cmixlev
+	if (acmod & 4) reader.Skip(2); // surmixlev
+	if (acmod == 2) reader.Skip(2); // dsurmod
+	auto lfeon = reader.Read(1) == 1;
+	if (reader.HasOverrun()) return false;
+
+	header->codec = AC3;
+	header->samplesPerBurst = 1536;
+	header->sampleRate = ac3SampleRates[fscod];
+	header->bitRate = ac3BitRates[frmsizecod >> 1] * 1000U;
+	header->channelCount = static_cast<uint8_t>(ac3Channels[acmod] + (lfeon ? 1 : 0));
+	header->lfe = lfeon;
+	// the rate can change between frames without a new preamble so allow for the highest
+	header->maxBurstSize = GetAc3FrameSizeInBytes(fscod, 37);
+	return true;
+}
+
+bool ParseEac3Header(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header)
+{
+	uint32_t samples = 0;
+	uint32_t sampleRate = 0;
+	uint8_t channelCount = 0;
+	bool lfe = false;
+	uint32_t pos = 0;
+	while (pos + 6 <= len)
+	{
+		BitReader reader(burst + pos, len - pos);
+		if (reader.Read(16) != 0x0B77) break;
+		auto strmtyp = reader.Read(2);
+		auto substreamid = reader.Read(3);
+		auto frameSize = (reader.Read(11) + 1) * 2;
+		auto fscod = reader.Read(2);
+		auto fscod2OrBlocks = reader.Read(2);
+		auto acmod = reader.Read(3);
+		auto lfeon = reader.Read(1) == 1;
+		auto bsid = reader.Read(5);
+		if (strmtyp == 3 || bsid <= 10 || bsid > 16 || (fscod == 3 && fscod2OrBlocks == 3)) break;
+
+		// only the independent substream 0 frames add to the duration, the others carry more channels or programs
+		if (strmtyp != 1 && substreamid == 0)
+		{
+			auto frameRate = fscod == 3 ? ac3SampleRates[fscod2OrBlocks] / 2 : ac3SampleRates[fscod];
+			if (sampleRate == 0)
+			{
+				sampleRate = frameRate;
+				channelCount = static_cast<uint8_t>(ac3Channels[acmod] + (lfeon ? 1 : 0));
+				lfe = lfeon;
+			}
+			else if (frameRate != sampleRate)
+			{
+				break;
+			}
+			samples += (fscod == 3 ? 6 : eac3Blocks[fscod2OrBlocks]) * 256U;
+		}
+		pos += frameSize;
+	}
+	if (samples == 0) return false;
+
+	header->codec = EAC3;
+	header->samplesPerBurst = samples;
+	header->sampleRate = sampleRate;
+	header->bitRate = GetBitRate(pos < len ? pos : len, samples, sampleRate);
+	header->channelCount = channelCount;
+	header->lfe = lfe;
+	header->maxBurstSize = GetIEC61937RepetitionPeriodInBytes(EAC3);
+	return true;
+}
+
+bool ParseDtsHeader(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header)
+{
+	BitReader reader(burst, len);
+	if (reader.Read(32) != 0x7FFE8001) return false;
+	reader.Skip(1 + 5 + 1); // ftype, short, cpf
+	auto nblks = reader.Read(7);
+	auto fsize = reader.Read(14);
+	auto amode = reader.Read(6);
+	auto sfreq = reader.Read(4);
+	auto rate = reader.Read(5);
+	reader.Skip(1 + 1 + 1 + 1 + 1 + 3 + 1 + 1); // fixed bit, dynf, timef, auxf, hdcd, ext_audio_id, ext_audio, aspf
+	auto lff = reader.Read(2);
+	if (reader.HasOverrun() || nblks < 5 || fsize < 95 || dtsSampleRates[sfreq] == 0 || lff == 3) return false;
+
+	header->codec = DTS;
+	header->samplesPerBurst = (nblks + 1) * 32;
+	header->sampleRate = dtsSampleRates[sfreq];
+	header->bitRate = dtsBitRates[rate];
+	header->lfe = lff != 0;
+	header->channelCount = amode < 16 ? static_cast<uint8_t>(dtsChannels[amode] + (header->lfe ? 1 : 0)) : 0;
+	// IEC 61937-5 type I, II and III bursts repeat every frame of 512, 1024 or 2048 samples of the stereo stream
+	header->maxBurstSize = std::min(header->samplesPerBurst * 4, GetIEC61937RepetitionPeriodInBytes(DTS));
+	return true;
+}
+
+bool ParseDtsHdHeader(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header)
+{
+	if (len >= dtsHdStartCodeLength && memcmp(burst, dtsHdStartCode, sizeof(dtsHdStartCode)) == 0)
+	{
+		burst += dtsHdStartCodeLength;
+		len -= dtsHdStartCodeLength;
+	}
+	BITSTREAM_HEADER parsed;
+	if (!ParseDtsHeader(burst, len, &parsed))
+	{
+		// no core so the duration comes from the extension substream
+		BitReader reader(burst, len);
+		if (reader.Read(32) != 0x64582025) return false;
+		reader.Skip(8 + 2); // user defined, nExtSSIndex
+		auto longHeader = reader.Read(1) == 1;
+		reader.Skip(longHeader ? 12 + 20 : 8 + 16); // header and frame size
+		auto staticFields = reader.Read(1) == 1;
+		auto referenceClock = reader.Read(2);
+		auto frameDuration = reader.Read(3);
+		if (reader.HasOverrun() || !staticFields || dtsHdReferenceClocks[referenceClock] == 0) return false;
+		parsed.samplesPerBurst = 512 * (frameDuration + 1);
+		parsed.sampleRate = dtsHdReferenceClocks[referenceClock];
+	}
+	header->codec = DTSHD;
+	header->samplesPerBurst = parsed.samplesPerBurst;
+	header->sampleRate = parsed.sampleRate;
+	// the core rate says nothing about the (variable rate) extension
+	header->bitRate = GetBitRate(len, parsed.samplesPerBurst, parsed.sampleRate);
+	header->channelCount = parsed.channelCount;
+	header->lfe = parsed.lfe;
+	header->maxBurstSize = GetIEC61937RepetitionPeriodInBytes(DTSHD);
+	return true;
+}
+
+bool ParseTrueHdHeader(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header)
+{
+	if (len < sizeof(matStartCode) || memcmp(burst, matStartCode, sizeof(matStartCode)) != 0) return false;
+	// the first access unit need not carry a major sync so search for one, each is format_sync 0xF8726FBA followed by
+	// format_info and the 0xB752 signature
+	for (uint32_t pos = sizeof(matStartCode) + 4; pos + 16 <= len; ++pos)
+	{
+		if (burst[pos] != 0xF8 || ReadUint32(burst + pos) != 0xF8726FBA || burst[pos + 8] != 0xB7 || burst[pos + 9] != 0x52)
+		{
+			continue;
+		}
+		BitReader reader(burst + pos + 4, 12);
+		auto ratebits = reader.Read(4);
+		reader.Skip(4 + 2 + 2);
+		auto arrangement6 = reader.Read(5);
+		reader.Skip(2);
+		auto arrangement8 = reader.Read(13);
+		reader.Skip(16 + 16 + 16 + 1); // signature, flags, reserved, variable_rate
+		auto peakDataRate = reader.Read(15);
+		if (ratebits == 0xF || (ratebits & 7) > 2) continue;
+
+		auto arrangement = arrangement8 != 0 ? arrangement8 : arrangement6;
+		uint8_t channelCount = 0;
+		for (uint8_t group = 0; group < 13; ++group)
+		{
+			if (arrangement & 1U << group) channelCount += trueHdChannels[group];
+		}
+		header->codec = TRUEHD;
+		header->sampleRate = (ratebits & 8 ? 44100U : 48000U) << (ratebits & 7);
+		// each access unit is 1/1200s (40 samples at 48kHz)
+		header->samplesPerBurst = matAccessUnits * (40U << (ratebits & 7));
+		header->bitRate = static_cast<uint32_t>((static_cast<uint64_t>(peakDataRate) * header->sampleRate + 8) >> 4);
+		header->channelCount = channelCount;
+		header->lfe = (arrangement & 1U << trueHdLfeGroup) != 0;
+		header->maxBurstSize = GetIEC61937RepetitionPeriodInBytes(TRUEHD);
+		return true;
+	}
+	return false;
+}
+
+bool ParseBitstreamHeader(Codec codec, const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header)
+{
+	switch (codec)
+	{
+	case AC3: return ParseAc3Header(burst, len, header);
+	case EAC3: return ParseEac3Header(burst, len, header);
+	case DTS: return ParseDtsHeader(burst, len, header);
+	case DTSHD: return ParseDtsHdHeader(burst, len, header);
+	case TRUEHD: return ParseTrueHdHeader(burst, len, header);
+	default: return false;
+	}
+}
@@ -0,0 +1,102 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstdint>
+#include "iec61937.h"
+
+// what the codec frame headers in a data burst say about the audio it carries
+struct BITSTREAM_HEADER
+{
+	Codec codec{ PCM };
+	// audio samples (per channel) carried by the burst at sampleRate
+	uint32_t samplesPerBurst{ 0 };
+	uint32_t sampleRate{ 0 };
+	// bits/s, the peak rate for TrueHD and the rate of this burst for the other variable rate codecs, 0 if unknown
+	uint32_t bitRate{ 0 };
+	// channels of the core or independent substream (i.e. excluding any extension), 0 if unknown
+	uint8_t channelCount{ 0 };
+	bool lfe{ false };
+	// the largest burst a stream in this configuration can carry
+	uint32_t maxBurstSize{ 0 };
+};
+
+// reads big endian bit fields from a buffer, reads past the end return 0 and set the overrun flag
+class BitReader
+{
+public:
+	BitReader(const uint8_t* buf, uint32_t len) :
+		mBuf(buf),
+		mLen(len)
+	{
+	}
+
+	uint32_t Read(uint8_t bits)
+	{
+		uint64_t value = 0;
+		for (uint8_t i = 0; i < bits; ++i, ++mPos)
+		{
+			auto byteIdx = mPos >> 3;
+			if (byteIdx >= mLen)
+			{
+				mOverrun = true;
+				value <<= bits - i;
+				mPos += bits - i;
+				break;
+			}
+			value = value << 1 | (mBuf[byteIdx] >> (7 - (mPos & 7)) & 1);
+		}
+		return static_cast<uint32_t>(value);
+	}
+
+	void Skip(uint32_t bits)
+	{
+		mPos += bits;
+		if (mPos > mLen * 8ULL) mOverrun = true;
+	}
+
+	bool HasOverrun() const
+	{
+		return mOverrun;
+	}
+
+private:
+	const uint8_t* mBuf;
+	uint32_t mLen;
+	uint64_t mPos{ 0 };
+	bool mOverrun{ false };
+};
+
+// each parser reads the (big endian) payload of a data burst of its codec, as collected by BitstreamParser, and returns
+// false if it does not start with a valid frame header. Nothing is allocated and only the headers are read.
+
+// ATSC A/52 section 5.4.1, one syncframe of 1536 samples
+bool ParseAc3Header(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header);
+// ATSC A/52 annex E, sums the samples of the independent substream frames packed into the burst
+bool ParseEac3Header(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header);
+// ETSI TS 102 114 section 5.3, the 16 bit big endian core frame only
+bool ParseDtsHeader(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header);
+// IEC 61937-5 type IV, the core if there is one otherwise the static fields of the extension substream header
+bool ParseDtsHdHeader(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header);
+// IEC 61937-9 MAT frame of 24 access units, the rate and channels come from the first major sync in the frame
+bool ParseTrueHdHeader(const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header);
+
+// parses the burst with the parser for the codec identified by its preamble
+bool ParseBitstreamHeader(Codec codec, const uint8_t* burst, uint32_t len, BITSTREAM_HEADER* header);
+
+// the duration of the audio carried by the burst in 100ns units, 0 if unknown
+constexpr int64_t GetBurstDuration(const BITSTREAM_HEADER* header)
+{
+	return header->sampleRate == 0 ? 0 : static_cast<int64_t>(header->samplesPerBurst) * 10000000LL / header->sampleRate;
+}
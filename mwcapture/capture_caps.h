@@ -0,0 +1,117 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// the formats a video pin offers through IAMStreamConfig, i.e. every combination of pixel format, size and frame
+// rate the card can capture in
+
+// frame intervals (in 100ns) closer than this are the same rate
+constexpr int64_t captureCapIntervalTolerance = 100;
+// smallest source area which may be cropped from the signal
+constexpr uint32_t minCropWidth = 64;
+constexpr uint32_t minCropHeight = 64;
+
+struct CAPTURE_SIZE
+{
+	uint32_t cx;
+	uint32_t cy;
+};
+
+struct CAPTURE_CAP
+{
+	uint32_t fourcc;
+	uint32_t cx;
+	uint32_t cy;
+	int64_t frameInterval;
+};
+
+inline bool IsSameCaptureCap(const CAPTURE_CAP& a, const CAPTURE_CAP& b)
+{
+	return a.fourcc == b.fourcc && a.cx == b.cx && a.cy == b.cy
+		&& std::llabs(a.frameInterval - b.frameInterval) < captureCapIntervalTolerance;
+}
+
+// the native format followed by every combination of the fourccs, sizes and frame intervals offered by the device,
+// in the order offered and without duplicates so an index into the result is a stable capability index
+inline std::vector<CAPTURE_CAP> CombineCaptureCaps(const CAPTURE_CAP& native, const std::vector<uint32_t>& fourccs,
+	const std::vector<CAPTURE_SIZE>& sizes, const std::vector<int64_t>& frameIntervals)
+{
+	std::vector<CAPTURE_CAP> caps{ native };
+	for (auto fourcc : fourccs)
+	{
+		for (const auto& size : sizes)
+		{
+			if (size.cx == 0 || size.cy == 0) continue;
+			for (auto frameInterval : frameIntervals)
+			{
+				if (frameInterval <= 0) continue;
+				CAPTURE_CAP cap{ fourcc, size.cx, size.cy, frameInterval };
+				auto duplicate = false;
+				for (const auto& existing : caps)
+				{
+					if (IsSameCaptureCap(existing, cap))
+					{
+						duplicate = true;
+						break;
+					}
+				}
+				if (!duplicate) caps.push_back(cap);
+			}
+		}
+	}
+	return caps;
+}
+
+// index of the cap matching the request or -1, a zero frame interval matches any rate
+inline int FindCaptureCap(const std::vector<CAPTURE_CAP>& caps, uint32_t fourcc, uint32_t cx, uint32_t cy,
+	int64_t frameInterval)
+{
+	for (size_t i = 0; i < caps.size(); ++i)
+	{
+		const auto& cap = caps[i];
+		if (cap.fourcc != fourcc || cap.cx != cx || cap.cy != cy) continue;
+		if (frameInterval != 0 && std::llabs(cap.frameInterval - frameInterval) >= captureCapIntervalTolerance) continue;
+		return static_cast<int>(i);
+	}
+	return -1;
+}
+
+// an area of the signal to capture, right and bottom are exclusive
+struct CROP_RECT
+{
+	int32_t left;
+	int32_t top;
+	int32_t right;
+	int32_t bottom;
+};
+
+inline bool IsEmptyCrop(const CROP_RECT& rect)
+{
+	return rect.right <= rect.left || rect.bottom <= rect.top;
+}
+
+// true if the area lies within a cx x cy signal, on even coordinates so no chroma sample is split and is no smaller
+// than the minimum crop
+inline bool IsValidCrop(const CROP_RECT& rect, uint32_t cx, uint32_t cy)
+{
+	if (IsEmptyCrop(rect) || rect.left < 0 || rect.top < 0) return false;
+	if (static_cast<uint32_t>(rect.right) > cx || static_cast<uint32_t>(rect.bottom) > cy) return false;
+	if ((rect.left | rect.top | rect.right | rect.bottom) & 1) return false;
+	return static_cast<uint32_t>(rect.right - rect.left) >= minCropWidth
+		&& static_cast<uint32_t>(rect.bottom - rect.top) >= minCropHeight;
+}
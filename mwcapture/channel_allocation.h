@@ -0,0 +1,337 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+#include "pcm_remap.h"
+
+// HDMI audio channel allocation, https://ia903006.us.archive.org/11/items/CEA-861-E/CEA-861-E.pdf
+
+// WAVEFORMATEXTENSIBLE dwChannelMask bits, output channels must be written in this order
+constexpr uint16_t speakerFrontLeft = 0x1;
+constexpr uint16_t speakerFrontRight = 0x2;
+constexpr uint16_t speakerFrontCenter = 0x4;
+constexpr uint16_t speakerLowFrequency = 0x8;
+constexpr uint16_t speakerBackLeft = 0x10;
+constexpr uint16_t speakerBackRight = 0x20;
+constexpr uint16_t speakerFrontLeftOfCenter = 0x40;
+constexpr uint16_t speakerFrontRightOfCenter = 0x80;
+constexpr uint16_t speakerBackCenter = 0x100;
+constexpr uint16_t speakerSideLeft = 0x200;
+constexpr uint16_t speakerSideRight = 0x400;
+constexpr uint16_t speakerTopCenter = 0x800;
+constexpr uint16_t speakerTopFrontLeft = 0x1000;
+constexpr uint16_t speakerTopFrontCenter = 0x2000;
+constexpr uint16_t speakerTopFrontRight = 0x4000;
+
+constexpr uint16_t speakerStereo = speakerFrontLeft | speakerFrontRight;
+constexpr uint16_t speaker2Point1 = speakerStereo | speakerLowFrequency;
+constexpr uint16_t speaker3Point0 = speakerStereo | speakerFrontCenter;
+constexpr uint16_t speaker3Point1 = speaker3Point0 | speakerLowFrequency;
+constexpr uint16_t speaker5Point1 = speaker3Point1 | speakerBackLeft | speakerBackRight;
+constexpr uint16_t speaker7Point1Surround = speaker5Point1 | speakerSideLeft | speakerSideRight;
+
+// the format of each allocation code
+//   channelOffsets shift each input channel (in HDMI order) to its position in the output (in channel mask order)
+//   remapPlans holds the plan for each bit depth, indexed by bitDepthInBytes - 1
+struct CHANNEL_ALLOCATION
+{
+	const char* channelLayout;
+	uint16_t channelMask;
+	uint8_t inputChannelCount;
+	uint8_t outputChannelCount;
+	std::array<int, 8> channelOffsets;
+	int lfeChannelIndex;
+	std::array<PCM_REMAP_PLAN, pcmInputSlotSizeInBytes> remapPlans;
+};
+
+constexpr CHANNEL_ALLOCATION MakeChannelAllocation(const char* channelLayout, uint16_t channelMask, uint8_t inputChannelCount,
+	uint8_t outputChannelCount, const std::array<int, 8>& channelOffsets, int lfeChannelIndex)
+{
+	CHANNEL_ALLOCATION ca{ channelLayout, channelMask, inputChannelCount, outputChannelCount, channelOffsets, lfeChannelIndex, {} };
+	for (auto i = 0; i < pcmInputSlotSizeInBytes; ++i)
+	{
+		ca.remapPlans[i] = MakePcmRemapPlan(static_cast<uint8_t>(i + 1), inputChannelCount, outputChannelCount, channelOffsets);
+	}
+	return ca;
+}
+
+namespace cea861
+{
+	constexpr auto np = not_present;
+
+	// CEA-861-E Table 28, comments give the speaker in each HDMI channel slot
+	// RL/RR are the surround pair (mapped to side when RLC/RRC are present), RC = back centre,
+	// FCH = top front centre, TC = top centre, FLH/FRH = top front left/right
+	inline constexpr std::array<CHANNEL_ALLOCATION, 0x32> channelAllocations{ {
+	// 0x00 FL FR
+	MakeChannelAllocation("FL FR", speakerStereo,
+		2, 2, { 0, 0, np, np, np, np, np, np }, np),
+	// 0x01 FL FR LFE --
+	MakeChannelAllocation("FL FR LFE", speaker2Point1,
+		4, 3, { 0, 0, 0, np, np, np, np, np }, 2),
+	// 0x02 FL FR -- FC
+	MakeChannelAllocation("FL FR FC", speaker3Point0,
+		4, 3, { 0, 0, np, 0, np, np, np, np }, np),
+	// 0x03 FL FR LFE FC
+	MakeChannelAllocation("FL FR FC LFE", speaker3Point1,
+		4, 4, { 0, 0, 1, -1, np, np, np, np }, 2),
+	// 0x04 FL FR -- -- RC --
+	MakeChannelAllocation("FL FR RC", speakerFrontLeft | speakerFrontRight | speakerBackCenter,
+		6, 3, { 0, 0, np, np, 0, np, np, np }, np),
+	// 0x05 FL FR LFE -- RC --
+	MakeChannelAllocation("FL FR LFE RC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerBackCenter,
+		6, 4, { 0, 0, 0, np, 0, np, np, np }, 2),
+	// 0x06 FL FR -- FC RC --
+	MakeChannelAllocation("FL FR FC RC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter | speakerBackCenter,
+		6, 4, { 0, 0, np, 0, 0, np, np, np }, np),
+	// 0x07 FL FR LFE FC RC --
+	MakeChannelAllocation("FL FR FC LFE RC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackCenter,
+		6, 5, { 0, 0, 1, -1, 0, np, np, np }, 2),
+	// 0x08 FL FR -- -- RL RR
+	MakeChannelAllocation("FL FR RL RR", speakerFrontLeft | speakerFrontRight | speakerBackLeft | speakerBackRight,
+		6, 4, { 0, 0, np, np, 0, 0, np, np }, np),
+	// 0x09 FL FR LFE -- RL RR
+	MakeChannelAllocation("FL FR LFE RL RR", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerBackLeft | speakerBackRight,
+		6, 5, { 0, 0, 0, np, 0, 0, np, np }, 2),
+	// 0x0A FL FR -- FC RL RR
+	MakeChannelAllocation("FL FR FC RL RR", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight,
+		6, 5, { 0, 0, np, 0, 0, 0, np, np }, np),
+	// 0x0B FL FR LFE FC RL RR
+	MakeChannelAllocation("FL FR FC LFE BL BR", speaker5Point1,
+		6, 6, { 0, 0, 1, -1, 0, 0, np, np }, 2),
+	// 0x0C FL FR -- -- RL RR RC --
+	MakeChannelAllocation("FL FR BL BR BC", speakerFrontLeft | speakerFrontRight | speakerBackLeft |
+		speakerBackRight | speakerBackCenter,
+		8, 5, { 0, 0, np, np, 0, 0, 0, np }, np),
+	// 0x0D FL FR LFE -- RL RR RC --
+	MakeChannelAllocation("FL FR LFE BL BR BC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerBackLeft | speakerBackRight | speakerBackCenter,
+		8, 6, { 0, 0, 0, np, 0, 0, 0, np }, 2),
+	// 0x0E FL FR -- FC RL RR RC --
+	MakeChannelAllocation("FL FR FC BL BR BC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight | speakerBackCenter,
+		8, 6, { 0, 0, np, 0, 0, 0, 0, np }, np),
+	// 0x0F FL FR LFE FC RL RR RC --
+	MakeChannelAllocation("FL FR FC LFE BL BR BC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerLowFrequency | speakerBackLeft | speakerBackRight | speakerBackCenter,
+		8, 7, { 0, 0, 1, -1, 0, 0, 0, np }, 2),
+	// 0x10 FL FR -- -- RL RR RLC RRC
+	MakeChannelAllocation("FL FR BL BR SL SR", speakerFrontLeft | speakerFrontRight | speakerSideLeft |
+		speakerSideRight | speakerBackLeft | speakerBackRight,
+		8, 6, { 0, 0, np, np, 2, 2, -2, -2 }, np),
+	// 0x11 FL FR LFE -- RL RR RLC RRC
+	MakeChannelAllocation("FL FR LFE BL BR SL SR", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerSideLeft | speakerSideRight | speakerBackLeft | speakerBackRight,
+		8, 7, { 0, 0, 0, np, 2, 2, -2, -2 }, 2),
+	// 0x12 FL FR -- FC RL RR RLC RRC
+	MakeChannelAllocation("FL FR FC BL BR SL SR", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerSideLeft | speakerSideRight | speakerBackLeft | speakerBackRight,
+		8, 7, { 0, 0, np, 0, 2, 2, -2, -2 }, np),
+	// 0x13 FL FR LFE FC RL RR RLC RRC (RL = side, RLC = back)
+	MakeChannelAllocation("FL FR FC LFE BL BR SL SR", speaker7Point1Surround,
+		8, 8, { 0, 0, 1, -1, 2, 2, -2, -2 }, 2),
+	// 0x14 FL FR -- -- -- -- FLC FRC
+	MakeChannelAllocation("FL FR FLC FRC", speakerFrontLeft | speakerFrontRight | speakerFrontLeftOfCenter |
+		speakerFrontRightOfCenter,
+		8, 4, { 0, 0, np, np, np, np, 0, 0 }, np),
+	// 0x15 FL FR LFE -- -- -- FLC FRC
+	MakeChannelAllocation("FL FR LFE FLC FRC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 5, { 0, 0, 0, np, np, np, 0, 0 }, 2),
+	// 0x16 FL FR -- FC -- -- FLC FRC
+	MakeChannelAllocation("FL FR FC FLC FRC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 5, { 0, 0, np, 0, np, np, 0, 0 }, np),
+	// 0x17 FL FR LFE FC -- -- FLC FRC
+	MakeChannelAllocation("FL FR FC LFE FLC FRC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 6, { 0, 0, 1, -1, np, np, 0, 0 }, 2),
+	// 0x18 FL FR -- -- RC -- FLC FRC
+	MakeChannelAllocation("FL FR RC FLC FRC", speakerFrontLeft | speakerFrontRight | speakerBackCenter |
+		speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 5, { 0, 0, np, np, 2, np, -1, -1 }, np),
+	// 0x19 FL FR LFE -- RC -- FLC FRC
+	MakeChannelAllocation("FL FR LFE RC FLC FRC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerBackCenter | speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 6, { 0, 0, 0, np, 2, np, -1, -1 }, 2),
+	// 0x1A FL FR -- FC RC -- FLC FRC
+	MakeChannelAllocation("FL FR FC RC FLC FRC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackCenter | speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 6, { 0, 0, np, 0, 2, np, -1, -1 }, np),
+	// 0x1B FL FR LFE FC RC -- FLC FRC
+	MakeChannelAllocation("FL FR FC LFE RC FLC FRC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackCenter | speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 7, { 0, 0, 1, -1, 2, np, -1, -1 }, 2),
+	// 0x1C FL FR -- -- RL RR FLC FRC
+	MakeChannelAllocation("FL FR BL BR FLC FRC", speakerFrontLeft | speakerFrontRight | speakerBackLeft |
+		speakerBackRight | speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 6, { 0, 0, np, np, 0, 0, 0, 0 }, np),
+	// 0x1D FL FR LFE -- RL RR FLC FRC
+	MakeChannelAllocation("FL FR LFE BL BR FLC FRC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerBackLeft | speakerBackRight | speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 7, { 0, 0, 0, np, 0, 0, 0, 0 }, 2),
+	// 0x1E FL FR -- FC RL RR FLC FRC
+	MakeChannelAllocation("FL FR FC BL BR FLC FRC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight | speakerFrontLeftOfCenter | speakerFrontRightOfCenter,
+		8, 7, { 0, 0, np, 0, 0, 0, 0, 0 }, np),
+	// 0x1F FL FR LFE FC RL RR FLC FRC
+	MakeChannelAllocation("FL FR FC LFE BL BR FLC FRC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackLeft | speakerBackRight | speakerFrontLeftOfCenter |
+		speakerFrontRightOfCenter,
+		8, 8, { 0, 0, 1, -1, 0, 0, 0, 0 }, 2),
+	// 0x20 FL FR -- FC RL RR FCH --
+	MakeChannelAllocation("FL FR FC BL BR TFC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight | speakerTopFrontCenter,
+		8, 6, { 0, 0, np, 0, 0, 0, 0, np }, np),
+	// 0x21 FL FR LFE FC RL RR FCH --
+	MakeChannelAllocation("FL FR FC LFE BL BR TFC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackLeft | speakerBackRight | speakerTopFrontCenter,
+		8, 7, { 0, 0, 1, -1, 0, 0, 0, np }, 2),
+	// 0x22 FL FR -- FC RL RR -- TC
+	MakeChannelAllocation("FL FR FC BL BR TC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight | speakerTopCenter,
+		8, 6, { 0, 0, np, 0, 0, 0, np, 0 }, np),
+	// 0x23 FL FR LFE FC RL RR -- TC
+	MakeChannelAllocation("FL FR FC LFE BL BR TC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackLeft | speakerBackRight | speakerTopCenter,
+		8, 7, { 0, 0, 1, -1, 0, 0, np, 0 }, 2),
+	// 0x24 FL FR -- -- RL RR FLH FRH
+	MakeChannelAllocation("FL FR BL BR TFL TFR", speakerFrontLeft | speakerFrontRight | speakerBackLeft |
+		speakerBackRight | speakerTopFrontLeft | speakerTopFrontRight,
+		8, 6, { 0, 0, np, np, 0, 0, 0, 0 }, np),
+	// 0x25 FL FR LFE -- RL RR FLH FRH
+	MakeChannelAllocation("FL FR LFE BL BR TFL TFR", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerBackLeft | speakerBackRight | speakerTopFrontLeft | speakerTopFrontRight,
+		8, 7, { 0, 0, 0, np, 0, 0, 0, 0 }, 2),
+	// 0x26 FL FR -- -- RL RR FLW FRW (WIDE not supported by Windows, discarded)
+	MakeChannelAllocation("FL FR BL BR", speakerFrontLeft | speakerFrontRight | speakerBackLeft | speakerBackRight,
+		8, 4, { 0, 0, np, np, 0, 0, np, np }, np),
+	// 0x27 FL FR LFE -- RL RR FLW FRW (WIDE not supported by Windows, discarded)
+	MakeChannelAllocation("FL FR LFE BL BR", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerBackLeft | speakerBackRight,
+		8, 5, { 0, 0, 0, np, 0, 0, np, np }, 2),
+	// 0x28 FL FR -- FC RL RR RC TC
+	MakeChannelAllocation("FL FR FC BL BR BC TC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight | speakerBackCenter | speakerTopCenter,
+		8, 7, { 0, 0, np, 0, 0, 0, 0, 0 }, np),
+	// 0x29 FL FR LFE FC RL RR RC TC
+	MakeChannelAllocation("FL FR FC LFE BL BR BC TC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackLeft | speakerBackRight | speakerBackCenter | speakerTopCenter,
+		8, 8, { 0, 0, 1, -1, 0, 0, 0, 0 }, 2),
+	// 0x2A FL FR -- FC RL RR RC FCH
+	MakeChannelAllocation("FL FR FC BL BR BC TFC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight | speakerBackCenter | speakerTopFrontCenter,
+		8, 7, { 0, 0, np, 0, 0, 0, 0, 0 }, np),
+	// 0x2B FL FR LFE FC RL RR RC FCH
+	MakeChannelAllocation("FL FR FC LFE BL BR BC TFC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackLeft | speakerBackRight | speakerBackCenter | speakerTopFrontCenter,
+		8, 8, { 0, 0, 1, -1, 0, 0, 0, 0 }, 2),
+	// 0x2C FL FR -- FC RL RR FCH TC
+	MakeChannelAllocation("FL FR FC BL BR TFC TC", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight | speakerTopFrontCenter | speakerTopCenter,
+		8, 7, { 0, 0, np, 0, 0, 0, 1, -1 }, np),
+	// 0x2D FL FR LFE FC RL RR FCH TC
+	MakeChannelAllocation("FL FR FC LFE BL BR TFC TC", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackLeft | speakerBackRight | speakerTopFrontCenter | speakerTopCenter,
+		8, 8, { 0, 0, 1, -1, 0, 0, 1, -1 }, 2),
+	// 0x2E FL FR -- FC RL RR FLH FRH
+	MakeChannelAllocation("FL FR FC BL BR TFL TFR", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight | speakerTopFrontLeft | speakerTopFrontRight,
+		8, 7, { 0, 0, np, 0, 0, 0, 0, 0 }, np),
+	// 0x2F FL FR LFE FC RL RR FLH FRH
+	MakeChannelAllocation("FL FR FC LFE BL BR TFL TFR", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackLeft | speakerBackRight | speakerTopFrontLeft | speakerTopFrontRight,
+		8, 8, { 0, 0, 1, -1, 0, 0, 0, 0 }, 2),
+	// 0x30 FL FR -- FC RL RR FLW FRW (WIDE not supported by Windows, discarded)
+	MakeChannelAllocation("FL FR FC BL BR", speakerFrontLeft | speakerFrontRight | speakerFrontCenter |
+		speakerBackLeft | speakerBackRight,
+		8, 5, { 0, 0, np, 0, 0, 0, np, np }, np),
+	// 0x31 FL FR LFE FC RL RR FLW FRW (WIDE not supported by Windows, discarded)
+	MakeChannelAllocation("FL FR FC LFE BL BR", speakerFrontLeft | speakerFrontRight | speakerLowFrequency |
+		speakerFrontCenter | speakerBackLeft | speakerBackRight,
+		8, 6, { 0, 0, 1, -1, 0, 0, np, np }, 2)
+	} };
+
+	// layouts implied by the valid channel pairs, used when there is no allocation code to go on
+	inline constexpr std::array<CHANNEL_ALLOCATION, 4> defaultChannelAllocations{ {
+		MakeChannelAllocation("FL FR", speakerStereo,
+			2, 2, { 0, 0, np, np, np, np, np, np }, np),
+		MakeChannelAllocation("FL FR FC LFE", speaker3Point1,
+			4, 4, { 0, 0, 1, -1, np, np, np, np }, 2),
+		MakeChannelAllocation("FL FR FC LFE BL BR", speaker5Point1,
+			6, 6, { 0, 0, 1, -1, 0, 0, np, np }, 2),
+		MakeChannelAllocation("FL FR FC LFE BL BR SL SR", speaker7Point1Surround,
+			8, 8, { 0, 0, 1, -1, 0, 0, 0, 0 }, 2)
+	} };
+
+	// every present input channel must land on a distinct speaker in the mask
+	constexpr bool IsConsistent(const CHANNEL_ALLOCATION& ca)
+	{
+		auto present = 0;
+		for (auto i = 0; i < ca.inputChannelCount; ++i)
+		{
+			if (ca.channelOffsets[i] != np) present++;
+		}
+		return present == ca.outputChannelCount && std::popcount(ca.channelMask) == ca.outputChannelCount;
+	}
+
+	constexpr bool AreConsistent()
+	{
+		for (const auto& ca : channelAllocations) if (!IsConsistent(ca)) return false;
+		for (const auto& ca : defaultChannelAllocations) if (!IsConsistent(ca)) return false;
+		return true;
+	}
+	static_assert(AreConsistent(), "channel allocation offsets do not match the channel mask");
+}
+
+// finds the format for the given allocation code (from the audio infoframe) and channel validity mask (from the signal status)
+// returns nullptr if no channels are present
+// 0x00 and any unknown code fall back to a layout derived from the number of valid channel pairs
+constexpr const CHANNEL_ALLOCATION* GetChannelAllocation(uint8_t channelAllocation, uint16_t channelValidityMask)
+{
+	if (!(channelValidityMask & 0x01)) return nullptr;
+
+	if (channelAllocation != 0x00 && channelAllocation < cea861::channelAllocations.size())
+	{
+		return &cea861::channelAllocations[channelAllocation];
+	}
+
+	auto pairs = 1;
+	if (channelValidityMask & (0x01 << 1))
+	{
+		pairs++;
+		if (channelValidityMask & (0x01 << 2))
+		{
+			pairs++;
+			if (channelValidityMask & (0x01 << 3)) pairs++;
+		}
+	}
+	return &cea861::defaultChannelAllocations[pairs - 1];
+}
+
+constexpr const PCM_REMAP_PLAN* GetPcmRemapPlan(const CHANNEL_ALLOCATION* channelAllocation, uint8_t bitDepthInBytes)
+{
+	if (channelAllocation == nullptr || bitDepthInBytes < 1 || bitDepthInBytes > pcmInputSlotSizeInBytes)
+	{
+		return &noPcmRemapPlan;
+	}
+	return &channelAllocation->remapPlans[bitDepthInBytes - 1];
+}
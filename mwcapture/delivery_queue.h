@@ -0,0 +1,241 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include "setting_name.h"
+
+// hands items from the capture thread to a dedicated delivery thread so a slow consumer never stalls capture
+//
+// the queue is bounded, when it is full the policy decides whether the oldest queued item or the incoming one is
+// dropped. Dropping the oldest means the producer removes an item the consumer may be about to take so the queue is
+// guarded by a mutex rather than being lock free, items arrive at the frame rate so the lock is uncontended in
+// practice. Every item is passed to the release function once the queue is done with it, whether it was delivered,
+// dropped, flushed or left behind when the queue was destroyed.
+
+enum DeliveryPolicy : uint8_t
+{
+	// favours latency, the consumer always receives the most recent items
+	DELIVERY_DROP_OLDEST,
+	// favours continuity, the consumer receives an unbroken run of items until the queue fills
+	DELIVERY_DROP_NEWEST
+};
+
+inline const char* deliverypolicy_to_name(DeliveryPolicy e)
+{
+	switch (e)
+	{
+	case DELIVERY_DROP_OLDEST: return "DropOldest";
+	case DELIVERY_DROP_NEWEST: return "DropNewest";
+	default: return "unknown";
+	}
+}
+
+// the policy named as per deliverypolicy_to_name, ignoring case, false if no policy has that name
+inline bool ParseDeliveryPolicy(std::string_view name, DeliveryPolicy* policy)
+{
+	return ParseSettingName(name, { DELIVERY_DROP_OLDEST, DELIVERY_DROP_NEWEST }, deliverypolicy_to_name, policy);
+}
+
+struct DELIVERY_QUEUE_STATS
+{
+	uint64_t pushed{ 0 };
+	uint64_t delivered{ 0 };
+	uint64_t dropped{ 0 };
+	uint64_t flushed{ 0 };
+	// items queued now and the most ever queued
+	uint32_t depth{ 0 };
+	uint32_t maxDepth{ 0 };
+};
+
+template <typename T>
+class DeliveryQueue
+{
+public:
+	// deliver returns false if the consumer rejects an item, nothing more is delivered after that
+	using DeliverFn = std::function<bool(T&)>;
+	using ReleaseFn = std::function<void(T&)>;
+
+	DeliveryQueue(uint32_t capacity, DeliveryPolicy policy, DeliverFn deliver, ReleaseFn release) :
+		mCapacity(std::max(capacity, 1u)),
+		mPolicy(policy),
+		mDeliver(std::move(deliver)),
+		mRelease(std::move(release)),
+		mThread([this] { Run(); })
+	{
+	}
+
+	~DeliveryQueue()
+	{
+		{
+			std::lock_guard lck(mMutex);
+			mStop = true;
+		}
+		mItemQueued.notify_all();
+		mThread.join();
+		for (auto& item : mItems) mRelease(item);
+	}
+
+	DeliveryQueue(const DeliveryQueue&) = delete;
+	DeliveryQueue& operator=(const DeliveryQueue&) = delete;
+
+	// queues the item for delivery, returns false if an item had to be dropped to make room for it or if it was dropped
+	// itself. Items pushed after the consumer has failed are released immediately.
+	bool Push(T item)
+	{
+		std::unique_lock lck(mMutex);
+		mStats.pushed++;
+		if (mFailed)
+		{
+			lck.unlock();
+			mRelease(item);
+			return false;
+		}
+		if (mItems.size() >= mCapacity)
+		{
+			mStats.dropped++;
+			if (mPolicy == DELIVERY_DROP_NEWEST)
+			{
+				lck.unlock();
+				mRelease(item);
+				return false;
+			}
+			auto oldest = std::move(mItems.front());
+			mItems.pop_front();
+			mItems.push_back(std::move(item));
+			UpdateDepth();
+			lck.unlock();
+			mItemQueued.notify_one();
+			mRelease(oldest);
+			return false;
+		}
+		mItems.push_back(std::move(item));
+		UpdateDepth();
+		lck.unlock();
+		mItemQueued.notify_one();
+		return true;
+	}
+
+	// discards every queued item and waits for any delivery in progress to complete
+	void Flush()
+	{
+		std::unique_lock lck(mMutex);
+		std::deque<T> flushed;
+		flushed.swap(mItems);
+		mStats.flushed += flushed.size();
+		UpdateDepth();
+		mIdle.wait(lck, [this] { return !mDelivering; });
+		lck.unlock();
+		for (auto& item : flushed) mRelease(item);
+	}
+
+	// waits until every queued item has been delivered (or the consumer has failed)
+	void Drain()
+	{
+		std::unique_lock lck(mMutex);
+		mIdle.wait(lck, [this] { return mFailed || (mItems.empty() && !mDelivering); });
+	}
+
+	// true once the consumer has rejected an item
+	bool HasFailed() const
+	{
+		std::lock_guard lck(mMutex);
+		return mFailed;
+	}
+
+	DELIVERY_QUEUE_STATS GetStats() const
+	{
+		std::lock_guard lck(mMutex);
+		return mStats;
+	}
+
+	uint32_t GetCapacity() const
+	{
+		return mCapacity;
+	}
+
+	DeliveryPolicy GetPolicy() const
+	{
+		return mPolicy;
+	}
+
+private:
+	void UpdateDepth()
+	{
+		mStats.depth = static_cast<uint32_t>(mItems.size());
+		mStats.maxDepth = std::max(mStats.maxDepth, mStats.depth);
+	}
+
+	void Run()
+	{
+		std::unique_lock lck(mMutex);
+		while (true)
+		{
+			mItemQueued.wait(lck, [this] { return mStop || (!mItems.empty() && !mFailed); });
+			if (mStop) return;
+
+			auto item = std::move(mItems.front());
+			mItems.pop_front();
+			UpdateDepth();
+			mDelivering = true;
+			lck.unlock();
+
+			auto delivered = mDeliver(item);
+			mRelease(item);
+
+			lck.lock();
+			mDelivering = false;
+			if (delivered)
+			{
+				mStats.delivered++;
+			}
+			else
+			{
+				// the consumer won't take anything else so the rest of the queue is released now
+				mFailed = true;
+				std::deque<T> rejected;
+				rejected.swap(mItems);
+				mStats.flushed += rejected.size();
+				UpdateDepth();
+				lck.unlock();
+				for (auto& r : rejected) mRelease(r);
+				lck.lock();
+			}
+			mIdle.notify_all();
+		}
+	}
+
+	const uint32_t mCapacity;
+	const DeliveryPolicy mPolicy;
+	DeliverFn mDeliver;
+	ReleaseFn mRelease;
+	mutable std::mutex mMutex;
+	std::condition_variable mItemQueued;
+	std::condition_variable mIdle;
+	std::deque<T> mItems;
+	bool mDelivering{ false };
+	bool mFailed{ false };
+	bool mStop{ false };
+	DELIVERY_QUEUE_STATS mStats{};
+	// last so the queue is fully constructed before the thread starts
+	std::thread mThread;
+};
@@ -0,0 +1,208 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+
+// a clock in 100ns units which follows a device clock without reading it on every call
+//
+// the device is read at a low rate against a free running counter (the CPU performance counter), each read gives the
+// phase error between the device and the clock's model of it. A PI loop steers the model's rate so the phase error
+// is driven to zero, the phase is corrected by slewing the rate rather than stepping the time so the clock stays
+// continuous. Between reads the time is interpolated from the counter. The counter is read either side of the device
+// so a read which was preempted, and so can't be placed accurately on the counter, is discarded.
+//
+// not thread safe, the owner must serialise calls to GetTime.
+
+struct DISCIPLINED_CLOCK_STATS
+{
+	uint64_t samples{ 0 };
+	// samples which took too long to read
+	uint64_t discarded{ 0 };
+	// the model restarted from the device time after the error grew too large
+	uint64_t resyncs{ 0 };
+	bool locked{ false };
+	// rate of the device clock relative to the counter, in parts per million
+	double driftPpm{ 0.0 };
+	// device time less the model time at the last sample, in 100ns units
+	double error{ 0.0 };
+	// rms of the error over recent samples, in 100ns units
+	double rmsError{ 0.0 };
+};
+
+class DisciplinedClock
+{
+public:
+	using TimeSource = std::function<int64_t()>;
+
+	// counter ticks at counterFrequency Hz, device returns 100ns units and is read every sampleIntervalMs. Without a
+	// device the clock is the counter converted to 100ns units.
+	DisciplinedClock(TimeSource counter, int64_t counterFrequency, TimeSource device = {}, uint32_t sampleIntervalMs = 100) :
+		mCounter(std::move(counter)),
+		mDevice(std::move(device)),
+		mCounterFrequency(std::max<int64_t>(counterFrequency, 1)),
+		mNominalTicksPerCount(static_cast<double>(ticksPerSecond) / static_cast<double>(mCounterFrequency)),
+		mSampleInterval(std::max<int64_t>(mCounterFrequency * sampleIntervalMs / 1000, 1)),
+		mMaxReadTime(std::max<int64_t>(mCounterFrequency * maxReadTimeUs / 1000000, 1))
+	{
+	}
+
+	int64_t GetTime()
+	{
+		if (!mDevice)
+		{
+			return CountsToTicks(mCounter());
+		}
+
+		auto now = mCounter();
+		if (!mStats.locked || now - mLastSample >= mSampleInterval)
+		{
+			Sample();
+			now = mCounter();
+		}
+		auto t = Model(now);
+		// interpolation never runs the time backwards, e.g. across a resync
+		if (t < mLastTime)
+		{
+			t = mLastTime;
+		}
+		mLastTime = t;
+		return t;
+	}
+
+	const DISCIPLINED_CLOCK_STATS& GetStats() const
+	{
+		return mStats;
+	}
+
+private:
+	static constexpr int64_t ticksPerSecond = 10000000;
+	// a device read slower than this is too imprecise to use
+	static constexpr int64_t maxReadTimeUs = 200;
+	// an error greater than this is treated as a discontinuity in the device clock
+	static constexpr double resyncThreshold = 100000.0;
+	// the fraction of the phase error removed per sample, the integral gain is chosen for a critically damped loop
+	static constexpr double proportionalGain = 0.1;
+	static constexpr double integralGain = proportionalGain * proportionalGain / 4.0;
+	// the device clock is never this far from the counter
+	static constexpr double maxRate = 0.001;
+	// smoothing applied to the rms error, in samples
+	static constexpr double errorSmoothing = 32.0;
+
+	int64_t CountsToTicks(int64_t counts) const
+	{
+		// split so the multiplication cannot overflow for a counter that has been running for a long time
+		return counts / mCounterFrequency * ticksPerSecond + counts % mCounterFrequency * ticksPerSecond / mCounterFrequency;
+	}
+
+	int64_t Model(int64_t counter) const
+	{
+		return mBaseTime + std::llround(static_cast<double>(counter - mBaseCounter) * mTicksPerCount);
+	}
+
+	void Sample()
+	{
+		auto before = mCounter();
+		auto device = mDevice();
+		auto after = mCounter();
+		if (after - before > mMaxReadTime)
+		{
+			mStats.discarded++;
+			// try again soon rather than waiting for the next interval
+			mLastSample = after - mSampleInterval + mSampleInterval / 16;
+			if (mStats.locked) return;
+		}
+		// the device was read at some point between the 2 counter reads
+		auto counter = before + (after - before) / 2;
+		mLastSample = after;
+		mStats.samples++;
+
+		if (!mStats.locked)
+		{
+			Restart(counter, device);
+			mStats.locked = true;
+			return;
+		}
+
+		auto modelTime = Model(counter);
+		auto error = static_cast<double>(device - modelTime);
+		if (std::abs(error) > resyncThreshold)
+		{
+			mStats.resyncs++;
+			Restart(counter, device);
+			return;
+		}
+
+		auto interval = static_cast<double>(counter - mBaseCounter) * mNominalTicksPerCount;
+		if (interval <= 0.0) return;
+
+		if (mSinceRestart++ == 0)
+		{
+			// the first interval measures the rate directly
+			mRate = std::clamp(static_cast<double>(device - mBaseDevice) / interval - 1.0, -maxRate, maxRate);
+			mBaseTime = device;
+		}
+		else
+		{
+			mRate = std::clamp(mRate + integralGain * error / interval, -maxRate, maxRate);
+			mBaseTime = modelTime;
+		}
+		// rebase on the model so the time is continuous, the proportional term slews out the phase error over the next
+		// interval
+		mBaseCounter = counter;
+		mBaseDevice = device;
+		auto phaseCorrection = mSinceRestart > 1 ? proportionalGain * error / interval : 0.0;
+		mTicksPerCount = mNominalTicksPerCount * (1.0 + mRate + phaseCorrection);
+
+		mStats.driftPpm = mRate * 1000000.0;
+		mStats.error = error;
+		mMeanSquareError += (error * error - mMeanSquareError) / errorSmoothing;
+		mStats.rmsError = std::sqrt(mMeanSquareError);
+	}
+
+	void Restart(int64_t counter, int64_t device)
+	{
+		mBaseCounter = counter;
+		mBaseTime = device;
+		mBaseDevice = device;
+		mTicksPerCount = mNominalTicksPerCount * (1.0 + mRate);
+		mSinceRestart = 0;
+		mMeanSquareError = 0.0;
+		mStats.error = 0.0;
+		mStats.rmsError = 0.0;
+	}
+
+	TimeSource mCounter;
+	TimeSource mDevice;
+	const int64_t mCounterFrequency;
+	const double mNominalTicksPerCount;
+	const int64_t mSampleInterval;
+	const int64_t mMaxReadTime;
+	int64_t mLastSample{ 0 };
+	int64_t mLastTime{ std::numeric_limits<int64_t>::min() };
+	// the model, time = mBaseTime + (counter - mBaseCounter) * mTicksPerCount
+	int64_t mBaseCounter{ 0 };
+	int64_t mBaseTime{ 0 };
+	int64_t mBaseDevice{ 0 };
+	double mTicksPerCount{ 1.0 };
+	double mRate{ 0.0 };
+	uint32_t mSinceRestart{ 0 };
+	double mMeanSquareError{ 0.0 };
+	DISCIPLINED_CLOCK_STATS mStats{};
+};
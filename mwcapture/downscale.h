@@ -0,0 +1,603 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+#include "simd.h"
+#include "worker_pool.h"
+
+// reduces captured frames to the size offered by the preview pin
+// each plane is halved with a 2x2 box filter until the next halving would undershoot the target, any remaining
+// difference in size is then made up with a bilinear filter so the bilinear step never skips source pixels
+
+enum DownscaleSize : uint8_t
+{
+	DOWNSCALE_NONE,
+	DOWNSCALE_HALF,
+	DOWNSCALE_QUARTER,
+	DOWNSCALE_960X540
+};
+
+inline const char* downscalesize_to_name(DownscaleSize e)
+{
+	switch (e)
+	{
+	case DOWNSCALE_NONE: return "Full";
+	case DOWNSCALE_HALF: return "Half";
+	case DOWNSCALE_QUARTER: return "Quarter";
+	case DOWNSCALE_960X540: return "960x540";
+	default: return "unknown";
+	}
+}
+
+// the pixel layouts delivered by the capture card, planes are stored one after the other with the same stride
+enum DownscaleLayout : uint8_t
+{
+	DOWNSCALE_NV12,
+	DOWNSCALE_P010,
+	DOWNSCALE_NV16,
+	DOWNSCALE_P210,
+	DOWNSCALE_AYUV,
+	DOWNSCALE_BGR24,
+	// 32 bit B10G10R10A2
+	DOWNSCALE_BGR10
+};
+
+struct DOWNSCALE_PLANE
+{
+	// 4 means a packed 10:10:10:2 pixel
+	uint8_t sampleBytes;
+	uint8_t components;
+	uint8_t widthDivisor;
+	uint8_t heightDivisor;
+	// low bits which are always clear, i.e. 10 bit samples stored in the high bits of 16
+	uint8_t lowBits;
+};
+
+inline uint32_t GetDownscalePlaneCount(DownscaleLayout layout)
+{
+	return layout == DOWNSCALE_AYUV || layout == DOWNSCALE_BGR24 || layout == DOWNSCALE_BGR10 ? 1 : 2;
+}
+
+inline DOWNSCALE_PLANE GetDownscalePlane(DownscaleLayout layout, uint32_t plane)
+{
+	switch (layout)
+	{
+	case DOWNSCALE_NV12: return plane == 0 ? DOWNSCALE_PLANE{ 1, 1, 1, 1, 0 } : DOWNSCALE_PLANE{ 1, 2, 2, 2, 0 };
+	case DOWNSCALE_P010: return plane == 0 ? DOWNSCALE_PLANE{ 2, 1, 1, 1, 6 } : DOWNSCALE_PLANE{ 2, 2, 2, 2, 6 };
+	case DOWNSCALE_NV16: return plane == 0 ? DOWNSCALE_PLANE{ 1, 1, 1, 1, 0 } : DOWNSCALE_PLANE{ 1, 2, 2, 1, 0 };
+	case DOWNSCALE_P210: return plane == 0 ? DOWNSCALE_PLANE{ 2, 1, 1, 1, 6 } : DOWNSCALE_PLANE{ 2, 2, 2, 1, 6 };
+	case DOWNSCALE_AYUV: return { 1, 4, 1, 1, 0 };
+	case DOWNSCALE_BGR24: return { 1, 3, 1, 1, 0 };
+	case DOWNSCALE_BGR10: return { 4, 1, 1, 1, 0 };
+	}
+	return { 1, 1, 1, 1, 0 };
+}
+
+// the size of a frame downscaled from cx x cy, dimensions are kept even so chroma is never split and the frame is
+// never enlarged
+inline void GetDownscaledSize(DownscaleSize size, uint32_t cx, uint32_t cy, uint32_t* outCx, uint32_t* outCy)
+{
+	uint32_t x = cx;
+	uint32_t y = cy;
+	switch (size)
+	{
+	case DOWNSCALE_HALF:
+		x = cx / 2;
+		y = cy / 2;
+		break;
+	case DOWNSCALE_QUARTER:
+		x = cx / 4;
+		y = cy / 4;
+		break;
+	case DOWNSCALE_960X540:
+		if (cx > 960 && cy > 540)
+		{
+			x = 960;
+			y = 540;
+		}
+		break;
+	default:
+		break;
+	}
+	if (x != cx || y != cy)
+	{
+		x = std::max(x & ~1u, 2u);
+		y = std::max(y & ~1u, 2u);
+	}
+	*outCx = x;
+	*outCy = y;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 2x2 box, each output sample is the rounded mean of the same sample in a 2x2 block of pixels
+//////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+inline T AverageSamples(uint32_t sum, uint32_t lowBits)
+{
+	// rounding at the precision of the samples keeps the always clear low bits clear
+	auto mean = std::min<uint32_t>((sum + (2u << lowBits)) >> 2, std::numeric_limits<T>::max());
+	return static_cast<T>(mean & ~((1u << lowBits) - 1u));
+}
+
+template <typename T>
+inline void HalveRowScalar(const T* row0, const T* row1, T* dst, size_t dstSamples, uint32_t components,
+	uint32_t lowBits)
+{
+	for (size_t i = 0; i < dstSamples; ++i)
+	{
+		auto s = (i / components) * 2 * components + i % components;
+		uint32_t sum = row0[s] + row0[s + components] + row1[s] + row1[s + components];
+		dst[i] = AverageSamples<T>(sum, lowBits);
+	}
+}
+
+inline uint32_t AveragePacked1010102(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+	uint32_t out = 0;
+	for (uint32_t shift : { 0u, 10u, 20u, 30u })
+	{
+		const uint32_t mask = shift == 30 ? 0x3 : 0x3FF;
+		auto sum = (a >> shift & mask) + (b >> shift & mask) + (c >> shift & mask) + (d >> shift & mask);
+		out |= ((sum + 2) >> 2) << shift;
+	}
+	return out;
+}
+
+inline void HalveRowPackedScalar(const uint32_t* row0, const uint32_t* row1, uint32_t* dst, size_t dstPixels)
+{
+	for (size_t i = 0; i < dstPixels; ++i)
+	{
+		dst[i] = AveragePacked1010102(row0[2 * i], row0[2 * i + 1], row1[2 * i], row1[2 * i + 1]);
+	}
+}
+
+#if defined(HAS_X86_SIMD)
+// 8 means of 2x2 blocks from 16 samples of each row, interleaved samples (NV12 chroma, AYUV) are regrouped before the
+// horizontal add
+TARGET_SSE41 inline __m128i HalveBlock8Sse41(const uint8_t* row0, const uint8_t* row1, uint32_t components)
+{
+	auto r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0));
+	auto r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1));
+	auto lo = _mm_add_epi16(_mm_cvtepu8_epi16(r0), _mm_cvtepu8_epi16(r1));
+	auto hi = _mm_add_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(r0, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(r1, 8)));
+	__m128i sum;
+	if (components == 4)
+	{
+		sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+	}
+	else
+	{
+		if (components == 2)
+		{
+			const auto pairs = _mm_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+			lo = _mm_shuffle_epi8(lo, pairs);
+			hi = _mm_shuffle_epi8(hi, pairs);
+		}
+		sum = _mm_hadd_epi16(lo, hi);
+	}
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+TARGET_SSE41 inline void HalveRow8Sse41(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstSamples,
+	uint32_t components)
+{
+	size_t i = 0;
+	if (components != 3)
+	{
+		for (; i + 16 <= dstSamples; i += 16)
+		{
+			auto a = HalveBlock8Sse41(row0 + 2 * i, row1 + 2 * i, components);
+			auto b = HalveBlock8Sse41(row0 + 2 * i + 16, row1 + 2 * i + 16, components);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+		}
+	}
+	HalveRowScalar(row0 + 2 * i, row1 + 2 * i, dst + i, dstSamples - i, components, 0);
+}
+
+// 4 sums of 2x2 blocks from 8 samples of each row
+TARGET_SSE41 inline __m128i HalveBlock16Sse41(const uint16_t* row0, const uint16_t* row1, uint32_t components,
+	__m128i bias)
+{
+	auto r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0));
+	auto r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1));
+	auto lo = _mm_add_epi32(_mm_cvtepu16_epi32(r0), _mm_cvtepu16_epi32(r1));
+	auto hi = _mm_add_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(r0, 8)), _mm_cvtepu16_epi32(_mm_srli_si128(r1, 8)));
+	if (components == 2)
+	{
+		lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+		hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+	}
+	return _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), bias), 2);
+}
+
+TARGET_SSE41 inline void HalveRow16Sse41(const uint16_t* row0, const uint16_t* row1, uint16_t* dst, size_t dstSamples,
+	uint32_t components, uint32_t lowBits)
+{
+	const auto bias = _mm_set1_epi32(static_cast<int>(2u << lowBits));
+	const auto mask = _mm_set1_epi16(static_cast<short>(~((1u << lowBits) - 1u)));
+	size_t i = 0;
+	if (components <= 2)
+	{
+		for (; i + 8 <= dstSamples; i += 8)
+		{
+			auto a = HalveBlock16Sse41(row0 + 2 * i, row1 + 2 * i, components, bias);
+			auto b = HalveBlock16Sse41(row0 + 2 * i + 8, row1 + 2 * i + 8, components, bias);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_and_si128(_mm_packus_epi32(a, b), mask));
+		}
+	}
+	HalveRowScalar(row0 + 2 * i, row1 + 2 * i, dst + i, dstSamples - i, components, lowBits);
+}
+
+// the mean of one field of 4 packed pixels from 8 pixels of each row, left in place
+TARGET_SSE41 inline __m128i HalveField1010102Sse41(__m128i a0, __m128i b0, __m128i a1, __m128i b1, int shift, int bits)
+{
+	const auto mask = _mm_set1_epi32((1 << bits) - 1);
+	const auto count = _mm_cvtsi32_si128(shift);
+	auto lo = _mm_add_epi32(_mm_and_si128(_mm_srl_epi32(a0, count), mask), _mm_and_si128(_mm_srl_epi32(a1, count), mask));
+	auto hi = _mm_add_epi32(_mm_and_si128(_mm_srl_epi32(b0, count), mask), _mm_and_si128(_mm_srl_epi32(b1, count), mask));
+	auto mean = _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), _mm_set1_epi32(2)), 2);
+	return _mm_sll_epi32(mean, count);
+}
+
+TARGET_SSE41 inline void HalveRowPackedSse41(const uint32_t* row0, const uint32_t* row1, uint32_t* dst, size_t dstPixels)
+{
+	size_t i = 0;
+	for (; i + 4 <= dstPixels; i += 4)
+	{
+		auto a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * i));
+		auto b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * i + 4));
+		auto a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * i));
+		auto b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * i + 4));
+		auto out = _mm_or_si128(
+			_mm_or_si128(HalveField1010102Sse41(a0, b0, a1, b1, 0, 10), HalveField1010102Sse41(a0, b0, a1, b1, 10, 10)),
+			_mm_or_si128(HalveField1010102Sse41(a0, b0, a1, b1, 20, 10), HalveField1010102Sse41(a0, b0, a1, b1, 30, 2)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), out);
+	}
+	HalveRowPackedScalar(row0 + 2 * i, row1 + 2 * i, dst + i, dstPixels - i);
+}
+#endif
+
+#if defined(HAS_NEON_SIMD)
+// vld2 splits interleaved pairs so both layouts reduce to adding neighbouring samples
+inline void HalveRow8Neon(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstSamples,
+	uint32_t components)
+{
+	size_t i = 0;
+	if (components == 1)
+	{
+		for (; i + 16 <= dstSamples; i += 16)
+		{
+			auto a = vpadalq_u8(vpaddlq_u8(vld1q_u8(row0 + 2 * i)), vld1q_u8(row1 + 2 * i));
+			auto b = vpadalq_u8(vpaddlq_u8(vld1q_u8(row0 + 2 * i + 16)), vld1q_u8(row1 + 2 * i + 16));
+			vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(a, 2), vrshrn_n_u16(b, 2)));
+		}
+	}
+	else if (components == 2)
+	{
+		for (; i + 16 <= dstSamples; i += 16)
+		{
+			auto r0 = vld2q_u8(row0 + 2 * i);
+			auto r1 = vld2q_u8(row1 + 2 * i);
+			uint8x8x2_t out;
+			out.val[0] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(r0.val[0]), r1.val[0]), 2);
+			out.val[1] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(r0.val[1]), r1.val[1]), 2);
+			vst2_u8(dst + i, out);
+		}
+	}
+	HalveRowScalar(row0 + 2 * i, row1 + 2 * i, dst + i, dstSamples - i, components, 0);
+}
+
+inline void HalveRow16Neon(const uint16_t* row0, const uint16_t* row1, uint16_t* dst, size_t dstSamples,
+	uint32_t components, uint32_t lowBits)
+{
+	const auto bias = vdupq_n_u32(2u << lowBits);
+	const auto mask = vdup_n_u16(static_cast<uint16_t>(~((1u << lowBits) - 1u)));
+	auto mean = [&](uint32x4_t sum) { return vand_u16(vqmovn_u32(vshrq_n_u32(vaddq_u32(sum, bias), 2)), mask); };
+	size_t i = 0;
+	if (components == 1)
+	{
+		for (; i + 8 <= dstSamples; i += 8)
+		{
+			auto a = vpadalq_u16(vpaddlq_u16(vld1q_u16(row0 + 2 * i)), vld1q_u16(row1 + 2 * i));
+			auto b = vpadalq_u16(vpaddlq_u16(vld1q_u16(row0 + 2 * i + 8)), vld1q_u16(row1 + 2 * i + 8));
+			vst1q_u16(dst + i, vcombine_u16(mean(a), mean(b)));
+		}
+	}
+	else if (components == 2)
+	{
+		for (; i + 8 <= dstSamples; i += 8)
+		{
+			auto r0 = vld2q_u16(row0 + 2 * i);
+			auto r1 = vld2q_u16(row1 + 2 * i);
+			uint16x4x2_t out;
+			out.val[0] = mean(vpadalq_u16(vpaddlq_u16(r0.val[0]), r1.val[0]));
+			out.val[1] = mean(vpadalq_u16(vpaddlq_u16(r0.val[1]), r1.val[1]));
+			vst2_u16(dst + i, out);
+		}
+	}
+	HalveRowScalar(row0 + 2 * i, row1 + 2 * i, dst + i, dstSamples - i, components, lowBits);
+}
+#endif
+
+// halves dstPixels pixels of a plane from two of its rows
+inline void HalveRow(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t dstPixels,
+	const DOWNSCALE_PLANE& plane, SimdLevel level = GetSimdLevel())
+{
+	auto samples = dstPixels * plane.components;
+	if (plane.sampleBytes == 4)
+	{
+		auto s0 = reinterpret_cast<const uint32_t*>(row0);
+		auto s1 = reinterpret_cast<const uint32_t*>(row1);
+		auto d = reinterpret_cast<uint32_t*>(dst);
+		#if defined(HAS_X86_SIMD)
+		if (level == SIMD_SSE41 || level == SIMD_AVX2)
+		{
+			HalveRowPackedSse41(s0, s1, d, dstPixels);
+			return;
+		}
+		#endif
+		HalveRowPackedScalar(s0, s1, d, dstPixels);
+	}
+	else if (plane.sampleBytes == 2)
+	{
+		auto s0 = reinterpret_cast<const uint16_t*>(row0);
+		auto s1 = reinterpret_cast<const uint16_t*>(row1);
+		auto d = reinterpret_cast<uint16_t*>(dst);
+		switch (level)
+		{
+		#if defined(HAS_X86_SIMD)
+		// the kernel is bound by memory bandwidth so AVX2 gains nothing over SSE4.1
+		case SIMD_AVX2:
+		case SIMD_SSE41:
+			HalveRow16Sse41(s0, s1, d, samples, plane.components, plane.lowBits);
+			break;
+		#endif
+		#if defined(HAS_NEON_SIMD)
+		case SIMD_NEON:
+			HalveRow16Neon(s0, s1, d, samples, plane.components, plane.lowBits);
+			break;
+		#endif
+		default:
+			HalveRowScalar(s0, s1, d, samples, plane.components, plane.lowBits);
+			break;
+		}
+	}
+	else
+	{
+		switch (level)
+		{
+		#if defined(HAS_X86_SIMD)
+		case SIMD_AVX2:
+		case SIMD_SSE41:
+			HalveRow8Sse41(row0, row1, dst, samples, plane.components);
+			break;
+		#endif
+		#if defined(HAS_NEON_SIMD)
+		case SIMD_NEON:
+			HalveRow8Neon(row0, row1, dst, samples, plane.components);
+			break;
+		#endif
+		default:
+			HalveRowScalar(row0, row1, dst, samples, plane.components, 0);
+			break;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// bilinear, used for whatever is left once halving would undershoot the target so is never more than a 2:1 reduction
+//////////////////////////////////////////////////////////////////////////
+
+// source position of an output pixel in 1/256 of a pixel, pixel centres are aligned
+struct BILINEAR_TAP
+{
+	uint32_t index;
+	uint32_t weight;
+};
+
+inline void GetBilinearTaps(uint32_t srcSize, uint32_t dstSize, std::vector<BILINEAR_TAP>* taps)
+{
+	taps->resize(dstSize);
+	for (uint32_t i = 0; i < dstSize; ++i)
+	{
+		auto pos = static_cast<int64_t>((2 * static_cast<uint64_t>(i) + 1) * srcSize * 256 / (2 * static_cast<uint64_t>(dstSize))) - 128;
+		pos = std::max<int64_t>(pos, 0);
+		auto index = static_cast<uint32_t>(pos >> 8);
+		auto weight = static_cast<uint32_t>(pos & 0xFF);
+		if (index >= srcSize - 1)
+		{
+			index = srcSize - 1;
+			weight = 0;
+		}
+		(*taps)[i] = { index, weight };
+	}
+}
+
+template <typename T>
+inline uint32_t BlendSamples(T a, T b, uint32_t weight)
+{
+	return a * (256 - weight) + b * weight;
+}
+
+template <typename T>
+inline void BilinearRowScalar(const T* row0, const T* row1, uint32_t rowWeight, T* dst,
+	const std::vector<BILINEAR_TAP>& taps, uint32_t components, uint32_t lowBits)
+{
+	const auto last = static_cast<uint32_t>(std::numeric_limits<T>::max()) & ~((1u << lowBits) - 1u);
+	const auto half = lowBits == 0 ? 0u : 1u << (lowBits - 1);
+	for (size_t x = 0; x < taps.size(); ++x)
+	{
+		auto s0 = taps[x].index * components;
+		auto s1 = s0 + (taps[x].weight == 0 ? 0 : components);
+		for (uint32_t c = 0; c < components; ++c)
+		{
+			auto top = BlendSamples(row0[s0 + c], row0[s1 + c], taps[x].weight);
+			auto bottom = BlendSamples(row1[s0 + c], row1[s1 + c], taps[x].weight);
+			// 16 bit samples use all 32 bits at full weight so the blend is split to stay in range
+			auto value = static_cast<uint32_t>((static_cast<uint64_t>(top) * (256 - rowWeight)
+				+ static_cast<uint64_t>(bottom) * rowWeight + (1u << 15)) >> 16);
+			dst[x * components + c] = static_cast<T>(std::min(value + half, last) & ~((1u << lowBits) - 1u));
+		}
+	}
+}
+
+inline void BilinearRowPackedScalar(const uint32_t* row0, const uint32_t* row1, uint32_t rowWeight, uint32_t* dst,
+	const std::vector<BILINEAR_TAP>& taps)
+{
+	for (size_t x = 0; x < taps.size(); ++x)
+	{
+		auto s0 = taps[x].index;
+		auto s1 = s0 + (taps[x].weight == 0 ? 0 : 1);
+		uint32_t out = 0;
+		for (uint32_t shift : { 0u, 10u, 20u, 30u })
+		{
+			const uint32_t mask = shift == 30 ? 0x3 : 0x3FF;
+			auto top = BlendSamples(row0[s0] >> shift & mask, row0[s1] >> shift & mask, taps[x].weight);
+			auto bottom = BlendSamples(row1[s0] >> shift & mask, row1[s1] >> shift & mask, taps[x].weight);
+			out |= ((top * (256 - rowWeight) + bottom * rowWeight + (1u << 15)) >> 16) << shift;
+		}
+		dst[x] = out;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// frame downscaler
+//////////////////////////////////////////////////////////////////////////
+
+// the preview is secondary to the capture stream so takes at most one extra core
+inline unsigned int GetDownscaleWorkerCount()
+{
+	return std::thread::hardware_concurrency() >= 8 ? 1 : 0;
+}
+
+// holds the intermediate planes so a frame can be downscaled without allocating once the sizes settle
+class FrameDownscaler
+{
+public:
+	// downscales a frame of cx x cy pixels to dstCx x dstCy, split by row band across the workers
+	void Downscale(RowBandWorkers* workers, DownscaleLayout layout, const uint8_t* src, uint32_t cx, uint32_t cy,
+		uint32_t lineLength, uint8_t* dst, uint32_t dstCx, uint32_t dstCy, uint32_t dstLineLength,
+		SimdLevel level = GetSimdLevel())
+	{
+		for (uint32_t p = 0; p < GetDownscalePlaneCount(layout); ++p)
+		{
+			auto plane = GetDownscalePlane(layout, p);
+			DownscalePlane(workers, plane,
+				{ src + static_cast<size_t>(lineLength) * cy * p, cx / plane.widthDivisor, cy / plane.heightDivisor, lineLength },
+				{ dst + static_cast<size_t>(dstLineLength) * dstCy * p, dstCx / plane.widthDivisor, dstCy / plane.heightDivisor, dstLineLength },
+				level);
+		}
+	}
+
+private:
+	struct PLANE_VIEW
+	{
+		const uint8_t* data;
+		uint32_t width;
+		uint32_t rows;
+		uint32_t stride;
+	};
+
+	void DownscalePlane(RowBandWorkers* workers, const DOWNSCALE_PLANE& plane, PLANE_VIEW src, PLANE_VIEW dst,
+		SimdLevel level)
+	{
+		auto out = const_cast<uint8_t*>(dst.data);
+		const size_t pixelBytes = static_cast<size_t>(plane.sampleBytes == 4 ? 1 : plane.components) * plane.sampleBytes;
+		if (src.width == dst.width && src.rows == dst.rows)
+		{
+			workers->Run(dst.rows, [src, out, dst, pixelBytes](uint32_t first, uint32_t last)
+			{
+				for (auto y = first; y < last; ++y)
+				{
+					memcpy(out + static_cast<size_t>(y) * dst.stride, src.data + static_cast<size_t>(y) * src.stride,
+						dst.width * pixelBytes);
+				}
+			});
+			return;
+		}
+
+		auto scratch = 0;
+		while (src.width / 2 >= dst.width && src.rows / 2 >= dst.rows)
+		{
+			PLANE_VIEW halved{ nullptr, src.width / 2, src.rows / 2, 0 };
+			if (halved.width == dst.width && halved.rows == dst.rows)
+			{
+				halved.data = dst.data;
+				halved.stride = dst.stride;
+			}
+			else
+			{
+				halved.stride = static_cast<uint32_t>(halved.width * pixelBytes);
+				auto& buffer = mScratch[scratch];
+				scratch ^= 1;
+				buffer.resize(static_cast<size_t>(halved.stride) * halved.rows);
+				halved.data = buffer.data();
+			}
+			auto halvedData = const_cast<uint8_t*>(halved.data);
+			workers->Run(halved.rows, [src, halved, halvedData, &plane, level](uint32_t first, uint32_t last)
+			{
+				for (auto y = first; y < last; ++y)
+				{
+					auto row0 = src.data + static_cast<size_t>(2 * y) * src.stride;
+					HalveRow(row0, row0 + src.stride, halvedData + static_cast<size_t>(y) * halved.stride, halved.width,
+						plane, level);
+				}
+			});
+			src = halved;
+		}
+		if (src.data == dst.data)
+		{
+			return;
+		}
+
+		GetBilinearTaps(src.width, dst.width, &mColumnTaps);
+		GetBilinearTaps(src.rows, dst.rows, &mRowTaps);
+		workers->Run(dst.rows, [this, src, dst, out, &plane](uint32_t first, uint32_t last)
+		{
+			for (auto y = first; y < last; ++y)
+			{
+				auto tap = mRowTaps[y];
+				auto row0 = src.data + static_cast<size_t>(tap.index) * src.stride;
+				auto row1 = tap.weight == 0 ? row0 : row0 + src.stride;
+				auto row = out + static_cast<size_t>(y) * dst.stride;
+				if (plane.sampleBytes == 4)
+				{
+					BilinearRowPackedScalar(reinterpret_cast<const uint32_t*>(row0), reinterpret_cast<const uint32_t*>(row1),
+						tap.weight, reinterpret_cast<uint32_t*>(row), mColumnTaps);
+				}
+				else if (plane.sampleBytes == 2)
+				{
+					BilinearRowScalar(reinterpret_cast<const uint16_t*>(row0), reinterpret_cast<const uint16_t*>(row1),
+						tap.weight, reinterpret_cast<uint16_t*>(row), mColumnTaps, plane.components, plane.lowBits);
+				}
+				else
+				{
+					BilinearRowScalar(row0, row1, tap.weight, row, mColumnTaps, plane.components, 0);
+				}
+			}
+		});
+	}
+
+	std::vector<uint8_t> mScratch[2];
+	std::vector<BILINEAR_TAP> mColumnTaps;
+	std::vector<BILINEAR_TAP> mRowTaps;
+};
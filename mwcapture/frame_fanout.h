@@ -0,0 +1,464 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "delivery_queue.h"
+
+// slot storage is aligned to a cache line so a slot can be handed downstream as a sample buffer
+constexpr size_t captureSlotAlignment = 64;
+
+// a frame read from the device
+struct CAPTURED_FRAME
+{
+	uint8_t* data{ nullptr };
+	int length{ 0 };
+	uint64_t ts{ 0 };
+	// position of the frame in the sequence of frames offered by the producer, gaps indicate dropped frames
+	uint64_t sequence{ 0 };
+};
+
+struct FANOUT_CONSUMER_STATS
+{
+	// frames queued for the consumer
+	uint64_t received{ 0 };
+	// frames the consumer lost to its drop policy because it fell behind
+	uint64_t dropped{ 0 };
+	uint32_t depth{ 0 };
+};
+
+// shares each frame read from the device with every consumer (output pin) without copying it
+//
+// frames live in a fixed set of ref counted slots, the producer fills a free slot and publishes it to every consumer
+// which takes a reference per consumer. A consumer takes frames from its own bounded queue and releases them when it
+// is done, or passes the reference on (e.g. to the sample which delivers the slot downstream) so slots come back in
+// any order. When a queue is full the consumer's policy decides whether its oldest frame or the incoming one is
+// dropped so a slow consumer only loses its own frames, the producer only drops a frame when every slot is held.
+// Neither the producer nor a consumer takes a lock. Each queue is a ring only the producer writes to, the consumer
+// and the producer (when it drops the oldest frame) both advance its head with a CAS, and references are atomic so a
+// slot can be released from any thread. Only subscribing and unsubscribing take the lock.
+class FrameFanout
+{
+public:
+	static constexpr int noSlot = -1;
+	static constexpr int noConsumer = -1;
+	// called by the producer whenever a frame is queued for the consumer so must not unsubscribe
+	using NotifyFn = std::function<void()>;
+
+	explicit FrameFanout(uint32_t maxSlots = 64, uint32_t maxConsumers = 8) :
+		mMaxSlots(maxSlots < 1 ? 1 : maxSlots),
+		mSlots(std::make_unique<SLOT[]>(mMaxSlots)),
+		mMaxConsumers(maxConsumers < 1 ? 1 : maxConsumers),
+		mConsumers(std::make_unique<CONSUMER[]>(mMaxConsumers))
+	{
+	}
+
+	FrameFanout(const FrameFanout&) = delete;
+	FrameFanout& operator=(const FrameFanout&) = delete;
+
+	// ensures there are slotCount slots which can hold frameSize bytes, slots can be added alongside queued or held
+	// ones but storage is only replaced when no slot is held so any queued frames are discarded first. Returns false
+	// if a held slot prevented a required resize. Producer only.
+	bool Reset(uint32_t slotCount, size_t frameSize)
+	{
+		slotCount = slotCount < 1 ? 1 : slotCount > mMaxSlots ? mMaxSlots : slotCount;
+		auto slots = mSlotCount.load(std::memory_order_relaxed);
+		if (frameSize > mFrameCapacity.load(std::memory_order_relaxed) || slotCount < slots)
+		{
+			for (uint32_t i = 0; i < mMaxConsumers; ++i)
+			{
+				WithConsumer(i, [this](CONSUMER& consumer) { DiscardQueued(consumer); });
+			}
+			// claiming every slot stops a consumer acquiring one while its storage is replaced
+			uint32_t claimed = 0;
+			for (; claimed < slots; ++claimed)
+			{
+				uint32_t expected = 0;
+				if (!mSlots[claimed].refs.compare_exchange_strong(expected, 1, std::memory_order_acquire,
+					std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			if (claimed < slots)
+			{
+				for (uint32_t i = 0; i < claimed; ++i) Release(static_cast<int>(i));
+				return false;
+			}
+			// slots stay claimed until they are allocated again
+			mSlotCount.store(0, std::memory_order_release);
+			for (uint32_t i = 0; i < slots; ++i)
+			{
+				mSlots[i].storage.reset();
+				mSlots[i].frame.data = nullptr;
+			}
+			slots = 0;
+			mFrameCapacity.store(frameSize, std::memory_order_relaxed);
+		}
+		// new slots are not held by anyone so can be added alongside held ones
+		auto capacity = mFrameCapacity.load(std::memory_order_relaxed);
+		for (auto i = slots; i < slotCount; ++i)
+		{
+			mSlots[i].storage = std::make_unique<uint8_t[]>(capacity + captureSlotAlignment - 1);
+			auto address = reinterpret_cast<uintptr_t>(mSlots[i].storage.get());
+			auto aligned = (address + captureSlotAlignment - 1) & ~static_cast<uintptr_t>(captureSlotAlignment - 1);
+			mSlots[i].frame.data = reinterpret_cast<uint8_t*>(aligned);
+			mSlots[i].refs.store(0, std::memory_order_release);
+		}
+		if (slotCount > slots)
+		{
+			mSlotCount.store(slotCount, std::memory_order_release);
+		}
+		return true;
+	}
+
+	size_t GetFrameCapacity() const
+	{
+		return mFrameCapacity.load(std::memory_order_relaxed);
+	}
+
+	uint32_t GetSlotCount() const
+	{
+		return mSlotCount.load(std::memory_order_acquire);
+	}
+
+	uint32_t GetMaxSlotCount() const
+	{
+		return mMaxSlots;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//  producer
+	//////////////////////////////////////////////////////////////////////////
+
+	// a free slot, holding whatever was last written to it, with a reference owned by the caller. Returns noSlot if
+	// every slot is held. May also be used by a consumer which needs a buffer when there is no frame to deliver.
+	int Acquire()
+	{
+		auto slotCount = mSlotCount.load(std::memory_order_acquire);
+		auto next = mNextWrite.load(std::memory_order_relaxed);
+		for (uint32_t i = 0; i < slotCount; ++i)
+		{
+			auto slot = (next + i) % slotCount;
+			uint32_t expected = 0;
+			if (mSlots[slot].refs.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				mNextWrite.store((slot + 1) % slotCount, std::memory_order_relaxed);
+				return static_cast<int>(slot);
+			}
+		}
+		return noSlot;
+	}
+
+	// records a frame the producer could not capture because every slot was held
+	void Drop()
+	{
+		mSequence++;
+		mDropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// queues a slot from Acquire, now holding a frame of the given length, for every consumer and drops the caller's
+	// reference
+	void Publish(int slot, int length, uint64_t ts)
+	{
+		auto& frame = mSlots[slot].frame;
+		frame.length = length;
+		frame.ts = ts;
+		frame.sequence = mSequence++;
+		for (uint32_t i = 0; i < mMaxConsumers; ++i)
+		{
+			WithConsumer(i, [this, slot](CONSUMER& consumer)
+			{
+				if (Enqueue(consumer, slot) && consumer.notify) consumer.notify();
+			});
+		}
+		Release(slot);
+	}
+
+	// copies the frame into a free slot and publishes it, returns false if the frame was dropped
+	bool Push(const uint8_t* data, int length, uint64_t ts)
+	{
+		if (length < 0 || static_cast<size_t>(length) > GetFrameCapacity())
+		{
+			mSequence++;
+			mOversized.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		auto slot = Acquire();
+		if (slot == noSlot)
+		{
+			Drop();
+			return false;
+		}
+		memcpy(mSlots[slot].frame.data, data, length);
+		Publish(slot, length, ts);
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//  consumers
+	//////////////////////////////////////////////////////////////////////////
+
+	// adds a consumer which receives every frame published from now on, holding up to depth frames, returns
+	// noConsumer if there are already as many consumers as the fanout allows. A consumer which is noConsumer never
+	// receives anything.
+	int Subscribe(uint32_t depth, DeliveryPolicy policy, NotifyFn notify = {})
+	{
+		std::lock_guard lck(mMutex);
+		uint32_t id = 0;
+		while (id < mMaxConsumers && mConsumers[id].subscribed) id++;
+		if (id == mMaxConsumers)
+		{
+			return noConsumer;
+		}
+		// the producer ignores the consumer until it is active so it can be set up without the producer seeing it
+		auto& consumer = mConsumers[id];
+		consumer.subscribed = true;
+		consumer.depth = depth < 1 ? 1 : depth;
+		if (consumer.ringCapacity < consumer.depth)
+		{
+			consumer.ring = std::make_unique<std::atomic<int>[]>(consumer.depth);
+			consumer.ringCapacity = consumer.depth;
+		}
+		consumer.policy = policy;
+		consumer.notify = std::move(notify);
+		consumer.head.store(0, std::memory_order_relaxed);
+		consumer.tail.store(0, std::memory_order_relaxed);
+		consumer.received.store(0, std::memory_order_relaxed);
+		consumer.dropped.store(0, std::memory_order_relaxed);
+		consumer.active.store(true, std::memory_order_seq_cst);
+		return static_cast<int>(id);
+	}
+
+	// removes the consumer, releasing any frames it has not taken
+	void Unsubscribe(int consumer)
+	{
+		if (consumer == noConsumer) return;
+		std::lock_guard lck(mMutex);
+		auto& c = mConsumers[consumer];
+		c.active.store(false, std::memory_order_seq_cst);
+		// a publish which saw the consumer active finishes with it first, it is never more than a few instructions
+		while (c.publishing.load(std::memory_order_seq_cst) != 0) std::this_thread::yield();
+		DiscardQueued(c);
+		c.notify = nullptr;
+		c.subscribed = false;
+	}
+
+	uint32_t GetConsumerCount() const
+	{
+		std::lock_guard lck(mMutex);
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < mMaxConsumers; ++i)
+		{
+			if (mConsumers[i].subscribed) count++;
+		}
+		return count;
+	}
+
+	// takes the oldest frame queued for the consumer along with its reference, returns noSlot if nothing is queued
+	int Take(int consumer)
+	{
+		if (consumer == noConsumer) return noSlot;
+		auto& c = mConsumers[consumer];
+		auto head = c.head.load(std::memory_order_acquire);
+		while (head != c.tail.load(std::memory_order_acquire))
+		{
+			// a CAS which fails means the producer dropped this frame so the next is tried
+			auto slot = c.ring[head % c.depth].load(std::memory_order_acquire);
+			if (c.head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				return slot;
+			}
+		}
+		return noSlot;
+	}
+
+	bool Empty(int consumer) const
+	{
+		if (consumer == noConsumer) return true;
+		const auto& c = mConsumers[consumer];
+		return c.head.load(std::memory_order_acquire) == c.tail.load(std::memory_order_acquire);
+	}
+
+	FANOUT_CONSUMER_STATS GetStats(int consumer) const
+	{
+		if (consumer == noConsumer) return {};
+		const auto& c = mConsumers[consumer];
+		auto head = c.head.load(std::memory_order_acquire);
+		auto tail = c.tail.load(std::memory_order_acquire);
+		return {
+			c.received.load(std::memory_order_relaxed),
+			c.dropped.load(std::memory_order_relaxed),
+			static_cast<uint32_t>(tail > head ? tail - head : 0)
+		};
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//  holder of a reference
+	//////////////////////////////////////////////////////////////////////////
+
+	// the frame in a slot, remains valid while a reference to the slot is held
+	const CAPTURED_FRAME& Get(int slot) const
+	{
+		return mSlots[slot].frame;
+	}
+
+	void AddRef(int slot)
+	{
+		mSlots[slot].refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// drops a reference, the slot is free again once the last one has gone. May be called from any thread.
+	void Release(int slot)
+	{
+		mSlots[slot].refs.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//  anyone
+	//////////////////////////////////////////////////////////////////////////
+
+	// slots which are queued or held by someone
+	uint32_t GetHeldCount() const
+	{
+		uint32_t held = 0;
+		auto slotCount = mSlotCount.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < slotCount; ++i)
+		{
+			if (mSlots[i].refs.load(std::memory_order_acquire) > 0) held++;
+		}
+		return held;
+	}
+
+	// frames the producer dropped because every slot was held
+	uint64_t GetDroppedCount() const
+	{
+		return mDropped.load(std::memory_order_relaxed);
+	}
+
+	// frames dropped because they did not fit in a slot
+	uint64_t GetOversizedCount() const
+	{
+		return mOversized.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct SLOT
+	{
+		// unallocated slots are claimed so they are never acquired
+		std::atomic<uint32_t> refs{ 1 };
+		CAPTURED_FRAME frame{};
+		std::unique_ptr<uint8_t[]> storage;
+	};
+
+	struct CONSUMER
+	{
+		// read by the producer, the rest of the setup is visible once it is set
+		std::atomic<bool> active{ false };
+		// set while the producer is queueing for the consumer
+		std::atomic<uint32_t> publishing{ 0 };
+		// guarded by the lock
+		bool subscribed{ false };
+		uint32_t depth{ 1 };
+		DeliveryPolicy policy{ DELIVERY_DROP_OLDEST };
+		NotifyFn notify;
+		std::unique_ptr<std::atomic<int>[]> ring;
+		uint32_t ringCapacity{ 0 };
+		// next frame to take, advanced by the consumer or by the producer dropping the oldest frame
+		alignas(64) std::atomic<uint64_t> head{ 0 };
+		// next frame to queue, producer only
+		alignas(64) std::atomic<uint64_t> tail{ 0 };
+		std::atomic<uint64_t> received{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+	};
+
+	// calls fn with the consumer if it is active, Unsubscribe waits for fn to return
+	template <typename Fn>
+	void WithConsumer(uint32_t id, Fn&& fn)
+	{
+		auto& consumer = mConsumers[id];
+		if (!consumer.active.load(std::memory_order_acquire)) return;
+		consumer.publishing.fetch_add(1, std::memory_order_seq_cst);
+		if (consumer.active.load(std::memory_order_seq_cst))
+		{
+			fn(consumer);
+		}
+		consumer.publishing.fetch_sub(1, std::memory_order_release);
+	}
+
+	// producer only, returns false if the consumer's policy dropped the frame
+	bool Enqueue(CONSUMER& consumer, int slot)
+	{
+		consumer.received.fetch_add(1, std::memory_order_relaxed);
+		auto tail = consumer.tail.load(std::memory_order_relaxed);
+		auto head = consumer.head.load(std::memory_order_acquire);
+		if (tail - head >= consumer.depth)
+		{
+			if (consumer.policy == DELIVERY_DROP_NEWEST)
+			{
+				consumer.dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			// if the consumer takes the oldest frame first there is room anyway
+			auto oldest = consumer.ring[head % consumer.depth].load(std::memory_order_relaxed);
+			if (consumer.head.compare_exchange_strong(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				consumer.dropped.fetch_add(1, std::memory_order_relaxed);
+				Release(oldest);
+			}
+		}
+		AddRef(slot);
+		consumer.ring[tail % consumer.depth].store(slot, std::memory_order_release);
+		consumer.tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// releases every frame queued for the consumer, counted as dropped
+	void DiscardQueued(CONSUMER& consumer)
+	{
+		auto head = consumer.head.load(std::memory_order_acquire);
+		while (head != consumer.tail.load(std::memory_order_acquire))
+		{
+			auto slot = consumer.ring[head % consumer.depth].load(std::memory_order_acquire);
+			if (consumer.head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				consumer.dropped.fetch_add(1, std::memory_order_relaxed);
+				Release(slot);
+			}
+		}
+	}
+
+	const uint32_t mMaxSlots;
+	// allocated up front so a slot never moves while someone holds it
+	std::unique_ptr<SLOT[]> mSlots;
+	std::atomic<uint32_t> mSlotCount{ 0 };
+	std::atomic<size_t> mFrameCapacity{ 0 };
+	const uint32_t mMaxConsumers;
+	// allocated up front so the producer never sees a consumer move
+	std::unique_ptr<CONSUMER[]> mConsumers;
+	// guards subscribing, never taken by the producer
+	mutable std::mutex mMutex;
+	// where the search for a free slot starts, only a hint so it is not kept exact between threads
+	std::atomic<uint32_t> mNextWrite{ 0 };
+	// producer only
+	uint64_t mSequence{ 0 };
+	alignas(64) std::atomic<uint64_t> mDropped{ 0 };
+	std::atomic<uint64_t> mOversized{ 0 };
+};
@@ -0,0 +1,304 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "iec61937.h"
+
+#include <algorithm>
+#include <cstring>
+
+// from IEC 61937-2 Table 2
+bool GetCodecFromIEC61937Preamble(const IEC61937DataType dataType, uint16_t* burstSize, Codec* codec)
+{
+	switch (dataType & 0xff)
+	{
+	case IEC61937_AC3:
+		*burstSize /= 8; // bits
+		*codec = AC3;
+		break;
+	case IEC61937_DTS1:
+	case IEC61937_DTS2:
+	case IEC61937_DTS3:
+		*burstSize /= 8; // bits
+		*codec = DTS;
+		break;
+	case IEC61937_DTSHD:
+		*codec = DTSHD;
+		break;
+	case IEC61937_EAC3:
+		*codec = EAC3;
+		break;
+	case IEC61937_TRUEHD:
+		*codec = TRUEHD;
+		break;
+	case IEC61937_NULL:
+	case IEC61937_PAUSE:
+		*codec = PAUSE_OR_NULL;
+		break;
+	default:
+		*codec = PAUSE_OR_NULL;
+		return false;
+	}
+	return true;
+}
+
+BitstreamParser::BitstreamParser(SimdLevel level) :
+	mSimdLevel(level),
+	mDataBurstBuffer(dataBurstBufferSize, 0)
+{
+	Reset();
+}
+
+void BitstreamParser::Reset()
+{
+	memset(mBuffer, 0, sizeof(mBuffer));
+}
+
+void BitstreamParser::UpdatePlan(uint16_t inputChannelCount, uint8_t bitDepthInBytes)
+{
+	if (mPlan.bitDepthInBytes != bitDepthInBytes || mPlan.outputChannelCount != inputChannelCount / 2 * 2)
+	{
+		mPlan = MakeBitstreamRemapPlan(bitDepthInBytes, inputChannelCount);
+	}
+}
+
+void BitstreamParser::Extract(const uint8_t* frame, uint32_t from, uint32_t len, uint8_t* out) const
+{
+	const uint32_t blockSize = mPlan.outputBlockSize;
+	auto sampleIdx = from / blockSize;
+	auto byteIdx = from % blockSize;
+	// the end of a partially consumed sample
+	for (; byteIdx != 0 && byteIdx < blockSize && len > 0; ++byteIdx, --len)
+	{
+		*out++ = frame[sampleIdx * pcmInputBlockSizeInBytes + mPlan.byteMap[byteIdx]];
+	}
+	if (byteIdx == blockSize) ++sampleIdx;
+	// whole samples
+	auto samples = len / blockSize;
+	if (samples > 0)
+	{
+		RemapPcm(&mPlan, frame + sampleIdx * pcmInputBlockSizeInBytes, out, samples * blockSize, samples, mSimdLevel);
+		sampleIdx += samples;
+		out += samples * blockSize;
+		len -= samples * blockSize;
+	}
+	// the start of the next sample
+	for (byteIdx = 0; byteIdx < len; ++byteIdx)
+	{
+		*out++ = frame[sampleIdx * pcmInputBlockSizeInBytes + mPlan.byteMap[byteIdx]];
+	}
+}
+
+uint16_t BitstreamParser::CopyFrame(const uint8_t* frame, uint16_t inputChannelCount, uint8_t bitDepthInBytes)
+{
+	UpdatePlan(inputChannelCount, bitDepthInBytes);
+	uint16_t bufSize = pcmSamplesPerFrame * mPlan.outputBlockSize;
+	if (bufSize > 0)
+	{
+		Extract(frame, 0, bufSize, mBuffer);
+	}
+	return bufSize;
+}
+
+BitstreamParseResult BitstreamParser::ParseFrame(const uint8_t* frame, uint16_t inputChannelCount, uint8_t bitDepthInBytes, Codec* codec)
+{
+	UpdatePlan(inputChannelCount, bitDepthInBytes);
+	if (mPlan.outputBlockSize == 0)
+	{
+		return PARSE_NOTHING;
+	}
+	const uint16_t bufSize = pcmSamplesPerFrame * mPlan.outputBlockSize;
+	// searched a few samples at a time so that a data burst is extracted straight to the data burst buffer
+	const uint16_t searchChunkSize = 16 * mPlan.outputBlockSize;
+	uint16_t bytesRead = 0;
+	bool copiedBytes = false;
+	bool partialDataBurst = false;
+	bool maybeBitstream = false;
+
+	while (bytesRead < bufSize)
+	{
+		uint16_t remainingInBurst = std::max(mDataBurstSize - mDataBurstRead, 0);
+		if (remainingInBurst > 0)
+		{
+			uint16_t remainingInBuffer = bufSize - bytesRead;
+			auto toCopy = std::min(remainingInBurst, remainingInBuffer);
+			Extract(frame, bytesRead, toCopy, mDataBurstBuffer.data() + mDataBurstRead);
+			bytesRead += toCopy;
+			mDataBurstRead += toCopy;
+			remainingInBurst -= toCopy;
+			mBytesSincePaPb += toCopy;
+			copiedBytes = true;
+
+			if (remainingInBurst == 0)
+			{
+				mDataBurstPayloadSize = mDataBurstSize;
+			}
+		}
+		// more to read = will need another frame
+		if (remainingInBurst > 0)
+		{
+			partialDataBurst = true;
+			continue;
+		}
+
+		// no more to read so reset the databurst state ready for the next frame
+		mDataBurstSize = mDataBurstRead = 0;
+
+		// burst complete so search the next chunk for the PaPb preamble F8 72 4E 1F (248 114 78 31)
+		if (mPaPbBytesRead != 4)
+		{
+			uint16_t chunkSize = std::min<uint16_t>(searchChunkSize, bufSize - bytesRead);
+			Extract(frame, bytesRead, chunkSize, mBuffer + bytesRead);
+			bytesRead = FindPaPb(bytesRead, bytesRead + chunkSize);
+			maybeBitstream = mPaPbBytesRead > 0 && mPaPbBytesRead < 4;
+			if (mPaPbBytesRead != 4)
+			{
+				continue;
+			}
+		}
+
+		// grab PcPd preamble words
+		uint8_t bytesToCopy = std::min(bufSize - bytesRead, 4 - mPcPdBytesRead);
+		if (bytesToCopy > 0)
+		{
+			Extract(frame, bytesRead, bytesToCopy, mPcPdBuffer + mPcPdBytesRead);
+			mPcPdBytesRead += bytesToCopy;
+			bytesRead += bytesToCopy;
+			mBytesSincePaPb += bytesToCopy;
+			copiedBytes = true;
+		}
+
+		if (mPcPdBytesRead != 4)
+		{
+			continue;
+		}
+
+		mDataBurstSize = ((static_cast<uint16_t>(mPcPdBuffer[2]) << 8) + static_cast<uint16_t>(mPcPdBuffer[3]));
+		auto dt = static_cast<uint8_t>(mPcPdBuffer[1] & 0x7f);
+		if (!GetCodecFromIEC61937Preamble(IEC61937DataType{ dt }, &mDataBurstSize, codec))
+		{
+			mLastUnknownDataType = dt;
+			mUnknownDataTypes++;
+		}
+
+		// ignore PAUSE_OR_NULL, start search again
+		if (*codec == PAUSE_OR_NULL)
+		{
+			mPaPbBytesRead = mPcPdBytesRead = 0;
+			mDataBurstSize = mDataBurstPayloadSize = mDataBurstRead = 0;
+			continue;
+		}
+
+		mPaPbBytesRead = mPcPdBytesRead = 0;
+	}
+	return partialDataBurst ? PARSE_PARTIAL_DATABURST : maybeBitstream ? PARSE_POSSIBLE_BITSTREAM : copiedBytes ? PARSE_OK : PARSE_NOTHING;
+}
+
+uint16_t BitstreamParser::FindPaPb(uint16_t from, uint16_t bufSize)
+{
+	// complete a preamble started at the end of the previous frame, it can't overlap itself so a mismatch restarts the
+	// search at the mismatched byte
+	while (mPaPbBytesRead > 0 && mPaPbBytesRead < 4 && from < bufSize)
+	{
+		if (mBuffer[from] != iec61937Sync[mPaPbBytesRead])
+		{
+			mPaPbBytesRead = 0;
+			break;
+		}
+		++mPaPbBytesRead;
+		++from;
+		++mBytesSincePaPb;
+	}
+	if (mPaPbBytesRead == 4)
+	{
+		mBytesSincePaPb = 4;
+		return from;
+	}
+	if (mPaPbBytesRead > 0)
+	{
+		return from;
+	}
+
+	auto remaining = static_cast<size_t>(bufSize - from);
+	auto offset = FindIEC61937Sync(mBuffer + from, remaining, mSimdLevel);
+	if (offset < remaining)
+	{
+		mPaPbBytesRead = 4;
+		mBytesSincePaPb = 4;
+		return static_cast<uint16_t>(from + offset + 4);
+	}
+	mPaPbBytesRead = GetIEC61937SyncPrefixLength(mBuffer + from, remaining);
+	// saturates rather than wrapping while a PCM stream is scanned
+	mBytesSincePaPb = remaining > UINT32_MAX - mBytesSincePaPb ? UINT32_MAX : mBytesSincePaPb + static_cast<uint32_t>(remaining);
+	return bufSize;
+}
+
+IEC61937Passthrough::IEC61937Passthrough(SimdLevel level) :
+	mSimdLevel(level)
+{
+}
+
+bool IEC61937Passthrough::ScanFrame(const uint8_t* frame, uint16_t inputChannelCount, Codec* codec)
+{
+	const int pairs = std::min<int>(inputChannelCount, pcmInputSlotCount) / 2;
+	const auto frameSize = GetFrameSizeInBytes(static_cast<uint16_t>(pairs * 2));
+	// the transmitted word is the top 16 bits of the (little endian) slot, pair p is in slots p and p + 4
+	auto word = [frame](int sampleIdx, int slot)
+	{
+		uint32_t value;
+		memcpy(&value, frame + sampleIdx * pcmInputBlockSizeInBytes + slot * pcmInputSlotSizeInBytes, sizeof(value));
+		return static_cast<uint16_t>(value >> 16);
+	};
+	bool found = false;
+	for (int sampleIdx = 0; sampleIdx < pcmSamplesPerFrame; ++sampleIdx)
+	{
+		for (int pairIdx = 0; pairIdx < pairs; ++pairIdx)
+		{
+			if (word(sampleIdx, pairIdx) != IEC61937_SYNCWORD_1 || word(sampleIdx, pairIdx + pcmInputSlotCount / 2) != IEC61937_SYNCWORD_2)
+			{
+				continue;
+			}
+			// Pc Pd follow in the next pair
+			auto pcPdSampleIdx = pairIdx + 1 < pairs ? sampleIdx : sampleIdx + 1;
+			auto pcPdPairIdx = pairIdx + 1 < pairs ? pairIdx + 1 : 0;
+			if (pcPdSampleIdx == pcmSamplesPerFrame)
+			{
+				break;
+			}
+			uint16_t burstSize = word(pcPdSampleIdx, pcPdPairIdx + pcmInputSlotCount / 2);
+			auto dt = static_cast<uint8_t>(word(pcPdSampleIdx, pcPdPairIdx) & 0x7f);
+			GetCodecFromIEC61937Preamble(IEC61937DataType{ dt }, &burstSize, codec);
+			found = true;
+			mBytesSincePaPb = frameSize - static_cast<uint32_t>(sampleIdx * pairs + pairIdx) * 4;
+			if (*codec != PAUSE_OR_NULL)
+			{
+				return true;
+			}
+		}
+	}
+	if (!found)
+	{
+		mBytesSincePaPb = frameSize > UINT32_MAX - mBytesSincePaPb ? UINT32_MAX : mBytesSincePaPb + frameSize;
+	}
+	return found;
+}
+
+uint32_t IEC61937Passthrough::CopyFrames(const uint8_t* frames, uint8_t frameCount, uint16_t inputChannelCount, uint8_t* out, uint32_t outSize)
+{
+	if (mPlan.outputChannelCount != inputChannelCount / 2 * 2)
+	{
+		mPlan = MakeBitstreamRemapPlan(2, inputChannelCount, false);
+	}
+	auto samples = RemapPcm(&mPlan, frames, out, outSize, static_cast<uint32_t>(frameCount) * pcmSamplesPerFrame, mSimdLevel);
+	return samples * mPlan.outputBlockSize;
+}
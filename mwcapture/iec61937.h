@@ -0,0 +1,294 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "iec61937_sync.h"
+#include "pcm_remap.h"
+
+// HDMI Audio Bitstream Codec Identification metadata
+
+// IEC 61937-1 Chapter 6.1.7 Field Pa
+constexpr auto IEC61937_SYNCWORD_1 = 0xF872;
+// IEC 61937-1 Chapter 6.1.7 Field Pb
+constexpr auto IEC61937_SYNCWORD_2 = 0x4E1F;
+// IEC 61937-2 Table 2
+enum IEC61937DataType : uint8_t
+{
+	IEC61937_NULL               = 0x0,           ///< NULL
+	IEC61937_AC3                = 0x01,          ///< AC-3 data
+	IEC61937_PAUSE              = 0x03,          ///< Pause
+	IEC61937_MPEG1_LAYER1       = 0x04,          ///< MPEG-1 layer 1
+	IEC61937_MPEG1_LAYER23      = 0x05,          ///< MPEG-1 layer 2 or 3 data or MPEG-2 without extension
+	IEC61937_MPEG2_EXT          = 0x06,          ///< MPEG-2 data with extension
+	IEC61937_MPEG2_AAC          = 0x07,          ///< MPEG-2 AAC ADTS
+	IEC61937_MPEG2_LAYER1_LSF   = 0x08,          ///< MPEG-2, layer-1 low sampling frequency
+	IEC61937_MPEG2_LAYER2_LSF   = 0x09,          ///< MPEG-2, layer-2 low sampling frequency
+	IEC61937_MPEG2_LAYER3_LSF   = 0x0A,          ///< MPEG-2, layer-3 low sampling frequency
+	IEC61937_DTS1               = 0x0B,          ///< DTS type I   (512 samples)
+	IEC61937_DTS2               = 0x0C,          ///< DTS type II  (1024 samples)
+	IEC61937_DTS3               = 0x0D,          ///< DTS type III (2048 samples)
+	IEC61937_ATRAC              = 0x0E,          ///< ATRAC data
+	IEC61937_ATRAC3             = 0x0F,          ///< ATRAC3 data
+	IEC61937_ATRACX             = 0x10,          ///< ATRAC3+ data
+	IEC61937_DTSHD              = 0x11,          ///< DTS HD data
+	IEC61937_WMAPRO             = 0x12,          ///< WMA 9 Professional data
+	IEC61937_MPEG2_AAC_LSF_2048 = 0x13,          ///< MPEG-2 AAC ADTS half-rate low sampling frequency
+	IEC61937_MPEG2_AAC_LSF_4096 = 0x13 | 0x20,   ///< MPEG-2 AAC ADTS quarter-rate low sampling frequency
+	IEC61937_EAC3               = 0x15,          ///< E-AC-3 data
+	IEC61937_TRUEHD             = 0x16,          ///< TrueHD/MAT data
+};
+enum Codec
+{
+	PCM,
+	AC3,
+	DTS,
+	DTSHD,
+	EAC3,
+	TRUEHD,
+	BITSTREAM,
+	PAUSE_OR_NULL
+};
+static const std::string codecNames[8] = {
+	"PCM",
+	"AC3",
+	"DTS",
+	"DTSHD",
+	"EAC3",
+	"TrueHD",
+	"Unidentified",
+	"PAUSE_OR_NULL"
+};
+
+// a captured frame holds at most this many bytes of bitstream
+constexpr int maxBitstreamFrameLengthInBytes = pcmSamplesPerFrame * pcmInputBlockSizeInBytes;
+// Pd holds the data burst length in 16 bits so a buffer of this size holds any burst without ever being resized
+constexpr uint32_t dataBurstBufferSize = UINT16_MAX;
+
+// IEC 61937-3/-5 repetition period of each codec's data bursts in bytes of the stream, i.e. the longest gap between
+// preambles and so the largest burst of that codec. DTS is the type III period and DTS-HD the longest (8192 frame)
+// period.
+constexpr uint32_t GetIEC61937RepetitionPeriodInBytes(Codec codec)
+{
+	switch (codec)
+	{
+	case AC3: return 1536 * 4;
+	case DTS: return 2048 * 4;
+	case DTSHD: return 8192 * 4;
+	case EAC3: return 6144 * 4;
+	case TRUEHD: return 15360 * 4;
+	default: return 15360 * 4;
+	}
+}
+
+// the byte stream carried by the captured frame, i.e. the top bitDepthInBytes of each present slot in the order
+// L0,R0,L1,R1.. (as for PCM) but byte swapped as the IEC 61937 words are big endian. Not swapped, the words are left
+// in the little endian order in which they are transmitted.
+constexpr PCM_REMAP_PLAN MakeBitstreamRemapPlan(uint8_t bitDepthInBytes, uint16_t inputChannelCount, bool byteSwapped = true)
+{
+	PCM_REMAP_PLAN plan{};
+	plan.byteMap.fill(pcmUnmappedByte);
+	plan.shuffleLo.fill(pcmUnmappedByte);
+	plan.shuffleHi.fill(pcmUnmappedByte);
+	if (bitDepthInBytes < 1 || bitDepthInBytes > pcmInputSlotSizeInBytes || inputChannelCount < 2 || inputChannelCount > pcmInputSlotCount)
+	{
+		return plan;
+	}
+	auto channelCount = inputChannelCount / 2 * 2;
+	plan.bitDepthInBytes = bitDepthInBytes;
+	plan.outputChannelCount = static_cast<uint8_t>(channelCount);
+	plan.outputBlockSize = static_cast<uint8_t>(bitDepthInBytes * channelCount);
+	for (auto channelIdx = 0; channelIdx < channelCount; ++channelIdx)
+	{
+		auto pairIdx = channelIdx / 2;
+		auto inputSlot = channelIdx % 2 == 0 ? pairIdx : pairIdx + pcmInputSlotCount / 2;
+		for (auto k = 0; k < bitDepthInBytes; ++k)
+		{
+			auto inputByte = byteSwapped ? pcmInputSlotSizeInBytes - 1 - k : pcmInputSlotSizeInBytes - bitDepthInBytes + k;
+			plan.byteMap[channelIdx * bitDepthInBytes + k] = static_cast<uint8_t>(inputSlot * pcmInputSlotSizeInBytes + inputByte);
+		}
+	}
+	SplitPcmRemapPlan(&plan);
+	return plan;
+}
+
+enum BitstreamParseResult : uint8_t
+{
+	// nothing was read from the buffer
+	PARSE_NOTHING,
+	// data burst content or a preamble was read
+	PARSE_OK,
+	// the buffer ended part way through a data burst
+	PARSE_PARTIAL_DATABURST,
+	// the buffer ended part way through a Pa Pb preamble
+	PARSE_POSSIBLE_BITSTREAM
+};
+
+// identifies codecs that are known/expected to be carried via HDMI in an AV setup, burstSize is converted from the
+// length code in Pd to a length in bytes. Returns false if the data type is unknown, such bursts are treated as PAUSE.
+bool GetCodecFromIEC61937Preamble(IEC61937DataType dataType, uint16_t* burstSize, Codec* codec);
+
+// extracts the IEC 61937 data bursts from the captured audio frames of one stream
+//
+// each captured frame is read once, the byte stream it carries is extracted (byte swapped and compacted) a chunk at a
+// time and scanned for the Pa Pb preamble. The Pc Pd words that follow identify the codec and the length of the data
+// burst, the rest of the burst is extracted straight into the data burst buffer across frames if necessary. A
+// preamble split across frames is matched as well so every frame can be scanned, PCM or not.
+class BitstreamParser
+{
+public:
+	explicit BitstreamParser(SimdLevel level = GetSimdLevel());
+
+	// discards the buffered frame
+	void Reset();
+
+	// copies the whole byte stream carried by the captured frame into the parse buffer, returns the number of bytes
+	// copied. Only needed to inspect the stream as ParseFrame extracts the stream itself.
+	uint16_t CopyFrame(const uint8_t* frame, uint16_t inputChannelCount, uint8_t bitDepthInBytes);
+
+	// probes the captured frame for the codec and/or copies its content to the data burst, codec is updated when a
+	// Pc Pd preamble is found
+	BitstreamParseResult ParseFrame(const uint8_t* frame, uint16_t inputChannelCount, uint8_t bitDepthInBytes, Codec* codec);
+
+	const uint8_t* GetBuffer() const
+	{
+		return mBuffer;
+	}
+
+	// length of the data burst currently being collected
+	uint16_t GetDataBurstSize() const
+	{
+		return mDataBurstSize;
+	}
+
+	// bytes collected so far for the current data burst
+	uint16_t GetDataBurstRead() const
+	{
+		return mDataBurstRead;
+	}
+
+	// length of the last complete data burst, 0 once that burst has been consumed
+	uint16_t GetDataBurstPayloadSize() const
+	{
+		return mDataBurstPayloadSize;
+	}
+
+	const uint8_t* GetDataBurst() const
+	{
+		return mDataBurstBuffer.data();
+	}
+
+	void ConsumeDataBurst()
+	{
+		mDataBurstPayloadSize = 0;
+	}
+
+	uint32_t GetBytesSincePaPb() const
+	{
+		return mBytesSincePaPb;
+	}
+
+	void ResetBytesSincePaPb()
+	{
+		mBytesSincePaPb = 0;
+	}
+
+	// true if no preamble has been seen for longer than the repetition period of the codec, i.e. the stream has
+	// stopped carrying that codec (allowing for one lost burst)
+	bool HasLostSync(Codec codec) const
+	{
+		return mBytesSincePaPb > 2 * GetIEC61937RepetitionPeriodInBytes(codec);
+	}
+
+	// the data type of the last unknown Pc seen
+	uint8_t GetLastUnknownDataType() const
+	{
+		return mLastUnknownDataType;
+	}
+
+	uint64_t GetUnknownDataTypeCount() const
+	{
+		return mUnknownDataTypes;
+	}
+
+private:
+	// advances from the given offset to the byte after the next Pa Pb preamble, returns bufSize if there is none
+	uint16_t FindPaPb(uint16_t from, uint16_t bufSize);
+	// writes len bytes of the stream carried by frame, starting at byte from, to out
+	void Extract(const uint8_t* frame, uint32_t from, uint32_t len, uint8_t* out) const;
+	void UpdatePlan(uint16_t inputChannelCount, uint8_t bitDepthInBytes);
+
+	SimdLevel mSimdLevel;
+	PCM_REMAP_PLAN mPlan{};
+	uint8_t mBuffer[maxBitstreamFrameLengthInBytes];
+	uint8_t mPaPbBytesRead{ 0 };
+	uint8_t mPcPdBuffer[4]{};
+	uint8_t mPcPdBytesRead{ 0 };
+	uint16_t mDataBurstRead{ 0 };
+	uint16_t mDataBurstSize{ 0 };
+	uint16_t mDataBurstPayloadSize{ 0 };
+	uint32_t mBytesSincePaPb{ 0 };
+	// allocated once, a burst is never larger
+	std::vector<uint8_t> mDataBurstBuffer;
+	uint8_t mLastUnknownDataType{ 0 };
+	uint64_t mUnknownDataTypes{ 0 };
+};
+
+// delivers the IEC 61937 stream carried by the captured frames untouched, i.e. as 16 bit little endian words at the HDMI
+// sample rate, for a renderer which bitstreams to the next device itself
+//
+// nothing is reassembled, each frame is only peeked at for a burst preamble to track the codec. As the stream is
+// delivered as it was captured, every sample covers the same number of frames whatever the codec or burst size.
+class IEC61937Passthrough
+{
+public:
+	explicit IEC61937Passthrough(SimdLevel level = GetSimdLevel());
+
+	// looks for a burst preamble which lies wholly within the captured frame, Pa is carried in the first subframe so
+	// only the first channel of each pair is checked. Returns true if one is found and sets codec to its codec, a real
+	// codec is preferred over PAUSE_OR_NULL if the frame holds both.
+	bool ScanFrame(const uint8_t* frame, uint16_t inputChannelCount, Codec* codec);
+
+	// writes the stream carried by frameCount contiguous captured frames to out, returns the number of bytes written
+	uint32_t CopyFrames(const uint8_t* frames, uint8_t frameCount, uint16_t inputChannelCount, uint8_t* out, uint32_t outSize);
+
+	// bytes of the stream carried by each captured frame
+	static constexpr uint32_t GetFrameSizeInBytes(uint16_t inputChannelCount)
+	{
+		return pcmSamplesPerFrame * (inputChannelCount / 2 * 2) * 2;
+	}
+
+	uint32_t GetBytesSincePaPb() const
+	{
+		return mBytesSincePaPb;
+	}
+
+	void ResetBytesSincePaPb()
+	{
+		mBytesSincePaPb = 0;
+	}
+
+	// as BitstreamParser::HasLostSync
+	bool HasLostSync(Codec codec) const
+	{
+		return mBytesSincePaPb > 2 * GetIEC61937RepetitionPeriodInBytes(codec);
+	}
+
+private:
+	SimdLevel mSimdLevel;
+	PCM_REMAP_PLAN mPlan{};
+	uint32_t mBytesSincePaPb{ 0 };
+};
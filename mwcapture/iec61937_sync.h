@@ -0,0 +1,146 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include "simd.h"
+
+// locates the IEC 61937 Pa Pb preamble (F8 72 4E 1F) in a big endian byte stream
+// the vector kernels compare the 4 byte pattern at each of 16 (or 32) consecutive offsets per step and leave the last
+// few bytes to the scalar kernel
+
+inline constexpr uint8_t iec61937Sync[4]{ 0xF8, 0x72, 0x4E, 0x1F };
+
+// returns the offset of the first complete preamble or len if there is none
+inline size_t FindIEC61937SyncScalar(const uint8_t* buf, size_t len)
+{
+	for (size_t i = 0; i + 4 <= len; ++i)
+	{
+		if (buf[i] == iec61937Sync[0] && buf[i + 1] == iec61937Sync[1] && buf[i + 2] == iec61937Sync[2] && buf[i + 3] == iec61937Sync[3])
+		{
+			return i;
+		}
+	}
+	return len;
+}
+
+#if defined(HAS_X86_SIMD)
+TARGET_SSE41 inline size_t FindIEC61937SyncSse41(const uint8_t* buf, size_t len)
+{
+	const auto pa0 = _mm_set1_epi8(static_cast<char>(iec61937Sync[0]));
+	const auto pa1 = _mm_set1_epi8(static_cast<char>(iec61937Sync[1]));
+	const auto pb0 = _mm_set1_epi8(static_cast<char>(iec61937Sync[2]));
+	const auto pb1 = _mm_set1_epi8(static_cast<char>(iec61937Sync[3]));
+	size_t i = 0;
+	for (; i + 16 + 3 <= len; i += 16)
+	{
+		auto m0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i)), pa0);
+		auto m1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i + 1)), pa1);
+		auto m2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i + 2)), pb0);
+		auto m3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i + 3)), pb1);
+		auto hits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(m0, m1), _mm_and_si128(m2, m3))));
+		if (hits)
+		{
+			return i + std::countr_zero(hits);
+		}
+	}
+	return i + FindIEC61937SyncScalar(buf + i, len - i);
+}
+
+TARGET_AVX2 inline size_t FindIEC61937SyncAvx2(const uint8_t* buf, size_t len)
+{
+	const auto pa0 = _mm256_set1_epi8(static_cast<char>(iec61937Sync[0]));
+	const auto pa1 = _mm256_set1_epi8(static_cast<char>(iec61937Sync[1]));
+	const auto pb0 = _mm256_set1_epi8(static_cast<char>(iec61937Sync[2]));
+	const auto pb1 = _mm256_set1_epi8(static_cast<char>(iec61937Sync[3]));
+	size_t i = 0;
+	for (; i + 32 + 3 <= len; i += 32)
+	{
+		auto m0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i)), pa0);
+		auto m1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i + 1)), pa1);
+		auto m2 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i + 2)), pb0);
+		auto m3 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i + 3)), pb1);
+		auto hits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(m0, m1), _mm256_and_si256(m2, m3))));
+		if (hits)
+		{
+			_mm256_zeroupper();
+			return i + std::countr_zero(hits);
+		}
+	}
+	_mm256_zeroupper();
+	return i + FindIEC61937SyncScalar(buf + i, len - i);
+}
+#endif
+
+#if defined(HAS_NEON_SIMD)
+inline size_t FindIEC61937SyncNeon(const uint8_t* buf, size_t len)
+{
+	const auto pa0 = vdupq_n_u8(iec61937Sync[0]);
+	const auto pa1 = vdupq_n_u8(iec61937Sync[1]);
+	const auto pb0 = vdupq_n_u8(iec61937Sync[2]);
+	const auto pb1 = vdupq_n_u8(iec61937Sync[3]);
+	size_t i = 0;
+	for (; i + 16 + 3 <= len; i += 16)
+	{
+		auto m01 = vandq_u8(vceqq_u8(vld1q_u8(buf + i), pa0), vceqq_u8(vld1q_u8(buf + i + 1), pa1));
+		auto m23 = vandq_u8(vceqq_u8(vld1q_u8(buf + i + 2), pb0), vceqq_u8(vld1q_u8(buf + i + 3), pb1));
+		// narrow to 4 bits per byte so the first hit is found with a 64bit count
+		auto hits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(m01, m23)), 4)), 0);
+		if (hits)
+		{
+			return i + std::countr_zero(hits) / 4;
+		}
+	}
+	return i + FindIEC61937SyncScalar(buf + i, len - i);
+}
+#endif
+
+inline size_t FindIEC61937Sync(const uint8_t* buf, size_t len, SimdLevel level = GetSimdLevel())
+{
+	switch (level)
+	{
+	#if defined(HAS_X86_SIMD)
+	case SIMD_AVX2:
+		return FindIEC61937SyncAvx2(buf, len);
+	case SIMD_SSE41:
+		return FindIEC61937SyncSse41(buf, len);
+	#endif
+	#if defined(HAS_NEON_SIMD)
+	case SIMD_NEON:
+		return FindIEC61937SyncNeon(buf, len);
+	#endif
+	default:
+		return FindIEC61937SyncScalar(buf, len);
+	}
+}
+
+// the length of the start of a preamble found at the end of the buffer, i.e. 0 to 3 bytes which have to be matched
+// against the start of the next buffer
+inline uint8_t GetIEC61937SyncPrefixLength(const uint8_t* buf, size_t len)
+{
+	for (uint8_t prefix = 3; prefix > 0; --prefix)
+	{
+		if (len < prefix) continue;
+		auto tail = buf + len - prefix;
+		auto matched = true;
+		for (uint8_t i = 0; i < prefix && matched; ++i)
+		{
+			matched = tail[i] == iec61937Sync[i];
+		}
+		if (matched) return prefix;
+	}
+	return 0;
+}
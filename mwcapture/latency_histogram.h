@@ -0,0 +1,113 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// counts durations in fixed width buckets so the distribution of per frame work can be logged cheaply
+//
+// recording is a division and an increment so it can sit on the capture path, anything beyond the last bucket is
+// counted in an overflow bucket. Percentiles are reported as the upper edge of the bucket they fall in.
+//
+// each pin logs a summary every captureLatencyReportInterval labelled with its capture mode, the video latency modes can
+// be compared by changing videolatencymode in the registry between runs. Not measured on hardware, neither the latency
+// of each mode nor whether the buckets used by the pins suit the range seen in practice.
+class LatencyHistogram
+{
+public:
+	explicit LatencyHistogram(uint32_t bucketWidthUs = 500, uint32_t bucketCount = 64) :
+		mBucketWidthUs(std::max(bucketWidthUs, 1u)),
+		mBuckets(static_cast<size_t>(std::max(bucketCount, 1u)) + 1)
+	{
+	}
+
+	void Record(uint64_t durationUs)
+	{
+		auto bucket = std::min<uint64_t>(durationUs / mBucketWidthUs, mBuckets.size() - 1);
+		mBuckets[bucket]++;
+		mCount++;
+		mTotalUs += durationUs;
+		mMaxUs = std::max(mMaxUs, durationUs);
+	}
+
+	void Reset()
+	{
+		std::fill(mBuckets.begin(), mBuckets.end(), 0);
+		mCount = 0;
+		mTotalUs = 0;
+		mMaxUs = 0;
+	}
+
+	uint64_t GetCount() const
+	{
+		return mCount;
+	}
+
+	uint64_t GetMaxUs() const
+	{
+		return mMaxUs;
+	}
+
+	double GetMeanUs() const
+	{
+		return mCount == 0 ? 0.0 : static_cast<double>(mTotalUs) / static_cast<double>(mCount);
+	}
+
+	// the duration below which the fraction p (0 to 1) of the recorded durations fall, the max if it overflowed
+	uint64_t GetPercentileUs(double p) const
+	{
+		if (mCount == 0) return 0;
+		auto target = static_cast<uint64_t>(std::clamp(p, 0.0, 1.0) * static_cast<double>(mCount));
+		target = std::max<uint64_t>(target, 1);
+		uint64_t seen = 0;
+		for (size_t i = 0; i < mBuckets.size() - 1; ++i)
+		{
+			seen += mBuckets[i];
+			if (seen >= target) return std::min<uint64_t>((i + 1) * mBucketWidthUs, mMaxUs);
+		}
+		return mMaxUs;
+	}
+
+	const std::vector<uint64_t>& GetBuckets() const
+	{
+		return mBuckets;
+	}
+
+	// the non empty buckets as lower edge in us:count, e.g. "0:12 500:3 >32000:1"
+	std::string Format() const
+	{
+		std::string out;
+		for (size_t i = 0; i < mBuckets.size(); ++i)
+		{
+			if (mBuckets[i] == 0) continue;
+			if (!out.empty()) out += ' ';
+			if (i == mBuckets.size() - 1) out += '>';
+			out += std::to_string(i * mBucketWidthUs);
+			out += ':';
+			out += std::to_string(mBuckets[i]);
+		}
+		return out;
+	}
+
+private:
+	const uint32_t mBucketWidthUs;
+	// the last bucket counts everything beyond the others
+	std::vector<uint64_t> mBuckets;
+	uint64_t mCount{ 0 };
+	uint64_t mTotalUs{ 0 };
+	uint64_t mMaxUs{ 0 };
+};
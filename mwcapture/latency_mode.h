@@ -0,0 +1,107 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include "setting_name.h"
+
+// when a pro card copies each frame out of its on board buffer
+enum VideoLatencyMode : uint8_t
+{
+	// once the frame is fully buffered, adds the time taken to copy the frame
+	LATENCY_FRAME_BUFFERED,
+	// as soon as the frame starts buffering, the copy follows the card and completes just after the frame does
+	LATENCY_FRAME_BUFFERING,
+	// as LATENCY_FRAME_BUFFERING for a progressive signal, each field of an interlaced signal is delivered as a frame
+	// of its own as soon as it is buffered
+	LATENCY_FIELD_BUFFERED
+};
+
+inline const char* videolatencymode_to_name(VideoLatencyMode e)
+{
+	switch (e)
+	{
+	case LATENCY_FRAME_BUFFERED: return "FrameBuffered";
+	case LATENCY_FRAME_BUFFERING: return "FrameBuffering";
+	case LATENCY_FIELD_BUFFERED: return "FieldBuffered";
+	}
+	return "";
+}
+
+// the mode named as per videolatencymode_to_name, ignoring case, false if no mode has that name
+inline bool ParseVideoLatencyMode(std::string_view name, VideoLatencyMode* mode)
+{
+	return ParseSettingName(name, { LATENCY_FRAME_BUFFERED, LATENCY_FRAME_BUFFERING, LATENCY_FIELD_BUFFERED },
+		videolatencymode_to_name, mode);
+}
+
+// true if each field is captured and delivered as a frame
+inline bool IsFieldRate(VideoLatencyMode mode, bool interlaced)
+{
+	return mode == LATENCY_FIELD_BUFFERED && interlaced;
+}
+
+// the interval between the frames delivered for a signal of the given frame interval
+inline int64_t GetDeliveredFrameInterval(VideoLatencyMode mode, bool interlaced, int64_t frameInterval)
+{
+	return IsFieldRate(mode, interlaced) ? frameInterval / 2 : frameInterval;
+}
+
+// follows the fields captured from the ring of frames buffered on the card so each field is captured once, a late
+// notification can cover more than one field in which case only the newest is captured and the rest are counted as lost
+class FieldSequence
+{
+public:
+	explicit FieldSequence(uint32_t frameCount = 1) :
+		mFieldCount(frameCount > 0 ? frameCount * 2 : 2)
+	{
+	}
+
+	// the card's frame buffer count, restarts the sequence if it changed
+	void SetFrameCount(uint32_t frameCount)
+	{
+		auto fieldCount = frameCount > 0 ? frameCount * 2 : 2;
+		if (fieldCount != mFieldCount)
+		{
+			mFieldCount = fieldCount;
+			Reset();
+		}
+	}
+
+	void Reset()
+	{
+		mHasLast = false;
+	}
+
+	// the number of fields from the last field captured to this one, 0 if it was already captured, 1 for the next field
+	// and 1 for the first field seen after a reset
+	uint32_t Advance(uint32_t frameId, uint32_t fieldIndex)
+	{
+		auto field = (frameId * 2 + (fieldIndex & 1)) % mFieldCount;
+		uint32_t steps = 1;
+		if (mHasLast)
+		{
+			steps = (field + mFieldCount - mLastField) % mFieldCount;
+		}
+		mLastField = field;
+		mHasLast = true;
+		return steps;
+	}
+
+private:
+	uint32_t mFieldCount;
+	uint32_t mLastField{ 0 };
+	bool mHasLast{ false };
+};
@@ -39,6 +39,8 @@
 #include <cmath>
 // std::reverse
 #include <algorithm>
+// std::gcd
+#include <numeric>
 
 #ifdef _DEBUG
 #define MIN_LOG_LEVEL quill::LogLevel::TraceL3
@@ -48,30 +50,62 @@
 
 #define BACKOFF Sleep(20)
 #define SHORT_BACKOFF Sleep(1)
-#define S_PARTIAL_DATABURST    ((HRESULT)2L)
-#define S_POSSIBLE_BITSTREAM    ((HRESULT)3L)
 #define S_NO_CHANNELS    ((HRESULT)2L)
 
-constexpr auto bitstreamDetectionWindowSecs = 0.075;
-constexpr auto bitstreamDetectionRetryAfter = 1.0 / bitstreamDetectionWindowSecs;
-constexpr auto bitstreamBufferSize = 6144;
-constexpr auto unity = 1.0;
 constexpr auto chromaticity_scale_factor = 0.00002;
 constexpr auto high_luminance_scale_factor = 1.0;
 constexpr auto low_luminance_scale_factor = 0.0001;
 
 // bit depth -> pixel encoding -> fourcc
+// the card captures no more than 10 bits so 12 bit sources use the same formats as 10 bit
 constexpr DWORD fourcc[3][4] = {
 	// RGB444, YUV422, YUV444, YUY420
 	{MWFOURCC_BGR24, MWFOURCC_NV16, MWFOURCC_AYUV, MWFOURCC_NV12}, // 8  bit
-	{MWFOURCC_BGR10, MWFOURCC_P210, MWFOURCC_AYUV, MWFOURCC_P010}, // 10 bit
-	{MWFOURCC_BGR10, MWFOURCC_P210, MWFOURCC_AYUV, MWFOURCC_P010}, // 12 bit
+	{MWFOURCC_BGR10, MWFOURCC_P210, MWFOURCC_Y410, MWFOURCC_P010}, // 10 bit
+	{MWFOURCC_BGR10, MWFOURCC_P210, MWFOURCC_Y410, MWFOURCC_P010}, // 12 bit
 };
 constexpr std::string_view fourccName[3][4] = {
 	{"BGR24", "NV16", "AYUV", "NV12"},
-	{"BGR10", "P210", "AYUV", "P010"},
-	{"BGR10", "P210", "AYUV", "P010"},
+	{"BGR10", "P210", "Y410", "P010"},
+	{"BGR10", "P210", "Y410", "P010"},
 };
+// not a capture format, Y410 frames are converted to it for a filter which does not accept Y410
+constexpr DWORD fourccY416 = MWFOURCC('Y', '4', '1', '6');
+
+std::string FourccToString(DWORD fourcc)
+{
+	std::string name{ static_cast<char>(fourcc & 0xFF) };
+	name += static_cast<char>(fourcc >> 8 & 0xFF);
+	name += static_cast<char>(fourcc >> 16 & 0xFF);
+	name += static_cast<char>(fourcc >> 24 & 0xFF);
+	return name;
+}
+
+// reads a REG_DWORD setting from settingsRegistryKey, false if it is not set
+bool ReadSetting(const char* name, DWORD* value)
+{
+	DWORD size = sizeof(DWORD);
+	return ERROR_SUCCESS == RegGetValueA(HKEY_CURRENT_USER, settingsRegistryKey, name, RRF_RT_REG_DWORD, nullptr, value, &size);
+}
+
+bool ReadSetting(const char* name, bool* value)
+{
+	DWORD dw;
+	if (!ReadSetting(name, &dw))
+	{
+		return false;
+	}
+	*value = dw != 0;
+	return true;
+}
+
+// reads a REG_SZ setting from settingsRegistryKey, false if it is not set or does not fit in value
+template <DWORD N>
+bool ReadSetting(const char* name, char (&value)[N])
+{
+	DWORD size = N;
+	return ERROR_SUCCESS == RegGetValueA(HKEY_CURRENT_USER, settingsRegistryKey, name, RRF_RT_REG_SZ, nullptr, value, &size);
+}
 
 //////////////////////////////////////////////////////////////////////////
 // MagewellCaptureFilter
@@ -161,6 +195,55 @@ MagewellCaptureFilter::MagewellCaptureFilter(LPUNKNOWN punk, HRESULT* phr) :
 	}
 	#endif
 
+	// lets each room pick its settings without a build of its own
+	char latencyModeName[32];
+	if (ReadSetting("videolatencymode", latencyModeName))
+	{
+		if (!ParseVideoLatencyMode(latencyModeName, &mVideoLatencyMode))
+		{
+			#ifndef NO_QUILL
+			LOG_WARNING(mLogger, "Ignoring unknown video latency mode {}", latencyModeName);
+			#endif
+		}
+	}
+	char timestampModeName[32];
+	if (ReadSetting("timestampmode", timestampModeName))
+	{
+		if (!ParseTimestampMode(timestampModeName, &mTimestampMode))
+		{
+			#ifndef NO_QUILL
+			LOG_WARNING(mLogger, "Ignoring unknown timestamp mode {}", timestampModeName);
+			#endif
+		}
+	}
+	ReadSetting("iec61937passthrough", &mIec61937Passthrough);
+	ReadSetting("pcmjitterbuffer", &mPcmJitterBuffer);
+	DWORD jitterTargetDepthMs;
+	if (ReadSetting("pcmjittertargetdepthms", &jitterTargetDepthMs))
+	{
+		if (jitterTargetDepthMs > 0 && jitterTargetDepthMs <= maxPcmJitterTargetDepthMs)
+		{
+			mPcmJitterTargetDepthMs = jitterTargetDepthMs;
+		}
+		else
+		{
+			#ifndef NO_QUILL
+			LOG_WARNING(mLogger, "Ignoring jitter buffer target depth {} ms, must be 1 to {}", jitterTargetDepthMs, maxPcmJitterTargetDepthMs);
+			#endif
+		}
+	}
+	ReadDeliverySettings("video", &mVideoDelivery);
+	ReadDeliverySettings("audio", &mAudioDelivery);
+	#ifndef NO_QUILL
+	LOG_INFO(mLogger, "Video latency mode {}", videolatencymode_to_name(mVideoLatencyMode));
+	LOG_INFO(mLogger, "Timestamp mode {}", timestampmode_to_name(mTimestampMode));
+	LOG_INFO(mLogger, "IEC 61937 passthrough? {}", mIec61937Passthrough);
+	LOG_INFO(mLogger, "PCM jitter buffer? {} target {} ms", mPcmJitterBuffer, mPcmJitterTargetDepthMs);
+	LOG_INFO(mLogger, "Video async delivery? {} queue {} ({}), audio async delivery? {} queue {} ({})",
+		mVideoDelivery.async, mVideoDelivery.queueDepth, deliverypolicy_to_name(mVideoDelivery.policy),
+		mAudioDelivery.async, mAudioDelivery.queueDepth, deliverypolicy_to_name(mAudioDelivery.policy));
+	#endif
+
 	CAutoLock lck(&m_cStateLock);
 	DEVICE_INFO* diToUse(nullptr);
 	int channelCount = MWGetChannelCount();
@@ -258,6 +341,9 @@ MagewellCaptureFilter::MagewellCaptureFilter(LPUNKNOWN punk, HRESULT* phr) :
 	}
 
 
+	// created before the signal monitor which reports on it
+	mClock = new MWReferenceClock(phr, mDeviceInfo.hChannel, mDeviceInfo.deviceType == PRO);
+
 	if (diToUse == nullptr)
 	{
 		#ifndef NO_QUILL
@@ -269,9 +355,35 @@ MagewellCaptureFilter::MagewellCaptureFilter(LPUNKNOWN punk, HRESULT* phr) :
 	else
 	{
 		OnDeviceSelected();
+
+		// pins read the signal from a shared snapshot which is only reloaded when the driver reports a change
+		mSignalChangeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		mSignalMonitorStopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		if (mDeviceInfo.deviceType == PRO)
+		{
+			mSignalNotify = MWRegisterNotify(mDeviceInfo.hChannel, mSignalChangeEvent,
+				MWCAP_NOTIFY_INPUT_SPECIFIC_CHANGE |
+				MWCAP_NOTIFY_VIDEO_INPUT_SOURCE_CHANGE |
+				MWCAP_NOTIFY_AUDIO_INPUT_SOURCE_CHANGE |
+				MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE |
+				MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE |
+				MWCAP_NOTIFY_HDMI_INFOFRAME_HDR |
+				MWCAP_NOTIFY_HDMI_INFOFRAME_AVI |
+				MWCAP_NOTIFY_HDMI_INFOFRAME_AUDIO);
+		}
+		#ifndef NO_QUILL
+		if (!mSignalNotify)
+		{
+			LOG_INFO(mLogger, "[{}] Signal changes will be detected by reloading every {} ms", mLogPrefix,
+				signalRefreshIntervalMs);
+		}
+		#endif
+		RefreshSignal();
+		mSignalMonitor = std::thread(&MagewellCaptureFilter::MonitorSignal, this);
 	}
 
-	mClock = new MWReferenceClock(phr, mDeviceInfo.hChannel, mDeviceInfo.deviceType == PRO);
+	mVideoEngine = std::make_unique<VideoCaptureEngine>(this);
+	mAudioEngine = std::make_unique<AudioCaptureEngine>(this);
 
 	new MagewellVideoCapturePin(phr, this, false);
 	new MagewellVideoCapturePin(phr, this, true);
@@ -281,6 +393,22 @@ MagewellCaptureFilter::MagewellCaptureFilter(LPUNKNOWN punk, HRESULT* phr) :
 
 MagewellCaptureFilter::~MagewellCaptureFilter()
 {
+	// the pins have stopped so nothing is reading
+	mVideoEngine.reset();
+	mAudioEngine.reset();
+
+	if (mSignalMonitor.joinable())
+	{
+		SetEvent(mSignalMonitorStopEvent);
+		mSignalMonitor.join();
+	}
+	if (mSignalNotify)
+	{
+		MWUnregisterNotify(mDeviceInfo.hChannel, mSignalNotify);
+	}
+	if (mSignalChangeEvent) CloseHandle(mSignalChangeEvent);
+	if (mSignalMonitorStopEvent) CloseHandle(mSignalMonitorStopEvent);
+
 	if (mInited)
 	{
 		MWCaptureExitInstance();
@@ -292,6 +420,107 @@ void MagewellCaptureFilter::GetReferenceTime(REFERENCE_TIME* rt) const
 	m_pClock->GetTime(rt);
 }
 
+uint64_t MagewellCaptureFilter::GetSignal(DEVICE_SIGNAL* signal) const
+{
+	return mSignal.Read(signal);
+}
+
+void MagewellCaptureFilter::RefreshSignal()
+{
+	CAutoLock lck(&mSignalLock);
+
+	auto hChannel = mDeviceInfo.hChannel;
+	// zeroed so an unchanged signal compares equal to the last one
+	DEVICE_SIGNAL signal;
+	memset(&signal, 0, sizeof(signal));
+	signal.videoSignalResult = MWGetVideoSignalStatus(hChannel, &signal.videoSignal);
+	signal.audioSignalResult = MWGetAudioSignalStatus(hChannel, &signal.audioSignal);
+	signal.inputStatusResult = MWGetInputSpecificStatus(hChannel, &signal.inputStatus);
+	signal.infoFrameResult = MW_FAILED;
+	if (signal.inputStatusResult == MW_SUCCEEDED && signal.inputStatus.bValid)
+	{
+		signal.infoFrameResult = MWGetHDMIInfoFrameValidFlag(hChannel, &signal.infoFrameValidFlags);
+		HDMI_INFOFRAME_PACKET pkt;
+		if (signal.infoFrameValidFlags & MWCAP_HDMI_INFOFRAME_MASK_HDR
+			&& MW_SUCCEEDED == MWGetHDMIInfoFramePacket(hChannel, MWCAP_HDMI_INFOFRAME_ID_HDR, &pkt))
+		{
+			signal.hasHdrInfo = true;
+			signal.hdrInfo = pkt.hdrInfoFramePayload;
+		}
+		if (signal.infoFrameValidFlags & MWCAP_HDMI_INFOFRAME_MASK_AVI
+			&& MW_SUCCEEDED == MWGetHDMIInfoFramePacket(hChannel, MWCAP_HDMI_INFOFRAME_ID_AVI, &pkt))
+		{
+			signal.hasAviInfo = true;
+			signal.aviInfo = pkt.aviInfoFramePayload;
+		}
+		if (signal.infoFrameValidFlags & MWCAP_HDMI_INFOFRAME_MASK_AUDIO
+			&& MW_SUCCEEDED == MWGetHDMIInfoFramePacket(hChannel, MWCAP_HDMI_INFOFRAME_ID_AUDIO, &pkt))
+		{
+			signal.hasAudioInfo = true;
+			signal.audioInfo = pkt.audioInfoFramePayload;
+		}
+	}
+
+	// pins only reprocess the signal when the version moves on
+	DEVICE_SIGNAL current;
+	if (mSignal.Read(&current) == 0 || memcmp(&current, &signal, sizeof(signal)) != 0)
+	{
+		mSignal.Publish(signal);
+
+		#ifndef NO_QUILL
+		LOG_TRACE_L1(mLogger, "[{}] Device signal updated to version {}", mLogPrefix, mSignal.GetVersion());
+		#endif
+	}
+}
+
+void MagewellCaptureFilter::MonitorSignal()
+{
+	const HANDLE events[2] = { mSignalMonitorStopEvent, mSignalChangeEvent };
+	#ifndef NO_QUILL
+	uint64_t clockResyncs = 0;
+	uint32_t sinceClockReport = 0;
+	#endif
+	while (true)
+	{
+		auto dwRet = WaitForMultipleObjects(2, events, FALSE, signalRefreshIntervalMs);
+		if (dwRet == WAIT_OBJECT_0)
+		{
+			break;
+		}
+		if (dwRet == WAIT_FAILED)
+		{
+			#ifndef NO_QUILL
+			LOG_ERROR(mLogger, "[{}] Unable to wait for signal changes, signal will no longer be reloaded", mLogPrefix);
+			#endif
+			break;
+		}
+		if (dwRet == WAIT_OBJECT_0 + 1 && mSignalNotify)
+		{
+			// the status is only read to reset it, any change means the whole signal is reloaded
+			ULONGLONG statusBits = 0;
+			MWGetNotifyStatus(mDeviceInfo.hChannel, mSignalNotify, &statusBits);
+		}
+		RefreshSignal();
+
+		#ifndef NO_QUILL
+		// the clock error is reported every minute or so and whenever the clock has to resync
+		auto clockStats = mClock->GetStats();
+		if (clockStats.resyncs != clockResyncs)
+		{
+			LOG_WARNING(mLogger, "[{}] Reference clock resynced to the device time (error {:.1f})", mLogPrefix, clockStats.error);
+			clockResyncs = clockStats.resyncs;
+		}
+		if (++sinceClockReport * signalRefreshIntervalMs >= 60000)
+		{
+			sinceClockReport = 0;
+			LOG_TRACE_L1(mLogger, "[{}] Reference clock locked? {} drift {:.3f} ppm error {:.1f} rms {:.1f} samples {} discarded {}",
+				mLogPrefix, clockStats.locked, clockStats.driftPpm, clockStats.error, clockStats.rmsError, clockStats.samples,
+				clockStats.discarded);
+		}
+		#endif
+	}
+}
+
 void MagewellCaptureFilter::OnVideoSignalLoaded(VIDEO_SIGNAL* vs)
 {
 	mVideoInputStatus.inX = vs->signalStatus.cx;
@@ -543,6 +772,19 @@ void MagewellCaptureFilter::OnAudioFormatLoaded(AUDIO_FORMAT* af)
 	}
 	mAudioOutputStatus.audioOutChannelCount = af->outputChannelCount;
 	mAudioOutputStatus.audioOutDataBurstSize = af->dataBurstSize;
+	mAudioOutputStatus.audioOutFramesPerSample = af->framesPerSample;
+	mAudioOutputStatus.audioOutJitterBuffer = mPcmJitterBuffer;
+
+	if (mInfoCallback != nullptr)
+	{
+		mInfoCallback->Reload(&mAudioOutputStatus);
+	}
+}
+
+void MagewellCaptureFilter::OnPcmJitterStats(const PCM_JITTER_STATS* stats)
+{
+	mAudioOutputStatus.audioOutJitterDepthMs = stats->depthMs;
+	mAudioOutputStatus.audioOutJitterRatioPpm = stats->ratioPpm;
 
 	if (mInfoCallback != nullptr)
 	{
@@ -604,6 +846,83 @@ DeviceType MagewellCaptureFilter::GetDeviceType() const
 	return mDeviceInfo.deviceType;
 }
 
+VideoLatencyMode MagewellCaptureFilter::GetVideoLatencyMode() const
+{
+	return mVideoLatencyMode;
+}
+
+TimestampMode MagewellCaptureFilter::GetTimestampMode() const
+{
+	return mTimestampMode;
+}
+
+bool MagewellCaptureFilter::IsIec61937Passthrough() const
+{
+	return mIec61937Passthrough;
+}
+
+bool MagewellCaptureFilter::IsPcmJitterBufferEnabled() const
+{
+	return mPcmJitterBuffer;
+}
+
+uint32_t MagewellCaptureFilter::GetPcmJitterTargetDepthMs() const
+{
+	return mPcmJitterTargetDepthMs;
+}
+
+const DELIVERY_SETTINGS& MagewellCaptureFilter::GetVideoDeliverySettings() const
+{
+	return mVideoDelivery;
+}
+
+const DELIVERY_SETTINGS& MagewellCaptureFilter::GetAudioDeliverySettings() const
+{
+	return mAudioDelivery;
+}
+
+void MagewellCaptureFilter::ReadDeliverySettings(const char* stream, DELIVERY_SETTINGS* settings)
+{
+	std::string prefix{ stream };
+	ReadSetting((prefix + "asyncdelivery").c_str(), &settings->async);
+
+	DWORD queueDepth;
+	if (ReadSetting((prefix + "deliveryqueuedepth").c_str(), &queueDepth))
+	{
+		if (queueDepth > 0 && queueDepth <= maxDeliveryQueueDepth)
+		{
+			settings->queueDepth = queueDepth;
+		}
+		else
+		{
+			#ifndef NO_QUILL
+			LOG_WARNING(mLogger, "Ignoring {} delivery queue depth {}, must be 1 to {}", stream, queueDepth, maxDeliveryQueueDepth);
+			#endif
+		}
+	}
+
+	char policyName[32];
+	if (ReadSetting((prefix + "deliverypolicy").c_str(), policyName))
+	{
+		if (!ParseDeliveryPolicy(policyName, &settings->policy))
+		{
+			#ifndef NO_QUILL
+			LOG_WARNING(mLogger, "Ignoring unknown {} delivery policy {}", stream, policyName);
+			#endif
+		}
+	}
+}
+
+VideoCaptureEngine* MagewellCaptureFilter::GetVideoEngine() const
+{
+	return mVideoEngine.get();
+}
+
+AudioCaptureEngine* MagewellCaptureFilter::GetAudioEngine() const
+{
+	return mAudioEngine.get();
+}
+
 STDMETHODIMP MagewellCaptureFilter::GetState(DWORD dw, FILTER_STATE* pState)
 {
 	CBaseFilter::GetState(dw, pState);
@@ -733,22 +1052,10 @@ STDMETHODIMP MagewellCaptureFilter::CreatePage(const GUID& guid, IPropertyPage**
 }
 
 //////////////////////////////////////////////////////////////////////////
-// MagewellCapturePin
+// CaptureEngine
 //////////////////////////////////////////////////////////////////////////
-MagewellCapturePin::MagewellCapturePin(HRESULT* phr, MagewellCaptureFilter* pParent, LPCSTR pObjectName,
-	LPCWSTR pPinName, std::string pLogPrefix) :
-	CSourceStream(pObjectName, phr, pParent, pPinName),
-	mFrameCounter(0),
-	mPreview(false),
-	mFilter(pParent),
-	mStreamStartTime(0),
-	mNotify(nullptr),
-	mCaptureEvent(nullptr),
-	mNotifyEvent(CreateEvent(nullptr, FALSE, FALSE, nullptr)),
-	mLastMwResult(),
-	mLastSampleDiscarded(0),
-	mSendMediaType(0),
-	mFrameEndTime(0)
+CaptureEngine::CaptureEngine(MagewellCaptureFilter* pFilter, std::string pLogPrefix) :
+	mFilter(pFilter)
 {
 	#ifndef NO_QUILL
 	mLogPrefix = std::move(pLogPrefix);
@@ -756,92 +1063,872 @@ MagewellCapturePin::MagewellCapturePin(HRESULT* phr, MagewellCaptureFilter* pPar
 	#endif
 }
 
-MagewellCapturePin::~MagewellCapturePin()
-{
-	CloseHandle(mNotifyEvent);
-}
-
-HRESULT MagewellCapturePin::HandleStreamStateChange(IMediaSample* pms)
+int CaptureEngine::Subscribe(uint32_t depth, DeliveryPolicy policy, uint32_t heldSlots, HANDLE notifyEvent)
 {
-	// TODO override this if MediaType changed?
-	int iStreamState = CheckStreamState(pms);
-	if (iStreamState == STREAM_FLOWING)
-	{
-		if (mLastSampleDiscarded)
-		{
-			#ifndef NO_QUILL
-			LOG_TRACE_L1(mLogger, "[{}] Recovery after sample discard, setting discontinuity", mLogPrefix);
-			#endif
+	CAutoLock lck(&mConsumerLock);
 
-			pms->SetDiscontinuity(TRUE);
-			mLastSampleDiscarded = FALSE;
-		}
-		return S_OK;
-	}
-	else
+	auto consumer = mFrames->Subscribe(depth, policy, [notifyEvent] { SetEvent(notifyEvent); });
+	if (consumer == FrameFanout::noConsumer)
 	{
 		#ifndef NO_QUILL
-		LOG_TRACE_L1(mLogger, "[{}] Entering stream discard", mLogPrefix);
+		LOG_ERROR(mLogger, "[{}] Unable to subscribe, {} consumers already subscribed", mLogPrefix, mConsumerCount);
 		#endif
 
-		mLastSampleDiscarded = TRUE;
-		return S_FALSE;
+		return consumer;
 	}
-}
+	if (static_cast<size_t>(consumer) >= mHeldSlots.size())
+	{
+		mHeldSlots.resize(consumer + 1, 0);
+	}
+	// a consumer can have a full queue while holding as many frames as it is allowed to
+	mHeldSlots[consumer] = depth + std::max(heldSlots, 1u);
+	mConsumerCount++;
+
+	uint32_t slotCount = 1;
+	for (auto held : mHeldSlots) slotCount += held;
+	RequestSlotCount(slotCount);
 
-HRESULT MagewellCapturePin::OnThreadStartPlay()
-{
 	#ifndef NO_QUILL
-	REFERENCE_TIME rt;
-	mFilter->GetReferenceTime(&rt);
+	LOG_INFO(mLogger, "[{}] Consumer {} subscribed (depth {} {}, holds {}), {} consumers need {} slots", mLogPrefix, consumer,
+		depth, deliverypolicy_to_name(policy), heldSlots, mConsumerCount, slotCount);
+	#endif
 
-	if (mStreamStartTime == 0)
+	if (!mReading)
 	{
-		LOG_WARNING(mLogger, "[{}] Pin worker thread starting at {} but stream not started yet", mLogPrefix, rt);
+		StartReading();
+		mReading = true;
 	}
-	else
+	return consumer;
+}
+
+void CaptureEngine::Unsubscribe(int consumer)
+{
+	CAutoLock lck(&mConsumerLock);
+	if (consumer == FrameFanout::noConsumer)
 	{
-		LOG_WARNING(mLogger, "[{}] Pin worker thread starting at {}, stream started at {}", mLogPrefix, rt,
-			mStreamStartTime);
+		return;
 	}
+
+	#ifndef NO_QUILL
+	auto stats = mFrames->GetStats(consumer);
+	LOG_INFO(mLogger, "[{}] Consumer {} unsubscribed, received {} frames and dropped {}", mLogPrefix, consumer,
+		stats.received, stats.dropped);
 	#endif
-	return S_OK;
+
+	mFrames->Unsubscribe(consumer);
+	mHeldSlots[consumer] = 0;
+	if (--mConsumerCount == 0 && mReading)
+	{
+		StopReading();
+		mReading = false;
+
+		#ifndef NO_QUILL
+		LOG_INFO(mLogger, "[{}] Stopped reading, {} frames dropped as every slot was held and {} as they did not fit",
+			mLogPrefix, mFrames->GetDroppedCount(), mFrames->GetOversizedCount());
+		#endif
+	}
 }
 
-STDMETHODIMP MagewellCapturePin::NonDelegatingQueryInterface(REFIID riid, void** ppv)
+void CaptureEngine::RequestSlotCount(uint32_t slotCount)
 {
-	CheckPointer(ppv, E_POINTER)
-
-	if (riid == _uuidof(IAMStreamConfig))
+	CAutoLock lck(&mRequestLock);
+	// slots are never taken away while reading as a consumer may still hold them
+	if (slotCount > mRequestedSlotCount)
 	{
-		return GetInterface(static_cast<IAMStreamConfig*>(this), ppv);
+		mRequestedSlotCount = std::min(slotCount, mFrames->GetMaxSlotCount());
+		mSlotsRequested.store(true, std::memory_order_release);
 	}
-	if (riid == _uuidof(IKsPropertySet))
+}
+
+void CaptureEngine::RequestFrameSize(size_t frameSize)
+{
+	CAutoLock lck(&mRequestLock);
+	if (frameSize != mRequestedFrameSize)
 	{
-		return GetInterface(static_cast<IKsPropertySet*>(this), ppv);
+		mRequestedFrameSize = frameSize;
+		mSlotsRequested.store(true, std::memory_order_release);
 	}
-	if (riid == _uuidof(IAMStreamControl))
+}
+
+bool CaptureEngine::ApplyRequestedSlots()
+{
+	// nothing is pending so the last resize succeeded and the slots fit
+	if (!mSlotsRequested.load(std::memory_order_acquire))
 	{
-		return GetInterface(static_cast<IAMStreamControl*>(this), ppv);
+		return true;
 	}
-	if (riid == _uuidof(IAMPushSource))
+	CAutoLock lck(&mRequestLock);
+	if (mSlotsRequested.load(std::memory_order_relaxed))
 	{
-		return GetInterface(static_cast<IAMPushSource*>(this), ppv);
+		if (mRequestedFrameSize > mFrames->GetFrameCapacity())
+		{
+			OnSlotsReplaced();
+		}
+		if (mFrames->Reset(mRequestedSlotCount, mRequestedFrameSize))
+		{
+			mSlotsRequested.store(false, std::memory_order_relaxed);
+			mSlotsBlocked = false;
+
+			#ifndef NO_QUILL
+			LOG_INFO(mLogger, "[{}] Reading into {} slots of {} bytes", mLogPrefix, mFrames->GetSlotCount(),
+				mFrames->GetFrameCapacity());
+			#endif
+		}
+		else if (!mSlotsBlocked)
+		{
+			// retried on every frame until downstream returns the slots it holds
+			mSlotsBlocked = true;
+
+			#ifndef NO_QUILL
+			LOG_WARNING(mLogger, "[{}] Unable to resize slots to {} bytes while {} are held", mLogPrefix,
+				mRequestedFrameSize, mFrames->GetHeldCount());
+			#endif
+		}
 	}
-	return CSourceStream::NonDelegatingQueryInterface(riid, ppv);
+	return mFrames->GetFrameCapacity() >= mRequestedFrameSize;
 }
 
-// largely a copy of CSourceStream but with logging replaced (as DbgLog to file seems to never ever work)
-// and with better error handling to avoid visible freezes with no option but to restart
-HRESULT MagewellCapturePin::DoBufferProcessingLoop(void) {
-	#ifndef NO_QUILL
-	LOG_INFO(mLogger, "[{}] Entering DoBufferProcessingLoop", mLogPrefix);
-	#endif
+//////////////////////////////////////////////////////////////////////////
+// VideoCaptureEngine
+//////////////////////////////////////////////////////////////////////////
+VideoCaptureEngine::VideoCaptureEngine(MagewellCaptureFilter* pFilter) :
+	CaptureEngine(pFilter, "VideoEngine"),
+	mStopEvent(CreateEvent(nullptr, TRUE, FALSE, nullptr)),
+	mNotifyEvent(CreateEvent(nullptr, FALSE, FALSE, nullptr)),
+	mCaptureEvent(CreateEvent(nullptr, FALSE, FALSE, nullptr)),
+	mPinnedSlots(MWVideoBufferPinApi{ pFilter->GetChannelHandle() })
+{
+}
+
+VideoCaptureEngine::~VideoCaptureEngine()
+{
+	CAutoLock lck(&mConsumerLock);
+	if (mReading)
+	{
+		StopReading();
+		mReading = false;
+	}
+	CloseHandle(mStopEvent);
+	CloseHandle(mNotifyEvent);
+	CloseHandle(mCaptureEvent);
+}
+
+void VideoCaptureEngine::SetFormat(const VIDEO_FORMAT& format)
+{
+	CAutoLock lck(&mConsumerLock);
+	{
+		CAutoLock fmt(&mRequestLock);
+		if (mFormat.cx == format.cx && mFormat.cy == format.cy && mFormat.pixelStructure == format.pixelStructure
+			&& mFormat.lineLength == format.lineLength && mFormat.imageSize == format.imageSize
+			&& mFormat.frameInterval == format.frameInterval && mFormat.colourFormat == format.colourFormat
+			&& mFormat.quantization == format.quantization && mFormat.saturation == format.saturation
+			&& mFormat.aspectX == format.aspectX && mFormat.aspectY == format.aspectY
+			&& EqualRect(&mFormat.crop, &format.crop) && mFormat.fieldRate == format.fieldRate)
+		{
+			return;
+		}
+		mFormat = format;
+		// in the same critical section so the producer never sees the new format without the slots to hold it
+		RequestFrameSize(format.imageSize);
+	}
+
+	#ifndef NO_QUILL
+	LOG_INFO(mLogger, "[{}] Capturing {} x {} {} {} bytes", mLogPrefix, format.cx, format.cy, format.pixelStructureName,
+		format.imageSize);
+	#endif
+
+	if (mReading && mFilter->GetDeviceType() == USB)
+	{
+		StopReading();
+		StartReading();
+	}
+}
+
+void VideoCaptureEngine::SetCaptureRequest(const VIDEO_CAPTURE_REQUEST& request)
+{
+	CAutoLock lck(&mRequestLock);
+	mCaptureRequest = request;
+}
+
+VIDEO_CAPTURE_REQUEST VideoCaptureEngine::GetCaptureRequest()
+{
+	CAutoLock lck(&mRequestLock);
+	return mCaptureRequest;
+}
+
+void VideoCaptureEngine::StartReading()
+{
+	// nothing is producing yet
+	ApplyRequestedSlots();
+
+	auto hChannel = mFilter->GetChannelHandle();
+	if (mFilter->GetDeviceType() == PRO)
+	{
+		auto mwResult = MWStartVideoCapture(hChannel, mCaptureEvent);
+		#ifndef NO_QUILL
+		if (mwResult != MW_SUCCEEDED)
+		{
+			LOG_ERROR(mLogger, "[{}] Unable to MWStartVideoCapture", mLogPrefix);
+		}
+		else
+		{
+			LOG_INFO(mLogger, "[{}] MWStartVideoCapture started", mLogPrefix);
+		}
+		#endif
+
+		// register for signal change events & video buffering, fields are only captured from an interlaced signal
+		auto latencyMode = mFilter->GetVideoLatencyMode();
+		ULONGLONG bufferingBits = latencyMode == LATENCY_FRAME_BUFFERED
+			? MWCAP_NOTIFY_VIDEO_FRAME_BUFFERED
+			: latencyMode == LATENCY_FIELD_BUFFERED
+			? MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING | MWCAP_NOTIFY_VIDEO_FIELD_BUFFERED
+			: MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING;
+		mNotify = MWRegisterNotify(hChannel, mNotifyEvent,
+			MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE |
+			bufferingBits |
+			MWCAP_NOTIFY_VIDEO_INPUT_SOURCE_CHANGE);
+		if (!mNotify)
+		{
+			#ifndef NO_QUILL
+			LOG_ERROR(mLogger, "[{}] Unable to MWRegistryNotify", mLogPrefix);
+			#endif
+		}
+		ResetEvent(mStopEvent);
+		mFields.Reset();
+		mReader = std::thread(&VideoCaptureEngine::ReadFrames, this);
+	}
+	else
+	{
+		{
+			CAutoLock lck(&mRequestLock);
+			mCaptureFormat = mFormat;
+		}
+		mCapture = MWCreateVideoCapture(hChannel, mCaptureFormat.cx, mCaptureFormat.cy, mCaptureFormat.pixelStructure,
+			mCaptureFormat.frameInterval, OnFrameCaptured, this);
+		#ifndef NO_QUILL
+		if (mCapture == nullptr)
+		{
+			LOG_ERROR(mLogger, "[{}] MWCreateVideoCapture failed {}x{} {} {}", mLogPrefix, mCaptureFormat.cx,
+				mCaptureFormat.cy, mCaptureFormat.pixelStructureName, mCaptureFormat.frameInterval);
+		}
+		else
+		{
+			LOG_INFO(mLogger, "[{}] MWCreateVideoCapture succeeded {}x{} {} {}", mLogPrefix, mCaptureFormat.cx,
+				mCaptureFormat.cy, mCaptureFormat.pixelStructureName, mCaptureFormat.frameInterval);
+		}
+		#endif
+	}
+}
+
+void VideoCaptureEngine::StopReading()
+{
+	auto hChannel = mFilter->GetChannelHandle();
+	if (mFilter->GetDeviceType() == PRO)
+	{
+		SetEvent(mStopEvent);
+		if (mReader.joinable())
+		{
+			mReader.join();
+		}
+		if (mNotify)
+		{
+			MWUnregisterNotify(hChannel, mNotify);
+			mNotify = nullptr;
+		}
+		MWStopVideoCapture(hChannel);
+		mPinnedSlots.Clear();
+	}
+	else if (mCapture != nullptr)
+	{
+		const auto mwResult = MWDestoryVideoCapture(mCapture);
+		mCapture = nullptr;
+
+		#ifndef NO_QUILL
+		if (MW_SUCCEEDED == mwResult)
+		{
+			LOG_INFO(mLogger, "[{}] MWDestoryVideoCapture complete", mLogPrefix);
+		}
+		else
+		{
+			LOG_WARNING(mLogger, "[{}] MWDestoryVideoCapture failed", mLogPrefix);
+		}
+		#endif
+	}
+}
+
+void VideoCaptureEngine::OnSlotsReplaced()
+{
+	// slots are only replaced by the producer so nothing is being captured into them
+	mPinnedSlots.Clear();
+}
+
+void VideoCaptureEngine::ReadFrames()
+{
+	#ifndef NO_QUILL
+	CustomFrontend::preallocate();
+	#endif
+
+	auto hChannel = mFilter->GetChannelHandle();
+	auto latencyMode = mFilter->GetVideoLatencyMode();
+	const HANDLE events[2] = { mStopEvent, mNotifyEvent };
+	DEVICE_SIGNAL signal;
+	VIDEO_FORMAT format;
+	while (true)
+	{
+		auto dwRet = WaitForMultipleObjects(2, events, FALSE, 1000);
+		if (dwRet == WAIT_OBJECT_0)
+		{
+			break;
+		}
+		if (dwRet == WAIT_FAILED)
+		{
+			#ifndef NO_QUILL
+			LOG_TRACE_L1(mLogger, "[{}] Wait for frame failed, retry after backoff", mLogPrefix);
+			#endif
+
+			BACKOFF;
+			continue;
+		}
+		mFilter->GetSignal(&signal);
+		auto hasSignal = signal.videoSignalResult == MW_SUCCEEDED && signal.videoSignal.state == MWCAP_VIDEO_SIGNAL_LOCKED;
+		{
+			CAutoLock lck(&mRequestLock);
+			format = mFormat;
+		}
+		if (dwRet == WAIT_OBJECT_0 + 1)
+		{
+			ULONGLONG statusBits = 0;
+			auto mwResult = MWGetNotifyStatus(hChannel, mNotify, &statusBits);
+			if (mwResult != MW_SUCCEEDED)
+			{
+				#ifndef NO_QUILL
+				LOG_TRACE_L1(mLogger, "[{}] MWGetNotifyStatus failed {}", mLogPrefix, static_cast<int>(mwResult));
+				#endif
+
+				BACKOFF;
+				continue;
+			}
+			if (statusBits & (MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE | MWCAP_NOTIFY_VIDEO_INPUT_SOURCE_CHANGE))
+			{
+				#ifndef NO_QUILL
+				LOG_TRACE_L1(mLogger, "[{}] Video signal change, reloading signal", mLogPrefix);
+				#endif
+
+				// the pins pick up the new signal and renegotiate, setting the new format here if it changed
+				mFilter->RefreshSignal();
+				continue;
+			}
+			ULONGLONG captureBits = format.fieldRate
+				? MWCAP_NOTIFY_VIDEO_FIELD_BUFFERED
+				: latencyMode == LATENCY_FRAME_BUFFERED
+				? MWCAP_NOTIFY_VIDEO_FRAME_BUFFERED
+				: MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING;
+			if (!(statusBits & captureBits) && hasSignal)
+			{
+				continue;
+			}
+		}
+		else if (hasSignal)
+		{
+			continue;
+		}
+
+		// without a signal the device renders a no signal image
+		if (!ApplyRequestedSlots())
+		{
+			mFrames->Drop();
+			continue;
+		}
+		CaptureFrame(format, hasSignal);
+	}
+}
+
+void VideoCaptureEngine::CaptureFrame(const VIDEO_FORMAT& format, bool hasSignal)
+{
+	auto hChannel = mFilter->GetChannelHandle();
+	auto slot = mFrames->Acquire();
+	if (slot == FrameFanout::noSlot)
+	{
+		// the pins see the gap in the frame sequence
+		mFrames->Drop();
+
+		#ifndef NO_QUILL
+		LOG_TRACE_L1(mLogger, "[{}] Every slot is held, dropping frame", mLogPrefix);
+		#endif
+
+		return;
+	}
+	if (format.imageSize > mFrames->GetFrameCapacity())
+	{
+		#ifndef NO_QUILL
+		LOG_WARNING(mLogger, "[{}] {} byte frame does not fit in a {} byte slot, dropping frame", mLogPrefix,
+			format.imageSize, mFrames->GetFrameCapacity());
+		#endif
+
+		mFrames->Release(slot);
+		mFrames->Drop();
+		return;
+	}
+	auto data = mFrames->Get(slot).data;
+	if (!mPinnedSlots.Pin(data, mFrames->GetFrameCapacity()))
+	{
+		#ifndef NO_QUILL
+		LOG_WARNING(mLogger, "[{}] Unable to pin {} byte slot, dropping frame", mLogPrefix, mFrames->GetFrameCapacity());
+		#endif
+
+		mFrames->Release(slot);
+		mFrames->Drop();
+		return;
+	}
+
+	MWCAP_VIDEO_BUFFER_INFO bufferInfo;
+	auto mwResult = MWGetVideoBufferInfo(hChannel, &bufferInfo);
+	auto frameId = MWCAP_VIDEO_FRAME_ID_NEWEST_BUFFERING;
+	auto deinterlaceMode = MWCAP_VIDEO_DEINTERLACE_BLEND;
+	uint32_t fieldIndex = 0;
+	if (mwResult == MW_SUCCEEDED && hasSignal)
+	{
+		if (format.fieldRate)
+		{
+			// the newest field is captured alone, a notification which arrives late can leave fields behind
+			fieldIndex = bufferInfo.iBufferedFieldIndex & 1;
+			mFields.SetFrameCount(bufferInfo.cMaxFrames);
+			auto fields = mFields.Advance(bufferInfo.iNewestBuffered, fieldIndex);
+			if (fields == 0)
+			{
+				mFrames->Release(slot);
+				return;
+			}
+			for (uint32_t i = 1; i < fields; i++)
+			{
+				mFrames->Drop();
+			}
+			frameId = bufferInfo.iNewestBuffered;
+			deinterlaceMode = fieldIndex == 0 ? MWCAP_VIDEO_DEINTERLACE_TOP_FIELD : MWCAP_VIDEO_DEINTERLACE_BOTTOM_FIELD;
+		}
+		else if (mFilter->GetVideoLatencyMode() == LATENCY_FRAME_BUFFERED)
+		{
+			frameId = bufferInfo.iNewestBufferedFullFrame;
+		}
+		else
+		{
+			frameId = bufferInfo.iNewestBuffering;
+		}
+	}
+	if (mwResult == MW_SUCCEEDED)
+	{
+		mwResult = MWCaptureVideoFrameToVirtualAddressEx(
+			hChannel,
+			frameId,
+			data,
+			format.imageSize,
+			format.lineLength,
+			FALSE,
+			nullptr,
+			format.pixelStructure,
+			format.cx,
+			format.cy,
+			0,
+			64,
+			nullptr,
+			nullptr,
+			0,
+			100,
+			0,
+			100,
+			0,
+			deinterlaceMode,
+			MWCAP_VIDEO_ASPECT_RATIO_IGNORE,
+			IsRectEmpty(&format.crop) ? nullptr : &format.crop,
+			nullptr,
+			format.aspectX,
+			format.aspectY,
+			format.colourFormat,
+			format.quantization,
+			format.saturation
+		);
+	}
+	auto completed = false;
+	MWCAP_VIDEO_CAPTURE_STATUS captureStatus{};
+	if (mwResult == MW_SUCCEEDED)
+	{
+		// the capture is waited for even when stopping as the device is writing into the slot
+		do
+		{
+			auto dwRet = WaitForSingleObject(mCaptureEvent, 1000);
+			if (dwRet != WAIT_OBJECT_0)
+			{
+				#ifndef NO_QUILL
+				LOG_TRACE_L1(mLogger, "[{}] Wait for capture failed ({:#08x})", mLogPrefix, dwRet);
+				#endif
+
+				break;
+			}
+			mwResult = MWGetVideoCaptureStatus(hChannel, &captureStatus);
+			completed = captureStatus.bFrameCompleted;
+		} while (mwResult == MW_SUCCEEDED && !completed);
+	}
+	if (!completed)
+	{
+		#ifndef NO_QUILL
+		LOG_TRACE_L1(mLogger, "[{}] Unable to capture frame ({})", mLogPrefix, static_cast<int>(mwResult));
+		#endif
+
+		mFrames->Release(slot);
+		mFrames->Drop();
+		return;
+	}
+
+	// the frame is stamped when the last field is fully buffered, a field when it is
+	LONGLONG deviceTime = 0;
+	MWCAP_VIDEO_FRAME_INFO capturedFrameInfo;
+	if (MWGetVideoFrameInfo(hChannel, captureStatus.iFrame, &capturedFrameInfo) == MW_SUCCEEDED)
+	{
+		deviceTime = format.fieldRate
+			? capturedFrameInfo.allFieldBufferedTimes[fieldIndex]
+			: capturedFrameInfo.bInterlaced
+			? std::max(capturedFrameInfo.allFieldBufferedTimes[0], capturedFrameInfo.allFieldBufferedTimes[1])
+			: capturedFrameInfo.allFieldBufferedTimes[0];
+	}
+	if (format.pixelStructure == MWFOURCC_AYUV)
+	{
+		// card writes each pixel as A Y U V whereas directshow expects V U Y A
+		SwizzleAyuv(&mAyuvWorkers, data, format.lineLength, format.cy);
+	}
+	mFrames->Publish(slot, static_cast<int>(format.imageSize), static_cast<uint64_t>(std::max(deviceTime, 0LL)));
+}
+
+void VideoCaptureEngine::OnFrameCaptured(BYTE* pbFrame, int cbFrame, UINT64 u64TimeStamp, void* pParam)
+{
+	auto engine = static_cast<VideoCaptureEngine*>(pParam);
+	auto& frames = *engine->mFrames;
+	if (!engine->ApplyRequestedSlots() || cbFrame < 0 || static_cast<size_t>(cbFrame) > frames.GetFrameCapacity())
+	{
+		frames.Drop();
+		return;
+	}
+	auto slot = frames.Acquire();
+	if (slot == FrameFanout::noSlot)
+	{
+		// the pins see the gap in the frame sequence
+		frames.Drop();
+		return;
+	}
+	auto data = frames.Get(slot).data;
+	memcpy(data, pbFrame, cbFrame);
+	const auto& format = engine->mCaptureFormat;
+	if (format.pixelStructure == MWFOURCC_AYUV)
+	{
+		SwizzleAyuv(&engine->mAyuvWorkers, data, format.lineLength, format.cy);
+	}
+	frames.Publish(slot, cbFrame, u64TimeStamp);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AudioCaptureEngine
+//////////////////////////////////////////////////////////////////////////
+AudioCaptureEngine::AudioCaptureEngine(MagewellCaptureFilter* pFilter) :
+	CaptureEngine(pFilter, "AudioEngine"),
+	mStopEvent(CreateEvent(nullptr, TRUE, FALSE, nullptr)),
+	mNotifyEvent(CreateEvent(nullptr, FALSE, FALSE, nullptr))
+{
+	// every frame is the same size whatever the format
+	RequestFrameSize(maxFrameLengthInBytes);
+}
+
+AudioCaptureEngine::~AudioCaptureEngine()
+{
+	CAutoLock lck(&mConsumerLock);
+	if (mReading)
+	{
+		StopReading();
+		mReading = false;
+	}
+	CloseHandle(mStopEvent);
+	CloseHandle(mNotifyEvent);
+}
+
+void AudioCaptureEngine::SetFormat(const AUDIO_FORMAT& format)
+{
+	CAutoLock lck(&mConsumerLock);
+	if (mFs == format.fs && mBitDepth == format.bitDepth && mChannelCount == format.inputChannelCount)
+	{
+		return;
+	}
+	mFs = format.fs;
+	mBitDepth = format.bitDepth;
+	mChannelCount = format.inputChannelCount;
+	if (mReading && mFilter->GetDeviceType() == USB)
+	{
+		StopReading();
+		StartReading();
+	}
+}
+
+void AudioCaptureEngine::StartReading()
+{
+	// nothing is producing yet
+	ApplyRequestedSlots();
+
+	auto hChannel = mFilter->GetChannelHandle();
+	if (mFilter->GetDeviceType() == PRO)
+	{
+		if (MWStartAudioCapture(hChannel) != MW_SUCCEEDED)
+		{
+			#ifndef NO_QUILL
+			LOG_ERROR(mLogger, "[{}] Unable to MWStartAudioCapture", mLogPrefix);
+			#endif
+		}
+
+		// register for signal change events & audio buffered
+		mNotify = MWRegisterNotify(hChannel, mNotifyEvent,
+			MWCAP_NOTIFY_AUDIO_INPUT_SOURCE_CHANGE | MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE |
+			MWCAP_NOTIFY_AUDIO_FRAME_BUFFERED);
+		if (!mNotify)
+		{
+			#ifndef NO_QUILL
+			LOG_ERROR(mLogger, "[{}] Unable to MWRegistryNotify", mLogPrefix);
+			#endif
+		}
+		ResetEvent(mStopEvent);
+		mReader = std::thread(&AudioCaptureEngine::ReadFrames, this);
+	}
+	else
+	{
+		mCapture = MWCreateAudioCapture(hChannel, MWCAP_AUDIO_CAPTURE_NODE_EMBEDDED_CAPTURE, mFs, mBitDepth, mChannelCount,
+			OnFrameCaptured, this);
+		#ifndef NO_QUILL
+		if (mCapture == nullptr)
+		{
+			LOG_ERROR(mLogger, "[{}] MWCreateAudioCapture failed {} Hz {} bits {} channels", mLogPrefix, mFs, mBitDepth,
+				mChannelCount);
+		}
+		#endif
+	}
+}
+
+void AudioCaptureEngine::StopReading()
+{
+	auto hChannel = mFilter->GetChannelHandle();
+	if (mFilter->GetDeviceType() == PRO)
+	{
+		SetEvent(mStopEvent);
+		if (mReader.joinable())
+		{
+			mReader.join();
+		}
+		if (mNotify)
+		{
+			MWUnregisterNotify(hChannel, mNotify);
+			mNotify = nullptr;
+		}
+		MWStopAudioCapture(hChannel);
+	}
+	else if (mCapture != nullptr)
+	{
+		const auto mwResult = MWDestoryAudioCapture(mCapture);
+		mCapture = nullptr;
+
+		#ifndef NO_QUILL
+		if (MW_SUCCEEDED != mwResult)
+		{
+			LOG_WARNING(mLogger, "[{}] MWDestoryAudioCapture failed", mLogPrefix);
+		}
+		#endif
+	}
+}
+
+void AudioCaptureEngine::ReadFrames()
+{
+	#ifndef NO_QUILL
+	CustomFrontend::preallocate();
+	#endif
+
+	auto hChannel = mFilter->GetChannelHandle();
+	const HANDLE events[2] = { mStopEvent, mNotifyEvent };
+	MWCAP_AUDIO_CAPTURE_FRAME frame;
+	while (true)
+	{
+		auto dwRet = WaitForMultipleObjects(2, events, FALSE, 1000);
+		if (dwRet == WAIT_OBJECT_0)
+		{
+			break;
+		}
+		if (dwRet != WAIT_OBJECT_0 + 1)
+		{
+			continue;
+		}
+		ULONGLONG statusBits = 0;
+		if (MWGetNotifyStatus(hChannel, mNotify, &statusBits) != MW_SUCCEEDED)
+		{
+			BACKOFF;
+			continue;
+		}
+		if (statusBits & (MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE | MWCAP_NOTIFY_AUDIO_INPUT_SOURCE_CHANGE))
+		{
+			#ifndef NO_QUILL
+			LOG_TRACE_L1(mLogger, "[{}] Audio signal change, reloading signal", mLogPrefix);
+			#endif
+
+			mFilter->RefreshSignal();
+			continue;
+		}
+		if (!(statusBits & MWCAP_NOTIFY_AUDIO_FRAME_BUFFERED))
+		{
+			continue;
+		}
+		ApplyRequestedSlots();
+
+		// keep reading until the device has no more frames to give, a notification raised meanwhile may be for a
+		// frame that has already been read so finding nothing to read is expected
+		auto framesRead = 0;
+		while (WaitForSingleObject(mStopEvent, 0) != WAIT_OBJECT_0 && MW_SUCCEEDED == MWCaptureAudioFrame(hChannel, &frame))
+		{
+			// a frame which can't be queued shows up as a gap in the frame sequence
+			mFrames->Push(reinterpret_cast<const uint8_t*>(frame.adwSamples), maxFrameLengthInBytes,
+				static_cast<uint64_t>(std::max(frame.llTimestamp, 0LL)));
+			framesRead++;
+		}
+
+		#ifndef NO_QUILL
+		if (framesRead > 1)
+		{
+			LOG_TRACE_L3(mLogger, "[{}] Read {} buffered frames", mLogPrefix, framesRead);
+		}
+		#endif
+	}
+}
+
+void AudioCaptureEngine::OnFrameCaptured(const BYTE* pbFrame, int cbFrame, UINT64 u64TimeStamp, void* pParam)
+{
+	auto engine = static_cast<AudioCaptureEngine*>(pParam);
+	engine->ApplyRequestedSlots();
+	// a frame which can't be queued shows up as a gap in the frame sequence
+	engine->mFrames->Push(pbFrame, cbFrame, u64TimeStamp);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// MagewellCapturePin
+//////////////////////////////////////////////////////////////////////////
+MagewellCapturePin::MagewellCapturePin(HRESULT* phr, MagewellCaptureFilter* pParent, LPCSTR pObjectName,
+	LPCWSTR pPinName, std::string pLogPrefix) :
+	CSourceStream(pObjectName, phr, pParent, pPinName),
+	mFrameCounter(0),
+	mPreview(false),
+	mFilter(pParent),
+	mStreamStartTime(0),
+	mNotifyEvent(CreateEvent(nullptr, FALSE, FALSE, nullptr)),
+	mLastMwResult(),
+	mLastSampleDiscarded(0),
+	mSendMediaType(0),
+	mFrameEndTime(0)
+{
+	#ifndef NO_QUILL
+	mLogPrefix = std::move(pLogPrefix);
+	mLogger = CustomFrontend::get_logger("filter");
+	#endif
+}
+
+MagewellCapturePin::~MagewellCapturePin()
+{
+	CloseHandle(mNotifyEvent);
+}
+
+HRESULT MagewellCapturePin::HandleStreamStateChange(IMediaSample* pms)
+{
+	// TODO override this if MediaType changed?
+	int iStreamState = CheckStreamState(pms);
+	if (iStreamState == STREAM_FLOWING)
+	{
+		if (mLastSampleDiscarded)
+		{
+			#ifndef NO_QUILL
+			LOG_TRACE_L1(mLogger, "[{}] Recovery after sample discard, setting discontinuity", mLogPrefix);
+			#endif
+
+			pms->SetDiscontinuity(TRUE);
+			mLastSampleDiscarded = FALSE;
+		}
+		return S_OK;
+	}
+	else
+	{
+		#ifndef NO_QUILL
+		LOG_TRACE_L1(mLogger, "[{}] Entering stream discard", mLogPrefix);
+		#endif
+
+		mLastSampleDiscarded = TRUE;
+		return S_FALSE;
+	}
+}
+
+HRESULT MagewellCapturePin::OnThreadStartPlay()
+{
+	#ifndef NO_QUILL
+	REFERENCE_TIME rt;
+	mFilter->GetReferenceTime(&rt);
+
+	if (mStreamStartTime == 0)
+	{
+		LOG_WARNING(mLogger, "[{}] Pin worker thread starting at {} but stream not started yet", mLogPrefix, rt);
+	}
+	else
+	{
+		LOG_WARNING(mLogger, "[{}] Pin worker thread starting at {}, stream started at {}", mLogPrefix, rt,
+			mStreamStartTime);
+	}
+	#endif
+	return S_OK;
+}
+
+STDMETHODIMP MagewellCapturePin::NonDelegatingQueryInterface(REFIID riid, void** ppv)
+{
+	CheckPointer(ppv, E_POINTER)
+
+	if (riid == _uuidof(IAMStreamConfig))
+	{
+		return GetInterface(static_cast<IAMStreamConfig*>(this), ppv);
+	}
+	if (riid == _uuidof(IKsPropertySet))
+	{
+		return GetInterface(static_cast<IKsPropertySet*>(this), ppv);
+	}
+	if (riid == _uuidof(IAMStreamControl))
+	{
+		return GetInterface(static_cast<IAMStreamControl*>(this), ppv);
+	}
+	if (riid == _uuidof(IAMPushSource))
+	{
+		return GetInterface(static_cast<IAMPushSource*>(this), ppv);
+	}
+	return CSourceStream::NonDelegatingQueryInterface(riid, ppv);
+}
+
+// largely a copy of CSourceStream but with logging replaced (as DbgLog to file seems to never ever work)
+// and with better error handling to avoid visible freezes with no option but to restart
+HRESULT MagewellCapturePin::DoBufferProcessingLoop(void) {
+	#ifndef NO_QUILL
+	LOG_INFO(mLogger, "[{}] Entering DoBufferProcessingLoop", mLogPrefix);
+	#endif
 
 	Command com;
 
 	OnThreadStartPlay();
 
+	const auto& delivery = GetDeliverySettings();
+	if (delivery.async)
+	{
+		// the queue holds the reference taken by GetDeliveryBuffer until the sample has been delivered or dropped
+		mDeliveryQueue = std::make_unique<DeliveryQueue<IMediaSample*>>(delivery.queueDepth, delivery.policy,
+			[this](IMediaSample*& s) { return DeliverQueued(s); }, [](IMediaSample*& s) { s->Release(); });
+		mDeliveryDrops = 0;
+
+		#ifndef NO_QUILL
+		LOG_INFO(mLogger, "[{}] Delivering asynchronously via a queue of {} samples ({})", mLogPrefix,
+			delivery.queueDepth, deliverypolicy_to_name(delivery.policy));
+		#endif
+	}
+
 	do {
 		while (!CheckRequest(&com)) {
 
@@ -861,8 +1948,18 @@ HRESULT MagewellCapturePin::DoBufferProcessingLoop(void) {
 
 			if (hr == S_OK)
 			{
-				hr = Deliver(pSample);
-				pSample->Release();
+				RecordCaptureLatency();
+
+				if (mDeliveryQueue)
+				{
+					QueueForDelivery(pSample);
+					hr = mDeliveryQueue->HasFailed() ? S_FALSE : S_OK;
+				}
+				else
+				{
+					hr = Deliver(pSample);
+					pSample->Release();
+				}
 
 				if (hr != S_OK)
 				{
@@ -888,6 +1985,7 @@ HRESULT MagewellCapturePin::DoBufferProcessingLoop(void) {
 				#endif
 
 				pSample->Release();
+				if (mDeliveryQueue) mDeliveryQueue->Drain();
 				DeliverEndOfStream();
 				m_pFilter->NotifyEvent(EC_ERRORABORT, hr, 0);
 				return hr;
@@ -920,10 +2018,75 @@ HRESULT MagewellCapturePin::DoBufferProcessingLoop(void) {
 		}
 	} while (com != CMD_STOP);
 
-	#ifndef NO_QUILL
-	LOG_INFO(mLogger, "[{}] Exiting DoBufferProcessingLoop", mLogPrefix);
-	#endif
-	return S_FALSE;
+	#ifndef NO_QUILL
+	LOG_INFO(mLogger, "[{}] Exiting DoBufferProcessingLoop", mLogPrefix);
+	#endif
+	return S_FALSE;
+}
+
+bool MagewellCapturePin::DeliverQueued(IMediaSample* pSample)
+{
+	auto hr = Deliver(pSample);
+
+	#ifndef NO_QUILL
+	if (hr != S_OK)
+	{
+		LOG_WARNING(mLogger, "[{}] Failed to deliver queued sample downstream ({:#08x}), process loop will exit", mLogPrefix, hr);
+	}
+	#endif
+
+	return hr == S_OK;
+}
+
+void MagewellCapturePin::QueueForDelivery(IMediaSample* pSample)
+{
+	if (mDeliveryQueue->Push(pSample))
+	{
+		return;
+	}
+	mDeliveryDrops++;
+
+	#ifndef NO_QUILL
+	auto stats = mDeliveryQueue->GetStats();
+	// every drop is a lost frame so warn but not on every one if downstream is persistently slow
+	if ((mDeliveryDrops & (mDeliveryDrops - 1)) == 0)
+	{
+		LOG_WARNING(mLogger, "[{}] Delivery queue full, {} samples dropped ({}, depth {}/{} delivered {})", mLogPrefix,
+			stats.dropped, deliverypolicy_to_name(GetDeliverySettings().policy), stats.depth, GetDeliverySettings().queueDepth,
+			stats.delivered);
+	}
+	#endif
+}
+
+void MagewellCapturePin::RecordCaptureLatency()
+{
+	// a sample sent without a newly captured frame (e.g. no signal) has no latency to record
+	if (mFrameEndTime == mCaptureLatencyFrameEndTime)
+	{
+		return;
+	}
+	mCaptureLatencyFrameEndTime = mFrameEndTime;
+	REFERENCE_TIME now;
+	mFilter->GetReferenceTime(&now);
+	// frames stamped from the device can end marginally after the clock was read
+	mCaptureLatency.Record(now > mFrameEndTime ? static_cast<uint64_t>(now - mFrameEndTime) / 10 : 0);
+
+	if (mCaptureLatencyReportedAt == 0)
+	{
+		mCaptureLatencyReportedAt = now;
+	}
+	else if (now - mCaptureLatencyReportedAt >= captureLatencyReportInterval)
+	{
+		#ifndef NO_QUILL
+		LOG_INFO(mLogger, "[{}] {} capture latency (us) over {} samples mean {:.0f} p50 {} p95 {} p99 {} max {} [{}]",
+			mLogPrefix, GetCaptureModeName(), mCaptureLatency.GetCount(), mCaptureLatency.GetMeanUs(), mCaptureLatency.GetPercentileUs(0.5),
+			mCaptureLatency.GetPercentileUs(0.95), mCaptureLatency.GetPercentileUs(0.99), mCaptureLatency.GetMaxUs(),
+			mCaptureLatency.Format());
+		#endif
+
+		mCaptureLatency.Reset();
+		mCaptureLatencyReportedAt = now;
+	}
 }
 
 HRESULT MagewellCapturePin::OnThreadDestroy()
@@ -932,15 +2095,21 @@ HRESULT MagewellCapturePin::OnThreadDestroy()
 	LOG_INFO(mLogger, "[{}] >>> MagewellCapturePin::OnThreadDestroy", mLogPrefix);
 	#endif
 
-	if (mNotify)
-	{
-		MWUnregisterNotify(mFilter->GetChannelHandle(), mNotify);
-	}
 	StopCapture();
-	if (mCaptureEvent)
+	if (mDeliveryQueue)
 	{
-		CloseHandle(mCaptureEvent);
+		#ifndef NO_QUILL
+		auto stats = mDeliveryQueue->GetStats();
+		LOG_INFO(mLogger, "[{}] Delivery queue pushed {} delivered {} dropped {} flushed {} max depth {}", mLogPrefix,
+			stats.pushed, stats.delivered, stats.dropped, stats.flushed, stats.maxDepth);
+		#endif
+
+		// releases anything still queued
+		mDeliveryQueue.reset();
 	}
+	mCaptureLatency.Reset();
+	mCaptureLatencyReportedAt = 0;
+	mCaptureLatencyFrameEndTime = 0;
 
 	#ifndef NO_QUILL
 	LOG_INFO(mLogger, "[{}] <<< MagewellCapturePin::OnThreadDestroy", mLogPrefix);
@@ -958,6 +2127,101 @@ void MagewellCapturePin::SetStartTime(LONGLONG streamStartTime)
 	#endif
 }
 
+void MagewellCapturePin::UpdateFrameEndTime(LONGLONG deviceTime)
+{
+	REFERENCE_TIME now;
+	mFilter->GetReferenceTime(&now);
+	if (mFilter->GetTimestampMode() != TIMESTAMP_DEVICE || deviceTime <= 0)
+	{
+		mFrameEndTime = now;
+		return;
+	}
+
+	#ifndef NO_QUILL
+	auto resyncs = mTimestampMapper.GetStats().resyncs;
+	#endif
+
+	mFrameEndTime = mTimestampMapper.Map(deviceTime, now);
+
+	#ifndef NO_QUILL
+	const auto& stats = mTimestampMapper.GetStats();
+	if (stats.resyncs != resyncs)
+	{
+		LOG_WARNING(mLogger, "[{}] Device timestamp {} is discontinuous at {}, restarting timestamp mapping", mLogPrefix, deviceTime, now);
+	}
+	else if (stats.observations % 1024 == 0)
+	{
+		LOG_TRACE_L1(mLogger, "[{}] Device timestamps locked? {} drift {:.3f} ppm jitter {:.1f} delay {:.1f} (mapped {} at {})", mLogPrefix,
+			stats.locked, stats.driftPpm, stats.jitter, stats.meanDelay, mFrameEndTime, now);
+	}
+	#endif
+}
+
+uint64_t MagewellCapturePin::OnCapturedFrameConsumed(uint64_t sequence, uint64_t droppedCount)
+{
+	auto lost = sequence > mNextCapturedSequence ? sequence - mNextCapturedSequence : 0;
+
+	#ifndef NO_QUILL
+	if (lost > 0)
+	{
+		LOG_WARNING(mLogger, "[{}] Dropped {} captured frames before frame {} ({} dropped in total)", mLogPrefix,
+			lost, sequence, droppedCount);
+	}
+	#endif
+	mNextCapturedSequence = sequence + 1;
+	return lost;
+}
+
+void MagewellCapturePin::SubscribeToFrames(CaptureEngine* engine, uint32_t heldSlots)
+{
+	UnsubscribeFromFrames();
+
+	mEngine = engine;
+	mNextCapturedSequence = UINT64_MAX;
+	mFrameConsumer = mEngine->Subscribe(GetFrameQueueDepth(), mPreview ? previewFramePolicy : captureFramePolicy,
+		heldSlots, mNotifyEvent);
+
+	#ifndef NO_QUILL
+	LOG_INFO(mLogger, "[{}] Receiving captured frames as consumer {}", mLogPrefix, mFrameConsumer);
+	#endif
+}
+
+void MagewellCapturePin::UnsubscribeFromFrames()
+{
+	if (mEngine == nullptr)
+	{
+		return;
+	}
+	mEngine->Unsubscribe(mFrameConsumer);
+	mEngine = nullptr;
+	mFrameConsumer = FrameFanout::noConsumer;
+}
+
+bool MagewellCapturePin::IsFrameQueued() const
+{
+	return mEngine != nullptr && !mEngine->GetFrames()->Empty(mFrameConsumer);
+}
+
+int MagewellCapturePin::TakeFrame(uint64_t* framesLost)
+{
+	if (mEngine == nullptr)
+	{
+		return FrameFanout::noSlot;
+	}
+	const auto& frames = mEngine->GetFrames();
+	auto slot = frames->Take(mFrameConsumer);
+	if (slot != FrameFanout::noSlot)
+	{
+		auto dropped = frames->GetDroppedCount() + frames->GetStats(mFrameConsumer).dropped;
+		auto lost = OnCapturedFrameConsumed(frames->Get(slot).sequence, dropped);
+		if (framesLost != nullptr)
+		{
+			*framesLost += lost;
+		}
+	}
+	return slot;
+}
+
 HRESULT MagewellCapturePin::BeginFlush()
 {
 	#ifndef NO_QUILL
@@ -1024,6 +2288,11 @@ HRESULT MagewellCapturePin::DecideBufferSize(IMemAllocator* pIMemAlloc, ALLOCATO
 		CAutoLock cAutoLock(m_pFilter->pStateLock());
 	HRESULT hr = NOERROR;
 	auto acceptedUpstreamBufferCount = ProposeBuffers(pProperties);
+	if (GetDeliverySettings().async)
+	{
+		// queued samples are not available to the capture thread
+		pProperties->cBuffers += static_cast<long>(GetDeliverySettings().queueDepth);
+	}
 
 	#ifndef NO_QUILL
 	LOG_TRACE_L1(mLogger, "[{}] MagewellCapturePin::DecideBufferSize size: {} count: {} (from upstream? {})",
@@ -1101,6 +2370,9 @@ HRESULT MagewellCapturePin::QuerySupported(REFGUID guidPropSet, DWORD dwPropID,
 
 HRESULT MagewellCapturePin::RenegotiateMediaType(const CMediaType* pmt, long newSize, boolean renegotiateOnQueryAccept)
 {
+	// samples in the old format go downstream before the format changes
+	if (mDeliveryQueue) mDeliveryQueue->Drain();
+
 	auto timeout = 100;
 	auto retVal = VFW_E_CHANGING_FORMAT;
 	auto oldMediaType = m_mt;
@@ -1242,223 +2514,99 @@ receiveconnection:
 	return retVal;
 }
 
-//////////////////////////////////////////////////////////////////////////
-//  MagewellVideoCapturePin::VideoCapture
-//////////////////////////////////////////////////////////////////////////
-MagewellVideoCapturePin::VideoCapture::VideoCapture(MagewellVideoCapturePin* pin, HCHANNEL hChannel) :
-	pin(pin)
-{
-	mEvent = MWCreateVideoCapture(hChannel, pin->mVideoFormat.cx, pin->mVideoFormat.cy, pin->mVideoFormat.pixelStructure, 
-		pin->mVideoFormat.frameInterval, CaptureFrame, pin);
-	#ifndef NO_QUILL
-	if (mEvent == nullptr)
-	{
-		LOG_ERROR(pin->mLogger, "[{}] MWCreateVideoCapture failed {}x{} {} {}", pin->mLogPrefix, 
-			pin->mVideoFormat.cx, pin->mVideoFormat.cy, pin->mVideoFormat.pixelStructureName, pin->mVideoFormat.frameInterval);
-	}
-	else
-	{
-		LOG_INFO(pin->mLogger, "[{}] MWCreateVideoCapture succeeded {}x{} {} {}", pin->mLogPrefix,
-			pin->mVideoFormat.cx, pin->mVideoFormat.cy, pin->mVideoFormat.pixelStructureName, pin->mVideoFormat.frameInterval);
-	}
-	#endif
-}
-
-MagewellVideoCapturePin::VideoCapture::~VideoCapture()
-{
-	if (mEvent != nullptr)
-	{
-		#ifndef NO_QUILL
-		LOG_TRACE_L3(pin->mLogger, "[{}] ~VideoCapture", pin->mLogPrefix);
-		#endif
-
-		#ifndef NO_QUILL
-		LOG_TRACE_L3(pin->mLogger, "[{}] Ready to MWDestoryVideoCapture", pin->mLogPrefix);
-		#endif
-
-		const auto hr = MWDestoryVideoCapture(mEvent);
-		mEvent = nullptr;
-
-		#ifndef NO_QUILL
-		if (MW_SUCCEEDED == hr)
-		{
-			LOG_INFO(pin->mLogger, "[{}] MWDestoryVideoCapture complete", pin->mLogPrefix);
-		}
-		else
-		{
-			LOG_WARNING(pin->mLogger, "[{}] MWDestoryVideoCapture failed", pin->mLogPrefix);
-		}
-		#endif
-	}
-}
-
 //////////////////////////////////////////////////////////////////////////
 //  MagewellVideoCapturePin::VideoFrameGrabber
 //////////////////////////////////////////////////////////////////////////
-MagewellVideoCapturePin::VideoFrameGrabber::VideoFrameGrabber(MagewellVideoCapturePin* pin,
-	HCHANNEL hChannel, DeviceType deviceType, IMediaSample* pms) :
-	hChannel(hChannel),
-	deviceType(deviceType),
+MagewellVideoCapturePin::VideoFrameGrabber::VideoFrameGrabber(MagewellVideoCapturePin* pin, IMediaSample* pms) :
 	pin(pin),
 	pms(pms)
 {
 	this->pms->GetPointer(&pmsData);
-
-	if (deviceType == PRO)
-	{
-		#ifndef NO_QUILL
-		LOG_TRACE_L2(pin->mLogger, "[{}] Pinning {} bytes", this->pin->mLogPrefix, this->pms->GetSize());
-		#endif
-		MWPinVideoBuffer(hChannel, pmsData, this->pms->GetSize());
-	}
 }
 
-MagewellVideoCapturePin::VideoFrameGrabber::~VideoFrameGrabber()
+HRESULT MagewellVideoCapturePin::VideoFrameGrabber::grab()
 {
-	if (deviceType == PRO)
+	auto retVal = S_OK;
+	auto hasFrame = true;
+	// no frame means the wait timed out without a signal so the buffer is sent as is
+	auto slot = pin->mPendingSlot;
+	pin->mPendingSlot = FrameFanout::noSlot;
+	pin->mFrameDeviceTime = 0;
+	const auto& frames = pin->mEngine->GetFrames();
+	if (slot != FrameFanout::noSlot)
 	{
-		#ifndef NO_QUILL
-		LOG_TRACE_L2(pin->mLogger, "[{}] Unpinning {} bytes, captured {} bytes", pin->mLogPrefix, pms->GetSize(),
-			pms->GetActualDataLength());
-		#endif
-
-		MWUnpinVideoBuffer(hChannel, pmsData);
+		pin->mFrameDeviceTime = static_cast<LONGLONG>(frames->Get(slot).ts);
 	}
-}
-
-HRESULT MagewellVideoCapturePin::VideoFrameGrabber::grab() const
-{
-	auto retVal = S_OK;
-	auto hasFrame = false;
-	auto proDevice = deviceType == PRO;
-	auto mustExit = false;
-	while (!hasFrame && !mustExit)
+	if (pin->IsZeroCopy())
 	{
-		if (proDevice)
+		// the slot itself is delivered and returns to the engine when downstream releases the sample,
+		// any free slot stands in for the buffer when there is no frame
+		if (slot == FrameFanout::noSlot)
 		{
-			pin->mLastMwResult = MWGetVideoBufferInfo(hChannel, &pin->mVideoSignal.bufferInfo);
-			if (pin->mLastMwResult != MW_SUCCEEDED)
-			{
-				#ifndef NO_QUILL
-				LOG_TRACE_L1(pin->mLogger, "[{}] Can't get VideoBufferInfo ({})", pin->mLogPrefix, static_cast<int>(pin->mLastMwResult));
-				#endif
-
-				continue;
-			}
+			slot = frames->Acquire();
+		}
+		if (slot == FrameFanout::noSlot)
+		{
+			#ifndef NO_QUILL
+			LOG_WARNING(pin->mLogger, "[{}] No capture slot available to deliver", pin->mLogPrefix);
+			#endif
 
-			pin->mLastMwResult = MWGetVideoFrameInfo(hChannel, pin->mVideoSignal.bufferInfo.iNewestBuffered,
-				&pin->mVideoSignal.frameInfo);
-			if (pin->mLastMwResult != MW_SUCCEEDED)
+			retVal = S_FALSE;
+			hasFrame = false;
+		}
+		else
+		{
+			pmsData = pin->mSlotAllocator->Bind(pms, slot);
+		}
+	}
+	else if (slot != FrameFanout::noSlot)
+	{
+		const auto& frame = frames->Get(slot);
+		const auto& src = pin->mSourceFormat;
+		const auto& dst = pin->mVideoFormat;
+		DownscaleLayout layout;
+		auto downscaled = pin->IsDownscaled() && GetDownscaleLayout(src.pixelStructure, &layout);
+		Yuv444Output output;
+		if (pin->IsConverted() && GetYuv444Output(dst.pixelStructure, &output))
+		{
+			// a downscaled frame is converted from a buffer in the captured format
+			const BYTE* convertFrom = frame.data;
+			auto convertLineLength = static_cast<uint32_t>(src.lineLength);
+			if (downscaled)
 			{
-				#ifndef NO_QUILL
-				LOG_TRACE_L1(pin->mLogger, "[{}] Can't get VideoFrameInfo ({})", pin->mLogPrefix, static_cast<int>(pin->mLastMwResult));
-				#endif
-
-				continue;
+				convertLineLength = FOURCC_CalcMinStride(src.pixelStructure, dst.cx, 2);
+				pin->mConvertBuffer.resize(static_cast<size_t>(convertLineLength) * dst.cy);
+				pin->mDownscaler.Downscale(pin->mDownscaleWorkers.get(), layout, frame.data, src.cx, src.cy, src.lineLength,
+					pin->mConvertBuffer.data(), dst.cx, dst.cy, convertLineLength);
+				convertFrom = pin->mConvertBuffer.data();
 			}
-
-			pin->mLastMwResult = MWCaptureVideoFrameToVirtualAddressEx(
-				hChannel,
-				pin->mHasSignal ? pin->mVideoSignal.bufferInfo.iNewestBuffering : MWCAP_VIDEO_FRAME_ID_NEWEST_BUFFERING,
-				pmsData,
-				pin->mVideoFormat.imageSize,
-				pin->mVideoFormat.lineLength,
-				FALSE,
-				nullptr,
-				pin->mVideoFormat.pixelStructure,
-				pin->mVideoFormat.cx,
-				pin->mVideoFormat.cy,
-				0,
-				64,
-				nullptr,
-				nullptr,
-				0,
-				100,
-				0,
-				100,
-				0,
-				MWCAP_VIDEO_DEINTERLACE_BLEND,
-				MWCAP_VIDEO_ASPECT_RATIO_IGNORE,
-				nullptr,
-				nullptr,
-				pin->mVideoFormat.aspectX,
-				pin->mVideoFormat.aspectY,
-				pin->mVideoFormat.colourFormat,
-				pin->mVideoFormat.quantization,
-				pin->mVideoFormat.saturation
-			);
-			if (pin->mLastMwResult != MW_SUCCEEDED)
+			if (!pin->mConvertWorkers)
 			{
-				#ifndef NO_QUILL
-				LOG_WARNING(pin->mLogger, "[{}] Unexpected failed call to MWCaptureVideoFrameToVirtualAddressEx ({})", pin->mLogPrefix, 
-					static_cast<int>(pin->mLastMwResult));
-				#endif
-				break;
+				pin->mConvertWorkers = std::make_unique<RowBandWorkers>(GetYuv444ConvertWorkerCount());
 			}
-			do
-			{
-				DWORD dwRet = WaitForSingleObject(pin->mCaptureEvent, 1000);
-				auto skip = dwRet != WAIT_OBJECT_0;
-				if (skip)
-				{
-					#ifndef NO_QUILL
-					LOG_TRACE_L1(pin->mLogger, "[{}] Unexpected capture event ({:#08x})", pin->mLogPrefix, dwRet);
-					#endif
-
-					if (dwRet == STATUS_TIMEOUT)
-					{
-						#ifndef NO_QUILL
-						LOG_TRACE_L1(pin->mLogger, "[{}] Wait for frame has timed out", pin->mLogPrefix);
-						#endif
-						mustExit = true;
-						break;
-					}
-
-					if (pin->CheckStreamState(nullptr) == STREAM_DISCARDING)
-					{
-						mustExit = true;
-						break;
-					}
-				}
-
-				if (skip) continue;
-
-				pin->mLastMwResult = MWGetVideoCaptureStatus(hChannel, &pin->mVideoSignal.captureStatus);
-
-				#ifndef NO_QUILL
-				if (pin->mLastMwResult != MW_SUCCEEDED)
-				{
-					LOG_TRACE_L1(pin->mLogger, "[{}] MWGetVideoCaptureStatus failed ({})", pin->mLogPrefix, static_cast<int>(pin->mLastMwResult));
-				}
-				#endif
-
-				hasFrame = pin->mVideoSignal.captureStatus.bFrameCompleted;
-
-			} while (pin->mLastMwResult == MW_SUCCEEDED && !hasFrame);
+			ConvertY410(pin->mConvertWorkers.get(), output, convertFrom, convertLineLength, pmsData, dst.lineLength, dst.cx,
+				dst.cy);
+		}
+		else if (downscaled)
+		{
+			pin->mDownscaler.Downscale(pin->mDownscaleWorkers.get(), layout, frame.data, src.cx, src.cy, src.lineLength,
+				pmsData, dst.cx, dst.cy, dst.lineLength);
 		}
 		else
 		{
-			CAutoLock lck(&pin->mCaptureCritSec);
-			memcpy(pmsData, pin->mCapturedFrame.data, pin->mCapturedFrame.length);
-			hasFrame = true;
+			memcpy(pmsData, frame.data, frame.length);
 		}
+		frames->Release(slot);
 	}
 	if (hasFrame)
 	{
-		pin->GetReferenceTime(&pin->mFrameEndTime);
+		pin->UpdateFrameEndTime(pin->mFrameDeviceTime);
 		auto endTime = pin->mFrameEndTime - pin->mStreamStartTime;
 		auto startTime = endTime - pin->mVideoFormat.frameInterval;
 		pms->SetTime(&startTime, &endTime);
 		pms->SetSyncPoint(TRUE);
 		pin->mFrameCounter++;
 
-		if (pin->mVideoFormat.pixelStructure == MWFOURCC_AYUV)
-		{
-			// TODO endianness is wrong so flip the bytes
-			BYTE* istart = pmsData, * iend = istart + pin->mVideoFormat.imageSize;
-			std::reverse(istart, iend);
-		}
-
 		#ifndef NO_QUILL
 		LOG_TRACE_L1(pin->mLogger, "[{}] Captured video frame {} at {}", pin->mLogPrefix,
 			pin->mFrameCounter, endTime);
@@ -1576,6 +2724,12 @@ MagewellVideoCapturePin::MagewellVideoCapturePin(HRESULT* phr, MagewellCaptureFi
 		pPreview ? "Preview" : "Capture"
 	)
 {
+	mPreview = pPreview;
+	if (mPreview && previewVideoSize != DOWNSCALE_NONE)
+	{
+		mOutputSize = previewVideoSize;
+		mDownscaleWorkers = std::make_unique<RowBandWorkers>(GetDownscaleWorkerCount());
+	}
 	auto hChannel = mFilter->GetChannelHandle();
 
 	if (mFilter->GetDeviceType() == USB)
@@ -1610,12 +2764,18 @@ MagewellVideoCapturePin::MagewellVideoCapturePin(HRESULT* phr, MagewellCaptureFi
 		}
 	}
 
-	auto hr = LoadSignal(&hChannel);
+	if (!mPreview)
+	{
+		LoadDeviceCaps();
+	}
+
+	auto hr = LoadSignal();
 	mFilter->OnVideoSignalLoaded(&mVideoSignal);
 
 	if (SUCCEEDED(hr))
 	{
-		LoadFormat(&mVideoFormat, &mVideoSignal, &mUsbCaptureFormats);
+		LoadFormat(&mVideoFormat, &mVideoSignal, &mUsbCaptureFormats,
+			mFilter->GetVideoEngine()->GetCaptureRequest(), mFilter->GetVideoLatencyMode());
 
 		#ifndef NO_QUILL
 		LOG_WARNING(
@@ -1644,11 +2804,25 @@ MagewellVideoCapturePin::MagewellVideoCapturePin(HRESULT* phr, MagewellCaptureFi
 			mVideoFormat.imageSize);
 		#endif
 	}
-	mFilter->OnVideoFormatLoaded(&mVideoFormat);
+	mSourceFormat = mVideoFormat;
+	ScaleFormat(&mVideoFormat, mOutputSize);
+	if (IsDownscaled())
+	{
+		#ifndef NO_QUILL
+		LOG_WARNING(mLogger, "[{}] Frames will be downscaled to {} x {} ({}) size {} bytes", mLogPrefix,
+			mVideoFormat.cx, mVideoFormat.cy, downscalesize_to_name(mOutputSize), mVideoFormat.imageSize);
+		#endif
+	}
+	mFilter->OnVideoFormatLoaded(&mSourceFormat);
+}
 
-	if (mFilter->GetDeviceType() == USB)
+MagewellVideoCapturePin::~MagewellVideoCapturePin()
+{
+	if (mSlotAllocator != nullptr)
 	{
-		mCapturedFrame.data = new BYTE[mVideoFormat.imageSize];
+		// downstream may still hold the allocator, it shares the slots so they outlive the engine
+		mSlotAllocator->Release();
+		mSlotAllocator = nullptr;
 	}
 }
 
@@ -1657,7 +2831,8 @@ void MagewellVideoCapturePin::GetReferenceTime(REFERENCE_TIME* rt) const
 	mFilter->GetReferenceTime(rt);
 }
 
-void MagewellVideoCapturePin::LoadFormat(VIDEO_FORMAT* videoFormat, VIDEO_SIGNAL* videoSignal, USB_CAPTURE_FORMATS* captureFormats)
+void MagewellVideoCapturePin::LoadFormat(VIDEO_FORMAT* videoFormat, VIDEO_SIGNAL* videoSignal, USB_CAPTURE_FORMATS* captureFormats,
+	const VIDEO_CAPTURE_REQUEST& request, VideoLatencyMode latencyMode)
 {
 	if (videoSignal->signalStatus.state == MWCAP_VIDEO_SIGNAL_LOCKED)
 	{
@@ -1673,7 +2848,9 @@ void MagewellVideoCapturePin::LoadFormat(VIDEO_FORMAT* videoFormat, VIDEO_SIGNAL
 		videoFormat->colourFormat = videoSignal->signalStatus.colorFormat;
 		videoFormat->pixelEncoding = videoSignal->inputStatus.hdmiStatus.pixelEncoding;
 
-		LoadHdrMeta(&videoFormat->hdrMeta, &videoSignal->hdrInfo);
+		HDR_INFOFRAME hdrInfo;
+		memcpy(&hdrInfo, &videoSignal->hdrInfo, sizeof(HDR_INFOFRAME));
+		LoadHdrMeta(&videoFormat->hdrMeta, &hdrInfo);
 	}
 	else
 	{
@@ -1691,6 +2868,45 @@ void MagewellVideoCapturePin::LoadFormat(VIDEO_FORMAT* videoFormat, VIDEO_SIGNAL
 	videoFormat->pixelStructure = fourcc[idx][videoFormat->pixelEncoding];
 	videoFormat->pixelStructureName = fourccName[idx][videoFormat->pixelEncoding];
 
+	// a format set through IAMStreamConfig replaces the one which best suits the signal
+	SetRectEmpty(&videoFormat->crop);
+	CROP_RECT crop{ request.crop.left, request.crop.top, request.crop.right, request.crop.bottom };
+	if (!IsEmptyCrop(crop) && IsValidCrop(crop, videoFormat->cx, videoFormat->cy))
+	{
+		// the cropped area is stretched over the whole frame so the picture takes on its shape
+		auto aspectX = static_cast<LONGLONG>(videoFormat->aspectX) * (crop.right - crop.left) * videoFormat->cy;
+		auto aspectY = static_cast<LONGLONG>(videoFormat->aspectY) * (crop.bottom - crop.top) * videoFormat->cx;
+		auto divisor = std::gcd(aspectX, aspectY);
+		if (divisor > 0)
+		{
+			videoFormat->aspectX = static_cast<int>(aspectX / divisor);
+			videoFormat->aspectY = static_cast<int>(aspectY / divisor);
+		}
+		videoFormat->crop = request.crop;
+	}
+	if (request.pixelStructure != 0)
+	{
+		videoFormat->pixelStructure = request.pixelStructure;
+		videoFormat->pixelStructureName = FourccToString(request.pixelStructure);
+	}
+	if (request.cx > 0 && request.cy > 0)
+	{
+		videoFormat->cx = request.cx;
+		videoFormat->cy = request.cy;
+	}
+	if (request.frameInterval > 0 && captureFormats->usb)
+	{
+		videoFormat->frameInterval = request.frameInterval;
+		videoFormat->fps = 10000000.0 / static_cast<double>(request.frameInterval);
+	}
+	videoFormat->fieldRate = !captureFormats->usb && videoSignal->signalStatus.state == MWCAP_VIDEO_SIGNAL_LOCKED
+		&& IsFieldRate(latencyMode, videoSignal->signalStatus.bInterlaced);
+	if (videoFormat->fieldRate)
+	{
+		videoFormat->frameInterval = GetDeliveredFrameInterval(latencyMode, true, videoFormat->frameInterval);
+		videoFormat->fps = 10000000.0 / static_cast<double>(videoFormat->frameInterval);
+	}
+
 	if (videoFormat->colourFormat == MWCAP_VIDEO_COLOR_FORMAT_YUV709)
 	{
 		videoFormat->colourFormatName = "YUV709";
@@ -1720,11 +2936,7 @@ void MagewellVideoCapturePin::LoadFormat(VIDEO_FORMAT* videoFormat, VIDEO_SIGNAL
 		if (!found)
 		{
 			videoFormat->pixelStructure = captureFormats->fourccs.adwFOURCCs[0];
-			std::string captureFormatName{ static_cast<char>(videoFormat->pixelStructure & 0xFF) };
-			captureFormatName += static_cast<char>(videoFormat->pixelStructure >> 8 & 0xFF);
-			captureFormatName += static_cast<char>(videoFormat->pixelStructure >> 16 & 0xFF);
-			captureFormatName += static_cast<char>(videoFormat->pixelStructure >> 24 & 0xFF);
-			videoFormat->pixelStructureName = captureFormatName;
+			videoFormat->pixelStructureName = FourccToString(videoFormat->pixelStructure);
 		}
 
 		found = false;
@@ -1759,6 +2971,104 @@ void MagewellVideoCapturePin::LoadFormat(VIDEO_FORMAT* videoFormat, VIDEO_SIGNAL
 	videoFormat->imageSize = FOURCC_CalcImageSize(videoFormat->pixelStructure, videoFormat->cx, videoFormat->cy, videoFormat->lineLength);
 }
 
+bool MagewellVideoCapturePin::GetDownscaleLayout(DWORD pixelStructure, DownscaleLayout* layout)
+{
+	switch (pixelStructure)
+	{
+	case MWFOURCC_NV12:
+		*layout = DOWNSCALE_NV12;
+		return true;
+	case MWFOURCC_P010:
+		*layout = DOWNSCALE_P010;
+		return true;
+	case MWFOURCC_NV16:
+		*layout = DOWNSCALE_NV16;
+		return true;
+	case MWFOURCC_P210:
+		*layout = DOWNSCALE_P210;
+		return true;
+	case MWFOURCC_AYUV:
+		*layout = DOWNSCALE_AYUV;
+		return true;
+	case MWFOURCC_BGR24:
+		*layout = DOWNSCALE_BGR24;
+		return true;
+	case MWFOURCC_BGR10:
+	// packed 10:10:10:2 like BGR10
+	case MWFOURCC_Y410:
+		*layout = DOWNSCALE_BGR10;
+		return true;
+	default:
+		return false;
+	}
+}
+
+void MagewellVideoCapturePin::ScaleFormat(VIDEO_FORMAT* videoFormat, DownscaleSize size)
+{
+	DownscaleLayout layout;
+	if (size == DOWNSCALE_NONE || !GetDownscaleLayout(videoFormat->pixelStructure, &layout))
+	{
+		return;
+	}
+	uint32_t cx, cy;
+	GetDownscaledSize(size, videoFormat->cx, videoFormat->cy, &cx, &cy);
+	// the picture aspect ratio is carried separately so is unchanged
+	videoFormat->cx = static_cast<int>(cx);
+	videoFormat->cy = static_cast<int>(cy);
+	videoFormat->lineLength = FOURCC_CalcMinStride(videoFormat->pixelStructure, videoFormat->cx, 2);
+	videoFormat->imageSize = FOURCC_CalcImageSize(videoFormat->pixelStructure, videoFormat->cx, videoFormat->cy, videoFormat->lineLength);
+}
+
+bool MagewellVideoCapturePin::GetYuv444Output(DWORD pixelStructure, Yuv444Output* output)
+{
+	switch (pixelStructure)
+	{
+	case MWFOURCC_Y410:
+		*output = YUV444_Y410;
+		return true;
+	case fourccY416:
+		*output = YUV444_Y416;
+		return true;
+	case MWFOURCC_AYUV:
+		*output = YUV444_AYUV;
+		return true;
+	default:
+		return false;
+	}
+}
+
+void MagewellVideoCapturePin::ConvertFormat(VIDEO_FORMAT* videoFormat, Yuv444Output output)
+{
+	if (videoFormat->pixelStructure != MWFOURCC_Y410 || output == YUV444_Y410)
+	{
+		return;
+	}
+	// the sdk knows nothing of Y416 so the size is worked out here, the signal bit depth is unchanged
+	auto bytesPerPixel = GetYuv444BytesPerPixel(output);
+	videoFormat->pixelStructure = output == YUV444_Y416 ? fourccY416 : MWFOURCC_AYUV;
+	videoFormat->pixelStructureName = yuv444output_to_name(output);
+	videoFormat->bitCount = static_cast<byte>(bytesPerPixel * 8);
+	videoFormat->lineLength = static_cast<DWORD>(videoFormat->cx) * bytesPerPixel;
+	videoFormat->imageSize = videoFormat->lineLength * static_cast<DWORD>(videoFormat->cy);
+}
+
+std::vector<VIDEO_FORMAT> MagewellVideoCapturePin::GetOutputFormats(const VIDEO_FORMAT& sourceFormat, DownscaleSize outputSize)
+{
+	auto videoFormat = sourceFormat;
+	ScaleFormat(&videoFormat, outputSize);
+	std::vector<VIDEO_FORMAT> outputFormats{ videoFormat };
+	if (sourceFormat.pixelStructure == MWFOURCC_Y410)
+	{
+		for (auto output : { YUV444_Y416, YUV444_AYUV })
+		{
+			auto convertedFormat = videoFormat;
+			ConvertFormat(&convertedFormat, output);
+			outputFormats.push_back(convertedFormat);
+		}
+	}
+	return outputFormats;
+}
+
 void MagewellVideoCapturePin::LogHdrMetaIfPresent(VIDEO_FORMAT* newVideoFormat)
 {
 	auto hdrIf = mVideoSignal.hdrInfo;
@@ -1941,6 +3251,15 @@ bool MagewellVideoCapturePin::ShouldChangeMediaType(VIDEO_FORMAT* newVideoFormat
 		LOG_INFO(mLogger, "[{}] Video bit depth change {} to {}", mLogPrefix, mVideoFormat.bitDepth, newVideoFormat->bitDepth);
 		#endif
 	}
+	if (mVideoFormat.pixelStructure != newVideoFormat->pixelStructure)
+	{
+		reconnect = true;
+
+		#ifndef NO_QUILL
+		LOG_INFO(mLogger, "[{}] Video pixel format change {} to {}", mLogPrefix, mVideoFormat.pixelStructureName,
+			newVideoFormat->pixelStructureName);
+		#endif
+	}
 	if (mVideoFormat.pixelEncoding != newVideoFormat->pixelEncoding)
 	{
 		reconnect = true;
@@ -1986,11 +3305,19 @@ bool MagewellVideoCapturePin::ShouldChangeMediaType(VIDEO_FORMAT* newVideoFormat
 	return reconnect;
 }
 
-HRESULT MagewellVideoCapturePin::LoadSignal(HCHANNEL* pChannel)
+HRESULT MagewellVideoCapturePin::LoadSignal()
 {
-	mLastMwResult = MWGetVideoSignalStatus(*pChannel, &mVideoSignal.signalStatus);
+	DEVICE_SIGNAL signal;
+	auto version = mFilter->GetSignal(&signal);
+	if (version == mSignalVersion)
+	{
+		return S_OK;
+	}
+	mSignalVersion = version;
+
+	mVideoSignal.signalStatus = signal.videoSignal;
 	auto retVal = S_OK;
-	if (mLastMwResult != MW_SUCCEEDED)
+	if (signal.videoSignalResult != MW_SUCCEEDED)
 	{
 		#ifndef NO_QUILL
 		LOG_WARNING(mLogger, "[{}] LoadSignal MWGetVideoSignalStatus failed", mLogPrefix);
@@ -2000,8 +3327,8 @@ HRESULT MagewellVideoCapturePin::LoadSignal(HCHANNEL* pChannel)
 
 		retVal = S_FALSE;
 	}
-	mLastMwResult = MWGetInputSpecificStatus(*pChannel, &mVideoSignal.inputStatus);
-	if (mLastMwResult != MW_SUCCEEDED)
+	mVideoSignal.inputStatus = signal.inputStatus;
+	if (signal.inputStatusResult != MW_SUCCEEDED)
 	{
 		#ifndef NO_QUILL
 		LOG_ERROR(mLogger, "[{}] LoadSignal MWGetInputSpecificStatus failed", mLogPrefix);
@@ -2030,29 +3357,20 @@ HRESULT MagewellVideoCapturePin::LoadSignal(HCHANNEL* pChannel)
 	}
 	else
 	{
-		DWORD tPdwValidFlag = 0;
-		MWGetHDMIInfoFrameValidFlag(*pChannel, &tPdwValidFlag);
-		HDMI_INFOFRAME_PACKET pkt;
-		auto readPacket = false;
-		if (tPdwValidFlag & MWCAP_HDMI_INFOFRAME_MASK_HDR)
+		if (signal.hasHdrInfo)
 		{
-			if (MW_SUCCEEDED == MWGetHDMIInfoFramePacket(*pChannel, MWCAP_HDMI_INFOFRAME_ID_HDR, &pkt))
+			if (!mHasHdrInfoFrame)
 			{
-				if (!mHasHdrInfoFrame)
-				{
-					#ifndef NO_QUILL
-					LOG_TRACE_L1(mLogger, "[{}] HDR Infoframe is present tf: {} to {}", mLogPrefix, mVideoSignal.hdrInfo.byEOTF,
-						pkt.hdrInfoFramePayload.byEOTF);
-					#endif
-					mHasHdrInfoFrame = true;
-				}
-				mVideoSignal.hdrInfo = pkt.hdrInfoFramePayload;
-				readPacket = true;
+				#ifndef NO_QUILL
+				LOG_TRACE_L1(mLogger, "[{}] HDR Infoframe is present tf: {} to {}", mLogPrefix, mVideoSignal.hdrInfo.byEOTF,
+					signal.hdrInfo.byEOTF);
+				#endif
+				mHasHdrInfoFrame = true;
 			}
+			mVideoSignal.hdrInfo = signal.hdrInfo;
 		}
-		if (!readPacket)
+		else
 		{
-			
 			if (mHasHdrInfoFrame)
 			{
 				#ifndef NO_QUILL
@@ -2063,16 +3381,11 @@ HRESULT MagewellVideoCapturePin::LoadSignal(HCHANNEL* pChannel)
 			mVideoSignal.hdrInfo = {};
 		}
 
-		readPacket = false;
-		if (tPdwValidFlag & MWCAP_HDMI_INFOFRAME_MASK_AVI)
+		if (signal.hasAviInfo)
 		{
-			if (MW_SUCCEEDED == MWGetHDMIInfoFramePacket(*pChannel, MWCAP_HDMI_INFOFRAME_ID_AVI, &pkt))
-			{
-				mVideoSignal.aviInfo = pkt.aviInfoFramePayload;
-				readPacket = true;
-			}
+			mVideoSignal.aviInfo = signal.aviInfo;
 		}
-		if (!readPacket)
+		else
 		{
 			mVideoSignal.aviInfo = {};
 		}
@@ -2080,7 +3393,8 @@ HRESULT MagewellVideoCapturePin::LoadSignal(HCHANNEL* pChannel)
 	return S_OK;
 }
 
-HRESULT MagewellVideoCapturePin::DoChangeMediaType(const CMediaType* pmt, const VIDEO_FORMAT* newVideoFormat)
+HRESULT MagewellVideoCapturePin::DoChangeMediaType(const CMediaType* pmt, const VIDEO_FORMAT* newVideoFormat,
+	const VIDEO_FORMAT* newSourceFormat)
 {
 	#ifndef NO_QUILL
 	LOG_WARNING(
@@ -2096,47 +3410,20 @@ HRESULT MagewellVideoCapturePin::DoChangeMediaType(const CMediaType* pmt, const
 	if (retVal == S_OK)
 	{
 		mFilter->NotifyEvent(EC_VIDEO_SIZE_CHANGED, MAKELPARAM(newVideoFormat->cx, newVideoFormat->cy), 0);
-		if (mFilter->GetDeviceType() == USB)
-		{
-			delete mVideoCapture;
-			mVideoCapture = new VideoCapture(this, mFilter->GetChannelHandle());
-			if (newVideoFormat->imageSize > mVideoFormat.imageSize)
-			{
-				CAutoLock lck(&mCaptureCritSec);
-				delete mCapturedFrame.data;
-				mCapturedFrame.data = new BYTE[newVideoFormat->imageSize];
-			}
-		}
 		mVideoFormat = *newVideoFormat;
+		mSourceFormat = *newSourceFormat;
+		mFilter->GetVideoEngine()->SetFormat(mSourceFormat);
 	}
 
 	return retVal;
 }
 
-void MagewellVideoCapturePin::CaptureFrame(BYTE* pbFrame, int cbFrame, UINT64 u64TimeStamp, void* pParam)
-{
-	MagewellVideoCapturePin* pin = static_cast<MagewellVideoCapturePin*>(pParam);
-	CAutoLock lck(&pin->mCaptureCritSec);
-	memcpy(pin->mCapturedFrame.data, pbFrame, cbFrame);
-	pin->mCapturedFrame.length = cbFrame;
-	pin->mCapturedFrame.ts = u64TimeStamp;
-	if (!SetEvent(pin->mNotifyEvent))
-	{
-		auto err  = GetLastError();
-		#ifndef NO_QUILL
-		LOG_ERROR(pin->mLogger, "[{}] Failed to notify on frame {:#08x}", pin->mLogPrefix, err);
-		#endif
-	}
-}
-
 // loops til we have a frame to process, dealing with any mediatype changes as we go and then grabs a buffer once it's time to go
 HRESULT MagewellVideoCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFERENCE_TIME* pStartTime,
 	REFERENCE_TIME* pEndTime, DWORD dwFlags)
 {
 	auto hasFrame = false;
 	auto retVal = S_FALSE;
-	auto proDevice = mFilter->GetDeviceType() == PRO;
-	auto hChannel = mFilter->GetChannelHandle();
 
 	while (!hasFrame)
 	{
@@ -2157,8 +3444,7 @@ HRESULT MagewellVideoCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 			BACKOFF;
 			continue;
 		}
-		auto channel = mFilter->GetChannelHandle();
-		auto hr = LoadSignal(&channel);
+		auto hr = LoadSignal();
 		auto hadSignal = mHasSignal == true;
 
 		mHasSignal = true;
@@ -2188,16 +3474,34 @@ HRESULT MagewellVideoCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 
 			mHasSignal = false;
 		}
-
-		VIDEO_FORMAT newVideoFormat;
-		LoadFormat(&newVideoFormat, &mVideoSignal, &mUsbCaptureFormats);
+
+		VIDEO_FORMAT newSourceFormat;
+		LoadFormat(&newSourceFormat, &mVideoSignal, &mUsbCaptureFormats,
+			mFilter->GetVideoEngine()->GetCaptureRequest(), mFilter->GetVideoLatencyMode());
+		// the output in use is kept if it is still on offer, frames delivered in place cannot be converted
+		auto outputFormats = GetOutputFormats(newSourceFormat, mOutputSize);
+		if (IsZeroCopy())
+		{
+			outputFormats.resize(1);
+		}
+		auto newVideoFormat = outputFormats.front();
+		for (const auto& outputFormat : outputFormats)
+		{
+			if (outputFormat.pixelStructure == mVideoFormat.pixelStructure)
+			{
+				newVideoFormat = outputFormat;
+			}
+		}
 
 		#ifndef NO_QUILL
 		LogHdrMetaIfPresent(&newVideoFormat);
 		#endif
 
 		// TODO compare to old format
-		if (ShouldChangeMediaType(&newVideoFormat))
+		// a fixed downscaled size hides a change in the captured size or area which the engine still has to pick up
+		auto sourceChanged = newSourceFormat.cx != mSourceFormat.cx || newSourceFormat.cy != mSourceFormat.cy
+			|| !EqualRect(&newSourceFormat.crop, &mSourceFormat.crop);
+		if (ShouldChangeMediaType(&newVideoFormat) || sourceChanged)
 		{
 			#ifndef NO_QUILL
 			LOG_WARNING(mLogger, "[{}] VideoFormat changed! Attempting to reconnect", mLogPrefix);
@@ -2206,7 +3510,28 @@ HRESULT MagewellVideoCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 			CMediaType proposedMediaType(m_mt);
 			VideoFormatToMediaType(&proposedMediaType, &newVideoFormat);
 
-			hr = DoChangeMediaType(&proposedMediaType, &newVideoFormat);
+			hr = DoChangeMediaType(&proposedMediaType, &newVideoFormat, &newSourceFormat);
+
+			// otherwise try the remaining outputs in order of preference
+			for (auto& outputFormat : outputFormats)
+			{
+				if (SUCCEEDED(hr))
+				{
+					break;
+				}
+				if (outputFormat.pixelStructure == newVideoFormat.pixelStructure)
+				{
+					continue;
+				}
+
+				#ifndef NO_QUILL
+				LOG_WARNING(mLogger, "[{}] Proposing fallback video format {}", mLogPrefix, outputFormat.pixelStructureName);
+				#endif
+
+				CMediaType fallbackMediaType(m_mt);
+				VideoFormatToMediaType(&fallbackMediaType, &outputFormat);
+				hr = DoChangeMediaType(&fallbackMediaType, &outputFormat, &newSourceFormat);
+			}
 
 			mFilter->OnVideoSignalLoaded(&mVideoSignal);
 
@@ -2222,7 +3547,7 @@ HRESULT MagewellVideoCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 				continue;
 			}
 
-			mFilter->OnVideoFormatLoaded(&mVideoFormat);
+			mFilter->OnVideoFormatLoaded(&mSourceFormat);
 		}
 
 		if (hadSignal && !mHasSignal)
@@ -2230,8 +3555,8 @@ HRESULT MagewellVideoCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 			mFilter->OnVideoSignalLoaded(&mVideoSignal);
 		}
 
-		// grab next frame 
-		DWORD dwRet = WaitForSingleObject(mNotifyEvent, 1000);
+		// frames which are already queued are taken without waiting for another notification
+		DWORD dwRet = IsFrameQueued() ? WAIT_OBJECT_0 : WaitForSingleObject(mNotifyEvent, 1000);
 
 		// unknown, try again
 		if (dwRet == WAIT_FAILED)
@@ -2244,97 +3569,55 @@ HRESULT MagewellVideoCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 
 		if (dwRet == WAIT_OBJECT_0)
 		{
-			if (proDevice)
+			// the notification may be for a frame which has already been taken
+			auto slot = TakeFrame();
+			if (slot == FrameFanout::noSlot)
 			{
-				// wait til we see a BUFFERING notification
-				mLastMwResult = MWGetNotifyStatus(hChannel, mNotify, &mStatusBits);
-				if (mLastMwResult != MW_SUCCEEDED) {
-					#ifndef NO_QUILL
-					LOG_TRACE_L1(mLogger, "[{}] MWGetNotifyStatus failed {}", mLogPrefix, static_cast<int>(mLastMwResult));
-					#endif
-
-					BACKOFF;
-					continue;
-				}
-
-				if (mStatusBits & MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE)
-				{
-					#ifndef NO_QUILL
-					LOG_TRACE_L1(mLogger, "[{}] Video signal change, retry after backoff", mLogPrefix);
-					#endif
-
-					BACKOFF;
-					continue;
-				}
-				if (mStatusBits & MWCAP_NOTIFY_VIDEO_INPUT_SOURCE_CHANGE)
-				{
-					#ifndef NO_QUILL
-					LOG_TRACE_L1(mLogger, "[{}] Video input source change, retry after backoff", mLogPrefix);
-					#endif
-
-					BACKOFF;
-					continue;
-				}
-
-				if (mStatusBits & MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING)
-				{
-					hasFrame = true;
-				}
-
-				if (!mHasSignal)
-				{
-					#ifndef NO_QUILL
-					LOG_TRACE_L1(mLogger, "[{}] No signal will be displayed ", mLogPrefix);
-					#endif
-
-					hasFrame = true;
-				}
+				continue;
 			}
-			else
+			// frames captured before a format change are of no use
+			const auto& frames = mEngine->GetFrames();
+			if (frames->Get(slot).length != static_cast<int>(mSourceFormat.imageSize))
 			{
-				// new frame is the only type of notification
-				hasFrame = true;
-			}
+				#ifndef NO_QUILL
+				LOG_TRACE_L1(mLogger, "[{}] Discarding {} byte frame captured in another format", mLogPrefix,
+					frames->Get(slot).length);
+				#endif
 
-			if (hasFrame)
-			{
-				retVal = MagewellCapturePin::GetDeliveryBuffer(ppSample, pStartTime, pEndTime, dwFlags);
-				if (!SUCCEEDED(retVal))
-				{
-					hasFrame = false;
-					#ifndef NO_QUILL
-					LOG_WARNING(mLogger, "[{}] Video frame buffered but unable to get delivery buffer, retry after backoff", mLogPrefix);
-					#endif
-				}
+				frames->Release(slot);
+				continue;
 			}
+			mPendingSlot = slot;
+			hasFrame = true;
+		}
+		else if (!mHasSignal && dwRet == STATUS_TIMEOUT)
+		{
+			#ifndef NO_QUILL
+			LOG_TRACE_L1(mLogger, "[{}] Timeout and no signal, get delivery buffer for no signal image", mLogPrefix);
+			#endif
 
-			if (!hasFrame) SHORT_BACKOFF;
+			hasFrame = true;
 		}
 		else
 		{
-			if (!mHasSignal && dwRet == STATUS_TIMEOUT)
-			{
-				#ifndef NO_QUILL
-				LOG_TRACE_L1(mLogger, "[{}] Timeout and no signal, get delivery buffer for no signal image", mLogPrefix);
-				#endif
-				retVal = MagewellCapturePin::GetDeliveryBuffer(ppSample, pStartTime, pEndTime, dwFlags);
-				if (!SUCCEEDED(retVal))
-				{
-					#ifndef NO_QUILL
-					LOG_WARNING(mLogger, "[{}] Unable to get delivery buffer, retry after backoff", mLogPrefix);
-					#endif
-					SHORT_BACKOFF;
-				}
-				else
-				{
-					hasFrame = true;
-				}
-			}
-			else
+			#ifndef NO_QUILL
+			LOG_TRACE_L1(mLogger, "[{}] Wait for frame unexpected response ({:#08x})", mLogPrefix, dwRet);
+			#endif
+		}
+
+		if (hasFrame)
+		{
+			retVal = MagewellCapturePin::GetDeliveryBuffer(ppSample, pStartTime, pEndTime, dwFlags);
+			if (!SUCCEEDED(retVal))
 			{
+				hasFrame = false;
+				ReleasePendingFrame();
+
 				#ifndef NO_QUILL
-				LOG_TRACE_L1(mLogger, "[{}] Wait for frame unexpected response ({:#08x})", mLogPrefix, dwRet);
+				LOG_WARNING(mLogger, "[{}] Video frame captured but unable to get delivery buffer, retry after backoff", mLogPrefix);
 				#endif
+
+				SHORT_BACKOFF;
 			}
 		}
 	}
@@ -2343,7 +3626,7 @@ HRESULT MagewellVideoCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 
 HRESULT MagewellVideoCapturePin::FillBuffer(IMediaSample* pms)
 {
-	VideoFrameGrabber vfg(this, mFilter->GetChannelHandle(), mFilter->GetDeviceType(), pms);
+	VideoFrameGrabber vfg(this, pms);
 	auto retVal = vfg.grab();
 	if (S_FALSE == HandleStreamStateChange(pms))
 	{
@@ -2352,12 +3635,73 @@ HRESULT MagewellVideoCapturePin::FillBuffer(IMediaSample* pms)
 	return retVal;
 }
 
+void MagewellVideoCapturePin::ReleasePendingFrame()
+{
+	if (mPendingSlot != FrameFanout::noSlot)
+	{
+		mEngine->GetFrames()->Release(mPendingSlot);
+		mPendingSlot = FrameFanout::noSlot;
+	}
+}
+
 HRESULT MagewellVideoCapturePin::GetMediaType(CMediaType* pmt)
 {
 	VideoFormatToMediaType(pmt, &mVideoFormat);
 	return NOERROR;
 }
 
+HRESULT MagewellVideoCapturePin::GetMediaType(int iPosition, CMediaType* pmt)
+{
+	CAutoLock lck(m_pFilter->pStateLock());
+
+	if (iPosition < 0)
+	{
+		return E_INVALIDARG;
+	}
+	auto outputFormats = GetOutputFormats(mSourceFormat, mOutputSize);
+	if (iPosition >= static_cast<int>(outputFormats.size()))
+	{
+		return VFW_S_NO_MORE_ITEMS;
+	}
+	VideoFormatToMediaType(pmt, &outputFormats[iPosition]);
+	return NOERROR;
+}
+
+HRESULT MagewellVideoCapturePin::CheckMediaType(const CMediaType* pmt)
+{
+	CAutoLock lck(m_pFilter->pStateLock());
+
+	CMediaType mt;
+	for (auto i = 0; GetMediaType(i, &mt) == NOERROR; i++)
+	{
+		if (mt == *pmt)
+		{
+			return NOERROR;
+		}
+	}
+	return E_FAIL;
+}
+
+HRESULT MagewellVideoCapturePin::SetMediaType(const CMediaType* pmt)
+{
+	auto hr = MagewellCapturePin::SetMediaType(pmt);
+	if (SUCCEEDED(hr))
+	{
+		// downstream picks the output when the pin connects
+		for (auto& outputFormat : GetOutputFormats(mSourceFormat, mOutputSize))
+		{
+			CMediaType outputType;
+			VideoFormatToMediaType(&outputType, &outputFormat);
+			if (*outputType.Subtype() == *pmt->Subtype())
+			{
+				mVideoFormat = outputFormat;
+				break;
+			}
+		}
+	}
+	return hr;
+}
+
 HRESULT MagewellVideoCapturePin::OnThreadCreate()
 {
 	#ifndef NO_QUILL
@@ -2366,117 +3710,473 @@ HRESULT MagewellVideoCapturePin::OnThreadCreate()
 	LOG_INFO(mLogger, "[{}] MagewellVideoCapturePin::OnThreadCreate", mLogPrefix);
 	#endif
 
-	auto hChannel = mFilter->GetChannelHandle();
-	LoadSignal(&hChannel);
+	LoadSignal();
+
+	mFilter->OnVideoSignalLoaded(&mVideoSignal);
+
+	// each sample held downstream keeps its slot when frames are delivered in place
+	uint32_t heldSlots = 1;
+	ALLOCATOR_PROPERTIES props;
+	if (IsZeroCopy() && SUCCEEDED(m_pAllocator->GetProperties(&props)))
+	{
+		heldSlots = props.cBuffers;
+	}
+	auto engine = mFilter->GetVideoEngine();
+	engine->SetFormat(mSourceFormat);
+	SubscribeToFrames(engine, heldSlots);
+	return NOERROR;
+}
+
+void MagewellVideoCapturePin::StopCapture()
+{
+	ReleasePendingFrame();
+	UnsubscribeFromFrames();
+}
+
+HRESULT MagewellVideoCapturePin::DecideAllocator(IMemInputPin* pPin, IMemAllocator** ppAlloc)
+{
+	// our own allocator is offered first so frames can be delivered in place, otherwise fallback to the usual negotiation
+	// downscaled or converted frames are written to a buffer of their own so can never be delivered in place
+	HRESULT hr = NOERROR;
+	*ppAlloc = nullptr;
+
+	if (mOutputSize != DOWNSCALE_NONE || IsConverted())
+	{
+		return MagewellCapturePin::DecideAllocator(pPin, ppAlloc);
+	}
+
+	if (mSlotAllocator == nullptr)
+	{
+		mSlotAllocator = new CaptureSlotAllocator(nullptr, &hr, mFilter->GetVideoEngine()->GetFrames());
+		if (FAILED(hr))
+		{
+			delete mSlotAllocator;
+			mSlotAllocator = nullptr;
+		}
+		else
+		{
+			mSlotAllocator->AddRef();
+		}
+	}
+	IMemAllocator* ownAllocator = mSlotAllocator;
+
+	if (ownAllocator != nullptr)
+	{
+		ALLOCATOR_PROPERTIES prop;
+		ZeroMemory(&prop, sizeof(prop));
+
+		pPin->GetAllocatorRequirements(&prop);
+		if (prop.cbAlign == 0)
+		{
+			prop.cbAlign = 1;
+		}
+
+		hr = ownAllocator->QueryInterface(IID_IMemAllocator, reinterpret_cast<void**>(ppAlloc));
+		if (SUCCEEDED(hr))
+		{
+			hr = DecideBufferSize(*ppAlloc, &prop);
+			if (SUCCEEDED(hr))
+			{
+				hr = pPin->NotifyAllocator(*ppAlloc, FALSE);
+				if (SUCCEEDED(hr))
+				{
+					#ifndef NO_QUILL
+					LOG_INFO(mLogger, "[{}] Captured frames will be delivered in place", mLogPrefix);
+					#endif
+
+					return NOERROR;
+				}
+			}
+		}
+
+		if (*ppAlloc)
+		{
+			(*ppAlloc)->Release();
+			*ppAlloc = nullptr;
+		}
+	}
+
+	#ifndef NO_QUILL
+	LOG_WARNING(mLogger, "[{}] Own allocator not accepted ({:#08x}), captured frames will be copied", mLogPrefix, hr);
+	#endif
+
+	return MagewellCapturePin::DecideAllocator(pPin, ppAlloc);
+}
+
+bool MagewellVideoCapturePin::IsZeroCopy() const
+{
+	return mSlotAllocator != nullptr && m_pAllocator == static_cast<IMemAllocator*>(mSlotAllocator);
+}
+
+bool MagewellVideoCapturePin::IsDownscaled() const
+{
+	return mVideoFormat.cx != mSourceFormat.cx || mVideoFormat.cy != mSourceFormat.cy;
+}
+
+bool MagewellVideoCapturePin::IsConverted() const
+{
+	return mVideoFormat.pixelStructure != mSourceFormat.pixelStructure;
+}
+
+const char* MagewellVideoCapturePin::GetCaptureModeName() const
+{
+	// a usb device delivers whole frames from its own capture thread
+	return mFilter->GetDeviceType() == USB ? "Usb" : videolatencymode_to_name(mFilter->GetVideoLatencyMode());
+}
+
+bool MagewellVideoCapturePin::ProposeBuffers(ALLOCATOR_PROPERTIES* pProperties)
+{
+	pProperties->cbBuffer = mVideoFormat.imageSize;
+	auto fromDownstream = pProperties->cBuffers >= 1;
+	if (!fromDownstream)
+	{
+		// 1 works for mpc-vr, 16 works for madVR so go with that as a default if the input pin doesn't suggest a number.
+		pProperties->cBuffers = 16;
+	}
+	return fromDownstream;
+}
+
+void MagewellVideoCapturePin::LoadDeviceCaps()
+{
+	if (mUsbCaptureFormats.usb)
+	{
+		for (int i = 0; i < mUsbCaptureFormats.fourccs.byCount; i++)
+		{
+			mDeviceFourccs.push_back(mUsbCaptureFormats.fourccs.adwFOURCCs[i]);
+		}
+		for (int i = 0; i < mUsbCaptureFormats.frameSizes.byCount; i++)
+		{
+			mDeviceSizes.push_back({
+				static_cast<uint32_t>(mUsbCaptureFormats.frameSizes.aSizes[i].cx),
+				static_cast<uint32_t>(mUsbCaptureFormats.frameSizes.aSizes[i].cy)
+			});
+		}
+	}
+	else
+	{
+		auto hChannel = mFilter->GetChannelHandle();
+		int count = 0;
+		if (MW_SUCCEEDED == MWGetVideoCaptureSupportColorFormat(hChannel, nullptr, &count) && count > 0)
+		{
+			std::vector<DWORD> fourccs(count);
+			if (MW_SUCCEEDED == MWGetVideoCaptureSupportColorFormat(hChannel, fourccs.data(), &count))
+			{
+				fourccs.resize(std::min(static_cast<size_t>(std::max(count, 0)), fourccs.size()));
+				mDeviceFourccs.assign(fourccs.begin(), fourccs.end());
+			}
+		}
+		count = 0;
+		if (MWGetVideoCaptureSupportFormat(hChannel, nullptr, &count) && count > 0)
+		{
+			std::vector<VIDEO_FORMAT_INFO> formats(count);
+			if (MWGetVideoCaptureSupportFormat(hChannel, formats.data(), &count))
+			{
+				for (int i = 0; i < count && i < static_cast<int>(formats.size()); i++)
+				{
+					mDeviceSizes.push_back({ formats[i].cx, formats[i].cy });
+				}
+			}
+		}
+	}
+	// formats with no known layout can't be sized
+	std::erase_if(mDeviceFourccs, [](uint32_t fourcc) { return FOURCC_GetBpp(fourcc) == 0; });
+
+	#ifndef NO_QUILL
+	LOG_INFO(mLogger, "[{}] Device can capture in {} pixel formats and {} sizes", mLogPrefix, mDeviceFourccs.size(),
+		mDeviceSizes.size());
+	#endif
+}
+
+const std::vector<CAPTURE_CAP>& MagewellVideoCapturePin::GetCaptureCaps()
+{
+	VIDEO_FORMAT native;
+	LoadFormat(&native, &mVideoSignal, &mUsbCaptureFormats, {}, mFilter->GetVideoLatencyMode());
+	CAPTURE_CAP nativeCap{
+		native.pixelStructure,
+		static_cast<uint32_t>(native.cx),
+		static_cast<uint32_t>(native.cy),
+		native.frameInterval
+	};
+	// only the native format depends on the signal so the combinations are kept until it changes
+	if (!mCaptureCaps.empty() && IsSameCaptureCap(mCaptureCaps[0], nativeCap))
+	{
+		return mCaptureCaps;
+	}
+	std::vector<int64_t> frameIntervals;
+	if (mUsbCaptureFormats.usb)
+	{
+		for (int i = 0; i < mUsbCaptureFormats.frameIntervals.byCount; i++)
+		{
+			frameIntervals.push_back(mUsbCaptureFormats.frameIntervals.adwIntervals[i]);
+		}
+	}
+	else
+	{
+		// a pro card captures at the rate of the signal whatever the format
+		frameIntervals.push_back(native.frameInterval);
+	}
+	mCaptureCaps = CombineCaptureCaps(nativeCap, mDeviceFourccs, mDeviceSizes, frameIntervals);
+	return mCaptureCaps;
+}
+
+std::vector<DownscaleSize> MagewellVideoCapturePin::GetPreviewSizes()
+{
+	VIDEO_FORMAT source;
+	LoadFormat(&source, &mVideoSignal, &mUsbCaptureFormats,
+		mFilter->GetVideoEngine()->GetCaptureRequest(), mFilter->GetVideoLatencyMode());
+	std::vector<DownscaleSize> sizes;
+	std::vector<std::pair<int, int>> dimensions;
+	for (auto size : { DOWNSCALE_NONE, DOWNSCALE_HALF, DOWNSCALE_QUARTER, DOWNSCALE_960X540 })
+	{
+		auto format = source;
+		ScaleFormat(&format, size);
+		std::pair dimension{ format.cx, format.cy };
+		if (std::find(dimensions.begin(), dimensions.end(), dimension) == dimensions.end())
+		{
+			dimensions.push_back(dimension);
+			sizes.push_back(size);
+		}
+	}
+	return sizes;
+}
+
+bool MagewellVideoCapturePin::LoadCapFormat(int iIndex, VIDEO_FORMAT* videoFormat, VIDEO_CAPTURE_REQUEST* request,
+	DownscaleSize* outputSize)
+{
+	if (iIndex < 0)
+	{
+		return false;
+	}
+	if (mPreview)
+	{
+		// the preview follows whatever the capture pin asked the card for
+		auto sizes = GetPreviewSizes();
+		if (iIndex >= static_cast<int>(sizes.size()))
+		{
+			return false;
+		}
+		*request = mFilter->GetVideoEngine()->GetCaptureRequest();
+		*outputSize = sizes[iIndex];
+		LoadFormat(videoFormat, &mVideoSignal, &mUsbCaptureFormats, *request, mFilter->GetVideoLatencyMode());
+		ScaleFormat(videoFormat, *outputSize);
+		return true;
+	}
+	const auto& caps = GetCaptureCaps();
+	if (iIndex >= static_cast<int>(caps.size()))
+	{
+		return false;
+	}
+	// the native format follows the signal
+	*request = {};
+	if (iIndex > 0)
+	{
+		const auto& cap = caps[iIndex];
+		request->pixelStructure = cap.fourcc;
+		request->cx = static_cast<int>(cap.cx);
+		request->cy = static_cast<int>(cap.cy);
+		request->frameInterval = mUsbCaptureFormats.usb ? cap.frameInterval : 0;
+	}
+	*outputSize = DOWNSCALE_NONE;
+	LoadFormat(videoFormat, &mVideoSignal, &mUsbCaptureFormats, *request, mFilter->GetVideoLatencyMode());
+	return true;
+}
 
-	mFilter->OnVideoSignalLoaded(&mVideoSignal);
+// see https://learn.microsoft.com/en-us/windows/win32/api/strmif/nf-strmif-iamstreamconfig-setformat
+STDMETHODIMP MagewellVideoCapturePin::SetFormat(AM_MEDIA_TYPE* pmt)
+{
+	CAutoLock lck(mFilter->pStateLock());
+	// the capture request is shared by both pins so can't change under the other pin while it streams
+	if (mFilter->IsActive())
+	{
+		return VFW_E_NOT_STOPPED;
+	}
 
-	auto deviceType = mFilter->GetDeviceType();
-	if (deviceType == PRO)
+	auto engine = mFilter->GetVideoEngine();
+	// no format restores the default
+	VIDEO_CAPTURE_REQUEST request{};
+	auto outputSize = mPreview ? previewVideoSize : DOWNSCALE_NONE;
+	if (mPreview)
 	{
-		// start capture
-		mCaptureEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-		mLastMwResult = MWStartVideoCapture(hChannel, mCaptureEvent);
-		#ifndef NO_QUILL
-		if (mLastMwResult != MW_SUCCEEDED)
+		request = engine->GetCaptureRequest();
+	}
+	if (pmt != nullptr)
+	{
+		const BITMAPINFOHEADER* bmi;
+		REFERENCE_TIME avgTimePerFrame;
+		RECT rcSource;
+		if (pmt->majortype != MEDIATYPE_Video || pmt->pbFormat == nullptr)
 		{
-			LOG_ERROR(mLogger, "[{}] Unable to MWStartVideoCapture", mLogPrefix);
-		} else
+			return VFW_E_INVALIDMEDIATYPE;
+		}
+		if (pmt->formattype == FORMAT_VideoInfo2 && pmt->cbFormat >= sizeof(VIDEOINFOHEADER2))
 		{
-			LOG_INFO(mLogger, "[{}] MWStartVideoCapture started", mLogPrefix);
+			auto vih2 = reinterpret_cast<const VIDEOINFOHEADER2*>(pmt->pbFormat);
+			bmi = &vih2->bmiHeader;
+			avgTimePerFrame = vih2->AvgTimePerFrame;
+			rcSource = vih2->rcSource;
+		}
+		else if (pmt->formattype == FORMAT_VideoInfo && pmt->cbFormat >= sizeof(VIDEOINFOHEADER))
+		{
+			auto vih = reinterpret_cast<const VIDEOINFOHEADER*>(pmt->pbFormat);
+			bmi = &vih->bmiHeader;
+			avgTimePerFrame = vih->AvgTimePerFrame;
+			rcSource = vih->rcSource;
+		}
+		else
+		{
+			return VFW_E_INVALIDMEDIATYPE;
 		}
-		#endif
 
-		// register for signal change events & video buffering 
-		mNotify = MWRegisterNotify(hChannel, mNotifyEvent,
-			MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE | 
-			MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING |
-			MWCAP_NOTIFY_VIDEO_INPUT_SOURCE_CHANGE);
-		if (!mNotify)
+		// offered formats are matched by the media type they produce so the fourcc to subtype mapping is in one place
+		auto found = false;
+		VIDEO_FORMAT capFormat;
+		for (int i = 0; !found && LoadCapFormat(i, &capFormat, &request, &outputSize); i++)
+		{
+			CMediaType capType;
+			VideoFormatToMediaType(&capType, &capFormat);
+			auto capVih = reinterpret_cast<VIDEOINFOHEADER2*>(capType.Format());
+			found = pmt->subtype == *capType.Subtype()
+				&& bmi->biWidth == capVih->bmiHeader.biWidth
+				&& abs(bmi->biHeight) == abs(capVih->bmiHeader.biHeight)
+				&& (avgTimePerFrame == 0 || abs(avgTimePerFrame - capVih->AvgTimePerFrame) < captureCapIntervalTolerance);
+		}
+		if (!found)
 		{
 			#ifndef NO_QUILL
-			LOG_ERROR(mLogger, "[{}] Unable to MWRegistryNotify", mLogPrefix);
+			LOG_WARNING(mLogger, "[{}] SetFormat {} x {} @ {} is not an offered format", mLogPrefix, bmi->biWidth,
+				bmi->biHeight, avgTimePerFrame);
 			#endif
 
-			// TODO throw
+			return VFW_E_INVALIDMEDIATYPE;
+		}
+
+		if (!IsRectEmpty(&rcSource))
+		{
+			VIDEO_FORMAT signalFormat;
+			LoadFormat(&signalFormat, &mVideoSignal, &mUsbCaptureFormats, {}, mFilter->GetVideoLatencyMode());
+			auto wholeSignal = rcSource.left == 0 && rcSource.top == 0 && rcSource.right == signalFormat.cx
+				&& rcSource.bottom == signalFormat.cy;
+			if (!wholeSignal)
+			{
+				// only a pro card can crop and the preview shows whatever the capture pin captures
+				CROP_RECT crop{ rcSource.left, rcSource.top, rcSource.right, rcSource.bottom };
+				if (mPreview || mUsbCaptureFormats.usb || !IsValidCrop(crop, signalFormat.cx, signalFormat.cy))
+				{
+					#ifndef NO_QUILL
+					LOG_WARNING(mLogger, "[{}] SetFormat cannot crop {},{} to {},{} from the {} x {} signal", mLogPrefix,
+						rcSource.left, rcSource.top, rcSource.right, rcSource.bottom, signalFormat.cx, signalFormat.cy);
+					#endif
+
+					return VFW_E_INVALIDMEDIATYPE;
+				}
+				request.crop = rcSource;
+			}
 		}
 	}
-	else if (deviceType == USB)
-	{
-		delete mVideoCapture;
-		mVideoCapture = new VideoCapture(this, mFilter->GetChannelHandle());
-	}
-	return NOERROR;
-}
 
-void MagewellVideoCapturePin::StopCapture()
-{
-	auto deviceType = mFilter->GetDeviceType();
-	if (deviceType == PRO)
+	VIDEO_FORMAT newSourceFormat;
+	LoadFormat(&newSourceFormat, &mVideoSignal, &mUsbCaptureFormats, request, mFilter->GetVideoLatencyMode());
+	// a connected pin moves to the first output downstream accepts
+	auto outputFormats = GetOutputFormats(newSourceFormat, outputSize);
+	auto newVideoFormat = outputFormats.front();
+	auto accepted = !IsConnected();
+	CMediaType proposedMediaType;
+	VideoFormatToMediaType(&proposedMediaType, &newVideoFormat);
+	for (size_t i = 0; !accepted && i < outputFormats.size(); i++)
 	{
-		MWStopVideoCapture(mFilter->GetChannelHandle());
+		CMediaType outputType;
+		VideoFormatToMediaType(&outputType, &outputFormats[i]);
+		if (GetConnected()->QueryAccept(&outputType) == S_OK)
+		{
+			newVideoFormat = outputFormats[i];
+			proposedMediaType = outputType;
+			accepted = true;
+		}
 	}
-	else if (deviceType == USB)
+	if (!accepted)
 	{
-		delete mVideoCapture;
-		mVideoCapture = nullptr;
+		#ifndef NO_QUILL
+		LOG_WARNING(mLogger, "[{}] SetFormat {} x {} {} rejected downstream", mLogPrefix, newVideoFormat.cx,
+			newVideoFormat.cy, newVideoFormat.pixelStructureName);
+		#endif
+
+		return VFW_E_INVALIDMEDIATYPE;
 	}
-}
 
-bool MagewellVideoCapturePin::ProposeBuffers(ALLOCATOR_PROPERTIES* pProperties)
-{
-	pProperties->cbBuffer = mVideoFormat.imageSize;
-	if (pProperties->cBuffers < 1)
+	#ifndef NO_QUILL
+	LOG_INFO(mLogger, "[{}] SetFormat {} x {} {} @ {:.3f} Hz captured at {} x {} crop {},{} to {},{}", mLogPrefix,
+		newVideoFormat.cx, newVideoFormat.cy, newVideoFormat.pixelStructureName, newVideoFormat.fps, newSourceFormat.cx,
+		newSourceFormat.cy, request.crop.left, request.crop.top, request.crop.right, request.crop.bottom);
+	#endif
+
+	if (!mPreview)
 	{
-		// 1 works for mpc-vr, 16 works for madVR so go with that as a default if the input pin doesn't suggest a number.
-		pProperties->cBuffers = 16;
-		return false;
+		engine->SetCaptureRequest(request);
 	}
-	return true;
+	mOutputSize = outputSize;
+	if (mOutputSize != DOWNSCALE_NONE && !mDownscaleWorkers)
+	{
+		mDownscaleWorkers = std::make_unique<RowBandWorkers>(GetDownscaleWorkerCount());
+	}
+	mSourceFormat = newSourceFormat;
+	mVideoFormat = newVideoFormat;
+	mFilter->OnVideoFormatLoaded(&mSourceFormat);
+
+	// a connected pin has to be reconnected to pick up the new format, GetMediaType now offers it
+	return IsConnected() ? mFilter->ReconnectPin(this, &proposedMediaType) : S_OK;
 }
 
 STDMETHODIMP MagewellVideoCapturePin::GetNumberOfCapabilities(int* piCount, int* piSize)
 {
-	*piCount = 1;
+	*piCount = static_cast<int>(mPreview ? GetPreviewSizes().size() : GetCaptureCaps().size());
 	*piSize = sizeof(VIDEO_STREAM_CONFIG_CAPS);
 	return S_OK;
 }
 
 STDMETHODIMP MagewellVideoCapturePin::GetStreamCaps(int iIndex, AM_MEDIA_TYPE** pmt, BYTE* pSCC)
 {
-	if (iIndex > 0)
-	{
-		return S_FALSE;
-	}
 	if (iIndex < 0)
 	{
 		return E_INVALIDARG;
 	}
+	VIDEO_FORMAT capFormat;
+	VIDEO_CAPTURE_REQUEST request;
+	DownscaleSize outputSize;
+	if (!LoadCapFormat(iIndex, &capFormat, &request, &outputSize))
+	{
+		return S_FALSE;
+	}
 	CMediaType cmt;
-	GetMediaType(&cmt);
+	VideoFormatToMediaType(&cmt, &capFormat);
 	*pmt = CreateMediaType(&cmt);
 
 	auto pvi = reinterpret_cast<VIDEOINFOHEADER2*>((*pmt)->pbFormat);
 
 	auto pvscc = reinterpret_cast<VIDEO_STREAM_CONFIG_CAPS*>(pSCC);
 
+	// the signal is the input which the card crops and scales to each output size
+	VIDEO_FORMAT signalFormat;
+	LoadFormat(&signalFormat, &mVideoSignal, &mUsbCaptureFormats, {}, mFilter->GetVideoLatencyMode());
+	auto canCrop = !mPreview && !mUsbCaptureFormats.usb;
+
 	pvscc->guid = FORMAT_VideoInfo2;
 	pvscc->VideoStandard = AnalogVideo_PAL_D;
-	pvscc->InputSize.cx = pvi->bmiHeader.biWidth;
-	pvscc->InputSize.cy = pvi->bmiHeader.biHeight;
-	pvscc->MinCroppingSize.cx = 80;
-	pvscc->MinCroppingSize.cy = 60;
-	pvscc->MaxCroppingSize.cx = pvi->bmiHeader.biWidth;
-	pvscc->MaxCroppingSize.cy = pvi->bmiHeader.biHeight;
-	pvscc->CropGranularityX = 80;
-	pvscc->CropGranularityY = 60;
-	pvscc->CropAlignX = 0;
-	pvscc->CropAlignY = 0;
-
-	pvscc->MinOutputSize.cx = 80;
-	pvscc->MinOutputSize.cy = 60;
+	pvscc->InputSize.cx = signalFormat.cx;
+	pvscc->InputSize.cy = signalFormat.cy;
+	pvscc->MinCroppingSize.cx = canCrop ? minCropWidth : signalFormat.cx;
+	pvscc->MinCroppingSize.cy = canCrop ? minCropHeight : signalFormat.cy;
+	pvscc->MaxCroppingSize.cx = signalFormat.cx;
+	pvscc->MaxCroppingSize.cy = signalFormat.cy;
+	pvscc->CropGranularityX = canCrop ? 2 : 0;
+	pvscc->CropGranularityY = canCrop ? 2 : 0;
+	pvscc->CropAlignX = canCrop ? 2 : 0;
+	pvscc->CropAlignY = canCrop ? 2 : 0;
+
+	// each capability is a single size
+	pvscc->MinOutputSize.cx = pvi->bmiHeader.biWidth;
+	pvscc->MinOutputSize.cy = abs(pvi->bmiHeader.biHeight);
 	pvscc->MaxOutputSize.cx = pvi->bmiHeader.biWidth;
-	pvscc->MaxOutputSize.cy = pvi->bmiHeader.biHeight;
+	pvscc->MaxOutputSize.cy = abs(pvi->bmiHeader.biHeight);
 	pvscc->OutputGranularityX = 0;
 	pvscc->OutputGranularityY = 0;
 	pvscc->StretchTapsX = 0;
@@ -2491,51 +4191,6 @@ STDMETHODIMP MagewellVideoCapturePin::GetStreamCaps(int iIndex, AM_MEDIA_TYPE**
 	return S_OK;
 }
 
-//////////////////////////////////////////////////////////////////////////
-//  MagewellAudioCapturePin::AudioCapture
-//////////////////////////////////////////////////////////////////////////
-MagewellAudioCapturePin::AudioCapture::AudioCapture(MagewellAudioCapturePin* pin, HCHANNEL hChannel) :
-	pin(pin)
-{
-	mEvent = MWCreateAudioCapture(hChannel, MWCAP_AUDIO_CAPTURE_NODE_EMBEDDED_CAPTURE, pin->mAudioFormat.fs,
-		pin->mAudioFormat.bitDepth, pin->mAudioFormat.inputChannelCount, CaptureFrame, pin);
-	if (mEvent == nullptr)
-	{
-		#ifndef NO_QUILL
-		LOG_ERROR(pin->mLogger, "[{}] MWCreateAudioCapture failed {} Hz {} bits {} channels", pin->mLogPrefix,
-			pin->mAudioFormat.fs, pin->mAudioFormat.bitDepth, pin->mAudioFormat.inputChannelCount);
-		#endif
-	}
-}
-
-MagewellAudioCapturePin::AudioCapture::~AudioCapture()
-{
-	if (mEvent != nullptr)
-	{
-		#ifndef NO_QUILL
-		LOG_TRACE_L3(pin->mLogger, "[{}] AudioCapture", pin->mLogPrefix);
-		#endif
-
-		#ifndef NO_QUILL
-		LOG_TRACE_L3(pin->mLogger, "[{}] Ready to MWDestoryAudioCapture", pin->mLogPrefix);
-		#endif
-
-		const auto hr = MWDestoryAudioCapture(mEvent);
-		mEvent = nullptr;
-
-		#ifndef NO_QUILL
-		if (MW_SUCCEEDED == hr)
-		{
-			LOG_TRACE_L3(pin->mLogger, "[{}] MWDestoryAudioCapture complete", pin->mLogPrefix);
-		}
-		else
-		{
-			LOG_WARNING(pin->mLogger, "[{}] MWDestoryAudioCapture failed", pin->mLogPrefix);
-		}
-		#endif
-	}
-}
-
 //////////////////////////////////////////////////////////////////////////
 // MagewellAudioCapturePin
 //////////////////////////////////////////////////////////////////////////
@@ -2546,13 +4201,10 @@ MagewellAudioCapturePin::MagewellAudioCapturePin(HRESULT* phr, MagewellCaptureFi
 		pPreview ? "AudioPreview" : "AudioCapture",
 		pPreview ? L"AudioPreview" : L"AudioCapture",
 		pPreview ? "AudioPreview" : "AudioCapture"
-	),
-	mDataBurstBuffer(bitstreamBufferSize) // initialise to a reasonable default size that is not wastefully large but also is unlikely to need to be expanded very often
+	)
 {
-	mCapturedFrame.data = new BYTE[maxFrameLengthInBytes];
-	mCapturedFrame.length = maxFrameLengthInBytes;
+	mPreview = pPreview;
 
-	mDataBurstBuffer.assign(bitstreamBufferSize, 0);
 	DWORD dwInputCount = 0;
 	auto hChannel = pParent->GetChannelHandle();
 	mLastMwResult = MWGetAudioInputSourceArray(hChannel, nullptr, &dwInputCount);
@@ -2571,7 +4223,7 @@ MagewellAudioCapturePin::MagewellAudioCapturePin(HRESULT* phr, MagewellCaptureFi
 	}
 	else
 	{
-		auto hr = LoadSignal(&hChannel);
+		auto hr = LoadSignal();
 		mFilter->OnAudioSignalLoaded(&mAudioSignal);
 		if (hr == S_OK)
 		{
@@ -2650,1001 +4302,90 @@ MagewellAudioCapturePin::~MagewellAudioCapturePin()
 	#endif
 
 	#ifdef RECORD_RAW
-	if (0 != fclose(mRawFile))
-	{
-		LOG_WARNING(mLogger, "[{}] Failed to close {}", mLogPrefix, mRawFileName);
-	}
-	#endif
-	delete mAudioCapture;
-}
-
-HRESULT MagewellAudioCapturePin::DecideAllocator(IMemInputPin* pPin, IMemAllocator** ppAlloc)
-{
-	// copied from CBaseOutputPin but preferring to use our own allocator first
-
-	HRESULT hr = NOERROR;
-	*ppAlloc = nullptr;
-
-	ALLOCATOR_PROPERTIES prop;
-	ZeroMemory(&prop, sizeof(prop));
-
-	pPin->GetAllocatorRequirements(&prop);
-	if (prop.cbAlign == 0)
-	{
-		prop.cbAlign = 1;
-	}
-
-	/* Try the allocator provided by the output pin. */
-	hr = InitAllocator(ppAlloc);
-	if (SUCCEEDED(hr))
-	{
-		hr = DecideBufferSize(*ppAlloc, &prop);
-		if (SUCCEEDED(hr))
-		{
-			hr = pPin->NotifyAllocator(*ppAlloc, FALSE);
-			if (SUCCEEDED(hr))
-			{
-				return NOERROR;
-			}
-		}
-	}
-
-	if (*ppAlloc)
-	{
-		(*ppAlloc)->Release();
-		*ppAlloc = nullptr;
-	}
-
-	/* Try the allocator provided by the input pin */
-	hr = pPin->GetAllocator(ppAlloc);
-	if (SUCCEEDED(hr))
-	{
-		hr = DecideBufferSize(*ppAlloc, &prop);
-		if (SUCCEEDED(hr))
-		{
-			hr = pPin->NotifyAllocator(*ppAlloc, FALSE);
-			if (SUCCEEDED(hr))
-			{
-				return NOERROR;
-			}
-		}
-	}
-
-	if (*ppAlloc)
-	{
-		(*ppAlloc)->Release();
-		*ppAlloc = nullptr;
-	}
-
-	return hr;
-}
-
-void MagewellAudioCapturePin::LoadFormat(AUDIO_FORMAT* audioFormat, const AUDIO_SIGNAL* audioSignal) const
-{
-	auto audioIn = *audioSignal;
-	auto currentChannelAlloc = audioFormat->channelAllocation;
-	auto currentChannelMask = audioFormat->channelValidityMask;
-	if (mFilter->GetDeviceType() == USB)
-	{
-		audioFormat->fs = 48000;
-	}
-	else
-	{
-		audioFormat->fs = audioIn.signalStatus.dwSampleRate;
-	}
-	audioFormat->bitDepth = audioIn.signalStatus.cBitsPerSample;
-	audioFormat->bitDepthInBytes = audioFormat->bitDepth / 8;
-	audioFormat->codec = audioIn.signalStatus.bLPCM ? PCM : BITSTREAM;
-	audioFormat->sampleInterval = 10000000.0 / audioFormat->fs;
-	audioFormat->channelAllocation = audioIn.audioInfo.byChannelAllocation;
-	audioFormat->channelValidityMask = audioIn.signalStatus.wChannelValid;
-
-	if (audioFormat->channelAllocation == currentChannelAlloc && audioFormat->channelValidityMask == currentChannelMask)
-	{
-		// no change, leave untouched [inputChannelCount, outputChannelCount, channelMask, channelOffsets]
-	}
-	else
-	{
-		// https://ia903006.us.archive.org/11/items/CEA-861-E/CEA-861-E.pdf 
-		if (audioIn.signalStatus.wChannelValid & (0x01 << 0))
-		{
-			if (audioIn.signalStatus.wChannelValid & (0x01 << 1))
-			{
-				if (audioIn.signalStatus.wChannelValid & (0x01 << 2))
-				{
-					if (audioIn.signalStatus.wChannelValid & (0x01 << 3))
-					{
-						audioFormat->inputChannelCount = 8;
-						audioFormat->outputChannelCount = 8;
-						audioFormat->channelMask = KSAUDIO_SPEAKER_7POINT1_SURROUND;
-						audioFormat->channelOffsets.fill(0);
-						// swap LFE and FC
-						audioFormat->channelOffsets[2] = 1;
-						audioFormat->channelOffsets[3] = -1;
-						audioFormat->lfeChannelIndex = 2;
-						audioFormat->channelLayout = "FL FR FC LFE BL BR SL SR";
-					}
-					else
-					{
-						audioFormat->inputChannelCount = 6;
-						audioFormat->outputChannelCount = 6;
-						audioFormat->channelMask = KSAUDIO_SPEAKER_5POINT1;
-						audioFormat->channelOffsets.fill(0);
-						audioFormat->channelOffsets[2] = 1;
-						audioFormat->channelOffsets[3] = -1;
-						audioFormat->channelOffsets[6] = not_present;
-						audioFormat->channelOffsets[7] = not_present;
-						audioFormat->lfeChannelIndex = 2;
-						audioFormat->channelLayout = "FL FR FC LFE BL BR";
-					}
-				}
-				else
-				{
-					audioFormat->inputChannelCount = 4;
-					audioFormat->outputChannelCount = 4;
-					audioFormat->channelMask = KSAUDIO_SPEAKER_3POINT1;
-					audioFormat->channelOffsets.fill(not_present);
-					audioFormat->channelOffsets[0] = 0;
-					audioFormat->channelOffsets[1] = 0;
-					audioFormat->channelOffsets[2] = 1;
-					audioFormat->channelOffsets[3] = -1;
-					audioFormat->lfeChannelIndex = 2;
-					audioFormat->channelLayout = "FL FR FC LFE";
-				}
-			}
-			else
-			{
-				audioFormat->inputChannelCount = 2;
-				audioFormat->outputChannelCount = 2;
-				audioFormat->channelMask = KSAUDIO_SPEAKER_STEREO;
-				audioFormat->channelOffsets.fill(not_present);
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				audioFormat->channelLayout = "FL FR";
-			}
-
-			// CEA-861-E Table 28
-			switch (audioFormat->channelAllocation)
-			{
-			case 0x00:
-				// FL FR
-				audioFormat->channelLayout = "FL FR";
-				break;
-			case 0x01:
-				// FL FR LFE --
-				audioFormat->channelLayout = "FL FR LFE";
-				audioFormat->channelMask = KSAUDIO_SPEAKER_2POINT1;
-				audioFormat->inputChannelCount = 4;
-				audioFormat->outputChannelCount = 3;
-				audioFormat->channelOffsets.fill(not_present);
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x02:
-				// FL FR -- FC
-				audioFormat->channelLayout = "FL FR FC";
-				audioFormat->channelMask = KSAUDIO_SPEAKER_3POINT0;
-				audioFormat->inputChannelCount = 4;
-				audioFormat->outputChannelCount = 3;
-				audioFormat->channelOffsets.fill(not_present);
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x03:
-				// FL FR LFE FC
-				audioFormat->channelLayout = "FL FR FC LFE";
-				audioFormat->channelMask = KSAUDIO_SPEAKER_3POINT1;
-				audioFormat->inputChannelCount = 4;
-				audioFormat->outputChannelCount = 4;
-				audioFormat->channelOffsets.fill(not_present);
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1; // LFE -> FC
-				audioFormat->channelOffsets[3] = -1; // FC -> LFE
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x04:
-				// FL FR -- -- RC --
-				audioFormat->channelLayout = "FL FR RC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_CENTER;
-				audioFormat->inputChannelCount = 6;
-				audioFormat->outputChannelCount = 3;
-				audioFormat->channelOffsets.fill(not_present);
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x05:
-				// FL FR LFE -- RC --
-				audioFormat->channelLayout = "FL FR LFE RC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_BACK_CENTER;
-				audioFormat->inputChannelCount = 6;
-				audioFormat->outputChannelCount = 4;
-				audioFormat->channelOffsets.fill(not_present);
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x06:
-				// FL FR -- FC RC --
-				audioFormat->channelLayout = "FL FR FC RC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_CENTER;
-				audioFormat->inputChannelCount = 6;
-				audioFormat->outputChannelCount = 4;
-				audioFormat->channelOffsets.fill(not_present);
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x07:
-				// FL FR LFE FC RC --
-				audioFormat->channelLayout = "FL FR LFE FC RC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_CENTER;
-				audioFormat->inputChannelCount = 6;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x08:
-				// FL FR -- -- RL RR
-				audioFormat->channelLayout = "FL FR RL RR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT |
-					SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 6;
-				audioFormat->outputChannelCount = 4;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				break;
-			case 0x09:
-				// FL FR LFE -- RL RR
-				audioFormat->channelLayout = "FL FR LFE RL RR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 6;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x0A:
-				// FL FR -- FC RL RR
-				audioFormat->channelLayout = "FL FR FC RL RR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 6;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x0B:
-				// FL FR LFE FC BL BR
-				audioFormat->channelLayout = "FL FR FC LFE BL BR";
-				audioFormat->channelMask = KSAUDIO_SPEAKER_5POINT1;
-				audioFormat->inputChannelCount = 6;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x0C:
-				// FL FR -- -- RL RR RC --
-				audioFormat->channelLayout = "FL FR BL BR BC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT |
-					SPEAKER_BACK_RIGHT | SPEAKER_BACK_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x0D:
-				// FL FR LFE -- RL RR RC --
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_BACK_CENTER;
-				audioFormat->channelLayout = "FL FR LFE BL BR BC";
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x0E:
-				// FL FR -- FC RL RR RC --
-				audioFormat->channelLayout = "FL FR FC BL BR BC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_BACK_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x0F:
-				// FL FR LFE FC RL RR RC --
-				audioFormat->channelLayout = "FL FR FC LFE BL BR BC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_LOW_FREQUENCY | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_BACK_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x10:
-				// FL FR -- -- RL RR RLC RRC
-				audioFormat->channelLayout = "FL FR BL BR SL SR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_SIDE_LEFT |
-					SPEAKER_SIDE_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 2;
-				audioFormat->channelOffsets[5] = 2;
-				audioFormat->channelOffsets[6] = -2;
-				audioFormat->channelOffsets[7] = -2;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x11:
-				// FL FR LFE -- RL RR RLC RRC
-				audioFormat->channelLayout = "FL FR LFE BL BR SL SR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 2;
-				audioFormat->channelOffsets[5] = 2;
-				audioFormat->channelOffsets[6] = -2;
-				audioFormat->channelOffsets[7] = -2;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x12:
-				// FL FR -- FC RL RR RLC RRC
-				audioFormat->channelLayout = "FL FR FC BL BR SL SR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 2;
-				audioFormat->channelOffsets[5] = 2;
-				audioFormat->channelOffsets[6] = -2;
-				audioFormat->channelOffsets[7] = -2;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x13:
-				// FL FR LFE FC RL RR RLC RRC (RL = side, RLC = back)
-				audioFormat->channelLayout = "FL FR FC LFE BL BR SL SR";
-				audioFormat->channelMask = KSAUDIO_SPEAKER_7POINT1_SURROUND;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 8;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 2;
-				audioFormat->channelOffsets[5] = 2;
-				audioFormat->channelOffsets[6] = -2;
-				audioFormat->channelOffsets[7] = -2;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x14:
-				// FL FR -- -- -- -- FLC FRC
-				audioFormat->channelLayout = "FL FR FLC FRC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_LEFT_OF_CENTER |
-					SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 4;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = not_present;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x15:
-				// FL FR LFE -- -- -- FLC FRC
-				audioFormat->channelLayout = "FL FR LFE FLC FRC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = not_present;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x16:
-				// FL FR -- FC -- -- FLC FRC
-				audioFormat->channelLayout = "FL FR FC FLC FRC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = not_present;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x17:
-				// FL FR LFE FC -- -- FLC FRC
-				audioFormat->channelLayout = "FL FR FC LFE FLC FRC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = not_present;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x18:
-				// FL FR -- -- RC -- FLC FRC
-				audioFormat->channelLayout = "FL FR RC FLC FRC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_CENTER |
-					SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 2;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = -1;
-				audioFormat->channelOffsets[7] = -1;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x19:
-				// FL FR LFE -- RC -- FLC FRC
-				audioFormat->channelLayout = "FL FR LFE RC FLC FRC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_BACK_CENTER | SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 2;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = -1;
-				audioFormat->channelOffsets[7] = -1;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x1A:
-				// FL FR -- FC RC -- FLC FRC
-				audioFormat->channelLayout = "FL FR FC RC FLC FRC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_CENTER | SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 2;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = -1;
-				audioFormat->channelOffsets[7] = -1;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x1B:
-				// FL FR LFE FC RC -- FLC FRC
-				audioFormat->channelLayout = "FL FR FC LFE RC FLC FRC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_CENTER | SPEAKER_FRONT_LEFT_OF_CENTER |
-					SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 2;
-				audioFormat->channelOffsets[5] = not_present;
-				audioFormat->channelOffsets[6] = -1;
-				audioFormat->channelOffsets[7] = -1;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x1C:
-				// FL FR -- -- RL RR FLC FRC
-				audioFormat->channelLayout = "FL FR BL BR FLC FLR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT |
-					SPEAKER_BACK_RIGHT | SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x1D:
-				// FL FR LFE -- RL RR FLC FRC
-				audioFormat->channelLayout = "FL FR LFE BL BR FLC FLR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_FRONT_LEFT_OF_CENTER |
-					SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x1E:
-				// FL FR -- FC RL RR FLC FRC
-				audioFormat->channelLayout = "FL FR FC BL BR FLC FLR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_FRONT_LEFT_OF_CENTER |
-					SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x1F:
-				// FL FR LFE FC RL RR FLC FRC
-				audioFormat->channelLayout = "FL FR LFE FC BL BR FLC FLR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_FRONT_LEFT_OF_CENTER |
-					SPEAKER_FRONT_RIGHT_OF_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 8;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x20:
-				// FL FR -- FC RL RR FCH --
-				audioFormat->channelLayout = "FL FR FC BL BR TFC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_TOP_FRONT_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x21:
-				// FL FR LFE FC RL RR FCH --
-				audioFormat->channelLayout = "FL FR FC LFE BL BR TFC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_TOP_FRONT_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x22:
-				// FL FR -- FC RL RR -- TC
-				audioFormat->channelLayout = "FL FR FC BL BR TC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_TOP_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x23:
-				// FL FR LFE FC RL RR -- TC
-				audioFormat->channelLayout = "FL FR FC LFE BL BR TC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_TOP_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x24:
-				// FL FR -- -- RL RR FLH FRH
-				audioFormat->channelLayout = "FL FR BL BR TFL TFR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT |
-					SPEAKER_BACK_RIGHT | SPEAKER_TOP_FRONT_LEFT | SPEAKER_TOP_FRONT_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x25:
-				// FL FR LFE -- RL RR FLH FRH
-				audioFormat->channelLayout = "FL FR LFE BL BR TFL TFR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_BACK_LEFT | SPEAKER_TOP_FRONT_LEFT | SPEAKER_TOP_FRONT_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x26:
-				// FL FR -- -- RL RR FLW FRW (WIDE not supported by Windows, discarded)
-				audioFormat->channelLayout = "FL FR BL BR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT |
-					SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 4;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x27:
-				// FL FR LFE -- RL RR FLW FRW (WIDE not supported by Windows, discarded)
-				audioFormat->channelLayout = "FL FR LFE BL BR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_BACK_LEFT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x28:
-				// FL FR -- FC RL RR RC TC
-				audioFormat->channelLayout = "FL FR FC BL BR BC TC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_BACK_CENTER | SPEAKER_TOP_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x29:
-				// FL FR LFE FC RL RR RC TC
-				audioFormat->channelLayout = "FL FR FC LFE BL BR BC TC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_BACK_CENTER |
-					SPEAKER_TOP_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 8;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x2A:
-				// FL FR -- FC RL RR RC FCH
-				audioFormat->channelLayout = "FL FR FC BL BR BC TFC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_BACK_CENTER | SPEAKER_TOP_FRONT_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x2B:
-				// FL FR LFE FC RL RR RC FCH
-				audioFormat->channelLayout = "FL FR FC LFE BL BR BC TFC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_BACK_CENTER |
-					SPEAKER_TOP_FRONT_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 8;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x2C:
-				// FL FR -- FC RL RR FCH TC
-				audioFormat->channelLayout = "FL FR FC BL BR TFC TC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_TOP_FRONT_CENTER | SPEAKER_TOP_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 0;
-				audioFormat->channelOffsets[3] = not_present;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 1;
-				audioFormat->channelOffsets[7] = -1;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x2D:
-				// FL FR LFE FC RL RR FCH TC
-				audioFormat->channelLayout = "FL FR FC LFE BL BR TFC TC";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_TOP_FRONT_CENTER |
-					SPEAKER_TOP_CENTER;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 8;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 1;
-				audioFormat->channelOffsets[7] = -1;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x2E:
-				// FL FR -- FC RL RR FLH FRH
-				audioFormat->channelLayout = "FL FR FC BL BR TFL TFR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_TOP_FRONT_LEFT | SPEAKER_TOP_FRONT_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 7;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x2F:
-				// FL FR LFE FC RL RR FLH FRH
-				audioFormat->channelLayout = "FL FR FC LFE BL BR TFL TFR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_TOP_FRONT_LEFT |
-					SPEAKER_TOP_FRONT_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 8;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = 0;
-				audioFormat->channelOffsets[7] = 0;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			case 0x30:
-				// FL FR -- FC RL RR FLW FRW (WIDE not supported by Windows, discarded)
-				audioFormat->channelLayout = "FL FR FC BL BR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
-					SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 5;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = not_present;
-				audioFormat->channelOffsets[3] = 0;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = not_present;
-				break;
-			case 0x31:
-				// FL FR LFE FC RL RR FLW FRW (WIDE not supported by Windows, discarded)
-				audioFormat->channelLayout = "FL FR FC LFE BL BR";
-				audioFormat->channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_LOW_FREQUENCY |
-					SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
-				audioFormat->inputChannelCount = 8;
-				audioFormat->outputChannelCount = 6;
-				audioFormat->channelOffsets[0] = 0;
-				audioFormat->channelOffsets[1] = 0;
-				audioFormat->channelOffsets[2] = 1;
-				audioFormat->channelOffsets[3] = -1;
-				audioFormat->channelOffsets[4] = 0;
-				audioFormat->channelOffsets[5] = 0;
-				audioFormat->channelOffsets[6] = not_present;
-				audioFormat->channelOffsets[7] = not_present;
-				audioFormat->lfeChannelIndex = 2;
-				break;
-			default:
-				// ignore
-				break;
-			}
+	if (0 != fclose(mRawFile))
+	{
+		LOG_WARNING(mLogger, "[{}] Failed to close {}", mLogPrefix, mRawFileName);
+	}
+	#endif
+}
+
+HRESULT MagewellAudioCapturePin::DecideAllocator(IMemInputPin* pPin, IMemAllocator** ppAlloc)
+{
+	// copied from CBaseOutputPin but preferring to use our own allocator first
+
+	HRESULT hr = NOERROR;
+	*ppAlloc = nullptr;
+
+	ALLOCATOR_PROPERTIES prop;
+	ZeroMemory(&prop, sizeof(prop));
 
-			// CEA-861-E Table 31
-			audioFormat->lfeLevelAdjustment = audioIn.audioInfo.byLFEPlaybackLevel == 0x2 ? minus_10db : unity;
+	pPin->GetAllocatorRequirements(&prop);
+	if (prop.cbAlign == 0)
+	{
+		prop.cbAlign = 1;
+	}
+
+	/* Try the allocator provided by the output pin. */
+	hr = InitAllocator(ppAlloc);
+	if (SUCCEEDED(hr))
+	{
+		hr = DecideBufferSize(*ppAlloc, &prop);
+		if (SUCCEEDED(hr))
+		{
+			hr = pPin->NotifyAllocator(*ppAlloc, FALSE);
+			if (SUCCEEDED(hr))
+			{
+				return NOERROR;
+			}
 		}
-		else
+	}
+
+	if (*ppAlloc)
+	{
+		(*ppAlloc)->Release();
+		*ppAlloc = nullptr;
+	}
+
+	/* Try the allocator provided by the input pin */
+	hr = pPin->GetAllocator(ppAlloc);
+	if (SUCCEEDED(hr))
+	{
+		hr = DecideBufferSize(*ppAlloc, &prop);
+		if (SUCCEEDED(hr))
 		{
-			audioFormat->inputChannelCount = 0;
-			audioFormat->outputChannelCount = 0;
-			audioFormat->channelOffsets.fill(not_present);
-			audioFormat->lfeChannelIndex = not_present;
+			hr = pPin->NotifyAllocator(*ppAlloc, FALSE);
+			if (SUCCEEDED(hr))
+			{
+				return NOERROR;
+			}
 		}
 	}
+
+	if (*ppAlloc)
+	{
+		(*ppAlloc)->Release();
+		*ppAlloc = nullptr;
+	}
+
+	return hr;
+}
+
+void MagewellAudioCapturePin::LoadFormat(AUDIO_FORMAT* audioFormat, const AUDIO_SIGNAL* audioSignal) const
+{
+	AUDIO_INPUT audioInput;
+	audioInput.fs = mFilter->GetDeviceType() == USB ? 48000 : audioSignal->signalStatus.dwSampleRate;
+	audioInput.bitsPerSample = audioSignal->signalStatus.cBitsPerSample;
+	audioInput.lpcm = audioSignal->signalStatus.bLPCM;
+	audioInput.channelAllocation = audioSignal->audioInfo.byChannelAllocation;
+	audioInput.lfePlaybackLevel = audioSignal->audioInfo.byLFEPlaybackLevel;
+	audioInput.channelValidityMask = audioSignal->signalStatus.wChannelValid;
+	audioInput.channelStatusValid = audioSignal->signalStatus.bChannelStatusValid;
+	memcpy(audioInput.channelStatus.data(), audioSignal->signalStatus.channelStatus.abyData, audioInput.channelStatus.size());
+	audioInput.codingType = audioSignal->audioInfo.byAudioCodingType;
+	LoadAudioFormat(audioFormat, &audioInput);
 }
 
-void MagewellAudioCapturePin::AudioFormatToMediaType(CMediaType* pmt, AUDIO_FORMAT* audioFormat)
+void MagewellAudioCapturePin::AudioFormatToMediaType(CMediaType* pmt, AUDIO_FORMAT* audioFormat) const
 {
 	// based on https://github.com/Nevcairiel/LAVFilters/blob/81c5676cb99d0acfb1457b8165a0becf5601cae3/decoder/LAVAudio/LAVAudio.cpp#L1186
 	pmt->majortype = MEDIATYPE_Audio;
@@ -3745,8 +4486,23 @@ void MagewellAudioCapturePin::AudioFormatToMediaType(CMediaType* pmt, AUDIO_FORM
 			// should never get here
 			break;
 		}
+		if (mFilter->IsIec61937Passthrough())
+		{
+			// the stream is delivered as captured so is described by the HDMI link rather than by the codec
+			pmt->subtype = wf->SubFormat;
+			wf->Format.nChannels = audioFormat->inputChannelCount / 2 * 2;
+			wf->Format.nSamplesPerSec = audioFormat->fs;
+		}
 		wf_iec61937.dwEncodedSamplesPerSec = 48000;
 		wf_iec61937.dwAverageBytesPerSec = 0;
+		// refined by the headers of the burst which triggered the change, if known
+		auto header = &audioFormat->bitstreamHeader;
+		if (header->codec == audioFormat->codec)
+		{
+			if (header->sampleRate > 0) wf_iec61937.dwEncodedSamplesPerSec = header->sampleRate;
+			if (header->channelCount > 0) wf_iec61937.dwEncodedChannelCount = header->channelCount;
+			wf_iec61937.dwAverageBytesPerSec = header->bitRate / 8;
+		}
 		wf->Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
 		wf->Format.wBitsPerSample = 16;
 		wf->Samples.wValidBitsPerSample = 16;
@@ -3759,45 +4515,54 @@ void MagewellAudioCapturePin::AudioFormatToMediaType(CMediaType* pmt, AUDIO_FORM
 	}
 }
 
-HRESULT MagewellAudioCapturePin::LoadSignal(HCHANNEL* hChannel)
+HRESULT MagewellAudioCapturePin::LoadSignal()
 {
-	mLastMwResult = MWGetAudioSignalStatus(*hChannel, &mAudioSignal.signalStatus);
-	if (MW_SUCCEEDED != mLastMwResult)
+	DEVICE_SIGNAL signal;
+	auto version = mFilter->GetSignal(&signal);
+	if (version == mSignalVersion)
+	{
+		return mSignalResult;
+	}
+	mSignalVersion = version;
+	mSignalResult = S_FALSE;
+
+	mAudioSignal.signalStatus = signal.audioSignal;
+	if (MW_SUCCEEDED != signal.audioSignalResult)
 	{
 		#ifndef NO_QUILL
 		LOG_ERROR(mLogger, "[{}] LoadSignal MWGetAudioSignalStatus", mLogPrefix);
 		#endif
-		return S_FALSE;
+		return mSignalResult;
 	}
 
-	MWCAP_INPUT_SPECIFIC_STATUS status;
-	mLastMwResult = MWGetInputSpecificStatus(*hChannel, &status);
-	if (mLastMwResult == MW_SUCCEEDED)
+	if (signal.inputStatusResult == MW_SUCCEEDED)
 	{
 		DWORD tPdwValidFlag = 0;
-		if (!status.bValid)
+		if (!signal.inputStatus.bValid)
 		{
 			#ifndef NO_QUILL
 			LOG_ERROR(mLogger, "[{}] MWGetInputSpecificStatus is invalid", mLogPrefix);
 			#endif
 		}
-		else if (status.dwVideoInputType != MWCAP_VIDEO_INPUT_TYPE_HDMI) 
+		else if (signal.inputStatus.dwVideoInputType != MWCAP_VIDEO_INPUT_TYPE_HDMI)
 		{
 			#ifndef NO_QUILL
-			LOG_ERROR(mLogger, "[{}] Video input type is not HDMI {}", mLogPrefix, status.dwVideoInputType);
+			LOG_ERROR(mLogger, "[{}] Video input type is not HDMI {}", mLogPrefix, signal.inputStatus.dwVideoInputType);
 			#endif
 		}
-		else if (MW_SUCCEEDED != MWGetHDMIInfoFrameValidFlag(*hChannel, &tPdwValidFlag))
+		else if (MW_SUCCEEDED != signal.infoFrameResult)
 		{
 			#ifndef NO_QUILL
 			LOG_TRACE_L1(mLogger, "[{}] Unable to detect HDMI InfoFrame", mLogPrefix);
 			#endif
 		}
-		if (tPdwValidFlag & MWCAP_HDMI_INFOFRAME_MASK_AUDIO)
+		else
+		{
+			tPdwValidFlag = signal.infoFrameValidFlags;
+		}
+		if (tPdwValidFlag & MWCAP_HDMI_INFOFRAME_MASK_AUDIO && signal.hasAudioInfo)
 		{
-			HDMI_INFOFRAME_PACKET pkt;
-			MWGetHDMIInfoFramePacket(*hChannel, MWCAP_HDMI_INFOFRAME_ID_AUDIO, &pkt);
-			mAudioSignal.audioInfo = pkt.audioInfoFramePayload;
+			mAudioSignal.audioInfo = signal.audioInfo;
 		}
 		else
 		{
@@ -3805,7 +4570,7 @@ HRESULT MagewellAudioCapturePin::LoadSignal(HCHANNEL* hChannel)
 			#ifndef NO_QUILL
 			LOG_TRACE_L1(mLogger, "[{}] No HDMI Audio infoframe detected", mLogPrefix);
 			#endif
-			return S_FALSE;
+			return mSignalResult;
 		}
 	}
 	else
@@ -3813,7 +4578,7 @@ HRESULT MagewellAudioCapturePin::LoadSignal(HCHANNEL* hChannel)
 		#ifndef NO_QUILL
 		LOG_ERROR(mLogger, "[{}] LoadSignal MWGetInputSpecificStatus", mLogPrefix);
 		#endif
-		return S_FALSE;
+		return mSignalResult;
 	}
 
 	if (mAudioSignal.signalStatus.wChannelValid == 0)
@@ -3822,90 +4587,60 @@ HRESULT MagewellAudioCapturePin::LoadSignal(HCHANNEL* hChannel)
 		LOG_TRACE_L1(mLogger, "[{}] No valid audio channels detected {}", mLogPrefix,
 			mAudioSignal.signalStatus.wChannelValid);
 		#endif
-		return S_NO_CHANNELS;
+		mSignalResult = S_NO_CHANNELS;
+		return mSignalResult;
 	}
-	return S_OK;
+	mSignalResult = S_OK;
+	return mSignalResult;
 }
 
 bool MagewellAudioCapturePin::ShouldChangeMediaType(AUDIO_FORMAT* newAudioFormat)
 {
-	auto reconnect = false;
-	if (mAudioFormat.inputChannelCount != newAudioFormat->inputChannelCount)
-	{
-		reconnect = true;
+	auto changes = GetAudioFormatChanges(&mAudioFormat, newAudioFormat);
 
-		#ifndef NO_QUILL
+	#ifndef NO_QUILL
+	if (changes & INPUT_CHANNEL_COUNT_CHANGED)
+	{
 		LOG_INFO(mLogger, "[{}] Input channel count change {} to {}", mLogPrefix, mAudioFormat.inputChannelCount,
 			newAudioFormat->inputChannelCount);
-		#endif
 	}
-	if (mAudioFormat.outputChannelCount != newAudioFormat->outputChannelCount)
+	if (changes & OUTPUT_CHANNEL_COUNT_CHANGED)
 	{
-		reconnect = true;
-
-		#ifndef NO_QUILL
 		LOG_INFO(mLogger, "[{}] Output channel count change {} to {}", mLogPrefix, mAudioFormat.outputChannelCount,
 			newAudioFormat->outputChannelCount);
-		#endif
 	}
-	if (mAudioFormat.bitDepthInBytes != newAudioFormat->bitDepthInBytes)
+	if (changes & BIT_DEPTH_CHANGED)
 	{
-		reconnect = true;
-
-		#ifndef NO_QUILL
 		LOG_INFO(mLogger, "[{}] Bit depth change {} to {}", mLogPrefix, mAudioFormat.bitDepthInBytes,
 			newAudioFormat->bitDepthInBytes);
-		#endif
 	}
-	if (mAudioFormat.fs != newAudioFormat->fs)
+	if (changes & FS_CHANGED)
 	{
-		reconnect = true;
-
-		#ifndef NO_QUILL
 		LOG_INFO(mLogger, "[{}] Fs change {} to {}", mLogPrefix, mAudioFormat.fs, newAudioFormat->fs);
-		#endif
 	}
-	if (mAudioFormat.codec != newAudioFormat->codec)
+	if (changes & CODEC_CHANGED)
 	{
-		reconnect = true;
-
-		#ifndef NO_QUILL
 		LOG_INFO(mLogger, "[{}] Codec change {} to {}", mLogPrefix, codecNames[mAudioFormat.codec], codecNames[newAudioFormat->codec]);
-		#endif
 	}
-	if (mAudioFormat.channelAllocation != newAudioFormat->channelAllocation)
+	if (changes & CHANNEL_ALLOCATION_CHANGED)
 	{
-		reconnect = true;
-		#ifndef NO_QUILL
 		LOG_INFO(mLogger, "[{}] Channel allocation change {} to {}", mLogPrefix, mAudioFormat.channelAllocation,
 			newAudioFormat->channelAllocation);
-		#endif
-	}
-	if (mAudioFormat.codec != PCM && newAudioFormat->codec != PCM && mAudioFormat.dataBurstSize != newAudioFormat->dataBurstSize)
-	{
-		reconnect = true;
-		#ifndef NO_QUILL
-		LOG_INFO(mLogger, "[{}] Bitstream databurst change {} to {}", mLogPrefix, mAudioFormat.dataBurstSize,
-			newAudioFormat->dataBurstSize);
-		#endif
 	}
-	return reconnect;
-}
+	#endif
 
-void MagewellAudioCapturePin::CaptureFrame(const BYTE* pbFrame, int cbFrame, UINT64 u64TimeStamp, void* pParam)
-{
-	MagewellAudioCapturePin* pin = static_cast<MagewellAudioCapturePin*>(pParam);
-	CAutoLock lck(&pin->mCaptureCritSec);
-	memcpy(pin->mCapturedFrame.data, pbFrame, cbFrame);
-	pin->mCapturedFrame.length = cbFrame;
-	pin->mCapturedFrame.ts = u64TimeStamp;
-	if (!SetEvent(pin->mNotifyEvent))
+	// the stream has switched to a configuration of the same codec with larger bursts (e.g. a different AC3 sample rate)
+	auto outgrown = !mFilter->IsIec61937Passthrough() && newAudioFormat->codec != PCM && newAudioFormat->codec == mAudioFormat.codec &&
+		GetSampleSize(newAudioFormat) > GetSampleSize(&mAudioFormat);
+
+	#ifndef NO_QUILL
+	if (outgrown)
 	{
-		auto err = GetLastError();
-		#ifndef NO_QUILL
-		LOG_ERROR(pin->mLogger, "[{}] Failed to notify on frame {:#08x}", pin->mLogPrefix, err);
-		#endif
+		LOG_INFO(mLogger, "[{}] {} bursts outgrow the {} byte samples", mLogPrefix, codecNames[newAudioFormat->codec], GetSampleSize(&mAudioFormat));
 	}
+	#endif
+
+	return changes != AUDIO_FORMAT_UNCHANGED || outgrown;
 }
 
 HRESULT MagewellAudioCapturePin::FillBuffer(IMediaSample* pms)
@@ -3926,132 +4661,76 @@ HRESULT MagewellAudioCapturePin::FillBuffer(IMediaSample* pms)
 	auto sampleSize = pms->GetSize();
 	auto bytesCaptured = 0L;
 	auto samplesCaptured = 0;
+	auto framesCaptured = 1;
+	auto jitterStartTime = 0LL;
+	auto jitterEndTime = 0LL;
 
-	if (mAudioFormat.codec != PCM)
+	if (mFilter->IsIec61937Passthrough() && mAudioFormat.codec != PCM)
+	{
+		framesCaptured = mPcmFramesBuffered;
+		mPcmFramesBuffered = 0;
+		bytesCaptured = static_cast<long>(mPassthrough.CopyFrames(mFrameBuffer, static_cast<uint8_t>(framesCaptured), mAudioFormat.inputChannelCount,
+			pmsData, static_cast<uint32_t>(sampleSize)));
+		samplesCaptured = framesCaptured * MWCAP_AUDIO_SAMPLES_PER_FRAME;
+		pms->SetActualDataLength(bytesCaptured);
+
+		#ifndef NO_QUILL
+		LOG_TRACE_L3(mLogger, "[{}] Passing through {} {} bytes from {} frames", mLogPrefix, bytesCaptured, codecNames[mAudioFormat.codec], framesCaptured);
+		#endif
+	}
+	else if (mAudioFormat.codec != PCM)
 	{
 		#ifndef NO_QUILL
-		LOG_TRACE_L3(mLogger, "[{}] Sending {} {} bytes", mLogPrefix, mDataBurstPayloadSize, codecNames[mAudioFormat.codec]);
+		LOG_TRACE_L3(mLogger, "[{}] Sending {} {} bytes", mLogPrefix, mBitstream.GetDataBurstPayloadSize(), codecNames[mAudioFormat.codec]);
 		#endif
 
-		for (auto i = 0; i < mDataBurstPayloadSize; i++)
+		auto payloadSize = mBitstream.GetDataBurstPayloadSize();
+		if (payloadSize > sampleSize)
 		{
-			pmsData[i] = mDataBurstBuffer[i];
+			#ifndef NO_QUILL
+			LOG_ERROR(mLogger, "[{}] Truncating {} byte {} databurst to {} bytes", mLogPrefix, payloadSize, codecNames[mAudioFormat.codec], sampleSize);
+			#endif
+			payloadSize = static_cast<uint16_t>(sampleSize);
 		}
-		pms->SetActualDataLength(mDataBurstPayloadSize);
+		memcpy(pmsData, mBitstream.GetDataBurst(), payloadSize);
+		pms->SetActualDataLength(payloadSize);
 		samplesCaptured++;
-		bytesCaptured = mDataBurstPayloadSize;
-		mDataBurstPayloadSize = 0;
+		bytesCaptured = payloadSize;
+		mBitstream.ConsumeDataBurst();
 	}
 	else
 	{
 		// channel order on input is L0-L3,R0-R3 which has to be remapped to L0,R0,L1,R1,L2,R2,L3,R3
 		// each 4 byte sample is left zero padded if the incoming stream is a lower bit depth (which is typically the case for HDMI audio)
-		// must also apply the channel offsets to ensure each input channel is offset as necessary to be written to the correct output channel index
-		auto outputChannelIdxL = -1;
-		auto outputChannelIdxR = -1;
-		auto outputChannels = -1;
-		auto mustRescaleLfe = mAudioFormat.lfeLevelAdjustment != unity; // NOLINT(clang-diagnostic-float-equal)
-
+		// the remap plan applies the channel offsets to ensure each input channel is written to the correct output channel index
 		#ifndef NO_QUILL
-		if (mustRescaleLfe)
+		if (mAudioFormat.lfeLevelAdjustment != unity) // NOLINT(clang-diagnostic-float-equal)
 		{
 			LOG_ERROR(mLogger, "[{}] ERROR! Rescale LFE not implemented!", mLogPrefix);
 		}
 		#endif
 
-		for (auto pairIdx = 0; pairIdx < mAudioFormat.inputChannelCount / 2; ++pairIdx)
+		// captured frames are contiguous so the aggregated frames are remapped as a single block
+		framesCaptured = mPcmFramesBuffered;
+		mPcmFramesBuffered = 0;
+		const auto samplesBuffered = framesCaptured * MWCAP_AUDIO_SAMPLES_PER_FRAME;
+		if (mFilter->IsPcmJitterBufferEnabled())
 		{
-			auto channelIdxL = pairIdx * 2;
-			auto outputOffsetL = mAudioFormat.channelOffsets[channelIdxL];
-			if (outputOffsetL != not_present) outputChannelIdxL = ++outputChannels;
-
-			auto channelIdxR = channelIdxL + 1;
-			auto outputOffsetR = mAudioFormat.channelOffsets[channelIdxR];
-			if (outputOffsetR != not_present) outputChannelIdxR = ++outputChannels;
-
-			if (outputOffsetL == not_present && outputOffsetR == not_present) continue;
-
-			for (auto sampleIdx = 0; sampleIdx < MWCAP_AUDIO_SAMPLES_PER_FRAME; sampleIdx++)
-			{
-				auto inByteStartIdxL = sampleIdx * MWCAP_AUDIO_MAX_NUM_CHANNELS;    // scroll to the sample block
-				inByteStartIdxL += pairIdx;										        // scroll to the left channel slot
-				inByteStartIdxL *= maxBitDepthInBytes;									// convert from slot index to byte index
-
-				auto inByteStartIdxR = sampleIdx * MWCAP_AUDIO_MAX_NUM_CHANNELS;    // scroll to the sample block
-				inByteStartIdxR += pairIdx + MWCAP_AUDIO_MAX_NUM_CHANNELS / 2;	        // scroll to the left channel slot then jump to the matching right channel
-				inByteStartIdxR *= maxBitDepthInBytes;									// convert from slot index to byte index
-
-				auto outByteStartIdxL = sampleIdx * mAudioFormat.outputChannelCount;// scroll to the sample block
-				outByteStartIdxL += (outputChannelIdxL + outputOffsetL);                // jump to the output channel slot
-				outByteStartIdxL *= mAudioFormat.bitDepthInBytes;                       // convert from slot index to byte index
-
-				auto outByteStartIdxR = sampleIdx * mAudioFormat.outputChannelCount;// scroll to the sample block
-				outByteStartIdxR += (outputChannelIdxR + outputOffsetR);                // jump to the output channel slot
-				outByteStartIdxR *= mAudioFormat.bitDepthInBytes;                       // convert from slot index to byte index
-
-				if (mAudioFormat.lfeChannelIndex == channelIdxL && mustRescaleLfe)
-				{
-					// PCM in network (big endian) byte order hence have to shift rather than use memcpy
-					//   convert to an int
-					int sampleValueL = mFrameBuffer[inByteStartIdxL] << 24 | mFrameBuffer[inByteStartIdxL + 1] << 16 |
-						mFrameBuffer[inByteStartIdxL + 2] << 8 | mFrameBuffer[inByteStartIdxL + 3];
-
-					int sampleValueR = mFrameBuffer[inByteStartIdxR] << 24 | mFrameBuffer[inByteStartIdxR + 1] << 16 |
-						mFrameBuffer[inByteStartIdxR + 2] << 8 | mFrameBuffer[inByteStartIdxR + 3];
-
-					//   adjust gain to a double
-					double scaledValueL = mAudioFormat.lfeLevelAdjustment * sampleValueL;
-					double scaledValueR = mAudioFormat.lfeLevelAdjustment * sampleValueR;
-
-					// TODO
-					//   triangular dither back to 16 or 24 bit PCM
-
-					//   convert back to bytes and write to the sample
-				}
-				else
-				{
-					// skip past any zero padding (if any)
-					inByteStartIdxL += maxBitDepthInBytes - mAudioFormat.bitDepthInBytes;
-					inByteStartIdxR += maxBitDepthInBytes - mAudioFormat.bitDepthInBytes;
-					for (int k = 0; k < mAudioFormat.bitDepthInBytes; ++k)
-					{
-						if (outputOffsetL != not_present)
-						{
-							auto outIdx = outByteStartIdxL + k;
-							bytesCaptured++;
-							if (outIdx < sampleSize)
-							{
-								pmsData[outIdx] = mFrameBuffer[inByteStartIdxL + k];
-							}
-							else
-							{
-								#ifndef NO_QUILL
-								LOG_ERROR(mLogger, "[{}] Skipping L byte {} when sample should only be {} bytes long", mLogPrefix, outIdx, sampleSize);
-								#endif
-							}
-						}
+			samplesCaptured = static_cast<int>(FillFromJitterBuffer(pmsData, sampleSize, static_cast<uint32_t>(samplesBuffered), &jitterStartTime, &jitterEndTime));
+		}
+		else
+		{
+			samplesCaptured = static_cast<int>(RemapPcm(mAudioFormat.remapPlan, mFrameBuffer, pmsData, static_cast<uint32_t>(sampleSize), samplesBuffered));
+		}
+		bytesCaptured = samplesCaptured * mAudioFormat.remapPlan->outputBlockSize;
 
-						if (outputOffsetR != not_present)
-						{
-							auto outIdx = outByteStartIdxR + k;
-							bytesCaptured++;
-							if (outIdx < sampleSize)
-							{
-								pmsData[outIdx] = mFrameBuffer[inByteStartIdxR + k];
-							}
-							else
-							{
-								#ifndef NO_QUILL
-								LOG_ERROR(mLogger, "[{}] Skipping R byte {} when sample should only be {} bytes long", mLogPrefix, outIdx, sampleSize);
-								#endif
-
-							}
-						}
-					}
-				}
-				if (pairIdx == 0) samplesCaptured++;
-			}
+		#ifndef NO_QUILL
+		if (!mFilter->IsPcmJitterBufferEnabled() && samplesCaptured < samplesBuffered)
+		{
+			LOG_ERROR(mLogger, "[{}] Skipping {} samples when sample should only be {} bytes long", mLogPrefix,
+				samplesBuffered - samplesCaptured, sampleSize);
 		}
+		#endif
 
 		#ifdef RECORD_ENCODED
 		LOG_TRACE_L3(mLogger, "[{}] pcm_out,{},{}", mLogPrefix, mFrameCounter, bytesCaptured);
@@ -4060,9 +4739,17 @@ HRESULT MagewellAudioCapturePin::FillBuffer(IMediaSample* pms)
 	}
 
 	auto lastEndTime = mFrameEndTime - mStreamStartTime;
-	mFilter->GetReferenceTime(&mFrameEndTime);
+	UpdateFrameEndTime(mFrameDeviceTime);
 	auto endTime = mFrameEndTime - mStreamStartTime;
-	auto startTime = endTime - static_cast<long>(mAudioFormat.sampleInterval * MWCAP_AUDIO_SAMPLES_PER_FRAME);
+	// a burst lasts as long as the audio it carries rather than the frame it completed in
+	auto burstDuration = !mFilter->IsIec61937Passthrough() && mAudioFormat.codec != PCM && mBurstHeader.codec == mAudioFormat.codec ? GetBurstDuration(&mBurstHeader) : 0;
+	auto startTime = endTime - (burstDuration > 0 ? burstDuration : static_cast<long>(mAudioFormat.sampleInterval * MWCAP_AUDIO_SAMPLES_PER_FRAME * framesCaptured));
+	if (mFilter->IsPcmJitterBufferEnabled() && mAudioFormat.codec == PCM)
+	{
+		// the jitter buffer output is continuous on the graph clock
+		startTime = jitterStartTime;
+		endTime = jitterEndTime;
+	}
 	auto sincePrev = endTime - lastEndTime;
 
 	#ifndef NO_QUILL
@@ -4079,7 +4766,7 @@ HRESULT MagewellAudioCapturePin::FillBuffer(IMediaSample* pms)
 	#endif
 
 	pms->SetTime(&startTime, &endTime);
-	pms->SetSyncPoint(mAudioFormat.codec == PCM);
+	pms->SetSyncPoint(mAudioFormat.codec == PCM || mFilter->IsIec61937Passthrough());
 	pms->SetDiscontinuity(mSinceCodecChange < 2 && mAudioFormat.codec != PCM);
 	if (mSendMediaType)
 	{
@@ -4096,6 +4783,67 @@ HRESULT MagewellAudioCapturePin::FillBuffer(IMediaSample* pms)
 	return retVal;
 }
 
+uint32_t MagewellAudioCapturePin::FillFromJitterBuffer(BYTE* pmsData, long sampleSize, uint32_t samplesBuffered,
+	REFERENCE_TIME* startTime, REFERENCE_TIME* endTime)
+{
+	auto plan = mAudioFormat.remapPlan;
+	if (plan->outputBlockSize == 0) return 0;
+
+	REFERENCE_TIME now;
+	mFilter->GetReferenceTime(&now);
+	auto targetDepthMs = mFilter->GetPcmJitterTargetDepthMs();
+	if (mJitterStartTime == 0 || !mJitterBuffer.IsConfiguredFor(mAudioFormat.fs, plan->bitDepthInBytes, plan->outputChannelCount, targetDepthMs))
+	{
+		mJitterBuffer.Reset(mAudioFormat.fs, plan->bitDepthInBytes, plan->outputChannelCount, targetDepthMs);
+		// the first sample ends now as it would without the jitter buffer
+		mJitterStartTime = now - static_cast<REFERENCE_TIME>(mAudioFormat.sampleInterval * samplesBuffered);
+		mJitterFramesDelivered = 0;
+		mJitterStatsTime = now;
+		mPcmFramesLost = 0;
+
+		#ifndef NO_QUILL
+		LOG_INFO(mLogger, "[{}] Jitter buffer reset to {} ms at {} Hz {} bytes {} channels", mLogPrefix, targetDepthMs,
+			mAudioFormat.fs, plan->bitDepthInBytes, plan->outputChannelCount);
+		#endif
+	}
+
+	// lost frames are replaced by silence so the buffered audio stays in step with the capture clock, beyond the target
+	// depth it would only be dropped again
+	if (mPcmFramesLost > 0)
+	{
+		auto lostSamples = std::min<uint64_t>(mPcmFramesLost * MWCAP_AUDIO_SAMPLES_PER_FRAME, mJitterBuffer.GetTargetDepth());
+		mJitterBuffer.PushSilence(static_cast<uint32_t>(lostSamples));
+		mPcmFramesLost = 0;
+	}
+	auto remapped = RemapPcm(plan, mFrameBuffer, mJitterInput, sizeof(mJitterInput), samplesBuffered);
+	mJitterBuffer.Push(mJitterInput, remapped);
+
+	// deliver whatever the graph clock says is due, any that don't fit are left for the next sample
+	auto due = static_cast<int64_t>(static_cast<double>(now - mJitterStartTime) * mAudioFormat.fs / oneSecondIn100ns) -
+		static_cast<int64_t>(mJitterFramesDelivered);
+	auto capacity = static_cast<int64_t>(sampleSize / plan->outputBlockSize);
+	auto samples = static_cast<uint32_t>(std::clamp<int64_t>(due, 0, capacity));
+	mJitterBuffer.Pull(pmsData, samples, static_cast<uint32_t>(std::max<int64_t>(due - samples, 0)));
+
+	*startTime = mJitterStartTime - mStreamStartTime + static_cast<REFERENCE_TIME>(mAudioFormat.sampleInterval * mJitterFramesDelivered);
+	mJitterFramesDelivered += samples;
+	*endTime = mJitterStartTime - mStreamStartTime + static_cast<REFERENCE_TIME>(mAudioFormat.sampleInterval * mJitterFramesDelivered);
+
+	if (now - mJitterStatsTime >= oneSecondIn100ns)
+	{
+		mJitterStatsTime = now;
+		const auto& stats = mJitterBuffer.GetStats();
+		mFilter->OnPcmJitterStats(&stats);
+
+		#ifndef NO_QUILL
+		LOG_TRACE_L1(mLogger, "[{}] Jitter buffer depth {:.2f} ms ratio {:.1f} ppm underruns {} overruns {} dropped {} gaps {} silent {}",
+			mLogPrefix, stats.depthMs, stats.ratioPpm, stats.underruns, stats.overruns, stats.framesDropped, stats.gapFrames,
+			stats.silentFrames);
+		#endif
+	}
+	return samples;
+}
+
 HRESULT MagewellAudioCapturePin::GetMediaType(CMediaType* pmt)
 {
 	AudioFormatToMediaType(pmt, &mAudioFormat);
@@ -4110,42 +4858,16 @@ HRESULT MagewellAudioCapturePin::OnThreadCreate()
 	LOG_INFO(mLogger, "[{}] MagewellAudioCapturePin::OnThreadCreate", mLogPrefix);
 	#endif
 
-	memset(mCompressedBuffer, 0, sizeof(mCompressedBuffer));
+	mBitstream.Reset();
+	// the jitter buffer restarts with the stream
+	mJitterStartTime = 0;
 
-	auto hChannel = mFilter->GetChannelHandle();
-	LoadSignal(&hChannel);
+	LoadSignal();
 	mFilter->OnAudioSignalLoaded(&mAudioSignal);
 
-	auto deviceType = mFilter->GetDeviceType();
-	if (deviceType == PRO)
-	{
-		// start capture
-		mLastMwResult = MWStartAudioCapture(hChannel);
-		if (mLastMwResult != MW_SUCCEEDED)
-		{
-			#ifndef NO_QUILL
-			LOG_ERROR(mLogger, "[{}] MagewellAudioCapturePin::OnThreadCreate Unable to MWStartAudioCapture", mLogPrefix);
-			#endif
-			// TODO throw
-		}
-
-		// register for signal change events & audio buffered
-		mNotify = MWRegisterNotify(hChannel, mNotifyEvent,
-			MWCAP_NOTIFY_AUDIO_INPUT_SOURCE_CHANGE | MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE |
-			MWCAP_NOTIFY_AUDIO_FRAME_BUFFERED);
-		if (!mNotify)
-		{
-			#ifndef NO_QUILL
-			LOG_ERROR(mLogger, "[{}] MagewellAudioCapturePin::OnThreadCreate Unable to MWRegistryNotify", mLogPrefix);
-			#endif
-			// TODO throw
-		}
-	}
-	else if (deviceType == USB)
-	{
-		delete mAudioCapture;
-		mAudioCapture = new AudioCapture(this, mFilter->GetChannelHandle());
-	}
+	auto engine = mFilter->GetAudioEngine();
+	engine->SetFormat(mAudioFormat);
+	SubscribeToFrames(engine, 1);
 	return NOERROR;
 }
 
@@ -4191,54 +4913,49 @@ HRESULT MagewellAudioCapturePin::DoChangeMediaType(const CMediaType* pmt, const
 	LOG_WARNING(mLogger, "[{}] Proposing new audio format Fs: {} Bits: {} Channels: {} Codec: {}", mLogPrefix,
 		newAudioFormat->fs, newAudioFormat->bitDepth, newAudioFormat->outputChannelCount, codecNames[newAudioFormat->codec]);
 	#endif
-	long newSize = MWCAP_AUDIO_SAMPLES_PER_FRAME * newAudioFormat->bitDepthInBytes * newAudioFormat->outputChannelCount;
-	if (newAudioFormat->codec != PCM)
-	{
-		newSize = newAudioFormat->dataBurstSize;
-	}
-	long oldSize = MWCAP_AUDIO_SAMPLES_PER_FRAME * mAudioFormat.bitDepthInBytes * mAudioFormat.outputChannelCount;
-	if (mAudioFormat.codec != PCM)
-	{
-		oldSize = mAudioFormat.dataBurstSize;
-	}
+	auto newSize = GetSampleSize(newAudioFormat);
+	auto oldSize = GetSampleSize(&mAudioFormat);
 	auto shouldRenegotiateOnQueryAccept = newSize != oldSize || mAudioFormat.codec != newAudioFormat->codec;
 	auto retVal = RenegotiateMediaType(pmt, newSize, shouldRenegotiateOnQueryAccept);
 	if (retVal == S_OK)
 	{
 		mAudioFormat = *newAudioFormat;
-		if (mFilter->GetDeviceType() == USB)
-		{
-			delete mAudioCapture;
-			mAudioCapture = new AudioCapture(this, mFilter->GetChannelHandle());
-		}
+		#ifndef NO_QUILL
+		LOG_INFO(mLogger, "[{}] Audio media type renegotiated {} times", mLogPrefix, ++mRenegotiations);
+		#endif
+		mFilter->GetAudioEngine()->SetFormat(mAudioFormat);
 	}
 	return retVal;
 }
 
 void MagewellAudioCapturePin::StopCapture()
 {
-	auto deviceType = mFilter->GetDeviceType();
-	if (deviceType == PRO)
+	UnsubscribeFromFrames();
+}
+
+long MagewellAudioCapturePin::GetSampleSize(const AUDIO_FORMAT* audioFormat) const
+{
+	if (audioFormat->codec == PCM)
 	{
-		MWStopAudioCapture(mFilter->GetChannelHandle());
+		// the jitter buffer delivers what is due on the graph clock so a sample may be a little longer than the audio captured
+		auto frames = audioFormat->framesPerSample + (mFilter->IsPcmJitterBufferEnabled() ? 1 : 0);
+		return MWCAP_AUDIO_SAMPLES_PER_FRAME * frames * audioFormat->bitDepthInBytes * audioFormat->outputChannelCount;
 	}
-	else if (deviceType == USB)
+	if (mFilter->IsIec61937Passthrough())
 	{
-		delete mAudioCapture;
-		mAudioCapture = nullptr;
+		// aggregated exactly as for PCM so the size and latency of each sample is fixed whatever the codec
+		return static_cast<long>(audioFormat->framesPerSample * IEC61937Passthrough::GetFrameSizeInBytes(audioFormat->inputChannelCount));
 	}
+	// sized for the largest burst the stream (or failing that the codec) can carry so the burst size varying within a
+	// stream doesn't need a new allocator
+	auto header = &audioFormat->bitstreamHeader;
+	auto maxBurstSize = header->codec == audioFormat->codec && header->maxBurstSize > 0 ? header->maxBurstSize : GetIEC61937RepetitionPeriodInBytes(audioFormat->codec);
+	return static_cast<long>(maxBurstSize);
 }
 
 bool MagewellAudioCapturePin::ProposeBuffers(ALLOCATOR_PROPERTIES* pProperties)
 {
-	if (mAudioFormat.codec == PCM)
-	{
-		pProperties->cbBuffer = MWCAP_AUDIO_SAMPLES_PER_FRAME * mAudioFormat.bitDepthInBytes * mAudioFormat.outputChannelCount;
-	}
-	else
-	{
-		pProperties->cbBuffer = mDataBurstBuffer.size();
-	}
+	pProperties->cbBuffer = GetSampleSize(&mAudioFormat);
 	if (pProperties->cBuffers < 1)
 	{
 		pProperties->cBuffers = 16;
@@ -4251,8 +4968,6 @@ bool MagewellAudioCapturePin::ProposeBuffers(ALLOCATOR_PROPERTIES* pProperties)
 HRESULT MagewellAudioCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFERENCE_TIME* pStartTime,
 	REFERENCE_TIME* pEndTime, DWORD dwFlags)
 {
-	auto hChannel = mFilter->GetChannelHandle();
-	auto proDevice = mFilter->GetDeviceType() == PRO;
 	auto hasFrame = false;
 	auto retVal = S_FALSE;
 	// keep going til we have a frame to process
@@ -4280,7 +4995,7 @@ HRESULT MagewellAudioCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 			continue;
 		}
 
-		auto sigLoaded = LoadSignal(&hChannel);
+		auto sigLoaded = LoadSignal();
 
 		if (S_OK != sigLoaded)
 		{
@@ -4335,110 +5050,45 @@ HRESULT MagewellAudioCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 			if (mSinceCodecChange > 0)
 				mFilter->OnAudioSignalLoaded(&mAudioSignal);
 
-			mSinceLast = 0;
 			mSinceCodecChange = 0;
 
 			BACKOFF;
 			continue;
 		}
 
-		// grab next frame 
-		DWORD dwRet = WaitForSingleObject(mNotifyEvent, 1000);
+		// grab next frame, frames which are already queued are read without waiting for another notification
+		auto frameBuffer = mFrameBuffer + static_cast<size_t>(mPcmFramesBuffered) * maxFrameLengthInBytes;
+		DWORD dwRet = IsFrameQueued() ? WAIT_OBJECT_0 : WaitForSingleObject(mNotifyEvent, 1000);
 
 		// unknown, try again
 		if (dwRet == WAIT_FAILED)
 		{
 			#ifndef NO_QUILL
-			LOG_TRACE_L1(mLogger, "[{}] Wait for frame failed, retrying", mLogPrefix);
-			#endif
-			continue;
-		}
-
-		if (dwRet == WAIT_OBJECT_0)
-		{
-			// TODO magewell SDK bug means audio is always reported as PCM, until fixed allow 6 frames of audio to pass through before declaring it definitely PCM
-			// 12 frames is 7680 bytes of 2 channel audio & 30720 of 8 channel which should be more than enough to be sure
-			mBitstreamDetectionWindowLength = std::lround(bitstreamDetectionWindowSecs / (static_cast<double>(MWCAP_AUDIO_SAMPLES_PER_FRAME) / newAudioFormat.fs));
-			if (mDetectedCodec != PCM)
-			{
-				newAudioFormat.codec = mDetectedCodec;
-			}
-
-			if (proDevice)
-			{
-				mStatusBits = 0;
-				mLastMwResult = MWGetNotifyStatus(hChannel, mNotify, &mStatusBits);
-				if (mStatusBits & MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE)
-				{
-					#ifndef NO_QUILL
-					LOG_TRACE_L1(mLogger, "[{}] Audio signal change, retry after backoff", mLogPrefix);
-					#endif
-
-					if (mSinceCodecChange > 0)
-						mFilter->OnAudioSignalLoaded(&mAudioSignal);
-
-					mSinceLast = 0;
-					mSinceCodecChange = 0;
-
-					BACKOFF;
-					continue;
-				}
-
-				if (mStatusBits & MWCAP_NOTIFY_AUDIO_INPUT_SOURCE_CHANGE)
-				{
-					#ifndef NO_QUILL
-					LOG_TRACE_L1(mLogger, "[{}] Audio input source change, retry after backoff", mLogPrefix);
-					#endif
-
-					if (mSinceCodecChange > 0)
-						mFilter->OnAudioSignalLoaded(&mAudioSignal);
-
-					mSinceLast = 0;
-					mSinceCodecChange = 0;
-					BACKOFF;
-					continue;
-				}
-
-				if (mStatusBits & MWCAP_NOTIFY_AUDIO_FRAME_BUFFERED)
-				{
-					mLastMwResult = MWCaptureAudioFrame(hChannel, &mAudioSignal.frameInfo);
-					if (MW_SUCCEEDED == mLastMwResult)
-					{
-						#ifndef NO_QUILL
-						LOG_TRACE_L3(mLogger, "[{}] Audio frame buffered and captured", mLogPrefix);
-						#endif
+			LOG_TRACE_L1(mLogger, "[{}] Wait for frame failed, retrying", mLogPrefix);
+			#endif
+			continue;
+		}
 
-						memcpy(mFrameBuffer, mAudioSignal.frameInfo.adwSamples, maxFrameLengthInBytes);
-						frameCopied = true;
-					}
-					else
-					{
-						// NB: evidence suggests this is harmless but logging for clarity
-						if (mDataBurstSize > 0)
-						{
-							#ifndef NO_QUILL
-							LOG_WARNING(mLogger, "[{}] Audio frame buffered but capture failed ({}), possible packet corruption after {} bytes", mLogPrefix,
-								static_cast<int>(mLastMwResult), mDataBurstRead);
-							#endif
-						}
-						else
-						{
-							#ifndef NO_QUILL
-							LOG_WARNING(mLogger, "[{}] Audio frame buffered but capture failed ({}), retrying", mLogPrefix, static_cast<int>(mLastMwResult));
-							#endif
-						}
-						continue;
-					}
-				}
+		if (dwRet == WAIT_OBJECT_0)
+		{
+			if (mDetectedCodec != PCM)
+			{
+				newAudioFormat.codec = mDetectedCodec;
 			}
-			else
+
+			// the notification may be for a frame which has already been taken
+			auto slot = TakeFrame(&mPcmFramesLost);
+			if (slot != FrameFanout::noSlot)
 			{
 				#ifndef NO_QUILL
 				LOG_TRACE_L3(mLogger, "[{}] Audio frame buffered and captured", mLogPrefix);
 				#endif
 
-				CAutoLock lck(&mCaptureCritSec);
-				memcpy(mFrameBuffer, mCapturedFrame.data, mCapturedFrame.length);
+				const auto& frames = mEngine->GetFrames();
+				const auto& frame = frames->Get(slot);
+				memcpy(frameBuffer, frame.data, frame.length);
+				mFrameDeviceTime = static_cast<LONGLONG>(frame.ts);
+				frames->Release(slot);
 				frameCopied = true;
 			}
 		}
@@ -4454,93 +5104,141 @@ HRESULT MagewellAudioCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 			#ifndef NO_QUILL
 			LOG_TRACE_L3(mLogger, "[{}] raw,{},{}", mLogPrefix, mFrameCounter, maxFrameLengthInBytes);
 			#endif
-			fwrite(mFrameBuffer, maxFrameLengthInBytes, 1, mRawFile);
+			fwrite(frameBuffer, maxFrameLengthInBytes, 1, mRawFile);
 			#endif
 
+			// TODO magewell SDK bug means audio is always reported as PCM so every frame is scanned for an IEC 61937 preamble,
+			// the channel status and infoframe are used as a hint to hold back or release PCM ahead of the preambles
+			if (newAudioFormat.classification != mAudioClassification)
+			{
+				#ifndef NO_QUILL
+				LOG_TRACE_L1(mLogger, "[{}] Audio classified as {} ({}) in frame {}, was {}", mLogPrefix, static_cast<int>(newAudioFormat.classification),
+					codecNames[newAudioFormat.codec], mFrameCounter, static_cast<int>(mAudioClassification));
+				#endif
+				mBitstream.ResetBytesSincePaPb();
+				mPassthrough.ResetBytesSincePaPb();
+			}
+			const auto releasedToPcm = mAudioClassification == CLASSIFIED_BITSTREAM && newAudioFormat.classification != CLASSIFIED_BITSTREAM;
+			mAudioClassification = newAudioFormat.classification;
 			Codec* detectedCodec = &newAudioFormat.codec;
-			const auto mightBeBitstream = newAudioFormat.fs >= 48000 && mSinceLast < mBitstreamDetectionWindowLength;
-			const auto examineBitstream = newAudioFormat.codec != PCM || mightBeBitstream || mDataBurstSize > 0;
-			if (examineBitstream)
+			#ifdef RECORD_ENCODED
+			auto bytesCopied = mBitstream.CopyFrame(frameBuffer, mAudioFormat.inputChannelCount, mAudioFormat.bitDepthInBytes);
+			LOG_TRACE_L3(mLogger, "[{}] encoder_in,{},{}", mLogPrefix, mFrameCounter, bytesCopied);
+			fwrite(mBitstream.GetBuffer(), bytesCopied, 1, mEncodedInFile);
+			#endif
+
+			if (mFilter->IsIec61937Passthrough())
 			{
+				// the frame is only peeked at to track the codec, the stream itself is delivered as captured
+				Codec burstCodec = PCM;
+				auto foundPreamble = mPassthrough.ScanFrame(frameBuffer, mAudioFormat.inputChannelCount, &burstCodec);
+				if (foundPreamble && burstCodec != PAUSE_OR_NULL)
+				{
+					if (mDetectedCodec == burstCodec)
+					{
+						mSinceCodecChange++;
+					}
+					else
+					{
+						#ifndef NO_QUILL
+						LOG_TRACE_L1(mLogger, "[{}] Passing through {} from frame {}, was {}", mLogPrefix, codecNames[burstCodec], mFrameCounter,
+							codecNames[mDetectedCodec]);
+						#endif
+						mSinceCodecChange = 0;
+						mDetectedCodec = burstCodec;
+					}
+				}
+				else if (mDetectedCodec != PCM)
+				{
+					if (releasedToPcm || mPassthrough.HasLostSync(mDetectedCodec))
+					{
+						#ifndef NO_QUILL
+						LOG_TRACE_L1(mLogger, "[{}] No IEC61937 preamble for {} bytes in frame {}, reverting from {} to PCM (flagged? {})", mLogPrefix,
+							mPassthrough.GetBytesSincePaPb(), mFrameCounter, codecNames[mDetectedCodec], releasedToPcm);
+						#endif
+						mDetectedCodec = PCM;
+						mPassthrough.ResetBytesSincePaPb();
+					}
+				}
+				else if (foundPreamble || (newAudioFormat.classification == CLASSIFIED_BITSTREAM && !mPassthrough.HasLostSync(newAudioFormat.codec)))
+				{
+					// pause bursts or flagged as bitstream with no codec yet, hold back the frame rather than deliver it as PCM
+					continue;
+				}
+			}
+			else
+			{
+				auto res = mBitstream.ParseFrame(frameBuffer, mAudioFormat.inputChannelCount, mAudioFormat.bitDepthInBytes, detectedCodec);
 				#ifndef NO_QUILL
-				if (!mProbeOnTimer && newAudioFormat.codec == PCM)
+				if (mBitstream.GetUnknownDataTypeCount() != mUnknownDataTypes)
 				{
-					LOG_TRACE_L2(mLogger, "[{}] Bitstream probe in frame {} - {} {} Hz (since: {} len: {} burst: {})", mLogPrefix, mFrameCounter,
-						codecNames[newAudioFormat.codec], newAudioFormat.fs, mSinceLast, mBitstreamDetectionWindowLength, mDataBurstSize);
+					LOG_WARNING(mLogger, "[{}] Unknown IEC61937 datatype {} will be treated as PAUSE", mLogPrefix, mBitstream.GetLastUnknownDataType());
 				}
 				#endif
-
-				CopyToBitstreamBuffer(mFrameBuffer);
-
-				uint16_t bufferSize = mAudioFormat.bitDepthInBytes * MWCAP_AUDIO_SAMPLES_PER_FRAME * mAudioFormat.inputChannelCount;
-				auto res = ParseBitstreamBuffer(bufferSize, &detectedCodec);
-				if (S_OK == res || S_PARTIAL_DATABURST == res)
+				mUnknownDataTypes = mBitstream.GetUnknownDataTypeCount();
+				if (PARSE_OK == res || PARSE_PARTIAL_DATABURST == res)
 				{
 					#ifndef NO_QUILL
-					LOG_TRACE_L2(mLogger, "[{}] Detected bitstream in frame {} {} (res: {:#08x})", mLogPrefix, mFrameCounter, codecNames[mDetectedCodec], res);
+					LOG_TRACE_L2(mLogger, "[{}] Detected bitstream in frame {} {} (res: {})", mLogPrefix, mFrameCounter, codecNames[mDetectedCodec], static_cast<int>(res));
 					#endif
-					mProbeOnTimer = false;
 					if (mDetectedCodec == *detectedCodec)
 					{
-						if (mDataBurstPayloadSize > 0) mSinceCodecChange++;
+						if (mBitstream.GetDataBurstPayloadSize() > 0) mSinceCodecChange++;
 					}
 					else
 					{
 						mSinceCodecChange = 0;
 						mDetectedCodec = *detectedCodec;
 					}
-					mSinceLast = 0;
-					if (mDataBurstPayloadSize > 0)
+					if (mBitstream.GetDataBurstPayloadSize() > 0)
 					{
 						#ifndef NO_QUILL
-						LOG_TRACE_L3(mLogger, "[{}] Bitstream databurst complete, collected {} bytes from {} frames", mLogPrefix, mDataBurstPayloadSize, ++mDataBurstFrameCount);
+						LOG_TRACE_L3(mLogger, "[{}] Bitstream databurst complete, collected {} bytes from {} frames", mLogPrefix, mBitstream.GetDataBurstPayloadSize(), ++mDataBurstFrameCount);
+						#endif
+						#ifdef RECORD_ENCODED
+						LOG_TRACE_L3(mLogger, "[{}] encoder_out,{},{}", mLogPrefix, mFrameCounter, mBitstream.GetDataBurstPayloadSize());
+						fwrite(mBitstream.GetDataBurst(), mBitstream.GetDataBurstPayloadSize(), 1, mEncodedOutFile);
 						#endif
-						newAudioFormat.dataBurstSize = mDataBurstPayloadSize;
+						newAudioFormat.dataBurstSize = mBitstream.GetDataBurstPayloadSize();
 						mDataBurstFrameCount = 0;
+
+						// a burst without a usable header (e.g. a MAT frame with no major sync) is described by the last one
+						if (!ParseBitstreamHeader(*detectedCodec, mBitstream.GetDataBurst(), newAudioFormat.dataBurstSize, &mBurstHeader) && mBurstHeader.codec != *detectedCodec)
+						{
+							#ifndef NO_QUILL
+							LOG_TRACE_L1(mLogger, "[{}] Unable to parse {} byte {} databurst header in frame {}", mLogPrefix, newAudioFormat.dataBurstSize,
+								codecNames[*detectedCodec], mFrameCounter);
+							#endif
+							mBurstHeader = {};
+						}
+						newAudioFormat.bitstreamHeader = mBurstHeader;
 					}
 					else
 					{
-						if (S_PARTIAL_DATABURST == res) mDataBurstFrameCount++;
+						if (PARSE_PARTIAL_DATABURST == res) mDataBurstFrameCount++;
 						continue;
 					}
 				}
-				else
+				else if (mDetectedCodec != PCM)
 				{
-					if (++mSinceLast < mBitstreamDetectionWindowLength)
+					// no preamble in this frame so it is padding between data bursts unless the stream has reverted to PCM,
+					// either flagged by the source clearing the non audio bit or seen as no preamble for too long
+					if (!releasedToPcm && !mBitstream.HasLostSync(mDetectedCodec))
 					{
-						// skip to the next frame if we're in the initial probe otherwise allow publication downstream to continue
-						if (!mProbeOnTimer)
-						{
-							continue;
-						}
-					}
-					else
-					{
-						#ifndef NO_QUILL
-						if (mSinceLast == mBitstreamDetectionWindowLength)
-						{
-							LOG_TRACE_L1(mLogger, "[{}] Probe complete after {} frames, not bitstream (timer? {})", mLogPrefix, mSinceLast, mProbeOnTimer);
-						}
-						#endif
-						mProbeOnTimer = false;
-						mDetectedCodec = PCM;
-						mBytesSincePaPb = 0;
+						continue;
 					}
+					#ifndef NO_QUILL
+					LOG_TRACE_L1(mLogger, "[{}] No IEC61937 preamble for {} bytes in frame {}, reverting from {} to PCM (flagged? {})", mLogPrefix,
+						mBitstream.GetBytesSincePaPb(), mFrameCounter, codecNames[mDetectedCodec], releasedToPcm);
+					#endif
+					mDetectedCodec = PCM;
+					mBitstream.ResetBytesSincePaPb();
+				}
+				else if (newAudioFormat.classification == CLASSIFIED_BITSTREAM && !mBitstream.HasLostSync(newAudioFormat.codec))
+				{
+					// flagged as bitstream but no preamble yet, hold back the frame rather than deliver it as PCM
+					continue;
 				}
-			}
-			else
-			{
-				mSinceLast++;
-			}
-			int probeTrigger = std::lround(mBitstreamDetectionWindowLength * bitstreamDetectionRetryAfter);
-			if (mSinceLast >= probeTrigger)
-			{
-				#ifndef NO_QUILL
-				LOG_TRACE_L1(mLogger, "[{}] Triggering bitstream probe after {} frames", mLogPrefix, mSinceLast);
-				#endif
-				mProbeOnTimer = true;
-				mSinceLast = 0;
-				mBytesSincePaPb = 0;
 			}
 
 			// don't try to publish PAUSE_OR_NULL downstream
@@ -4575,9 +5273,25 @@ HRESULT MagewellAudioCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 
 				mFilter->OnAudioSignalLoaded(&mAudioSignal);
 				mFilter->OnAudioFormatLoaded(&mAudioFormat);
+
+				// frames aggregated in the old format can't be delivered in the new one
+				if (mPcmFramesBuffered > 0)
+				{
+					#ifndef NO_QUILL
+					LOG_WARNING(mLogger, "[{}] Discarding {} aggregated frames after format change", mLogPrefix, mPcmFramesBuffered);
+					#endif
+
+					memmove(mFrameBuffer, frameBuffer, maxFrameLengthInBytes);
+					mPcmFramesBuffered = 0;
+				}
+			}
+
+			if ((newAudioFormat.codec == PCM || mFilter->IsIec61937Passthrough()) && ++mPcmFramesBuffered < mAudioFormat.framesPerSample)
+			{
+				continue;
 			}
 
-			if (newAudioFormat.codec == PCM || mDataBurstPayloadSize > 0)
+			if (newAudioFormat.codec == PCM || mFilter->IsIec61937Passthrough() || mBitstream.GetDataBurstPayloadSize() > 0)
 			{
 				retVal = MagewellCapturePin::GetDeliveryBuffer(ppSample, pStartTime, pEndTime, dwFlags);
 				if (SUCCEEDED(retVal))
@@ -4587,6 +5301,7 @@ HRESULT MagewellAudioCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 				else
 				{
 					mSinceCodecChange = 0;
+					mPcmFramesBuffered = 0;
 					#ifndef NO_QUILL
 					LOG_WARNING(mLogger, "[{}] Audio frame buffered but unable to get delivery buffer, retry after backoff", mLogPrefix);
 					#endif
@@ -4599,237 +5314,229 @@ HRESULT MagewellAudioCapturePin::GetDeliveryBuffer(IMediaSample** ppSample, REFE
 	return retVal;
 }
 
-// copies the inbound byte stream into a format that can be probed
-void MagewellAudioCapturePin::CopyToBitstreamBuffer(BYTE* buf)
+//////////////////////////////////////////////////////////////////////////
+// MemAllocator 
+//////////////////////////////////////////////////////////////////////////
+MemAllocator::MemAllocator(LPUNKNOWN pUnk, HRESULT* pHr) : CMemAllocator("MemAllocator", pUnk, pHr)
+{
+	// exists purely to allow for easy debugging of what is going on inside CMemAllocator
+}
+
+//////////////////////////////////////////////////////////////////////////
+// MediaSideDataSample
+//////////////////////////////////////////////////////////////////////////
+MediaSideDataSample::MediaSideDataSample(LPCTSTR pName, CBaseAllocator* pAllocator, HRESULT* phr, LPBYTE pBuffer,
+	LONG length) :
+	CMediaSample(pName, pAllocator, phr, pBuffer, length)
+{
+}
+
+STDMETHODIMP MediaSideDataSample::QueryInterface(REFIID riid, void** ppv)
 {
-	// copies from input to output skipping zero bytes and with a byte swap per sample
-	auto bytesCopied = 0;
-	for (auto pairIdx = 0; pairIdx < mAudioFormat.inputChannelCount / 2; ++pairIdx)
+	CheckPointer(ppv, E_POINTER);
+	if (riid == __uuidof(IMediaSideData))
 	{
-		for (auto sampleIdx = 0; sampleIdx < MWCAP_AUDIO_SAMPLES_PER_FRAME; sampleIdx++)
-		{
-			int inStartL = (sampleIdx * MWCAP_AUDIO_MAX_NUM_CHANNELS + pairIdx) * maxBitDepthInBytes;
-			int inStartR = (sampleIdx * MWCAP_AUDIO_MAX_NUM_CHANNELS + pairIdx + MWCAP_AUDIO_MAX_NUM_CHANNELS / 2) * maxBitDepthInBytes;
-			int outStart = (sampleIdx * mAudioFormat.inputChannelCount + pairIdx * mAudioFormat.inputChannelCount) * mAudioFormat.bitDepthInBytes;
-			for (int byteIdx = 0; byteIdx < mAudioFormat.bitDepthInBytes; ++byteIdx) {
-				auto outL = outStart + byteIdx;
-				auto outR = outStart + mAudioFormat.bitDepthInBytes + byteIdx;
-				auto inL = inStartL + maxBitDepthInBytes - byteIdx - 1;
-				auto inR = inStartR + maxBitDepthInBytes - byteIdx - 1;
-				// byte swap because compressed audio is big endian 
-				mCompressedBuffer[outL] = buf[inL];
-				mCompressedBuffer[outR] = buf[inR];
-				bytesCopied += 2;
-			}
-		}
+		return GetInterface(static_cast<IMediaSideData*>(this), ppv);
 	}
-	#ifdef RECORD_ENCODED
-	LOG_TRACE_L3(mLogger, "[{}] encoder_in,{},{}", mLogPrefix, mFrameCounter, bytesCopied);
-	fwrite(mCompressedBuffer, bytesCopied, 1, mEncodedInFile);
-	#endif
+	return CMediaSample::QueryInterface(riid, ppv);
 }
 
-// probes a non PCM buffer for the codec based on format of the IEC 61937 dataframes and/or copies the content to the data burst burffer
-HRESULT MagewellAudioCapturePin::ParseBitstreamBuffer(uint16_t bufSize, enum Codec** codec)
+STDMETHODIMP_(ULONG) MediaSideDataSample::AddRef()
 {
-	uint16_t bytesRead = 0;
-	bool copiedBytes = false;
-	bool partialDataBurst = false;
-	bool maybeBitstream = false;
+	return CMediaSample::AddRef();
+}
 
-	#ifndef NO_QUILL
-	bool foundPause = **codec == PAUSE_OR_NULL;
-	#endif
+STDMETHODIMP_(ULONG) MediaSideDataSample::Release()
+{
+	return CMediaSample::Release();
+}
 
-	while (bytesRead < bufSize)
+STDMETHODIMP MediaSideDataSample::SetSideData(GUID guidType, const BYTE* pData, size_t size)
+{
+	if (pData == nullptr && size > 0)
+	{
+		return E_POINTER;
+	}
+	for (auto& sideData : mSideData)
 	{
-		uint16_t remainingInBurst = std::max(mDataBurstSize - mDataBurstRead, 0);
-		if (remainingInBurst > 0)
+		if (sideData.first == guidType)
 		{
-			uint16_t remainingInBuffer = bufSize - bytesRead;
-			auto toCopy = std::min(remainingInBurst, remainingInBuffer);
-			#ifndef NO_QUILL
-			LOG_TRACE_L3(mLogger, "[{}] Copying {} bytes of databurst from {}-{} to {}-{}", mLogPrefix, toCopy,
-				bytesRead, bytesRead + toCopy - 1, mDataBurstRead, mDataBurstRead + toCopy - 1);
-			#endif
-			for (auto i = 0; i < toCopy; i++)
-			{
-				mDataBurstBuffer[mDataBurstRead + i] = mCompressedBuffer[bytesRead + i];
-			}
-			bytesRead += toCopy;
-			mDataBurstRead += toCopy;
-			remainingInBurst -= toCopy;
-			mBytesSincePaPb += toCopy;
-			copiedBytes = true;
-
-			if (remainingInBurst == 0)
-			{
-				mDataBurstPayloadSize = mDataBurstSize;
-				#ifdef RECORD_ENCODED
-				LOG_TRACE_L3(mLogger, "[{}] encoder_out,{},{}", mLogPrefix, mFrameCounter, mDataBurstSize);
-				fwrite(mDataBurstBuffer.data(), mDataBurstSize, 1, mEncodedOutFile);
-				#endif
-			}
+			sideData.second.assign(pData, pData + size);
+			return S_OK;
 		}
-		// more to read = will need another frame
-		if (remainingInBurst > 0)
+	}
+	mSideData.emplace_back(guidType, std::vector<BYTE>(pData, pData + size));
+	return S_OK;
+}
+
+STDMETHODIMP MediaSideDataSample::GetSideData(GUID guidType, const BYTE** pData, size_t* pSize)
+{
+	CheckPointer(pData, E_POINTER);
+	CheckPointer(pSize, E_POINTER);
+	for (const auto& sideData : mSideData)
+	{
+		if (sideData.first == guidType)
 		{
-			partialDataBurst = true;
-			continue;
+			*pData = sideData.second.data();
+			*pSize = sideData.second.size();
+			return S_OK;
 		}
+	}
+	return E_FAIL;
+}
 
-		// no more to read so reset the databurst state ready for the next frame
-		mDataBurstSize = mDataBurstRead = 0;
+void MediaSideDataSample::ClearSideData()
+{
+	mSideData.clear();
+}
 
-		// burst complete so search the frame for the PaPb preamble F8 72 4E 1F (248 114 78 31)
-		for (; (bytesRead < bufSize) && mPaPbBytesRead != 4; ++bytesRead, ++mBytesSincePaPb)
-		{
-			if (mCompressedBuffer[bytesRead] == 0xf8 && mPaPbBytesRead == 0
-				|| mCompressedBuffer[bytesRead] == 0x72 && mPaPbBytesRead == 1
-				|| mCompressedBuffer[bytesRead] == 0x4e && mPaPbBytesRead == 2
-				|| mCompressedBuffer[bytesRead] == 0x1f && mPaPbBytesRead == 3)
-			{
-				if (++mPaPbBytesRead == 4)
-				{
-					mDataBurstSize = mDataBurstRead = 0;
-					bytesRead++;
-					#ifndef NO_QUILL
-					if (!foundPause)
-						LOG_TRACE_L2(mLogger, "[{}] Found PaPb at position {}-{} ({} since last)", mLogPrefix, bytesRead - 4, bytesRead, mBytesSincePaPb);
-					#endif
-					mBytesSincePaPb = 4;
-					maybeBitstream = false;
-					break;
-				}
-			}
-			else
-			{
-				mPaPbBytesRead = 0;
-			}
-		}
+//////////////////////////////////////////////////////////////////////////
+// CaptureSlotSample
+//////////////////////////////////////////////////////////////////////////
+CaptureSlotSample::CaptureSlotSample(LPCTSTR pName, CBaseAllocator* pAllocator, HRESULT* phr) :
+	MediaSideDataSample(pName, pAllocator, phr)
+{
+}
 
-		if (mPaPbBytesRead == 1 || mPaPbBytesRead == 2 || mPaPbBytesRead == 3)
-		{
-			#ifndef NO_QUILL
-			if (!foundPause)
-			{
-				LOG_TRACE_L3(mLogger, "[{}] PaPb {} bytes found", mLogPrefix, mPaPbBytesRead);
-			}
-			#endif
-			maybeBitstream = true;
-			continue;
-		}
+void CaptureSlotSample::Bind(int slot, BYTE* pData, long size)
+{
+	mSlot = slot;
+	SetPointer(pData, size);
+}
 
-		// grab PcPd preamble words
-		uint8_t bytesToCopy = std::min(bufSize - bytesRead, 4 - mPcPdBytesRead);
-		if (bytesToCopy > 0)
-		{
-			memcpy(mPcPdBuffer, mCompressedBuffer + bytesRead, bytesToCopy);
-			mPcPdBytesRead += bytesToCopy;
-			bytesRead += bytesToCopy;
-			mBytesSincePaPb += bytesToCopy;
-			copiedBytes = true;
-		}
+int CaptureSlotSample::Unbind()
+{
+	auto slot = mSlot;
+	mSlot = FrameFanout::noSlot;
+	SetPointer(nullptr, 0);
+	ClearSideData();
+	return slot;
+}
 
-		if (mPcPdBytesRead != 4)
-		{
+//////////////////////////////////////////////////////////////////////////
+// CaptureSlotAllocator
+//////////////////////////////////////////////////////////////////////////
+CaptureSlotAllocator::CaptureSlotAllocator(LPUNKNOWN pUnk, HRESULT* pHr, std::shared_ptr<FrameFanout> frames) :
+	CBaseAllocator(NAME("CaptureSlotAllocator"), pUnk, pHr),
+	mFrames(std::move(frames))
+{
+}
 
-			#ifndef NO_QUILL
-			if (!foundPause && mPcPdBytesRead != 0)
-				LOG_TRACE_L3(mLogger, "[{}] Found PcPd at position {} but only {} bytes available", mLogPrefix, bytesRead - bytesToCopy, bytesToCopy);
-			#endif
-			continue;
-		}
+CaptureSlotAllocator::~CaptureSlotAllocator()
+{
+	Decommit();
+	ReallyFree();
+}
 
-		mDataBurstSize = ((static_cast<uint16_t>(mPcPdBuffer[2]) << 8) + static_cast<uint16_t>(mPcPdBuffer[3]));
-		auto dt = static_cast<uint8_t>(mPcPdBuffer[1] & 0x7f);
-		GetCodecFromIEC61937Preamble(IEC61937DataType{ dt }, &mDataBurstSize, *codec);
+// as per CMemAllocator except the alignment is limited to that of the slots
+STDMETHODIMP CaptureSlotAllocator::SetProperties(ALLOCATOR_PROPERTIES* pRequest, ALLOCATOR_PROPERTIES* pActual)
+{
+	CheckPointer(pRequest, E_POINTER);
+	CheckPointer(pActual, E_POINTER);
+	CAutoLock lck(this);
 
-		// ignore PAUSE_OR_NULL, start search again
-		if (**codec == PAUSE_OR_NULL)
-		{
-			#ifndef NO_QUILL
-			if (!foundPause)
-			{
-				foundPause = true;
-				LOG_TRACE_L2(mLogger, "[{}] Found PAUSE_OR_NULL ({}) with burst size {}, start skipping", mLogPrefix, dt, mDataBurstSize);
-			}
-			#endif
-			mPaPbBytesRead = mPcPdBytesRead = 0;
-			mDataBurstSize = mDataBurstPayloadSize = mDataBurstRead = 0;
-			continue;
-		}
+	ZeroMemory(pActual, sizeof(ALLOCATOR_PROPERTIES));
 
-		#ifndef NO_QUILL
-		if (foundPause)
-		{
-			LOG_TRACE_L2(mLogger, "[{}] Exiting PAUSE_OR_NULL skip mode", mLogPrefix);
-			foundPause = false;
-		}
-		#endif
+	if (pRequest->cbAlign <= 0 || (pRequest->cbAlign & (pRequest->cbAlign - 1)) != 0
+		|| static_cast<size_t>(pRequest->cbAlign) > captureSlotAlignment)
+	{
+		return VFW_E_BADALIGN;
+	}
+	// the slot is the whole buffer so there is nowhere to put a prefix
+	if (pRequest->cbPrefix != 0)
+	{
+		return E_INVALIDARG;
+	}
+	if (m_bCommitted)
+	{
+		return VFW_E_ALREADY_COMMITTED;
+	}
+	if (m_lFree.GetCount() < m_lAllocated)
+	{
+		return VFW_E_BUFFERS_OUTSTANDING;
+	}
 
-		if (mDataBurstBuffer.size() > mDataBurstSize)
-		{
-			mDataBurstBuffer.clear();
-		}
-		if (mDataBurstBuffer.size() < mDataBurstSize)
+	pActual->cbBuffer = m_lSize = pRequest->cbBuffer;
+	pActual->cBuffers = m_lCount = pRequest->cBuffers;
+	pActual->cbAlign = m_lAlignment = pRequest->cbAlign;
+	pActual->cbPrefix = m_lPrefix = 0;
+
+	m_bChanged = TRUE;
+	return NOERROR;
+}
+
+STDMETHODIMP CaptureSlotAllocator::ReleaseBuffer(IMediaSample* pSample)
+{
+	CheckPointer(pSample, E_POINTER);
+	{
+		CAutoLock lck(this);
+		auto slot = static_cast<CaptureSlotSample*>(pSample)->Unbind();
+		if (slot != FrameFanout::noSlot)
 		{
-			mDataBurstBuffer.resize(mDataBurstSize);
+			mFrames->Release(slot);
 		}
-
-		mPaPbBytesRead = mPcPdBytesRead = 0;
-		#ifndef NO_QUILL
-		LOG_TRACE_L2(mLogger, "[{}] Found codec {} with burst size {}", mLogPrefix, codecNames[static_cast<int>(**codec)], mDataBurstSize);
-		#endif
 	}
-	return partialDataBurst ? S_PARTIAL_DATABURST : maybeBitstream ? S_POSSIBLE_BITSTREAM : copiedBytes ? S_OK : S_FALSE;
+	return CBaseAllocator::ReleaseBuffer(pSample);
+}
+
+BYTE* CaptureSlotAllocator::Bind(IMediaSample* pSample, int slot)
+{
+	CAutoLock lck(this);
+	auto data = mFrames->Get(slot).data;
+	// a failed resize leaves the slots smaller than the buffer size
+	auto size = static_cast<long>(std::min(static_cast<size_t>(m_lSize), mFrames->GetFrameCapacity()));
+	static_cast<CaptureSlotSample*>(pSample)->Bind(slot, data, size);
+	return data;
 }
 
-// identifies codecs that are known/expected to be carried via HDMI in an AV setup
-// from IEC 61937-2 Table 2
-HRESULT MagewellAudioCapturePin::GetCodecFromIEC61937Preamble(const IEC61937DataType dataType, uint16_t* burstSize, Codec* codec)
+HRESULT CaptureSlotAllocator::Alloc()
 {
-	switch (dataType & 0xff)
+	CAutoLock lck(this);
+
+	HRESULT hr = CBaseAllocator::Alloc();
+	if (FAILED(hr))
 	{
-	case IEC61937_AC3:
-		*burstSize /= 8; // bits
-		*codec = AC3;
-		break;
-	case IEC61937_DTS1:
-	case IEC61937_DTS2:
-	case IEC61937_DTS3:
-		*burstSize /= 8; // bits
-		*codec = DTS;
-		break;
-	case IEC61937_DTSHD:
-		*codec = DTSHD;
-		break;
-	case IEC61937_EAC3:
-		*codec = EAC3;
-		break;
-	case IEC61937_TRUEHD:
-		*codec = TRUEHD;
-		break;
-	case IEC61937_NULL:
-	case IEC61937_PAUSE:
-		*codec = PAUSE_OR_NULL;
-		break;
-	default:
-		*codec = PAUSE_OR_NULL;
-		#ifndef NO_QUILL
-		LOG_WARNING(mLogger, "[{}] Unknown IEC61937 datatype {} will be treated as PAUSE", mLogPrefix, dataType & 0xff);
-		#endif
-		break;
+		return hr;
 	}
-	return S_OK;
+	// requirements are unchanged so keep the existing samples
+	if (hr == S_FALSE)
+	{
+		return NOERROR;
+	}
+
+	ReallyFree();
+
+	if (m_lSize < 0 || m_lCount < 0)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	for (; m_lAllocated < m_lCount; m_lAllocated++)
+	{
+		auto pSample = new CaptureSlotSample(NAME("Capture slot media sample"), this, &hr);
+		if (pSample == nullptr)
+		{
+			return E_OUTOFMEMORY;
+		}
+		m_lFree.Add(pSample);
+	}
+
+	m_bChanged = FALSE;
+	return NOERROR;
 }
 
-//////////////////////////////////////////////////////////////////////////
-// MemAllocator 
-//////////////////////////////////////////////////////////////////////////
-MemAllocator::MemAllocator(LPUNKNOWN pUnk, HRESULT* pHr) : CMemAllocator("MemAllocator", pUnk, pHr)
+void CaptureSlotAllocator::Free()
 {
-	// exists purely to allow for easy debugging of what is going on inside CMemAllocator
+	// samples are kept until the allocator is deleted or the requirements change
+}
+
+void CaptureSlotAllocator::ReallyFree()
+{
+	for (auto pSample = m_lFree.RemoveHead(); pSample != nullptr; pSample = m_lFree.RemoveHead())
+	{
+		delete pSample;
+	}
+	m_lAllocated = 0;
 }
 
 HRESULT MagewellAudioCapturePin::InitAllocator(IMemAllocator** ppAllocator)
@@ -15,7 +15,6 @@
 #pragma once
 
 #define NOMINMAX
-constexpr auto not_present = 1024;
 
 #ifndef NO_QUILL
 #include <quill/Logger.h>
@@ -34,6 +33,7 @@ using CustomLogger = quill::LoggerImpl<CustomFrontendOptions>;
 #else
 #include <vector>
 #include <chrono>
+#include <thread>
 #endif // !NO_QUILL
 
 #include <string>
@@ -48,63 +48,93 @@ using CustomLogger = quill::LoggerImpl<CustomFrontendOptions>;
 #include "ISpecifyPropertyPages2.h"
 #include "signalinfo.h"
 #include "util.h"
+#include "pcm_remap.h"
+#include "channel_allocation.h"
+#include "ayuv.h"
+#include "frame_fanout.h"
+#include "pinned_buffer_cache.h"
+#include "timestamp_mapper.h"
+#include "versioned_snapshot.h"
+#include "audio_format.h"
+#include "iec61937.h"
+#include "pcm_jitter_buffer.h"
+#include "disciplined_clock.h"
+#include "delivery_queue.h"
+#include "latency_histogram.h"
+#include "downscale.h"
+#include "capture_caps.h"
+#include "yuv444.h"
+#include "latency_mode.h"
 
-// HDMI Audio Bitstream Codec Identification metadata
-
-// IEC 61937-1 Chapter 6.1.7 Field Pa
-constexpr auto IEC61937_SYNCWORD_1 = 0xF872;
-// IEC 61937-1 Chapter 6.1.7 Field Pb
-constexpr auto IEC61937_SYNCWORD_2 = 0x4E1F;
-// IEC 61937-2 Table 2
-enum IEC61937DataType : uint8_t
-{
-    IEC61937_NULL               = 0x0,           ///< NULL
-    IEC61937_AC3                = 0x01,          ///< AC-3 data
-    IEC61937_PAUSE              = 0x03,          ///< Pause
-    IEC61937_MPEG1_LAYER1       = 0x04,          ///< MPEG-1 layer 1
-    IEC61937_MPEG1_LAYER23      = 0x05,          ///< MPEG-1 layer 2 or 3 data or MPEG-2 without extension
-    IEC61937_MPEG2_EXT          = 0x06,          ///< MPEG-2 data with extension
-    IEC61937_MPEG2_AAC          = 0x07,          ///< MPEG-2 AAC ADTS
-    IEC61937_MPEG2_LAYER1_LSF   = 0x08,          ///< MPEG-2, layer-1 low sampling frequency
-    IEC61937_MPEG2_LAYER2_LSF   = 0x09,          ///< MPEG-2, layer-2 low sampling frequency
-    IEC61937_MPEG2_LAYER3_LSF   = 0x0A,          ///< MPEG-2, layer-3 low sampling frequency
-    IEC61937_DTS1               = 0x0B,          ///< DTS type I   (512 samples)
-    IEC61937_DTS2               = 0x0C,          ///< DTS type II  (1024 samples)
-    IEC61937_DTS3               = 0x0D,          ///< DTS type III (2048 samples)
-    IEC61937_ATRAC              = 0x0E,          ///< ATRAC data
-    IEC61937_ATRAC3             = 0x0F,          ///< ATRAC3 data
-    IEC61937_ATRACX             = 0x10,          ///< ATRAC3+ data
-    IEC61937_DTSHD              = 0x11,          ///< DTS HD data
-    IEC61937_WMAPRO             = 0x12,          ///< WMA 9 Professional data
-    IEC61937_MPEG2_AAC_LSF_2048 = 0x13,          ///< MPEG-2 AAC ADTS half-rate low sampling frequency
-    IEC61937_MPEG2_AAC_LSF_4096 = 0x13 | 0x20,   ///< MPEG-2 AAC ADTS quarter-rate low sampling frequency
-    IEC61937_EAC3               = 0x15,          ///< E-AC-3 data
-    IEC61937_TRUEHD             = 0x16,          ///< TrueHD/MAT data
-};
-enum Codec
-{
-    PCM,
-    AC3,
-    DTS,
-    DTSHD,
-    EAC3,
-    TRUEHD,
-    BITSTREAM,
-    PAUSE_OR_NULL
-};
-static const std::string codecNames[8] = {
-    "PCM",
-    "AC3",
-    "DTS",
-    "DTSHD",
-    "EAC3",
-    "TrueHD",
-    "Unidentified",
-	"PAUSE_OR_NULL"
-};
 constexpr int maxBitDepthInBytes = sizeof(DWORD);
 constexpr int maxFrameLengthInBytes = MWCAP_AUDIO_SAMPLES_PER_FRAME * MWCAP_AUDIO_MAX_NUM_CHANNELS * maxBitDepthInBytes;
+// the portable audio code describes the captured frame layout independently of the SDK
+static_assert(maxFrameLengthInBytes == maxBitstreamFrameLengthInBytes, "captured audio frame layout mismatch");
+static_assert(sizeof(HDR_INFOFRAME) == sizeof(HDMI_HDR_INFOFRAME_PAYLOAD), "hdr infoframe layout mismatch");
 constexpr LONGLONG oneSecondIn100ns = 10000000L;
+// frames read from the device which each pin can queue ahead of its thread, preview pins favour the latest frame and
+// capture pins an unbroken stream
+constexpr uint32_t videoFrameQueueDepth = 3;
+constexpr uint32_t audioFrameQueueDepth = 16;
+constexpr DeliveryPolicy captureFramePolicy = DELIVERY_DROP_NEWEST;
+constexpr DeliveryPolicy previewFramePolicy = DELIVERY_DROP_OLDEST;
+// the device signal is reloaded when the driver reports a change or, failing that, at this interval
+constexpr DWORD signalRefreshIntervalMs = 250;
+// the reference clock reads the device time at this interval and interpolates in between
+constexpr uint32_t clockSampleIntervalMs = 100;
+// the settings below are build defaults, a value of the same name (lower case) under this key in HKEY_CURRENT_USER
+// overrides the default when the filter is created
+constexpr auto settingsRegistryKey = "Software\\mwcapture";
+// how samples are stamped, Clock is a fallback for a device whose timestamps can't be trusted. timestampmode is a
+// string named as per timestampmode_to_name
+constexpr TimestampMode timestampMode = TIMESTAMP_DEVICE;
+// deliver bitstreams as the captured IEC 61937 stream rather than the data bursts, iec61937passthrough is a DWORD
+// which is non zero to enable it, build with IEC61937_PASSTHROUGH to enable it by default
+#ifdef IEC61937_PASSTHROUGH
+constexpr bool iec61937Passthrough = true;
+#else
+constexpr bool iec61937Passthrough = false;
+#endif
+// deliver PCM on the graph clock, resampled to absorb its drift against the HDMI clock, pcmjitterbuffer is a DWORD which
+// is non zero to enable it, build with PCM_JITTER_BUFFER to enable it by default
+#ifdef PCM_JITTER_BUFFER
+constexpr bool pcmJitterBuffer = true;
+#else
+constexpr bool pcmJitterBuffer = false;
+#endif
+// audio held by the jitter buffer to ride out capture jitter, pcmjittertargetdepthms is a DWORD up to
+// maxPcmJitterTargetDepthMs
+constexpr uint32_t maxPcmJitterTargetDepthMs = 200;
+constexpr uint32_t pcmJitterTargetDepthMs = 20;
+// deliver samples from a separate thread so a slow downstream filter can't delay capture, videoasyncdelivery and
+// audioasyncdelivery are DWORDs which are non zero to enable it, build with ASYNC_DELIVERY to enable it by default
+#ifdef ASYNC_DELIVERY
+constexpr bool asyncDelivery = true;
+#else
+constexpr bool asyncDelivery = false;
+#endif
+// samples queued for delivery by each pin, video favours the latest frame and audio an unbroken stream.
+// videodeliveryqueuedepth and audiodeliveryqueuedepth are DWORDs up to maxDeliveryQueueDepth, videodeliverypolicy and
+// audiodeliverypolicy are strings named as per deliverypolicy_to_name
+constexpr uint32_t maxDeliveryQueueDepth = 32;
+constexpr uint32_t videoDeliveryQueueDepth = 2;
+constexpr DeliveryPolicy videoDeliveryPolicy = DELIVERY_DROP_OLDEST;
+constexpr uint32_t audioDeliveryQueueDepth = 8;
+constexpr DeliveryPolicy audioDeliveryPolicy = DELIVERY_DROP_NEWEST;
+// the latency from the end of each frame to its sample being handed downstream is summarised in the log at this interval
+constexpr LONGLONG captureLatencyReportInterval = 60 * oneSecondIn100ns;
+// the preview pin delivers frames downscaled to this size, the capture pin always delivers the captured frame
+constexpr DownscaleSize previewVideoSize = DOWNSCALE_HALF;
+// build with FRAME_BUFFERED_CAPTURE to copy each frame from a pro card once it is fully buffered or with
+// FIELD_BUFFERED_CAPTURE to deliver each field of an interlaced signal as it is buffered, otherwise the copy of each frame
+// starts as soon as the card starts buffering it. videolatencymode is a string named as per videolatencymode_to_name.
+#if defined(FRAME_BUFFERED_CAPTURE)
+constexpr VideoLatencyMode videoLatencyMode = LATENCY_FRAME_BUFFERED;
+#elif defined(FIELD_BUFFERED_CAPTURE)
+constexpr VideoLatencyMode videoLatencyMode = LATENCY_FIELD_BUFFERED;
+#else
+constexpr VideoLatencyMode videoLatencyMode = LATENCY_FRAME_BUFFERING;
+#endif
 
 EXTERN_C const GUID CLSID_MWCAPTURE_FILTER;
 EXTERN_C const GUID MEDIASUBTYPE_PCM_IN24;
@@ -124,9 +154,6 @@ struct VIDEO_SIGNAL
 {
     MWCAP_INPUT_SPECIFIC_STATUS inputStatus;
     MWCAP_VIDEO_SIGNAL_STATUS signalStatus;
-    MWCAP_VIDEO_BUFFER_INFO bufferInfo;
-    MWCAP_VIDEO_FRAME_INFO frameInfo;
-    MWCAP_VIDEO_CAPTURE_STATUS captureStatus;
     HDMI_HDR_INFOFRAME_PAYLOAD hdrInfo;
     HDMI_AVI_INFOFRAME_PAYLOAD aviInfo;
 };
@@ -144,6 +171,10 @@ struct VIDEO_FORMAT
     int aspectY{ 9 };
     MWCAP_VIDEO_QUANTIZATION_RANGE quantization{ MWCAP_VIDEO_QUANTIZATION_LIMITED };
     MWCAP_VIDEO_SATURATION_RANGE saturation{ MWCAP_VIDEO_SATURATION_LIMITED };
+    // the area of the signal which is captured, empty for all of it
+    RECT crop{ 0, 0, 0, 0 };
+    // PRO only, each field of an interlaced signal is captured as a frame at twice the frame rate of the signal
+    bool fieldRate{ false };
     HDR_META hdrMeta;
     // derived from the above attributes
     byte bitCount;
@@ -154,16 +185,44 @@ struct VIDEO_FORMAT
     DWORD imageSize;
 };
 
+// a capture format set through IAMStreamConfig::SetFormat, the card scales, crops and converts the signal to suit
+// fields left at zero (or empty) follow the signal
+struct VIDEO_CAPTURE_REQUEST
+{
+    DWORD pixelStructure{ 0 };
+    int cx{ 0 };
+    int cy{ 0 };
+    // USB only, a pro card always captures at the rate of the signal
+    LONGLONG frameInterval{ 0 };
+    // PRO only
+    RECT crop{ 0, 0, 0, 0 };
+};
+
 struct AUDIO_SIGNAL
 {
     MWCAP_AUDIO_SIGNAL_STATUS signalStatus;
-    MWCAP_AUDIO_CAPTURE_FRAME frameInfo;
     HDMI_AUDIO_INFOFRAME_PAYLOAD audioInfo;
 };
 
-struct AUDIO_FORMAT
+// everything read from the driver to describe the incoming signal, shared by all pins
+struct DEVICE_SIGNAL
 {
-    boolean pcm{ true };
+    MW_RESULT videoSignalResult{ MW_FAILED };
+    MWCAP_VIDEO_SIGNAL_STATUS videoSignal{};
+    MW_RESULT inputStatusResult{ MW_FAILED };
+    MWCAP_INPUT_SPECIFIC_STATUS inputStatus{};
+    MW_RESULT infoFrameResult{ MW_FAILED };
+    DWORD infoFrameValidFlags{ 0 };
+    bool hasHdrInfo{ false };
+    HDMI_HDR_INFOFRAME_PAYLOAD hdrInfo{};
+    bool hasAviInfo{ false };
+    HDMI_AVI_INFOFRAME_PAYLOAD aviInfo{};
+    bool hasAudioInfo{ false };
+    HDMI_AUDIO_INFOFRAME_PAYLOAD audioInfo{};
+    MW_RESULT audioSignalResult{ MW_FAILED };
+    MWCAP_AUDIO_SIGNAL_STATUS audioSignal{};
+};
+
     DWORD fs{ 48000 };
     double sampleInterval{ 10000000.0 / 48000 };
     BYTE bitDepth{ 16 };
@@ -178,6 +237,10 @@ struct AUDIO_FORMAT
     int lfeChannelIndex{ not_present };
     double lfeLevelAdjustment{ 1.0 };
     Codec codec{ PCM };
+    // derived from the above attributes
+    const CHANNEL_ALLOCATION* channelAllocationInfo{ GetChannelAllocation(0x00, 0x01) };
+    const PCM_REMAP_PLAN* remapPlan{ GetPcmRemapPlan(channelAllocationInfo, 2) };
+    uint8_t framesPerSample{ GetPcmFramesPerSample(48000, minAudioSampleDuration) };
     // encoded content only
     uint16_t dataBurstSize{ 0 };
 };
@@ -206,40 +269,213 @@ struct DEVICE_INFO
     HCHANNEL hChannel;
 };
 
-struct CAPTURED_FRAME
+// how a pin hands its samples downstream
+struct DELIVERY_SETTINGS
 {
-    BYTE* data;
-    int length;
-    UINT64 ts;
+    bool async;
+    uint32_t queueDepth;
+    DeliveryPolicy policy;
 };
 
 class MWReferenceClock final :
     public CBaseReferenceClock
 {
-    HCHANNEL mChannel;
-    bool mIsPro;
+    DisciplinedClock mClock;
+
+    static int64_t GetCounter()
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return counter.QuadPart;
+    }
+
+    static int64_t GetCounterFrequency()
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        return frequency.QuadPart;
+    }
 
 public:
+    // pro devices are followed by reading the device time at a low rate, usb devices have no device time so the clock
+    // is the performance counter
     MWReferenceClock(HRESULT* phr, HCHANNEL hChannel, bool isProDevice)
         : CBaseReferenceClock(L"MWReferenceClock", nullptr, phr, nullptr),
-    mChannel(hChannel),
-    mIsPro(isProDevice)
+    mClock(GetCounter, GetCounterFrequency(), isProDevice ? DisciplinedClock::TimeSource([hChannel]
+    {
+        LONGLONG t = 0;
+        MWGetDeviceTime(hChannel, &t);
+        return static_cast<int64_t>(t);
+    }) : DisciplinedClock::TimeSource{}, clockSampleIntervalMs)
     {
     }
 
+    // CBaseReferenceClock holds its lock while calling this
     REFERENCE_TIME GetPrivateTime() override
     {
-        REFERENCE_TIME t;
-        if (mIsPro)
-        {
-            MWGetDeviceTime(mChannel, &t);
-        }
-        else
-        {
-            t = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-        }
-        return t;
+        return mClock.GetTime();
+    }
+
+    DISCIPLINED_CLOCK_STATS GetStats()
+    {
+        CAutoLock lock(this);
+        return mClock.GetStats();
+    }
+};
+
+class MagewellCaptureFilter;
+
+// pins buffers for capture by a pro device
+struct MWVideoBufferPinApi
+{
+    HCHANNEL hChannel{ nullptr };
+
+    bool Pin(uint8_t* data, size_t size) const
+    {
+        return MW_SUCCEEDED == MWPinVideoBuffer(hChannel, data, static_cast<DWORD>(size));
     }
+
+    void Unpin(uint8_t* data) const
+    {
+        MWUnpinVideoBuffer(hChannel, data);
+    }
+};
+
+/**
+ * Reads a stream from the device once and shares each frame with every pin consuming that stream so adding a pin
+ * adds no device reads or copies. The device is read for as long as at least one pin is subscribed.
+ */
+class CaptureEngine
+{
+public:
+    CaptureEngine(MagewellCaptureFilter* pFilter, std::string pLogPrefix);
+    virtual ~CaptureEngine() = default;
+
+    CaptureEngine(const CaptureEngine&) = delete;
+    CaptureEngine& operator=(const CaptureEngine&) = delete;
+
+    // adds a consumer which queues up to depth frames and holds up to heldSlots frames once taken, notifyEvent is set
+    // whenever a frame is queued for it. Reading starts with the first consumer.
+    int Subscribe(uint32_t depth, DeliveryPolicy policy, uint32_t heldSlots, HANDLE notifyEvent);
+    // reading stops once the last consumer has gone
+    void Unsubscribe(int consumer);
+
+    // shared with the allocators which hand the slots downstream so they outlive the engine
+    const std::shared_ptr<FrameFanout>& GetFrames() const { return mFrames; }
+
+protected:
+    // called with mConsumerLock held
+    virtual void StartReading() = 0;
+    virtual void StopReading() = 0;
+    // called by the producer before the slot storage is replaced
+    virtual void OnSlotsReplaced() {}
+
+    // the slots are resized by the producer before its next frame
+    void RequestSlotCount(uint32_t slotCount);
+    void RequestFrameSize(size_t frameSize);
+    // producer only, applies any requested resize, returns false if the slots are still too small for a frame.
+    // Lock free unless a resize is pending.
+    bool ApplyRequestedSlots();
+
+    MagewellCaptureFilter* mFilter;
+    std::shared_ptr<FrameFanout> mFrames{ std::make_shared<FrameFanout>() };
+    // guards the consumers and starting or stopping the read, never taken by the producer
+    CCritSec mConsumerLock;
+    // slots each consumer may hold, indexed by consumer
+    std::vector<uint32_t> mHeldSlots;
+    uint32_t mConsumerCount{ 0 };
+    bool mReading{ false };
+    // guards the capture format and requested slots, the producer only takes it once a resize has been requested
+    CCritSec mRequestLock;
+    std::atomic<bool> mSlotsRequested{ false };
+    bool mSlotsBlocked{ false };
+    uint32_t mRequestedSlotCount{ 1 };
+    size_t mRequestedFrameSize{ 0 };
+
+#ifndef NO_QUILL
+    std::string mLogPrefix;
+    CustomLogger* mLogger;
+#endif
+};
+
+/**
+ * Reads video on a thread of its own for a pro device or from the SDK capture callback for a usb device, in the
+ * format set by the pins.
+ */
+class VideoCaptureEngine final : public CaptureEngine
+{
+public:
+    explicit VideoCaptureEngine(MagewellCaptureFilter* pFilter);
+    ~VideoCaptureEngine() override;
+
+    // sets the format frames are captured in, a usb capture is recreated if it changed
+    void SetFormat(const VIDEO_FORMAT& format);
+    // the request is shared by every pin so they all load the same format from the signal
+    void SetCaptureRequest(const VIDEO_CAPTURE_REQUEST& request);
+    VIDEO_CAPTURE_REQUEST GetCaptureRequest();
+
+protected:
+    void StartReading() override;
+    void StopReading() override;
+    void OnSlotsReplaced() override;
+
+private:
+    // PRO only
+    void ReadFrames();
+    void CaptureFrame(const VIDEO_FORMAT& format, bool hasSignal);
+    // USB only
+    static void OnFrameCaptured(BYTE* pbFrame, int cbFrame, UINT64 u64TimeStamp, void* pParam);
+
+    VIDEO_FORMAT mFormat{};
+    VIDEO_CAPTURE_REQUEST mCaptureRequest{};
+    // PRO only
+    std::thread mReader;
+    FieldSequence mFields;
+    HANDLE mStopEvent{ nullptr };
+    HANDLE mNotifyEvent{ nullptr };
+    HANDLE mCaptureEvent{ nullptr };
+    HNOTIFY mNotify{ nullptr };
+    // slots stay pinned until their storage is replaced or reading stops
+    PinnedBufferCache<MWVideoBufferPinApi> mPinnedSlots;
+    // USB only
+    HANDLE mCapture{ nullptr };
+    VIDEO_FORMAT mCaptureFormat{};
+    RowBandWorkers mAyuvWorkers{ GetAyuvSwizzleWorkerCount() };
+};
+
+/**
+ * Reads audio on a thread of its own for a pro device, draining the frames buffered on the device after each
+ * notification, or from the SDK capture callback for a usb device.
+ */
+class AudioCaptureEngine final : public CaptureEngine
+{
+public:
+    explicit AudioCaptureEngine(MagewellCaptureFilter* pFilter);
+    ~AudioCaptureEngine() override;
+
+    // USB only, sets the format frames are captured in, the capture is recreated if it changed
+    void SetFormat(const AUDIO_FORMAT& format);
+
+protected:
+    void StartReading() override;
+    void StopReading() override;
+
+private:
+    // PRO only
+    void ReadFrames();
+    // USB only
+    static void OnFrameCaptured(const BYTE* pbFrame, int cbFrame, UINT64 u64TimeStamp, void* pParam);
+
+    // PRO only
+    std::thread mReader;
+    HANDLE mStopEvent{ nullptr };
+    HANDLE mNotifyEvent{ nullptr };
+    HNOTIFY mNotify{ nullptr };
+    // USB only
+    HANDLE mCapture{ nullptr };
+    DWORD mFs{ 48000 };
+    BYTE mBitDepth{ 16 };
+    WORD mChannelCount{ 2 };
 };
 
 /**
@@ -266,14 +502,33 @@ public:
 
     DeviceType GetDeviceType() const;
 
+    // PRO only, fixed for the lifetime of the filter
+    VideoLatencyMode GetVideoLatencyMode() const;
+    // fixed for the lifetime of the filter
+    TimestampMode GetTimestampMode() const;
+    bool IsIec61937Passthrough() const;
+    bool IsPcmJitterBufferEnabled() const;
+    uint32_t GetPcmJitterTargetDepthMs() const;
+    const DELIVERY_SETTINGS& GetVideoDeliverySettings() const;
+    const DELIVERY_SETTINGS& GetAudioDeliverySettings() const;
+
     void GetReferenceTime(REFERENCE_TIME* rt) const;
 
+    // copies the latest device signal without touching the driver, returns its version
+    uint64_t GetSignal(DEVICE_SIGNAL* signal) const;
+    // reloads the device signal from the driver now, for use when an engine has been told the signal changed
+    void RefreshSignal();
+
+    VideoCaptureEngine* GetVideoEngine() const;
+    AudioCaptureEngine* GetAudioEngine() const;
+
 	// Callbacks to update the prop page data
     void OnVideoSignalLoaded(VIDEO_SIGNAL* vs);
     void OnVideoFormatLoaded(VIDEO_FORMAT* vf);
     void OnHdrUpdated(MediaSideDataHDR* hdr, MediaSideDataHDRContentLightLevel* light);
     void OnAudioSignalLoaded(AUDIO_SIGNAL* as);
     void OnAudioFormatLoaded(AUDIO_FORMAT* af);
+    void OnPcmJitterStats(const PCM_JITTER_STATS* stats);
     void OnDeviceSelected();
 
 private:
@@ -282,6 +537,9 @@ private:
     MagewellCaptureFilter(LPUNKNOWN punk, HRESULT* phr);
     ~MagewellCaptureFilter() override;
 
+    // overrides the defaults with the settings named for the stream (video or audio)
+    void ReadDeliverySettings(const char* stream, DELIVERY_SETTINGS* settings);
+
 public:
 
     //////////////////////////////////////////////////////////////////////////
@@ -323,6 +581,13 @@ public:
 
 private:
     DEVICE_INFO mDeviceInfo{};
+    VideoLatencyMode mVideoLatencyMode{ videoLatencyMode };
+    TimestampMode mTimestampMode{ timestampMode };
+    bool mIec61937Passthrough{ iec61937Passthrough };
+    bool mPcmJitterBuffer{ pcmJitterBuffer };
+    uint32_t mPcmJitterTargetDepthMs{ pcmJitterTargetDepthMs };
+    DELIVERY_SETTINGS mVideoDelivery{ asyncDelivery, videoDeliveryQueueDepth, videoDeliveryPolicy };
+    DELIVERY_SETTINGS mAudioDelivery{ asyncDelivery, audioDeliveryQueueDepth, audioDeliveryPolicy };
     BOOL mInited;
     MWReferenceClock* mClock;
     DEVICE_STATUS mDeviceStatus{};
@@ -332,6 +597,17 @@ private:
     VIDEO_OUTPUT_STATUS mVideoOutputStatus{};
     HDR_STATUS mHdrStatus{};
     ISignalInfoCB* mInfoCallback = nullptr;
+    // device signal, written by the monitor thread (or a pin via RefreshSignal) and read by the pins
+    void MonitorSignal();
+    VersionedSnapshot<DEVICE_SIGNAL> mSignal;
+    CCritSec mSignalLock;
+    HANDLE mSignalChangeEvent{ nullptr };
+    HANDLE mSignalMonitorStopEvent{ nullptr };
+    HNOTIFY mSignalNotify{ nullptr };
+    std::thread mSignalMonitor;
+    // the single reader of each stream, shared by the capture and preview pins
+    std::unique_ptr<VideoCaptureEngine> mVideoEngine;
+    std::unique_ptr<AudioCaptureEngine> mAudioEngine;
 
 #ifndef NO_QUILL
     std::string mLogPrefix = "MagewellCaptureFilter";
@@ -410,25 +686,42 @@ public:
 
 protected:
     virtual void StopCapture() = 0;
+    virtual uint32_t GetFrameQueueDepth() const = 0;
+    virtual const DELIVERY_SETTINGS& GetDeliverySettings() const = 0;
+    // how frames are captured, reported alongside the capture latency
+    virtual const char* GetCaptureModeName() const = 0;
     virtual bool ProposeBuffers(ALLOCATOR_PROPERTIES* pProperties) = 0;
     HRESULT RenegotiateMediaType(const CMediaType* pmt, long newSize, boolean renegotiateOnQueryAccept);
     HRESULT HandleStreamStateChange(IMediaSample* pms);
+    // sets mFrameEndTime from the device timestamp of the frame (if supplied and enabled) or the reference clock
+    void UpdateFrameEndTime(LONGLONG deviceTime);
+    // async delivery only, called on the delivery thread, returns false if downstream rejected the sample
+    bool DeliverQueued(IMediaSample* pSample);
+    // async delivery only, hands the reference to the sample to the delivery queue
+    void QueueForDelivery(IMediaSample* pSample);
+    // adds the time since the end of the current frame to mCaptureLatency, logging a summary now and then
+    void RecordCaptureLatency();
+    // joins the frames read by the engine, mNotifyEvent is set whenever a frame is queued for the pin
+    void SubscribeToFrames(CaptureEngine* engine, uint32_t heldSlots);
+    void UnsubscribeFromFrames();
+    bool IsFrameQueued() const;
+    // the oldest frame queued for the pin with a reference owned by the caller, noSlot if there is none
+    int TakeFrame(uint64_t* framesLost = nullptr);
+    // tracks the sequence of frames taken from the engine
+    // returns the number of frames lost since the previous frame consumed
+    uint64_t OnCapturedFrameConsumed(uint64_t sequence, uint64_t droppedCount);
 
 #ifndef NO_QUILL
     std::string mLogPrefix;
     CustomLogger* mLogger;
 #endif
 
-    CCritSec mCaptureCritSec;
 	LONGLONG mFrameCounter;
     bool mPreview;
     MagewellCaptureFilter* mFilter;
-    WORD mSinceLast{0};
     LONGLONG mStreamStartTime;
 
     // Common - temp 
-    HNOTIFY mNotify;
-    ULONGLONG mStatusBits = 0;
     HANDLE mNotifyEvent;
     MW_RESULT mLastMwResult;
     boolean mLastSampleDiscarded;
@@ -437,11 +730,25 @@ protected:
     LONGLONG mLastSentHdrMetaAt;
     // per frame
     LONGLONG mFrameEndTime;
-    // pro only
-    HANDLE mCaptureEvent;
+    LONGLONG mFrameDeviceTime{ 0 };
+    TimestampMapper mTimestampMapper{};
+    // version of the filter's device signal last loaded by this pin
+    uint64_t mSignalVersion{ UINT64_MAX };
+    CaptureEngine* mEngine{ nullptr };
+    int mFrameConsumer{ FrameFanout::noConsumer };
+    uint64_t mNextCapturedSequence{ UINT64_MAX };
+    // async delivery only, owns a reference to each queued sample
+    std::unique_ptr<DeliveryQueue<IMediaSample*>> mDeliveryQueue;
+    uint64_t mDeliveryDrops{ 0 };
+    // time from the end of each frame to the sample being handed downstream, 250us buckets up to 50ms
+    LatencyHistogram mCaptureLatency{ 250, 200 };
+    LONGLONG mCaptureLatencyReportedAt{ 0 };
+    LONGLONG mCaptureLatencyFrameEndTime{ 0 };
 };
 
 
+class CaptureSlotAllocator;
+
 /**
  * A video stream flowing from the capture device to an output pin.
  */
@@ -450,18 +757,21 @@ class MagewellVideoCapturePin :
 {
 public:
     MagewellVideoCapturePin(HRESULT* phr, MagewellCaptureFilter* pParent, bool pPreview);
+    ~MagewellVideoCapturePin() override;
 
     void GetReferenceTime(REFERENCE_TIME* rt) const;
 
 	//////////////////////////////////////////////////////////////////////////
     //  IAMStreamConfig
     //////////////////////////////////////////////////////////////////////////
+    HRESULT STDMETHODCALLTYPE SetFormat(AM_MEDIA_TYPE* pmt) override;
     HRESULT STDMETHODCALLTYPE GetNumberOfCapabilities(int* piCount, int* piSize) override;
     HRESULT STDMETHODCALLTYPE GetStreamCaps(int iIndex, AM_MEDIA_TYPE** pmt, BYTE* pSCC) override;
 
     //////////////////////////////////////////////////////////////////////////
     //  CBaseOutputPin
     //////////////////////////////////////////////////////////////////////////
+    HRESULT DecideAllocator(IMemInputPin* pPin, __deref_out IMemAllocator** pAlloc) override;
     HRESULT GetDeliveryBuffer(__deref_out IMediaSample** ppSample, __in_opt REFERENCE_TIME* pStartTime, __in_opt REFERENCE_TIME* pEndTime, DWORD dwFlags) override;
 
     //////////////////////////////////////////////////////////////////////////
@@ -469,62 +779,91 @@ public:
     //////////////////////////////////////////////////////////////////////////
     HRESULT FillBuffer(IMediaSample* pms) override;
     HRESULT GetMediaType(CMediaType* pmt) override;
+    // each output the captured frame can be delivered in, most preferred first
+    HRESULT GetMediaType(int iPosition, CMediaType* pmt) override;
+    HRESULT CheckMediaType(const CMediaType* pmt) override;
+    HRESULT SetMediaType(const CMediaType* pmt) override;
     HRESULT OnThreadCreate(void) override;
 
 protected:
-    // Encapsulates pinning the IMediaSample buffer into video memory (and unpinning on destruct)
+    // Fills the IMediaSample from the frame taken by GetDeliveryBuffer
     class VideoFrameGrabber
     {
     public:
-        VideoFrameGrabber(MagewellVideoCapturePin* pin, HCHANNEL hChannel, DeviceType deviceType, IMediaSample* pms);
-        ~VideoFrameGrabber();
+        VideoFrameGrabber(MagewellVideoCapturePin* pin, IMediaSample* pms);
 
         VideoFrameGrabber(VideoFrameGrabber const&) = delete;
         VideoFrameGrabber& operator =(VideoFrameGrabber const&) = delete;
         VideoFrameGrabber(VideoFrameGrabber&&) = delete;
         VideoFrameGrabber& operator=(VideoFrameGrabber&&) = delete;
 
-        HRESULT grab() const;
+        HRESULT grab();
 
     private:
-        HCHANNEL hChannel;
-        DeviceType deviceType;
         MagewellVideoCapturePin* pin;
         IMediaSample* pms;
         BYTE* pmsData;
     };
 
-    // USB only
-    class VideoCapture
-    {
-    public:
-        VideoCapture(MagewellVideoCapturePin* pin, HCHANNEL hChannel);
-        ~VideoCapture();
-
-    private:
-        MagewellVideoCapturePin* pin;
-        HANDLE mEvent;
-    };
-
     VIDEO_SIGNAL mVideoSignal{};
+    // the format delivered by this pin
     VIDEO_FORMAT mVideoFormat{};
+    // the format frames are captured in, differs from mVideoFormat only when frames are downscaled or converted
+    VIDEO_FORMAT mSourceFormat{};
+    DownscaleSize mOutputSize{ DOWNSCALE_NONE };
+    FrameDownscaler mDownscaler;
+    // only created when the pin downscales
+    std::unique_ptr<RowBandWorkers> mDownscaleWorkers;
+    // only created when the pin converts, the buffer holds a downscaled frame awaiting conversion
+    std::unique_ptr<RowBandWorkers> mConvertWorkers;
+    std::vector<uint8_t> mConvertBuffer;
+    // what the card can capture in, read once from the driver, the capture pin offers every combination
+    std::vector<uint32_t> mDeviceFourccs;
+    std::vector<CAPTURE_SIZE> mDeviceSizes;
+    std::vector<CAPTURE_CAP> mCaptureCaps;
     USB_CAPTURE_FORMATS mUsbCaptureFormats{};
     boolean mHasHdrInfoFrame{ false };
-    // USB only
-    VideoCapture* mVideoCapture{nullptr};
-    CAPTURED_FRAME mCapturedFrame{};
-
-    static void LoadFormat(VIDEO_FORMAT* videoFormat, VIDEO_SIGNAL* videoSignal, USB_CAPTURE_FORMATS* captureFormats);
-    // USB only
-    static void CaptureFrame(BYTE* pbFrame, int cbFrame, UINT64 u64TimeStamp, void* pParam);
-
+    // created on first use and kept for the lifetime of the pin
+    CaptureSlotAllocator* mSlotAllocator{ nullptr };
+    // the frame taken by GetDeliveryBuffer for FillBuffer, if any
+    int mPendingSlot{ FrameFanout::noSlot };
+
+    static void LoadFormat(VIDEO_FORMAT* videoFormat, VIDEO_SIGNAL* videoSignal, USB_CAPTURE_FORMATS* captureFormats,
+        const VIDEO_CAPTURE_REQUEST& request, VideoLatencyMode latencyMode);
+    // false if frames of this fourcc cannot be downscaled
+    static bool GetDownscaleLayout(DWORD pixelStructure, DownscaleLayout* layout);
+    // resizes the format to the given size, leaves it as is if it cannot be downscaled
+    static void ScaleFormat(VIDEO_FORMAT* videoFormat, DownscaleSize size);
+    // false if the fourcc is not one a Y410 frame can be delivered as
+    static bool GetYuv444Output(DWORD pixelStructure, Yuv444Output* output);
+    // changes the pixel format delivered, leaves it as is unless the frame is captured in Y410
+    static void ConvertFormat(VIDEO_FORMAT* videoFormat, Yuv444Output output);
+    // the formats a frame captured in sourceFormat can be delivered in, most preferred first
+    static std::vector<VIDEO_FORMAT> GetOutputFormats(const VIDEO_FORMAT& sourceFormat, DownscaleSize outputSize);
+
+    void LoadDeviceCaps();
+    // the capture pin offers every format the card can capture in, the native format first
+    const std::vector<CAPTURE_CAP>& GetCaptureCaps();
+    // the preview pin offers each size the captured frame can be downscaled to
+    std::vector<DownscaleSize> GetPreviewSizes();
+    // the format offered as capability iIndex along with what the pin must be set to in order to deliver it
+    bool LoadCapFormat(int iIndex, VIDEO_FORMAT* videoFormat, VIDEO_CAPTURE_REQUEST* request, DownscaleSize* outputSize);
     void LogHdrMetaIfPresent(VIDEO_FORMAT* newVideoFormat);
     void VideoFormatToMediaType(CMediaType* pmt, VIDEO_FORMAT* videoFormat) const;
     bool ShouldChangeMediaType(VIDEO_FORMAT* newVideoFormat);
-    HRESULT LoadSignal(HCHANNEL* pChannel);
-    HRESULT DoChangeMediaType(const CMediaType* pmt, const VIDEO_FORMAT* newVideoFormat);
+    // refreshes mVideoSignal from the filter if the device signal has changed since it was last loaded
+    HRESULT LoadSignal();
+    HRESULT DoChangeMediaType(const CMediaType* pmt, const VIDEO_FORMAT* newVideoFormat, const VIDEO_FORMAT* newSourceFormat);
     void StopCapture() override;
     bool ProposeBuffers(ALLOCATOR_PROPERTIES* pProperties) override;
+    uint32_t GetFrameQueueDepth() const override { return videoFrameQueueDepth; }
+    const DELIVERY_SETTINGS& GetDeliverySettings() const override { return mFilter->GetVideoDeliverySettings(); }
+    const char* GetCaptureModeName() const override;
+    // true if the captured frames are delivered in place via mSlotAllocator
+    bool IsZeroCopy() const;
+    bool IsDownscaled() const;
+    bool IsConverted() const;
+    void ReleasePendingFrame();
 };
 
 /**
@@ -537,10 +876,6 @@ public:
     MagewellAudioCapturePin(HRESULT* phr, MagewellCaptureFilter* pParent, bool pPreview);
     ~MagewellAudioCapturePin() override;
 
-    void CopyToBitstreamBuffer(BYTE* buf);
-    HRESULT ParseBitstreamBuffer(uint16_t bufSize, enum Codec** codec);
-    HRESULT GetCodecFromIEC61937Preamble(enum IEC61937DataType dataType, uint16_t* burstSize, enum Codec* codec);
-
 	//////////////////////////////////////////////////////////////////////////
     //  CBaseOutputPin
     //////////////////////////////////////////////////////////////////////////
@@ -562,37 +897,29 @@ public:
     HRESULT FillBuffer(IMediaSample* pms) override;
 
 protected:
-    class AudioCapture
-    {
-    public:
-        AudioCapture(MagewellAudioCapturePin* pin, HCHANNEL hChannel);
-        ~AudioCapture();
-
-    private:
-        MagewellAudioCapturePin* pin;
-        HANDLE mEvent;
-    };
-
-	double minus_10db{ pow(10.0, -10.0 / 20.0) };
     AUDIO_SIGNAL mAudioSignal{};
     AUDIO_FORMAT mAudioFormat{};
-    BYTE mFrameBuffer[maxFrameLengthInBytes];
+    BYTE mFrameBuffer[pcmMaxFramesPerSample * maxFrameLengthInBytes];
+    uint8_t mPcmFramesBuffered{ 0 };
+    // jitter buffer only
+    PcmJitterBuffer mJitterBuffer;
+    BYTE mJitterInput[pcmMaxFramesPerSample * maxFrameLengthInBytes];
+    uint64_t mPcmFramesLost{ 0 };
+    // graph time of the first frame delivered from the jitter buffer
+    REFERENCE_TIME mJitterStartTime{ 0 };
+    uint64_t mJitterFramesDelivered{ 0 };
+    REFERENCE_TIME mJitterStatsTime{ 0 };
     // IEC61937 processing
-    uint32_t mBitstreamDetectionWindowLength{ 0 };
-    uint8_t mPaPbBytesRead{ 0 };
-    BYTE mPcPdBuffer[4]; 
-    uint8_t mPcPdBytesRead{ 0 };
+    BitstreamParser mBitstream;
+    IEC61937Passthrough mPassthrough;
+    uint64_t mUnknownDataTypes{ 0 };
     uint16_t mDataBurstFrameCount{ 0 };
-    uint16_t mDataBurstRead{ 0 };
-    uint16_t mDataBurstSize{ 0 };
-    uint16_t mDataBurstPayloadSize{ 0 };
-    uint32_t mBytesSincePaPb{ 0 };
+    // the headers of the last burst collected
+    BITSTREAM_HEADER mBurstHeader{};
     uint64_t mSinceCodecChange{ 0 };
     bool mPacketMayBeCorrupt{ false };
-    BYTE mCompressedBuffer[maxFrameLengthInBytes];
-    std::vector<BYTE> mDataBurstBuffer; // variable size
-    AudioCapture* mAudioCapture{ nullptr };
-    CAPTURED_FRAME mCapturedFrame{};
+    // result of loading mSignalVersion
+    HRESULT mSignalResult{ S_FALSE };
 
     #ifdef RECORD_RAW
     char mRawFileName[MAX_PATH];
@@ -606,21 +933,100 @@ protected:
 	#endif
     // TODO remove after SDK bug is fixed
     Codec mDetectedCodec{ PCM };
-    bool mProbeOnTimer{ false };
+    AudioClassification mAudioClassification{ CLASSIFIED_UNKNOWN };
+    uint32_t mRenegotiations{ 0 };
 
-    static void AudioFormatToMediaType(CMediaType* pmt, AUDIO_FORMAT* audioFormat);
-    static void CaptureFrame(const BYTE* pbFrame, int cbFrame, UINT64 u64TimeStamp, void* pParam);
+    void AudioFormatToMediaType(CMediaType* pmt, AUDIO_FORMAT* audioFormat) const;
+    // the size of each media sample in the given format
+    long GetSampleSize(const AUDIO_FORMAT* audioFormat) const;
+    // pushes the aggregated frames into the jitter buffer and pulls the samples due on the graph clock into pmsData,
+    // returns the number of samples written
+    uint32_t FillFromJitterBuffer(BYTE* pmsData, long sampleSize, uint32_t samplesBuffered, REFERENCE_TIME* startTime, REFERENCE_TIME* endTime);
 
 	void LoadFormat(AUDIO_FORMAT* audioFormat, const AUDIO_SIGNAL* audioSignal) const;
-    HRESULT LoadSignal(HCHANNEL* hChannel);
+    // refreshes mAudioSignal from the filter if the device signal has changed since it was last loaded
+    HRESULT LoadSignal();
     bool ShouldChangeMediaType(AUDIO_FORMAT* newAudioFormat);
     HRESULT DoChangeMediaType(const CMediaType* pmt, const AUDIO_FORMAT* newAudioFormat);
     void StopCapture() override;
     bool ProposeBuffers(ALLOCATOR_PROPERTIES* pProperties) override;
+    uint32_t GetFrameQueueDepth() const override { return audioFrameQueueDepth; }
+    const DELIVERY_SETTINGS& GetDeliverySettings() const override { return mFilter->GetAudioDeliverySettings(); }
+    const char* GetCaptureModeName() const override { return "Buffered"; }
 };
 
 class MemAllocator final : public CMemAllocator
 {
 public:
     MemAllocator(__inout_opt LPUNKNOWN, __inout HRESULT*);
-};
\ No newline at end of file
+};
+
+/**
+ * A sample which can carry side data (i.e. HDR metadata) for samples allocated by our own allocators.
+ */
+class MediaSideDataSample :
+    public CMediaSample,
+    public IMediaSideData
+{
+public:
+    MediaSideDataSample(__in_opt LPCTSTR pName, __in_opt CBaseAllocator* pAllocator, __inout_opt HRESULT* phr,
+        __in_bcount_opt(length) LPBYTE pBuffer = nullptr, LONG length = 0);
+
+    STDMETHODIMP QueryInterface(REFIID riid, __deref_out void** ppv) override;
+    STDMETHODIMP_(ULONG) AddRef() override;
+    STDMETHODIMP_(ULONG) Release() override;
+
+    //////////////////////////////////////////////////////////////////////////
+    //  IMediaSideData
+    //////////////////////////////////////////////////////////////////////////
+    STDMETHODIMP SetSideData(GUID guidType, const BYTE* pData, size_t size) override;
+    STDMETHODIMP GetSideData(GUID guidType, const BYTE** pData, size_t* pSize) override;
+
+    // side data belongs to a single delivery so is cleared when the sample returns to the allocator
+    void ClearSideData();
+
+private:
+    std::vector<std::pair<GUID, std::vector<BYTE>>> mSideData;
+};
+
+/**
+ * A sample with no buffer of its own, a capture slot is bound to it for each delivery.
+ */
+class CaptureSlotSample final : public MediaSideDataSample
+{
+public:
+    CaptureSlotSample(__in_opt LPCTSTR pName, __in_opt CBaseAllocator* pAllocator, __inout_opt HRESULT* phr);
+
+    void Bind(int slot, BYTE* pData, long size);
+    // returns the slot bound to the sample, if any, and clears all per delivery state
+    int Unbind();
+
+private:
+    int mSlot{ FrameFanout::noSlot };
+};
+
+/**
+ * Hands capture slots downstream as the sample buffer so a frame is written once, by the device or the SDK, however
+ * many pins deliver it. The pin's reference to the slot is released when downstream releases the sample.
+ */
+class CaptureSlotAllocator final : public CBaseAllocator
+{
+public:
+    CaptureSlotAllocator(__inout_opt LPUNKNOWN, __inout HRESULT*, std::shared_ptr<FrameFanout> frames);
+    ~CaptureSlotAllocator() override;
+
+    STDMETHODIMP SetProperties(__in ALLOCATOR_PROPERTIES* pRequest, __out ALLOCATOR_PROPERTIES* pActual) override;
+    STDMETHODIMP ReleaseBuffer(IMediaSample* pSample) override;
+
+    // binds a held slot to a sample obtained from this allocator, returns the sample buffer
+    BYTE* Bind(IMediaSample* pSample, int slot);
+
+protected:
+    HRESULT Alloc() override;
+    void Free() override;
+
+private:
+    void ReallyFree();
+
+    std::shared_ptr<FrameFanout> mFrames;
+};
@@ -0,0 +1,226 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "pcm_jitter_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// the controller is critically damped with a time constant of 10s, fast enough to track a drifting clock while
+	// changing the ratio far too slowly to be heard as a change in pitch
+	constexpr double proportionalGain = 0.2;
+	constexpr double integralGain = proportionalGain * proportionalGain / 4.0;
+	// smooths out the scheduling jitter in when the pulls happen
+	constexpr double depthSmoothingSeconds = 0.5;
+	// the smallest target which still leaves a block of input ahead of the resampler
+	constexpr uint32_t minTargetDepth = resamplerTaps + 2 * pcmSamplesPerFrame;
+
+	void ToFloat(const uint8_t* pcm, uint8_t bitDepthInBytes, uint8_t channelCount, uint32_t frames, float* const* out,
+		uint32_t offset)
+	{
+		// each sample is placed in the top bytes of an int32 so every depth shares one scale
+		constexpr float scale = 1.0f / 2147483648.0f;
+		const auto shift = 8 * (4 - bitDepthInBytes);
+		for (uint32_t f = 0; f < frames; ++f)
+		{
+			for (uint8_t c = 0; c < channelCount; ++c, pcm += bitDepthInBytes)
+			{
+				uint32_t value = 0;
+				for (uint8_t b = 0; b < bitDepthInBytes; ++b)
+				{
+					value |= static_cast<uint32_t>(pcm[b]) << 8 * b;
+				}
+				out[c][offset + f] = static_cast<float>(static_cast<int32_t>(value << shift)) * scale;
+			}
+		}
+	}
+
+	void FromFloat(const float* in, uint8_t bitDepthInBytes, uint8_t channelCount, uint32_t frames, uint8_t* pcm)
+	{
+		const auto fullScale = static_cast<float>(1U << (8 * bitDepthInBytes - 1));
+		const auto maxValue = static_cast<int64_t>(fullScale) - 1;
+		const auto samples = frames * channelCount;
+		for (uint32_t s = 0; s < samples; ++s, pcm += bitDepthInBytes)
+		{
+			auto value = std::clamp<int64_t>(std::llrint(static_cast<double>(in[s]) * fullScale), -maxValue - 1, maxValue);
+			auto bits = static_cast<uint32_t>(value);
+			for (uint8_t b = 0; b < bitDepthInBytes; ++b)
+			{
+				pcm[b] = static_cast<uint8_t>(bits >> 8 * b);
+			}
+		}
+	}
+}
+
+PcmJitterBuffer::PcmJitterBuffer(SimdLevel level) :
+	mResampler(level)
+{
+}
+
+bool PcmJitterBuffer::Reset(uint32_t fs, uint8_t bitDepthInBytes, uint8_t channelCount, uint32_t targetDepthMs)
+{
+	mFs = fs;
+	mBitDepthInBytes = bitDepthInBytes;
+	mChannelCount = channelCount;
+	mTargetDepthMs = targetDepthMs;
+	mStats = {};
+	mRatio = 1.0;
+	mIntegral = 0.0;
+	mAverageDepth = 0.0;
+	mPrimed = false;
+	if (fs == 0 || bitDepthInBytes < 2 || bitDepthInBytes > 4 || channelCount < 1 || channelCount > resamplerMaxChannels)
+	{
+		mChannelCount = 0;
+		mFrames = 0;
+		mPosition = 0.0;
+		return false;
+	}
+
+	mTargetDepth = std::max(static_cast<uint32_t>(static_cast<uint64_t>(fs) * targetDepthMs / 1000), minTargetDepth);
+	mMaxDepth = 3 * mTargetDepth;
+	mCapacity = 2 * mMaxDepth + resamplerTaps;
+	mInput.assign(static_cast<size_t>(mCapacity) * channelCount, 0.0f);
+	for (uint8_t c = 0; c < channelCount; ++c)
+	{
+		mChannels[c] = mInput.data() + static_cast<size_t>(c) * mCapacity;
+	}
+	// the filter reaches back into silence until there is enough history
+	mFrames = resamplerHistory;
+	mPosition = resamplerHistory;
+	mResampled.reserve(static_cast<size_t>(pcmSamplesPerFrame) * pcmMaxFramesPerSample * channelCount);
+	return true;
+}
+
+void PcmJitterBuffer::Push(const uint8_t* pcm, uint32_t frames)
+{
+	Append(pcm, frames);
+}
+
+void PcmJitterBuffer::PushSilence(uint32_t frames)
+{
+	if (mChannelCount == 0) return;
+	mStats.gapFrames += frames;
+	Append(nullptr, frames);
+}
+
+void PcmJitterBuffer::Append(const uint8_t* pcm, uint32_t frames)
+{
+	if (mChannelCount == 0) return;
+	const uint32_t frameSize = mBitDepthInBytes * mChannelCount;
+	while (frames > 0)
+	{
+		if (mFrames == mCapacity) Compact();
+
+		auto chunk = std::min(frames, mCapacity - mFrames);
+		if (pcm == nullptr)
+		{
+			for (uint8_t c = 0; c < mChannelCount; ++c)
+			{
+				std::fill_n(mChannels[c] + mFrames, chunk, 0.0f);
+			}
+		}
+		else
+		{
+			ToFloat(pcm, mBitDepthInBytes, mChannelCount, chunk, mChannels.data(), mFrames);
+			pcm += static_cast<size_t>(chunk) * frameSize;
+		}
+		mFrames += chunk;
+		frames -= chunk;
+
+		// the consumer has stalled or is running far too slowly, drop the oldest audio rather than let the latency grow
+		auto depth = GetDepth();
+		if (depth > mMaxDepth)
+		{
+			auto dropped = depth - mTargetDepth;
+			mPosition += dropped;
+			mStats.overruns++;
+			mStats.framesDropped += dropped;
+			mAverageDepth = mTargetDepth;
+			Compact();
+		}
+	}
+	if (!mPrimed && GetDepth() >= mTargetDepth)
+	{
+		mPrimed = true;
+		mAverageDepth = GetDepth();
+	}
+}
+
+void PcmJitterBuffer::Compact()
+{
+	auto frame = static_cast<uint32_t>(mPosition);
+	if (frame <= resamplerHistory) return;
+
+	auto discard = std::min(frame - resamplerHistory, mFrames);
+	auto remaining = mFrames - discard;
+	for (uint8_t c = 0; c < mChannelCount; ++c)
+	{
+		memmove(mChannels[c], mChannels[c] + discard, remaining * sizeof(float));
+	}
+	mFrames = remaining;
+	mPosition -= discard;
+}
+
+uint32_t PcmJitterBuffer::Pull(uint8_t* out, uint32_t frames, uint32_t pending)
+{
+	const size_t frameSize = static_cast<size_t>(mBitDepthInBytes) * mChannelCount;
+	uint32_t produced = 0;
+	if (mPrimed)
+	{
+		mResampled.resize(static_cast<size_t>(frames) * mChannelCount);
+		produced = mResampler.Resample(mChannels.data(), mChannelCount, mFrames, &mPosition, mRatio, mResampled.data(), frames);
+		FromFloat(mResampled.data(), mBitDepthInBytes, mChannelCount, produced, out);
+		if (produced < frames)
+		{
+			// wait for the buffer to fill again, the ratio is kept as the drift won't have changed
+			mStats.underruns++;
+			mPrimed = false;
+		}
+		else
+		{
+			UpdateRatio(frames, pending);
+		}
+		if (static_cast<uint32_t>(mPosition) > mTargetDepth + resamplerHistory) Compact();
+	}
+	if (produced < frames)
+	{
+		memset(out + produced * frameSize, 0, (frames - produced) * frameSize);
+		mStats.silentFrames += frames - produced;
+	}
+	return produced;
+}
+
+void PcmJitterBuffer::UpdateRatio(uint32_t framesPulled, uint32_t pending)
+{
+	const auto dt = static_cast<double>(framesPulled) / mFs;
+	const auto depth = static_cast<double>(GetDepth()) - pending * mRatio;
+	mAverageDepth += dt / (dt + depthSmoothingSeconds) * (depth - mAverageDepth);
+	// the error in seconds, a positive error means the input is running faster than the output
+	const auto error = (mAverageDepth - mTargetDepth) / mFs;
+	constexpr auto limit = pcmJitterMaxCorrectionPpm / 1000000.0;
+	auto correction = proportionalGain * error + mIntegral;
+	// only integrate while the correction is achievable to avoid windup after a long stall
+	if (std::abs(correction) < limit)
+	{
+		mIntegral = std::clamp(mIntegral + integralGain * error * dt, -limit, limit);
+		correction = proportionalGain * error + mIntegral;
+	}
+	mRatio = 1.0 + std::clamp(correction, -limit, limit);
+
+	mStats.depthMs = mAverageDepth * 1000.0 / mFs;
+	mStats.ratioPpm = (mRatio - 1.0) * 1000000.0;
+}
@@ -0,0 +1,127 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "pcm_remap.h"
+#include "pcm_resampler.h"
+
+// decouples the rate at which PCM is captured (the HDMI sample clock) from the rate at which it is delivered (the
+// graph clock)
+//
+// captured audio is pushed in as it arrives and pulled out as the consumer needs it, the buffer holds a target depth
+// in between. Any drift between the 2 clocks shows up as a slow change in the depth, the pull side is resampled by a
+// ratio which a PI controller steers to hold the depth at its target so the drift is absorbed without dropping or
+// repeating samples. Gaps in the input are filled with silence to keep the timeline intact, an input burst which
+// overflows the buffer drops the oldest audio and an underrun yields silence until the buffer has refilled.
+
+// pulls within this many ppm of the input rate are absorbed by resampling
+constexpr double pcmJitterMaxCorrectionPpm = 1000.0;
+
+struct PCM_JITTER_STATS
+{
+	// input buffered ahead of the resampler averaged over recent pulls, in ms
+	double depthMs{ 0.0 };
+	// input frames consumed per output frame relative to 1, in parts per million
+	double ratioPpm{ 0.0 };
+	uint64_t underruns{ 0 };
+	uint64_t overruns{ 0 };
+	// input frames discarded to recover from an overrun
+	uint64_t framesDropped{ 0 };
+	// frames of silence pushed in place of lost input
+	uint64_t gapFrames{ 0 };
+	// frames of silence pulled while waiting for the buffer to fill
+	uint64_t silentFrames{ 0 };
+};
+
+class PcmJitterBuffer
+{
+public:
+	explicit PcmJitterBuffer(SimdLevel level = GetSimdLevel());
+
+	// discards any buffered audio and configures the buffer for interleaved little endian PCM in the given format, pulls
+	// are silent until targetDepthMs of input has been pushed. Returns false if the format is not 16, 24 or 32 bit with
+	// 1 to 8 channels.
+	bool Reset(uint32_t fs, uint8_t bitDepthInBytes, uint8_t channelCount, uint32_t targetDepthMs);
+
+	bool IsConfiguredFor(uint32_t fs, uint8_t bitDepthInBytes, uint8_t channelCount, uint32_t targetDepthMs) const
+	{
+		return mFs == fs && mBitDepthInBytes == bitDepthInBytes && mChannelCount == channelCount && mTargetDepthMs == targetDepthMs;
+	}
+
+	void Push(const uint8_t* pcm, uint32_t frames);
+	void PushSilence(uint32_t frames);
+
+	// writes frames of PCM to out, returns the number of those frames which were resampled from the input rather than
+	// silence. pending is the number of output frames already due which will be pulled later, they are treated as
+	// consumed when measuring the depth so it does not depend on how the pulls line up with the pushes.
+	uint32_t Pull(uint8_t* out, uint32_t frames, uint32_t pending = 0);
+
+	// true once the target depth has been reached, false again after an underrun until it has refilled
+	bool IsPrimed() const
+	{
+		return mPrimed;
+	}
+
+	// input frames buffered ahead of the resampler
+	uint32_t GetDepth() const
+	{
+		return mPosition >= mFrames ? 0 : static_cast<uint32_t>(mFrames - mPosition);
+	}
+
+	uint32_t GetTargetDepth() const
+	{
+		return mTargetDepth;
+	}
+
+	double GetRatio() const
+	{
+		return mRatio;
+	}
+
+	const PCM_JITTER_STATS& GetStats() const
+	{
+		return mStats;
+	}
+
+private:
+	// appends frames of pcm, or silence if pcm is null
+	void Append(const uint8_t* pcm, uint32_t frames);
+	// discards the input that is behind the resampler
+	void Compact();
+	void UpdateRatio(uint32_t framesPulled, uint32_t pending);
+
+	PcmResampler mResampler;
+	uint32_t mFs{ 0 };
+	uint8_t mBitDepthInBytes{ 0 };
+	uint8_t mChannelCount{ 0 };
+	uint32_t mTargetDepthMs{ 0 };
+	uint32_t mTargetDepth{ 0 };
+	uint32_t mMaxDepth{ 0 };
+	uint32_t mCapacity{ 0 };
+	// planar input, one block of mCapacity frames per channel
+	std::vector<float> mInput;
+	std::array<float*, resamplerMaxChannels> mChannels{};
+	uint32_t mFrames{ 0 };
+	// input position of the next output frame
+	double mPosition{ 0.0 };
+	double mRatio{ 1.0 };
+	double mIntegral{ 0.0 };
+	double mAverageDepth{ 0.0 };
+	bool mPrimed{ false };
+	std::vector<float> mResampled;
+	PCM_JITTER_STATS mStats{};
+};
@@ -0,0 +1,243 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <array>
+#include <cstdint>
+#include "simd.h"
+
+// converts the captured audio frame into interleaved PCM
+//
+// each captured sample is a block of 8 x 4 byte slots in channel order L0-L3,R0-R3, the audio is high bit aligned
+// so a lower bit depth stream is left zero padded. The output is the top bitDepthInBytes of each slot written to
+// L0,R0,L1,R1,L2,R2,L3,R3 after skipping absent channels and applying the per channel offsets.
+// The work is described by a plan which maps each output byte to a byte of the input block, this is evaluated
+// with a byte shuffle (pshufb/tbl) per sample where the cpu supports it.
+
+constexpr auto not_present = 1024;
+constexpr int pcmSamplesPerFrame = 192;
+constexpr int pcmInputSlotCount = 8;
+constexpr int pcmInputSlotSizeInBytes = 4;
+constexpr int pcmInputBlockSizeInBytes = pcmInputSlotCount * pcmInputSlotSizeInBytes;
+// any index with the top bit set yields 0 from both pshufb and tbl
+constexpr uint8_t pcmUnmappedByte = 0x80;
+constexpr uint8_t pcmMaxFramesPerSample = 16;
+
+// number of captured frames to aggregate into each delivered sample so that it lasts for at least minSampleDuration (in 100ns units)
+constexpr uint8_t GetPcmFramesPerSample(uint32_t fs, int64_t minSampleDuration)
+{
+	if (fs == 0 || minSampleDuration <= 0) return 1;
+	const int64_t frameSamples = pcmSamplesPerFrame * 10000000LL;
+	auto frames = (minSampleDuration * fs + frameSamples - 1) / frameSamples;
+	return static_cast<uint8_t>(frames < 1 ? 1 : frames > pcmMaxFramesPerSample ? pcmMaxFramesPerSample : frames);
+}
+
+struct PCM_REMAP_PLAN
+{
+	uint8_t bitDepthInBytes{ 0 };
+	uint8_t outputChannelCount{ 0 };
+	// bytes written per sample, 0 if the format cannot be remapped
+	uint8_t outputBlockSize{ 0 };
+	// input byte index for each output byte
+	std::array<uint8_t, pcmInputBlockSizeInBytes> byteMap{};
+	// byteMap split into shuffle masks for the low and high 16 bytes of the input block
+	std::array<uint8_t, pcmInputBlockSizeInBytes> shuffleLo{};
+	std::array<uint8_t, pcmInputBlockSizeInBytes> shuffleHi{};
+};
+
+// derives the shuffle masks from the byteMap
+constexpr void SplitPcmRemapPlan(PCM_REMAP_PLAN* plan)
+{
+	for (auto i = 0; i < pcmInputBlockSizeInBytes; ++i)
+	{
+		auto src = plan->byteMap[i];
+		if (src < 16) plan->shuffleLo[i] = src;
+		else if (src < pcmInputBlockSizeInBytes) plan->shuffleHi[i] = static_cast<uint8_t>(src - 16);
+	}
+}
+
+constexpr PCM_REMAP_PLAN MakePcmRemapPlan(uint8_t bitDepthInBytes, uint16_t inputChannelCount, uint16_t outputChannelCount,
+	const std::array<int, 8>& channelOffsets)
+{
+	PCM_REMAP_PLAN plan{};
+	plan.byteMap.fill(pcmUnmappedByte);
+	plan.shuffleLo.fill(pcmUnmappedByte);
+	plan.shuffleHi.fill(pcmUnmappedByte);
+	if (bitDepthInBytes < 1 || bitDepthInBytes > pcmInputSlotSizeInBytes
+		|| outputChannelCount < 1 || outputChannelCount > pcmInputSlotCount
+		|| inputChannelCount > pcmInputSlotCount)
+	{
+		return plan;
+	}
+	plan.bitDepthInBytes = bitDepthInBytes;
+	plan.outputChannelCount = static_cast<uint8_t>(outputChannelCount);
+	plan.outputBlockSize = static_cast<uint8_t>(bitDepthInBytes * outputChannelCount);
+
+	// output channel index increments for each present input channel, visited pair by pair (left then right)
+	auto outputChannelIdx = -1;
+	for (auto channelIdx = 0; channelIdx < inputChannelCount / 2 * 2; ++channelIdx)
+	{
+		auto offset = channelOffsets[channelIdx];
+		if (offset == not_present) continue;
+
+		auto outputSlot = ++outputChannelIdx + offset;
+		if (outputSlot < 0 || outputSlot >= outputChannelCount) continue;
+
+		auto pairIdx = channelIdx / 2;
+		auto inputSlot = channelIdx % 2 == 0 ? pairIdx : pairIdx + pcmInputSlotCount / 2;
+		auto inByteStartIdx = inputSlot * pcmInputSlotSizeInBytes + pcmInputSlotSizeInBytes - bitDepthInBytes;
+		auto outByteStartIdx = outputSlot * bitDepthInBytes;
+		for (auto k = 0; k < bitDepthInBytes; ++k)
+		{
+			plan.byteMap[outByteStartIdx + k] = static_cast<uint8_t>(inByteStartIdx + k);
+		}
+	}
+
+	SplitPcmRemapPlan(&plan);
+	return plan;
+}
+
+// remaps nothing, used when no channels are present
+inline constexpr PCM_REMAP_PLAN noPcmRemapPlan{};
+
+// each kernel writes sampleCount * outputBlockSize bytes to out and reads sampleCount * pcmInputBlockSizeInBytes from in
+inline void RemapPcmScalar(const PCM_REMAP_PLAN* plan, const uint8_t* in, uint8_t* out, uint32_t sampleCount)
+{
+	const auto blockSize = plan->outputBlockSize;
+	for (uint32_t s = 0; s < sampleCount; ++s, in += pcmInputBlockSizeInBytes, out += blockSize)
+	{
+		for (auto i = 0; i < blockSize; ++i)
+		{
+			auto src = plan->byteMap[i];
+			out[i] = src == pcmUnmappedByte ? 0 : in[src];
+		}
+	}
+}
+
+// the vector kernels store a full register per sample and rely on the next sample overwriting the excess,
+// the samples at the end of the buffer where that would overrun are handled by the scalar kernel
+#if defined(HAS_X86_SIMD)
+TARGET_SSE41 inline void RemapPcmSse41(const PCM_REMAP_PLAN* plan, const uint8_t* in, uint8_t* out, uint32_t sampleCount)
+{
+	const uint32_t blockSize = plan->outputBlockSize;
+	const auto totalBytes = sampleCount * blockSize;
+	const auto lo0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plan->shuffleLo.data()));
+	const auto lo1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plan->shuffleLo.data() + 16));
+	const auto hi0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plan->shuffleHi.data()));
+	const auto hi1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plan->shuffleHi.data() + 16));
+
+	uint32_t s = 0;
+	if (blockSize <= 16)
+	{
+		for (; s * blockSize + 16 <= totalBytes; ++s)
+		{
+			auto inLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + s * pcmInputBlockSizeInBytes));
+			auto inHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + s * pcmInputBlockSizeInBytes + 16));
+			auto out0 = _mm_or_si128(_mm_shuffle_epi8(inLo, lo0), _mm_shuffle_epi8(inHi, hi0));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + s * blockSize), out0);
+		}
+	}
+	else
+	{
+		for (; s * blockSize + 32 <= totalBytes; ++s)
+		{
+			auto inLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + s * pcmInputBlockSizeInBytes));
+			auto inHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + s * pcmInputBlockSizeInBytes + 16));
+			auto out0 = _mm_or_si128(_mm_shuffle_epi8(inLo, lo0), _mm_shuffle_epi8(inHi, hi0));
+			auto out1 = _mm_or_si128(_mm_shuffle_epi8(inLo, lo1), _mm_shuffle_epi8(inHi, hi1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + s * blockSize), out0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + s * blockSize + 16), out1);
+		}
+	}
+	RemapPcmScalar(plan, in + s * pcmInputBlockSizeInBytes, out + s * blockSize, sampleCount - s);
+}
+
+TARGET_AVX2 inline void RemapPcmAvx2(const PCM_REMAP_PLAN* plan, const uint8_t* in, uint8_t* out, uint32_t sampleCount)
+{
+	const uint32_t blockSize = plan->outputBlockSize;
+	const auto totalBytes = sampleCount * blockSize;
+	// pshufb works within each 128bit lane so each half of the input block is broadcast to both lanes
+	const auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(plan->shuffleLo.data()));
+	const auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(plan->shuffleHi.data()));
+
+	uint32_t s = 0;
+	for (; s * blockSize + 32 <= totalBytes; ++s)
+	{
+		auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + s * pcmInputBlockSizeInBytes));
+		auto inLo = _mm256_permute2x128_si256(block, block, 0x00);
+		auto inHi = _mm256_permute2x128_si256(block, block, 0x11);
+		auto remapped = _mm256_or_si256(_mm256_shuffle_epi8(inLo, lo), _mm256_shuffle_epi8(inHi, hi));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + s * blockSize), remapped);
+	}
+	_mm256_zeroupper();
+	RemapPcmScalar(plan, in + s * pcmInputBlockSizeInBytes, out + s * blockSize, sampleCount - s);
+}
+#endif
+
+#if defined(HAS_NEON_SIMD)
+inline void RemapPcmNeon(const PCM_REMAP_PLAN* plan, const uint8_t* in, uint8_t* out, uint32_t sampleCount)
+{
+	const uint32_t blockSize = plan->outputBlockSize;
+	const auto totalBytes = sampleCount * blockSize;
+	// tbl indexes the whole 32 byte block directly so the unsplit byteMap is used
+	const auto map0 = vld1q_u8(plan->byteMap.data());
+	const auto map1 = vld1q_u8(plan->byteMap.data() + 16);
+
+	uint32_t s = 0;
+	const uint32_t storeSize = blockSize <= 16 ? 16 : 32;
+	for (; s * blockSize + storeSize <= totalBytes; ++s)
+	{
+		uint8x16x2_t block{ {
+			vld1q_u8(in + s * pcmInputBlockSizeInBytes),
+			vld1q_u8(in + s * pcmInputBlockSizeInBytes + 16)
+		} };
+		vst1q_u8(out + s * blockSize, vqtbl2q_u8(block, map0));
+		if (storeSize == 32)
+		{
+			vst1q_u8(out + s * blockSize + 16, vqtbl2q_u8(block, map1));
+		}
+	}
+	RemapPcmScalar(plan, in + s * pcmInputBlockSizeInBytes, out + s * blockSize, sampleCount - s);
+}
+#endif
+
+// remaps as many samples as fit into outSize bytes, returns the number of samples written
+inline uint32_t RemapPcm(const PCM_REMAP_PLAN* plan, const uint8_t* in, uint8_t* out, uint32_t outSize,
+	uint32_t sampleCount = pcmSamplesPerFrame, SimdLevel level = GetSimdLevel())
+{
+	if (plan->outputBlockSize == 0) return 0;
+	auto samplesThatFit = outSize / plan->outputBlockSize;
+	if (sampleCount > samplesThatFit) sampleCount = samplesThatFit;
+
+	switch (level)
+	{
+	#if defined(HAS_X86_SIMD)
+	case SIMD_AVX2:
+		RemapPcmAvx2(plan, in, out, sampleCount);
+		break;
+	case SIMD_SSE41:
+		RemapPcmSse41(plan, in, out, sampleCount);
+		break;
+	#endif
+	#if defined(HAS_NEON_SIMD)
+	case SIMD_NEON:
+		RemapPcmNeon(plan, in, out, sampleCount);
+		break;
+	#endif
+	default:
+		RemapPcmScalar(plan, in, out, sampleCount);
+		break;
+	}
+	return sampleCount;
+}
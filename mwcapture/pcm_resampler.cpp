@@ -0,0 +1,85 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "pcm_resampler.h"
+
+#include <cmath>
+
+namespace
+{
+	// flat to 0.42 fs and 6dB down at 0.46 fs, images are not a concern when the ratio is so close to 1
+	constexpr double cutoff = 0.46;
+	constexpr double kaiserBeta = 8.0;
+
+	// zeroth order modified bessel function of the first kind
+	double BesselI0(double x)
+	{
+		double sum = 1.0;
+		double term = 1.0;
+		for (auto k = 1; k < 32; ++k)
+		{
+			term *= x * x / (4.0 * k * k);
+			sum += term;
+		}
+		return sum;
+	}
+}
+
+PcmResampler::PcmResampler(SimdLevel level) :
+	mResampleFrame(GetResampleFrame(level)),
+	mFilters(static_cast<size_t>(resamplerPhases + 1) * resamplerTaps)
+{
+	constexpr double pi = 3.14159265358979323846;
+	constexpr double halfWidth = resamplerTaps / 2.0;
+	const auto i0Beta = BesselI0(kaiserBeta);
+	for (uint32_t p = 0; p <= resamplerPhases; ++p)
+	{
+		auto filter = mFilters.data() + static_cast<size_t>(p) * resamplerTaps;
+		double sum = 0.0;
+		for (uint32_t k = 0; k < resamplerTaps; ++k)
+		{
+			// distance from the output position to the input frame read by this tap
+			auto x = static_cast<double>(p) / resamplerPhases + resamplerHistory - k;
+			auto sinc = x == 0.0 ? 1.0 : std::sin(2.0 * pi * cutoff * x) / (2.0 * pi * cutoff * x);
+			auto w = x / halfWidth;
+			auto window = std::abs(w) >= 1.0 ? 0.0 : BesselI0(kaiserBeta * std::sqrt(1.0 - w * w)) / i0Beta;
+			auto h = 2.0 * cutoff * sinc * window;
+			filter[k] = static_cast<float>(h);
+			sum += h;
+		}
+		// unity gain at DC for every phase so the ratio changing cannot modulate the level
+		for (uint32_t k = 0; k < resamplerTaps; ++k)
+		{
+			filter[k] = static_cast<float>(filter[k] / sum);
+		}
+	}
+}
+
+uint32_t PcmResampler::Resample(const float* const* in, uint8_t channelCount, uint32_t inFrames, double* pos, double ratio,
+	float* out, uint32_t outFrames) const
+{
+	auto position = *pos;
+	uint32_t written = 0;
+	for (; written < outFrames; ++written, position += ratio, out += channelCount)
+	{
+		auto frame = static_cast<int64_t>(position);
+		if (frame < resamplerHistory || frame + resamplerLookahead >= inFrames) break;
+
+		auto phase = (position - static_cast<double>(frame)) * resamplerPhases;
+		auto p = static_cast<uint32_t>(phase);
+		mResampleFrame(GetFilter(p), GetFilter(p + 1), static_cast<float>(phase - p), in, frame - resamplerHistory, channelCount, out);
+	}
+	*pos = position;
+	return written;
+}
@@ -0,0 +1,187 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "simd.h"
+
+// fine ratio sample rate conversion of planar float audio, i.e. a ratio within a few hundred ppm of 1 to absorb clock
+// drift rather than to change the sample rate
+//
+// a kaiser windowed sinc is tabulated at resamplerPhases fractional offsets, each output frame interpolates the filter
+// for its offset from the 2 nearest phases and then takes the dot product of that filter with each channel. The vector
+// kernels produce a whole frame so the interpolated filter is shared by every channel of the frame.
+
+constexpr uint32_t resamplerTaps = 64;
+constexpr uint32_t resamplerPhases = 256;
+// input frames needed either side of the output position
+constexpr uint32_t resamplerHistory = resamplerTaps / 2 - 1;
+constexpr uint32_t resamplerLookahead = resamplerTaps / 2;
+constexpr uint8_t resamplerMaxChannels = 8;
+
+static_assert(resamplerTaps % 16 == 0, "the vector kernels consume 16 taps per step");
+static_assert(resamplerTaps <= 64, "the avx2 kernel holds the filter in registers");
+
+// each kernel writes one output frame, the filter is interpolated between the 2 phases h0 and h1 by f and applied to
+// resamplerTaps input frames of each channel from first
+inline void ResampleFrameScalar(const float* h0, const float* h1, float f, const float* const* in, int64_t first,
+	uint8_t channelCount, float* out)
+{
+	float filter[resamplerTaps];
+	for (uint32_t k = 0; k < resamplerTaps; ++k)
+	{
+		filter[k] = h0[k] + f * (h1[k] - h0[k]);
+	}
+	for (uint8_t c = 0; c < channelCount; ++c)
+	{
+		// 4 partial sums so the compiler is free to vectorise without reassociating
+		const auto x = in[c] + first;
+		float acc[4]{};
+		for (uint32_t k = 0; k < resamplerTaps; k += 4)
+		{
+			acc[0] += filter[k] * x[k];
+			acc[1] += filter[k + 1] * x[k + 1];
+			acc[2] += filter[k + 2] * x[k + 2];
+			acc[3] += filter[k + 3] * x[k + 3];
+		}
+		out[c] = acc[0] + acc[1] + (acc[2] + acc[3]);
+	}
+}
+
+#if defined(HAS_X86_SIMD)
+TARGET_SSE41 inline void ResampleFrameSse41(const float* h0, const float* h1, float f, const float* const* in, int64_t first,
+	uint8_t channelCount, float* out)
+{
+	// too many taps to hold the filter in registers so it is interpolated into an aligned buffer
+	alignas(16) float filter[resamplerTaps];
+	const auto fv = _mm_set1_ps(f);
+	for (uint32_t k = 0; k < resamplerTaps; k += 4)
+	{
+		auto a = _mm_loadu_ps(h0 + k);
+		_mm_store_ps(filter + k, _mm_add_ps(a, _mm_mul_ps(fv, _mm_sub_ps(_mm_loadu_ps(h1 + k), a))));
+	}
+	for (uint8_t c = 0; c < channelCount; ++c)
+	{
+		const auto x = in[c] + first;
+		auto acc0 = _mm_setzero_ps();
+		auto acc1 = _mm_setzero_ps();
+		for (uint32_t k = 0; k < resamplerTaps; k += 8)
+		{
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(filter + k), _mm_loadu_ps(x + k)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(filter + k + 4), _mm_loadu_ps(x + k + 4)));
+		}
+		auto acc = _mm_add_ps(acc0, acc1);
+		acc = _mm_hadd_ps(acc, acc);
+		acc = _mm_hadd_ps(acc, acc);
+		out[c] = _mm_cvtss_f32(acc);
+	}
+}
+
+TARGET_AVX2 inline void ResampleFrameAvx2(const float* h0, const float* h1, float f, const float* const* in, int64_t first,
+	uint8_t channelCount, float* out)
+{
+	// the interpolated filter stays in registers for every channel
+	__m256 filter[resamplerTaps / 8];
+	const auto fv = _mm256_set1_ps(f);
+	for (uint32_t k = 0; k < resamplerTaps / 8; ++k)
+	{
+		auto a = _mm256_loadu_ps(h0 + 8 * k);
+		filter[k] = _mm256_add_ps(a, _mm256_mul_ps(fv, _mm256_sub_ps(_mm256_loadu_ps(h1 + 8 * k), a)));
+	}
+	for (uint8_t c = 0; c < channelCount; ++c)
+	{
+		const auto x = in[c] + first;
+		auto acc0 = _mm256_setzero_ps();
+		auto acc1 = _mm256_setzero_ps();
+		for (uint32_t k = 0; k < resamplerTaps / 8; k += 2)
+		{
+			acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(filter[k], _mm256_loadu_ps(x + 8 * k)));
+			acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(filter[k + 1], _mm256_loadu_ps(x + 8 * k + 8)));
+		}
+		auto acc256 = _mm256_add_ps(acc0, acc1);
+		auto acc = _mm_add_ps(_mm256_castps256_ps128(acc256), _mm256_extractf128_ps(acc256, 1));
+		acc = _mm_hadd_ps(acc, acc);
+		acc = _mm_hadd_ps(acc, acc);
+		out[c] = _mm_cvtss_f32(acc);
+	}
+	_mm256_zeroupper();
+}
+#endif
+
+#if defined(HAS_NEON_SIMD)
+inline void ResampleFrameNeon(const float* h0, const float* h1, float f, const float* const* in, int64_t first,
+	uint8_t channelCount, float* out)
+{
+	float32x4_t filter[resamplerTaps / 4];
+	for (uint32_t k = 0; k < resamplerTaps / 4; ++k)
+	{
+		auto a = vld1q_f32(h0 + 4 * k);
+		filter[k] = vfmaq_n_f32(a, vsubq_f32(vld1q_f32(h1 + 4 * k), a), f);
+	}
+	for (uint8_t c = 0; c < channelCount; ++c)
+	{
+		const auto x = in[c] + first;
+		auto acc0 = vdupq_n_f32(0.0f);
+		auto acc1 = vdupq_n_f32(0.0f);
+		for (uint32_t k = 0; k < resamplerTaps / 4; k += 2)
+		{
+			acc0 = vfmaq_f32(acc0, filter[k], vld1q_f32(x + 4 * k));
+			acc1 = vfmaq_f32(acc1, filter[k + 1], vld1q_f32(x + 4 * k + 4));
+		}
+		out[c] = vaddvq_f32(vaddq_f32(acc0, acc1));
+	}
+}
+#endif
+
+using ResampleFrameFn = void (*)(const float*, const float*, float, const float* const*, int64_t, uint8_t, float*);
+
+inline ResampleFrameFn GetResampleFrame(SimdLevel level = GetSimdLevel())
+{
+	switch (level)
+	{
+	#if defined(HAS_X86_SIMD)
+	case SIMD_AVX2: return ResampleFrameAvx2;
+	case SIMD_SSE41: return ResampleFrameSse41;
+	#endif
+	#if defined(HAS_NEON_SIMD)
+	case SIMD_NEON: return ResampleFrameNeon;
+	#endif
+	default: return ResampleFrameScalar;
+	}
+}
+
+class PcmResampler
+{
+public:
+	explicit PcmResampler(SimdLevel level = GetSimdLevel());
+
+	// produces up to outFrames interleaved frames from the planar input, the first at input position *pos and each
+	// subsequent frame ratio input frames later. Stops early if the next frame needs input beyond inFrames, i.e.
+	// position + resamplerLookahead must be < inFrames, and position - resamplerHistory must be >= 0.
+	// Returns the number of frames written, *pos is left at the position of the next frame.
+	uint32_t Resample(const float* const* in, uint8_t channelCount, uint32_t inFrames, double* pos, double ratio,
+		float* out, uint32_t outFrames) const;
+
+	// the resamplerTaps coefficients for an output frame phase / resamplerPhases of an input frame after the input
+	// frame at tap resamplerHistory, phase resamplerPhases is the filter for phase 0 shifted by 1 frame
+	const float* GetFilter(uint32_t phase) const
+	{
+		return mFilters.data() + static_cast<size_t>(phase) * resamplerTaps;
+	}
+
+private:
+	ResampleFrameFn mResampleFrame;
+	std::vector<float> mFilters;
+};
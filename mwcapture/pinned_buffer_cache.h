@@ -0,0 +1,126 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+// tracks the buffers pinned for capture so each one is pinned once for as long as it is in use rather than around
+// every frame, pinning locks the pages in memory which costs a kernel round trip per call.
+//
+// PinApi supplies
+//   bool Pin(uint8_t* data, size_t size)
+//   void Unpin(uint8_t* data)
+// and is not called concurrently, callers must serialise access to the cache.
+template <typename PinApi>
+class PinnedBufferCache
+{
+public:
+	explicit PinnedBufferCache(PinApi api = PinApi{}) :
+		mApi(std::move(api))
+	{
+	}
+
+	PinnedBufferCache(const PinnedBufferCache&) = delete;
+	PinnedBufferCache& operator=(const PinnedBufferCache&) = delete;
+
+	~PinnedBufferCache()
+	{
+		Clear();
+	}
+
+	// ensures the buffer is pinned at this size, returns false if it could not be pinned
+	bool Pin(uint8_t* data, size_t size)
+	{
+		auto it = mPinned.find(data);
+		if (it != mPinned.end())
+		{
+			if (it->second == size)
+			{
+				mHits++;
+				return true;
+			}
+			// same address reused for a different size so the old range has to go
+			mApi.Unpin(data);
+			mPinned.erase(it);
+		}
+		mMisses++;
+		if (!mApi.Pin(data, size))
+		{
+			mFailures++;
+			return false;
+		}
+		mPinned.emplace(data, size);
+		return true;
+	}
+
+	bool IsPinned(const uint8_t* data) const
+	{
+		return mPinned.find(const_cast<uint8_t*>(data)) != mPinned.end();
+	}
+
+	void Unpin(uint8_t* data)
+	{
+		auto it = mPinned.find(data);
+		if (it != mPinned.end())
+		{
+			mApi.Unpin(data);
+			mPinned.erase(it);
+		}
+	}
+
+	// unpins everything, for use before the buffers are freed or reallocated
+	void Clear()
+	{
+		for (auto& pinned : mPinned)
+		{
+			mApi.Unpin(pinned.first);
+		}
+		mPinned.clear();
+	}
+
+	size_t GetPinnedCount() const
+	{
+		return mPinned.size();
+	}
+
+	uint64_t GetHitCount() const
+	{
+		return mHits;
+	}
+
+	uint64_t GetMissCount() const
+	{
+		return mMisses;
+	}
+
+	uint64_t GetFailureCount() const
+	{
+		return mFailures;
+	}
+
+	PinApi& GetApi()
+	{
+		return mApi;
+	}
+
+private:
+	PinApi mApi;
+	std::unordered_map<uint8_t*, size_t> mPinned;
+	uint64_t mHits{ 0 };
+	uint64_t mMisses{ 0 };
+	uint64_t mFailures{ 0 };
+};
@@ -0,0 +1,40 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <initializer_list>
+#include <string_view>
+
+// the value whose name (as given by toName) matches name ignoring case, false if no value has that name
+template <typename E>
+bool ParseSettingName(std::string_view name, std::initializer_list<E> values, const char* (*toName)(E), E* value)
+{
+	for (auto candidate : values)
+	{
+		std::string_view candidateName = toName(candidate);
+		auto sameName = candidateName.size() == name.size()
+			&& std::equal(name.begin(), name.end(), candidateName.begin(), [](char a, char b)
+			{
+				return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+			});
+		if (sameName)
+		{
+			*value = candidate;
+			return true;
+		}
+	}
+	return false;
+}
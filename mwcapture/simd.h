@@ -0,0 +1,106 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstdint>
+
+// runtime cpu feature detection for the simd kernels
+// kernels are compiled for each instruction set via the TARGET_ macros so no global arch flags are required
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HAS_X86_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+// NEON is mandatory on aarch64 so needs no detection
+#define HAS_NEON_SIMD 1
+#include <arm_neon.h>
+#endif
+
+enum SimdLevel : uint8_t
+{
+	SIMD_SCALAR,
+	SIMD_SSE41,
+	SIMD_AVX2,
+	SIMD_NEON
+};
+
+inline const char* simdlevel_to_name(SimdLevel e)
+{
+	switch (e)
+	{
+	case SIMD_SCALAR: return "Scalar";
+	case SIMD_SSE41: return "SSE4.1";
+	case SIMD_AVX2: return "AVX2";
+	case SIMD_NEON: return "NEON";
+	default: return "unknown";
+	}
+}
+
+inline SimdLevel DetectSimdLevel()
+{
+	#if defined(HAS_X86_SIMD)
+	#if defined(_MSC_VER) && !defined(__clang__)
+	int regs[4];
+	__cpuid(regs, 0);
+	auto maxLeaf = regs[0];
+	__cpuid(regs, 1);
+	auto sse41 = (regs[2] & (1 << 19)) != 0;
+	auto osxsave = (regs[2] & (1 << 27)) != 0;
+	auto avx = (regs[2] & (1 << 28)) != 0;
+	auto avx2 = false;
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(regs, 7, 0);
+		avx2 = (regs[1] & (1 << 5)) != 0;
+	}
+	#else
+	__builtin_cpu_init();
+	auto sse41 = __builtin_cpu_supports("sse4.1") != 0;
+	auto avx2 = __builtin_cpu_supports("avx2") != 0;
+	#endif
+	if (avx2) return SIMD_AVX2;
+	if (sse41) return SIMD_SSE41;
+	return SIMD_SCALAR;
+	#elif defined(HAS_NEON_SIMD)
+	return SIMD_NEON;
+	#else
+	return SIMD_SCALAR;
+	#endif
+}
+
+inline SimdLevel GetSimdLevel()
+{
+	static const auto detected = DetectSimdLevel();
+	return detected;
+}
+
+inline bool IsSimdLevelSupported(SimdLevel level)
+{
+	auto detected = GetSimdLevel();
+	switch (level)
+	{
+	case SIMD_SCALAR: return true;
+	case SIMD_SSE41: return detected == SIMD_SSE41 || detected == SIMD_AVX2;
+	case SIMD_AVX2: return detected == SIMD_AVX2;
+	case SIMD_NEON: return detected == SIMD_NEON;
+	default: return false;
+	}
+}
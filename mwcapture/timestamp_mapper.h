@@ -0,0 +1,225 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+#include "setting_name.h"
+
+// maps the timestamps attached to each captured frame by the device onto the reference clock
+//
+// each frame is observed some time after the device stamped it, that delay is always positive and varies with
+// scheduling of the pin thread. A line is fitted to the recent (device, clock) pairs, the slope tracks the rate
+// difference between the 2 clocks (drift) while the intercept is taken from the lowest observed delay so the
+// mapped times follow the device cadence rather than the moment the pin thread got around to reading the frame.
+
+enum TimestampMode : uint8_t
+{
+	// stamp samples with the reference clock when they are delivered
+	TIMESTAMP_CLOCK,
+	// stamp samples with the device timestamp mapped onto the reference clock
+	TIMESTAMP_DEVICE
+};
+
+inline const char* timestampmode_to_name(TimestampMode e)
+{
+	switch (e)
+	{
+	case TIMESTAMP_CLOCK: return "Clock";
+	case TIMESTAMP_DEVICE: return "Device";
+	default: return "unknown";
+	}
+}
+
+// the mode named as per timestampmode_to_name, ignoring case, false if no mode has that name
+inline bool ParseTimestampMode(std::string_view name, TimestampMode* mode)
+{
+	return ParseSettingName(name, { TIMESTAMP_CLOCK, TIMESTAMP_DEVICE }, timestampmode_to_name, mode);
+}
+
+struct TIMESTAMP_STATS
+{
+	uint64_t observations{ 0 };
+	uint64_t resyncs{ 0 };
+	bool locked{ false };
+	// rate of the reference clock relative to the device clock, in parts per million
+	double driftPpm{ 0.0 };
+	// standard deviation of the observation delay, in clock units
+	double jitter{ 0.0 };
+	// mean observation delay above the fitted line, in clock units
+	double meanDelay{ 0.0 };
+};
+
+class TimestampMapper
+{
+public:
+	// windowSize observations are used to fit the line, clock time is passed through until lockThreshold are seen
+	// and the fit is restarted when an observation lands more than resyncThreshold away from the line
+	explicit TimestampMapper(uint32_t windowSize = 1024, uint32_t lockThreshold = 16, int64_t resyncThreshold = 10000000) :
+		mWindowSize(std::max(windowSize, 2u)),
+		mLockThreshold(std::clamp(lockThreshold, 2u, std::max(windowSize, 2u))),
+		mResyncThreshold(resyncThreshold)
+	{
+		mDevice.reserve(mWindowSize);
+		mClock.reserve(mWindowSize);
+	}
+
+	void Reset()
+	{
+		Restart();
+		mLastMapped = std::numeric_limits<int64_t>::min();
+		mStats = {};
+	}
+
+	// records a frame stamped at deviceTime by the device and read at clockTime, returns the time at which
+	// the frame should be presented in the clock domain, this never goes backwards
+	int64_t Map(int64_t deviceTime, int64_t clockTime)
+	{
+		if (mStats.locked && std::llabs(clockTime - Project(deviceTime)) > mResyncThreshold)
+		{
+			mStats.resyncs++;
+			Restart();
+		}
+
+		if (mDevice.size() < mWindowSize)
+		{
+			mDevice.push_back(deviceTime);
+			mClock.push_back(clockTime);
+		}
+		else
+		{
+			mDevice[mNext] = deviceTime;
+			mClock[mNext] = clockTime;
+			mNext = (mNext + 1) % mWindowSize;
+		}
+		mStats.observations++;
+
+		int64_t mapped;
+		if (mDevice.size() < mLockThreshold)
+		{
+			mapped = clockTime;
+		}
+		else if (!mStats.locked)
+		{
+			Fit();
+			mapped = Project(deviceTime);
+			mStats.locked = true;
+		}
+		else
+		{
+			// refits move the line by a small amount so step by the device interval and slew towards the line
+			Fit();
+			auto target = Project(deviceTime);
+			auto predicted = mLastMapped + std::llround(mSlope * static_cast<double>(deviceTime - mLastDevice));
+			mapped = predicted + (target - predicted) / slewDivisor;
+		}
+		mLastDevice = deviceTime;
+		if (mapped < mLastMapped)
+		{
+			mapped = mLastMapped;
+		}
+		mLastMapped = mapped;
+		return mapped;
+	}
+
+	const TIMESTAMP_STATS& GetStats() const
+	{
+		return mStats;
+	}
+
+private:
+	// discards the fit but keeps the output monotonic across the restart
+	void Restart()
+	{
+		mDevice.clear();
+		mClock.clear();
+		mNext = 0;
+		mSlope = 1.0;
+		mIntercept = 0.0;
+		mStats.locked = false;
+		mStats.driftPpm = 0.0;
+		mStats.jitter = 0.0;
+		mStats.meanDelay = 0.0;
+	}
+
+	int64_t Project(int64_t deviceTime) const
+	{
+		return mOriginClock + std::llround(mIntercept + mSlope * static_cast<double>(deviceTime - mOriginDevice));
+	}
+
+	void Fit()
+	{
+		// work relative to the oldest observation to keep the sums well within double precision
+		auto oldest = mDevice.size() < mWindowSize ? 0 : mNext;
+		mOriginDevice = mDevice[oldest];
+		mOriginClock = mClock[oldest];
+
+		const auto n = static_cast<double>(mDevice.size());
+		double sumX = 0.0, sumY = 0.0;
+		for (size_t i = 0; i < mDevice.size(); ++i)
+		{
+			sumX += static_cast<double>(mDevice[i] - mOriginDevice);
+			sumY += static_cast<double>(mClock[i] - mOriginClock);
+		}
+		const auto meanX = sumX / n;
+		const auto meanY = sumY / n;
+		double sxx = 0.0, sxy = 0.0;
+		for (size_t i = 0; i < mDevice.size(); ++i)
+		{
+			auto dx = static_cast<double>(mDevice[i] - mOriginDevice) - meanX;
+			auto dy = static_cast<double>(mClock[i] - mOriginClock) - meanY;
+			sxx += dx * dx;
+			sxy += dx * dy;
+		}
+		// a device which does not advance its timestamps gives no rate information
+		mSlope = sxx > 0.0 ? sxy / sxx : 1.0;
+
+		// the delay is one sided so the line is pinned to the smallest delay seen
+		double minDelay = std::numeric_limits<double>::max();
+		double sumDelay = 0.0, sumDelaySq = 0.0;
+		for (size_t i = 0; i < mDevice.size(); ++i)
+		{
+			auto delay = static_cast<double>(mClock[i] - mOriginClock) - mSlope * static_cast<double>(mDevice[i] - mOriginDevice);
+			minDelay = std::min(minDelay, delay);
+			sumDelay += delay;
+			sumDelaySq += delay * delay;
+		}
+		mIntercept = minDelay;
+
+		auto meanDelay = sumDelay / n;
+		mStats.driftPpm = (mSlope - 1.0) * 1000000.0;
+		mStats.meanDelay = meanDelay - minDelay;
+		mStats.jitter = std::sqrt(std::max(0.0, sumDelaySq / n - meanDelay * meanDelay));
+	}
+
+	static constexpr int64_t slewDivisor = 64;
+
+	const uint32_t mWindowSize;
+	const uint32_t mLockThreshold;
+	const int64_t mResyncThreshold;
+	std::vector<int64_t> mDevice;
+	std::vector<int64_t> mClock;
+	uint32_t mNext{ 0 };
+	int64_t mOriginDevice{ 0 };
+	int64_t mOriginClock{ 0 };
+	double mSlope{ 1.0 };
+	double mIntercept{ 0.0 };
+	int64_t mLastMapped{ std::numeric_limits<int64_t>::min() };
+	int64_t mLastDevice{ 0 };
+	TIMESTAMP_STATS mStats{};
+};
@@ -13,11 +13,49 @@
  * If not, see <https://www.gnu.org/licenses/>.
  */
 #pragma once
-#include <LibMWCapture/MWHDMIPackets.h>
+#include <cstdint>
 #include "domain.h"
 
+// CTA-861-G HDR static metadata infoframe payload, laid out as HDMI_HDR_INFOFRAME_PAYLOAD in the SDK
+struct HDR_INFOFRAME
+{
+	uint8_t byEOTF;
+	uint8_t byMetadataDescriptorID;
+
+	uint8_t display_primaries_lsb_x0;
+	uint8_t display_primaries_msb_x0;
+	uint8_t display_primaries_lsb_y0;
+	uint8_t display_primaries_msb_y0;
+
+	uint8_t display_primaries_lsb_x1;
+	uint8_t display_primaries_msb_x1;
+	uint8_t display_primaries_lsb_y1;
+	uint8_t display_primaries_msb_y1;
+
+	uint8_t display_primaries_lsb_x2;
+	uint8_t display_primaries_msb_x2;
+	uint8_t display_primaries_lsb_y2;
+	uint8_t display_primaries_msb_y2;
+
+	uint8_t white_point_lsb_x;
+	uint8_t white_point_msb_x;
+	uint8_t white_point_lsb_y;
+	uint8_t white_point_msb_y;
+
+	uint8_t max_display_mastering_lsb_luminance;
+	uint8_t max_display_mastering_msb_luminance;
+	uint8_t min_display_mastering_lsb_luminance;
+	uint8_t min_display_mastering_msb_luminance;
+
+	uint8_t maximum_content_light_level_lsb;
+	uint8_t maximum_content_light_level_msb;
+
+	uint8_t maximum_frame_average_light_level_lsb;
+	uint8_t maximum_frame_average_light_level_msb;
+};
+
 // utility functions
-inline void LoadHdrMeta(HDR_META* meta, HDMI_HDR_INFOFRAME_PAYLOAD* frame)
+inline void LoadHdrMeta(HDR_META* meta, const HDR_INFOFRAME* frame)
 {
 	auto hdrIn = *frame;
 	auto hdrOut = meta;
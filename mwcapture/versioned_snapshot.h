@@ -0,0 +1,91 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// a value published by one thread which any number of threads can copy without taking a lock
+//
+// a sequence lock, the sequence is odd while a publish is in progress and readers retry if it was odd or changed while
+// they were copying. The value is held as atomic words so a torn read is detected rather than being undefined.
+// Each publish increments the version, version 0 means nothing has been published yet.
+template <typename T>
+class VersionedSnapshot
+{
+	static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied bytewise");
+
+public:
+	VersionedSnapshot() = default;
+
+	VersionedSnapshot(const VersionedSnapshot&) = delete;
+	VersionedSnapshot& operator=(const VersionedSnapshot&) = delete;
+
+	// callers must serialise publishing, returns the new version
+	uint64_t Publish(const T& value)
+	{
+		uint64_t words[wordCount]{};
+		memcpy(words, &value, sizeof(T));
+
+		const auto sequence = mSequence.load(std::memory_order_relaxed);
+		mSequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < wordCount; ++i)
+		{
+			mWords[i].store(words[i], std::memory_order_relaxed);
+		}
+		mSequence.store(sequence + 2, std::memory_order_release);
+		return (sequence + 2) / 2;
+	}
+
+	// copies the latest value, returns its version
+	uint64_t Read(T* value) const
+	{
+		uint64_t words[wordCount];
+		for (uint32_t attempt = 0; ; ++attempt)
+		{
+			const auto before = mSequence.load(std::memory_order_acquire);
+			if ((before & 1) == 0)
+			{
+				for (size_t i = 0; i < wordCount; ++i)
+				{
+					words[i] = mWords[i].load(std::memory_order_relaxed);
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (mSequence.load(std::memory_order_relaxed) == before)
+				{
+					memcpy(value, words, sizeof(T));
+					return before / 2;
+				}
+			}
+			// the writer may have been preempted mid publish
+			if (attempt > 16) std::this_thread::yield();
+		}
+	}
+
+	// the version of the last completed publish
+	uint64_t GetVersion() const
+	{
+		return mSequence.load(std::memory_order_acquire) / 2;
+	}
+
+private:
+	static constexpr size_t wordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	alignas(64) std::atomic<uint64_t> mSequence{ 0 };
+	std::atomic<uint64_t> mWords[wordCount]{};
+};
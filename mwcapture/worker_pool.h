@@ -0,0 +1,124 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of threads which split per frame work on an image into bands of rows
+// the calling thread processes the first band so a pool with no workers simply runs the task inline
+class RowBandWorkers
+{
+public:
+	explicit RowBandWorkers(unsigned int workerCount) :
+		mBandCount(workerCount + 1)
+	{
+		mThreads.reserve(workerCount);
+		for (unsigned int i = 0; i < workerCount; ++i)
+		{
+			mThreads.emplace_back([this, i] { Work(i + 1); });
+		}
+	}
+
+	~RowBandWorkers()
+	{
+		{
+			std::lock_guard lck(mMutex);
+			mStop = true;
+		}
+		mWorkReady.notify_all();
+		for (auto& t : mThreads) t.join();
+	}
+
+	RowBandWorkers(const RowBandWorkers&) = delete;
+	RowBandWorkers& operator=(const RowBandWorkers&) = delete;
+
+	unsigned int GetBandCount() const
+	{
+		return mBandCount;
+	}
+
+	// invokes task(firstRow, lastRow) for each band of [0, rows) and returns once every band has completed
+	void Run(uint32_t rows, const std::function<void(uint32_t, uint32_t)>& task)
+	{
+		if (mThreads.empty())
+		{
+			task(0, rows);
+			return;
+		}
+		{
+			std::lock_guard lck(mMutex);
+			mTask = &task;
+			mRows = rows;
+			mPending = static_cast<unsigned int>(mThreads.size());
+			mGeneration++;
+		}
+		mWorkReady.notify_all();
+
+		RunBand(0, rows, task);
+
+		std::unique_lock lck(mMutex);
+		mWorkDone.wait(lck, [this] { return mPending == 0; });
+		mTask = nullptr;
+	}
+
+private:
+	void RunBand(unsigned int band, uint32_t rows, const std::function<void(uint32_t, uint32_t)>& task) const
+	{
+		auto bands = GetBandCount();
+		auto first = static_cast<uint32_t>(static_cast<uint64_t>(rows) * band / bands);
+		auto last = static_cast<uint32_t>(static_cast<uint64_t>(rows) * (band + 1) / bands);
+		if (first < last) task(first, last);
+	}
+
+	void Work(unsigned int band)
+	{
+		uint64_t seen = 0;
+		while (true)
+		{
+			const std::function<void(uint32_t, uint32_t)>* task;
+			uint32_t rows;
+			{
+				std::unique_lock lck(mMutex);
+				mWorkReady.wait(lck, [this, seen] { return mStop || mGeneration != seen; });
+				if (mStop) return;
+				seen = mGeneration;
+				task = mTask;
+				rows = mRows;
+			}
+
+			RunBand(band, rows, *task);
+
+			{
+				std::lock_guard lck(mMutex);
+				if (--mPending == 0) mWorkDone.notify_one();
+			}
+		}
+	}
+
+	const unsigned int mBandCount;
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::condition_variable mWorkDone;
+	const std::function<void(uint32_t, uint32_t)>* mTask{ nullptr };
+	uint32_t mRows{ 0 };
+	uint64_t mGeneration{ 0 };
+	unsigned int mPending{ 0 };
+	bool mStop{ false };
+};
@@ -0,0 +1,286 @@
+/*
+ *      Copyright (C) 2025 Matt Khan
+ *      https://github.com/3ll3d00d/mwcapture
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include "simd.h"
+#include "worker_pool.h"
+
+// the card captures high bit depth 4:4:4 as Y410, i.e. a little endian dword per pixel holding U in bits 0-9,
+// Y in 10-19, V in 20-29 and A in 30-31, which is also the directshow Y410 layout so it can be delivered as is.
+// a downstream filter which does not accept Y410 is sent Y416 (U Y V A words, MSB aligned) which keeps every bit
+// or, failing that, AYUV (V U Y A bytes) which drops the 2 LSBs.
+
+enum Yuv444Output : uint8_t
+{
+	YUV444_Y410,
+	YUV444_Y416,
+	YUV444_AYUV
+};
+
+inline const char* yuv444output_to_name(Yuv444Output e)
+{
+	switch (e)
+	{
+	case YUV444_Y410: return "Y410";
+	case YUV444_Y416: return "Y416";
+	case YUV444_AYUV: return "AYUV";
+	}
+	return "";
+}
+
+inline uint32_t GetYuv444BytesPerPixel(Yuv444Output output)
+{
+	return output == YUV444_Y416 ? 8 : 4;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Y410 to Y416
+//////////////////////////////////////////////////////////////////////////
+inline void UnpackY410ToY416Scalar(const uint32_t* src, uint16_t* dst, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; ++i, dst += 4)
+	{
+		auto px = src[i];
+		dst[0] = static_cast<uint16_t>((px & 0x3FF) << 6);
+		dst[1] = static_cast<uint16_t>((px >> 10 & 0x3FF) << 6);
+		dst[2] = static_cast<uint16_t>((px >> 20 & 0x3FF) << 6);
+		// 2 bit alpha is replicated so opaque stays opaque
+		dst[3] = static_cast<uint16_t>((px >> 30) * 0x5555);
+	}
+}
+
+#if defined(HAS_X86_SIMD)
+TARGET_SSE41 inline void UnpackY410ToY416Sse41(const uint32_t* src, uint16_t* dst, size_t pixelCount)
+{
+	const auto mask = _mm_set1_epi32(0xFFC0);
+	const auto alpha = _mm_set1_epi32(0x5555);
+	size_t i = 0;
+	for (; i + 4 <= pixelCount; i += 4)
+	{
+		auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		auto u = _mm_and_si128(_mm_slli_epi32(px, 6), mask);
+		auto y = _mm_and_si128(_mm_srli_epi32(px, 4), mask);
+		auto v = _mm_and_si128(_mm_srli_epi32(px, 14), mask);
+		auto a = _mm_mullo_epi16(_mm_srli_epi32(px, 30), alpha);
+		auto uy = _mm_or_si128(u, _mm_slli_epi32(y, 16));
+		auto va = _mm_or_si128(v, _mm_slli_epi32(a, 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_unpacklo_epi32(uy, va));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 8), _mm_unpackhi_epi32(uy, va));
+	}
+	UnpackY410ToY416Scalar(src + i, dst + i * 4, pixelCount - i);
+}
+
+TARGET_AVX2 inline void UnpackY410ToY416Avx2(const uint32_t* src, uint16_t* dst, size_t pixelCount)
+{
+	const auto mask = _mm256_set1_epi32(0xFFC0);
+	const auto alpha = _mm256_set1_epi32(0x5555);
+	size_t i = 0;
+	for (; i + 8 <= pixelCount; i += 8)
+	{
+		auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		auto u = _mm256_and_si256(_mm256_slli_epi32(px, 6), mask);
+		auto y = _mm256_and_si256(_mm256_srli_epi32(px, 4), mask);
+		auto v = _mm256_and_si256(_mm256_srli_epi32(px, 14), mask);
+		auto a = _mm256_mullo_epi16(_mm256_srli_epi32(px, 30), alpha);
+		auto uy = _mm256_or_si256(u, _mm256_slli_epi32(y, 16));
+		auto va = _mm256_or_si256(v, _mm256_slli_epi32(a, 16));
+		// unpack works within each 128 bit lane so pixels 0 1 4 5 and 2 3 6 7 are put back in order
+		auto lo = _mm256_unpacklo_epi32(uy, va);
+		auto hi = _mm256_unpackhi_epi32(uy, va);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4 + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	_mm256_zeroupper();
+	UnpackY410ToY416Scalar(src + i, dst + i * 4, pixelCount - i);
+}
+#endif
+
+#if defined(HAS_NEON_SIMD)
+inline void UnpackY410ToY416Neon(const uint32_t* src, uint16_t* dst, size_t pixelCount)
+{
+	const auto mask = vdupq_n_u32(0xFFC0);
+	size_t i = 0;
+	for (; i + 4 <= pixelCount; i += 4)
+	{
+		auto px = vld1q_u32(src + i);
+		uint16x4x4_t uyva;
+		uyva.val[0] = vmovn_u32(vandq_u32(vshlq_n_u32(px, 6), mask));
+		uyva.val[1] = vmovn_u32(vandq_u32(vshrq_n_u32(px, 4), mask));
+		uyva.val[2] = vmovn_u32(vandq_u32(vshrq_n_u32(px, 14), mask));
+		uyva.val[3] = vmovn_u32(vmulq_n_u32(vshrq_n_u32(px, 30), 0x5555));
+		vst4_u16(dst + i * 4, uyva);
+	}
+	UnpackY410ToY416Scalar(src + i, dst + i * 4, pixelCount - i);
+}
+#endif
+
+inline void UnpackY410ToY416(const uint32_t* src, uint16_t* dst, size_t pixelCount, SimdLevel level = GetSimdLevel())
+{
+	switch (level)
+	{
+	#if defined(HAS_X86_SIMD)
+	case SIMD_AVX2:
+		UnpackY410ToY416Avx2(src, dst, pixelCount);
+		break;
+	case SIMD_SSE41:
+		UnpackY410ToY416Sse41(src, dst, pixelCount);
+		break;
+	#endif
+	#if defined(HAS_NEON_SIMD)
+	case SIMD_NEON:
+		UnpackY410ToY416Neon(src, dst, pixelCount);
+		break;
+	#endif
+	default:
+		UnpackY410ToY416Scalar(src, dst, pixelCount);
+		break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Y410 to AYUV
+//////////////////////////////////////////////////////////////////////////
+inline void PackY410ToAyuvScalar(const uint32_t* src, uint32_t* dst, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; ++i)
+	{
+		auto px = src[i];
+		dst[i] = (px >> 22 & 0xFF) | (px << 6 & 0xFF00) | (px << 4 & 0xFF0000) | (px >> 30) * 0x55000000;
+	}
+}
+
+#if defined(HAS_X86_SIMD)
+TARGET_SSE41 inline void PackY410ToAyuvSse41(const uint32_t* src, uint32_t* dst, size_t pixelCount)
+{
+	const auto vMask = _mm_set1_epi32(0xFF);
+	const auto uMask = _mm_set1_epi32(0xFF00);
+	const auto yMask = _mm_set1_epi32(0xFF0000);
+	const auto alpha = _mm_set1_epi32(0x55000000);
+	size_t i = 0;
+	for (; i + 4 <= pixelCount; i += 4)
+	{
+		auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		auto vu = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 22), vMask), _mm_and_si128(_mm_slli_epi32(px, 6), uMask));
+		auto ya = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(px, 4), yMask), _mm_mullo_epi32(_mm_srli_epi32(px, 30), alpha));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(vu, ya));
+	}
+	PackY410ToAyuvScalar(src + i, dst + i, pixelCount - i);
+}
+
+TARGET_AVX2 inline void PackY410ToAyuvAvx2(const uint32_t* src, uint32_t* dst, size_t pixelCount)
+{
+	const auto vMask = _mm256_set1_epi32(0xFF);
+	const auto uMask = _mm256_set1_epi32(0xFF00);
+	const auto yMask = _mm256_set1_epi32(0xFF0000);
+	const auto alpha = _mm256_set1_epi32(0x55000000);
+	size_t i = 0;
+	for (; i + 8 <= pixelCount; i += 8)
+	{
+		auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		auto vu = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(px, 22), vMask),
+			_mm256_and_si256(_mm256_slli_epi32(px, 6), uMask));
+		auto ya = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(px, 4), yMask),
+			_mm256_mullo_epi32(_mm256_srli_epi32(px, 30), alpha));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(vu, ya));
+	}
+	_mm256_zeroupper();
+	PackY410ToAyuvScalar(src + i, dst + i, pixelCount - i);
+}
+#endif
+
+#if defined(HAS_NEON_SIMD)
+inline void PackY410ToAyuvNeon(const uint32_t* src, uint32_t* dst, size_t pixelCount)
+{
+	const auto vMask = vdupq_n_u32(0xFF);
+	const auto uMask = vdupq_n_u32(0xFF00);
+	const auto yMask = vdupq_n_u32(0xFF0000);
+	size_t i = 0;
+	for (; i + 4 <= pixelCount; i += 4)
+	{
+		auto px = vld1q_u32(src + i);
+		auto vu = vorrq_u32(vandq_u32(vshrq_n_u32(px, 22), vMask), vandq_u32(vshlq_n_u32(px, 6), uMask));
+		auto ya = vorrq_u32(vandq_u32(vshlq_n_u32(px, 4), yMask), vmulq_n_u32(vshrq_n_u32(px, 30), 0x55000000));
+		vst1q_u32(dst + i, vorrq_u32(vu, ya));
+	}
+	PackY410ToAyuvScalar(src + i, dst + i, pixelCount - i);
+}
+#endif
+
+inline void PackY410ToAyuv(const uint32_t* src, uint32_t* dst, size_t pixelCount, SimdLevel level = GetSimdLevel())
+{
+	switch (level)
+	{
+	#if defined(HAS_X86_SIMD)
+	case SIMD_AVX2:
+		PackY410ToAyuvAvx2(src, dst, pixelCount);
+		break;
+	case SIMD_SSE41:
+		PackY410ToAyuvSse41(src, dst, pixelCount);
+		break;
+	#endif
+	#if defined(HAS_NEON_SIMD)
+	case SIMD_NEON:
+		PackY410ToAyuvNeon(src, dst, pixelCount);
+		break;
+	#endif
+	default:
+		PackY410ToAyuvScalar(src, dst, pixelCount);
+		break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// whole frames
+//////////////////////////////////////////////////////////////////////////
+inline void ConvertY410Row(Yuv444Output output, const uint8_t* src, uint8_t* dst, size_t pixelCount, SimdLevel level)
+{
+	auto px = reinterpret_cast<const uint32_t*>(src);
+	switch (output)
+	{
+	case YUV444_Y416:
+		UnpackY410ToY416(px, reinterpret_cast<uint16_t*>(dst), pixelCount, level);
+		break;
+	case YUV444_AYUV:
+		PackY410ToAyuv(px, reinterpret_cast<uint32_t*>(dst), pixelCount, level);
+		break;
+	default:
+		memcpy(dst, src, pixelCount * 4);
+		break;
+	}
+}
+
+// the calling thread always takes a band so small machines convert inline
+inline unsigned int GetYuv444ConvertWorkerCount()
+{
+	auto cores = std::thread::hardware_concurrency();
+	return cores >= 8 ? 3 : cores >= 4 ? 1 : 0;
+}
+
+// converts a cx x cy Y410 image into the given output, split by row band across the workers
+inline void ConvertY410(RowBandWorkers* workers, Yuv444Output output, const uint8_t* src, uint32_t srcLineLength,
+	uint8_t* dst, uint32_t dstLineLength, uint32_t cx, uint32_t cy, SimdLevel level = GetSimdLevel())
+{
+	workers->Run(cy, [=](uint32_t first, uint32_t last)
+	{
+		for (auto row = first; row < last; ++row)
+		{
+			ConvertY410Row(output, src + static_cast<size_t>(row) * srcLineLength, dst + static_cast<size_t>(row) * dstLineLength,
+				cx, level);
+		}
+	});
+}